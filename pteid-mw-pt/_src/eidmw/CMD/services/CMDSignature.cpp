@@ -9,6 +9,9 @@
 ****************************************************************************-*/
 
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
 #include "CMDSignature.h"
 #include "MiscUtil.h"
 #include "StringOps.h"
@@ -19,8 +22,12 @@
 #include "Hash.h"
 #include "eidErrors.h"
 #include "cmdSignatureClient.h"
+#include "Thread.h"
+#include "PDFMemoryBudget.h"
 
 #define MAX_DOCNAME_LENGTH 44
+// Upper bound on the threads preparing the documents of a batch signature
+#define MAX_PREPARE_THREADS 8
 
 namespace eIDMW {
 
@@ -41,6 +48,48 @@ void printData(char *msg, unsigned char *data, unsigned int dataLen) {
 	printf("\n");
 }
 
+namespace {
+
+/*
+	Prepares PDF documents for signing (signature placeholder and hash) taking the next
+	pending handler from a shared index until all handlers of the batch are done.
+*/
+class PrepareDocumentThread : public CThread {
+public:
+	PrepareDocumentThread(std::vector<PDFSignature *> &handlers, std::vector<std::string *> &filenames,
+						  std::vector<int> &results, std::atomic<size_t> &next, const char *location,
+						  const char *reason)
+		: m_handlers(handlers), m_filenames(filenames), m_results(results), m_next(next), m_location(location),
+		  m_reason(reason), m_error(EIDMW_OK) {}
+
+	void Run() {
+		size_t i;
+		while ((i = m_next++) < m_handlers.size()) {
+			try {
+				m_results[i] = m_handlers[i]->signFiles(m_location, m_reason, m_filenames[i]->c_str(), false);
+			} catch (CMWException &e) {
+				m_error = e.GetError();
+				// Stop the other workers as the whole batch is going to fail
+				m_next = m_handlers.size();
+				return;
+			}
+		}
+	}
+
+	long getError() const { return m_error; }
+
+private:
+	std::vector<PDFSignature *> &m_handlers;
+	std::vector<std::string *> &m_filenames;
+	std::vector<int> &m_results;
+	std::atomic<size_t> &m_next;
+	const char *m_location;
+	const char *m_reason;
+	long m_error;
+};
+
+} // namespace
+
 CMDProxyInfo CMDProxyInfo::buildProxyInfo() {
 	ProxyInfo proxyinfo;
 
@@ -93,12 +142,11 @@ CMDSignature::CMDSignature(std::string basicAuthUser, std::string basicAuthPassw
 
 CMDSignature::~CMDSignature() {
 	m_pdf_handlers.clear();
-	if (cmdService) {
-		delete cmdService;
-	}
+	CMDServices::release(cmdService);
 }
 
 std::string CMDSignature::getEndpoint() { return CMDServices::getEndpoint(); }
+void CMDSignature::releaseIdleConnections() { CMDServices::releaseIdleClients(); }
 void CMDSignature::cancelRequest() { cmdService->cancelRequest(); }
 void CMDSignature::set_pdf_handler(PDFSignature *in_pdf_handler) {
 	m_pdf_handlers.clear();
@@ -150,6 +198,8 @@ int CMDSignature::cli_getCertificate(std::string in_userId) {
 	}
 
 	if (m_pdf_handlers.size() > 0) {
+		// All documents are signed with the same certificate so the LTV revocation data can be fetched only once
+		std::shared_ptr<LTVRevocationCache> revocationCache = std::make_shared<LTVRevocationCache>();
 		for (size_t i = 0; i < m_pdf_handlers.size(); i++) {
 			PDFSignature *pdf = m_pdf_handlers[i];
 			if (NULL == pdf) {
@@ -158,6 +208,7 @@ int CMDSignature::cli_getCertificate(std::string in_userId) {
 			}
 
 			pdf->setBatch_mode(false);
+			pdf->setRevocationCache(revocationCache);
 
 			pdf->setExternCertificate(m_certificates.at(0));
 
@@ -386,10 +437,9 @@ int CMDSignature::signOpen(CMDProxyInfo proxyinfo, std::string in_userId, std::s
 int CMDSignature::signOpen(CMDProxyInfo proxyinfo, std::string in_userId, std::string in_pin, const char *location,
 						   const char *reason, const char *outfile_path) {
 	m_userId = in_userId;
-	if (cmdService) {
-		delete cmdService;
+	if (!cmdService) {
+		cmdService = CMDServices::acquire(m_basicAuthUser, m_basicAuthPassword, m_applicationId);
 	}
-	cmdService = new CMDServices(m_basicAuthUser, m_basicAuthPassword, m_applicationId);
 	m_proxyInfo = proxyinfo;
 	MWLOG(LEV_DEBUG, MOD_CMD, L"Requesting GetCertificate endpoint");
 	int ret = cli_getCertificate(in_userId);
@@ -410,20 +460,44 @@ int CMDSignature::signOpen(CMDProxyInfo proxyinfo, std::string in_userId, std::s
 		else
 			filenames[0]->assign(outfile_path);
 
-		int error = ERR_NONE;
-		for (size_t i = 0; i < m_pdf_handlers.size(); i++) {
-			PDFSignature *pdf = m_pdf_handlers[i];
-
-			try {
-				ret = pdf->signFiles(location, reason, filenames[i]->c_str(), false);
-			} catch (eIDMW::CMWException &e) {
-				throw CMWEXCEPTION(e.GetError());
-			}
+		// The prepared documents stay open until the signatures arrive, unless the memory budget closes them,
+		// this is the peak of the batch
+		PDFBatchMemoryReport memoryReport("CMD signature preparation", m_pdf_handlers.size());
+
+		// Documents are independent of each other so the batch is prepared in parallel
+		std::vector<int> results(m_pdf_handlers.size(), ERR_NONE);
+		std::atomic<size_t> next(0);
+		size_t threadCount = std::min<size_t>(m_pdf_handlers.size(), MAX_PREPARE_THREADS);
+		unsigned int cores = std::thread::hardware_concurrency();
+		if (cores > 0)
+			threadCount = std::min<size_t>(threadCount, cores);
+
+		std::vector<std::unique_ptr<PrepareDocumentThread>> threads;
+		for (size_t t = 0; t < threadCount; t++) {
+			threads.emplace_back(
+				new PrepareDocumentThread(m_pdf_handlers, filenames, results, next, location, reason));
+		}
+		if (threadCount > 1) {
+			for (size_t t = 0; t < threadCount; t++)
+				threads[t]->Start();
+			for (size_t t = 0; t < threadCount; t++)
+				threads[t]->WaitTillStopped();
+		} else if (threadCount == 1) {
+			threads[0]->Run();
+		}
 
+		for (size_t i = 0; i < filenames.size(); i++)
 			delete filenames[i];
 
-			if (ret != ERR_NONE) {
-				MWLOG_ERR("PDFSignature::signFiles failed: %d", ret);
+		for (size_t t = 0; t < threadCount; t++) {
+			if (threads[t]->getError() != EIDMW_OK)
+				throw CMWEXCEPTION(threads[t]->getError());
+		}
+
+		int error = ERR_NONE;
+		for (size_t i = 0; i < results.size(); i++) {
+			if (results[i] != ERR_NONE) {
+				MWLOG_ERR("PDFSignature::signFiles failed: %d", results[i]);
 				error = ERR_SIGN_PDF;
 			}
 		}
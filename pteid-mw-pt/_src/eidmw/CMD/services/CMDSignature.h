@@ -82,6 +82,8 @@ public:
 	PTEIDCMD_API char *getCertificateCitizenID();
 
 	PTEIDCMD_API static std::string getEndpoint();
+	// Closes the connections kept open by the finished CMD operations
+	PTEIDCMD_API static void releaseIdleConnections();
 
 	/* Certificate chain from last call to cli_getCertificate. */
 	std::vector<CByteArray> m_certificates;
@@ -23,8 +23,11 @@
 #include "Config.h"
 #include "MiscUtil.h"
 #include "MWException.h"
+#include "Mutex.h"
 #include "eidErrors.h"
 
+#include <vector>
+
 #define CC_MOVEL_SERVICE_GET_CERTIFICATE ((char *)"http://Ama.Authentication.Service/CCMovelSignature/GetCertificate")
 #define CC_MOVEL_SERVICE_SIGN ((char *)"http://Ama.Authentication.Service/CCMovelSignature/CCMovelSign")
 #define CC_MOVEL_SERVICE_VALIDATE_OTP ((char *)"http://Ama.Authentication.Service/CCMovelSignature/ValidateOtp")
@@ -39,6 +42,11 @@
 #define SOAP_MUST_NO_UNDERSTAND 0
 #define SOAP_MUST_UNDERSTAND 1
 
+// Idle clients kept for reuse by CMDServices::acquire()
+#define CMD_IDLE_CLIENTS_MAX 2
+// Past this the server has most likely closed the connection and the TLS session is no longer worth keeping
+#define CMD_IDLE_CLIENT_TIMEOUT 300
+
 #ifndef WIN32
 #define _strdup strdup
 #endif
@@ -78,6 +86,20 @@ class CMDSignatureGsoapProxy : public BasicHttpBinding_USCORECCMovelSignaturePro
 
 public:
 	CMDSignatureGsoapProxy(struct soap *sp, CMDProxyInfo p) : BasicHttpBinding_USCORECCMovelSignatureProxy(sp) {
+		// Contexts reused by CMDServices::acquire() still have the proxy of their previous request
+		bool changed = p.host.size() > 0 ? sp->proxy_host == NULL || p.host != sp->proxy_host || p.port != sp->proxy_port
+										 : sp->proxy_host != NULL;
+		if (changed) {
+			// The kept-alive connection goes through the previous proxy
+			soap_closesock(sp);
+		}
+		free((void *)sp->proxy_host);
+		free((void *)sp->proxy_userid);
+		free((void *)sp->proxy_passwd);
+		sp->proxy_host = NULL;
+		sp->proxy_userid = NULL;
+		sp->proxy_passwd = NULL;
+
 		if (p.host.size() > 0) {
 
 			sp->proxy_host = _strdup(p.host.c_str());
@@ -122,6 +144,10 @@ int handleCommunicationError(BasicHttpBinding_USCORECCMovelSignatureProxy proxy,
  ***    CMDServices::CMDServices()                     ***
  ********************************************************* */
 CMDServices::CMDServices(std::string basicAuthUser, std::string basicAuthPassword, std::string applicationId) {
+	m_soap = NULL;
+	m_endpoint = NULL;
+	m_lastUsed = 0;
+
 	if (!init(SOAP_RECV_TIMEOUT_DEFAULT, SOAP_SEND_TIMEOUT_DEFAULT, SOAP_CONNECT_TIMEOUT_DEFAULT,
 			  SOAP_MUST_NO_UNDERSTAND))
 		return;
@@ -157,17 +183,120 @@ CMDServices::~CMDServices() {
 	setSoap(NULL);
 }
 
+static CMutex idleClientsMutex;
+static std::vector<CMDServices *> idleClients;
+
+static std::string testEndpoint;
+static std::string testCaFile;
+
+/*  *********************************************************
+ ***    CMDServices::acquire()                         ***
+ ********************************************************* */
+CMDServices *CMDServices::acquire(std::string basicAuthUser, std::string basicAuthPassword,
+								  std::string applicationId) {
+	CMDServices *client = NULL;
+	std::string endpoint = getEndpoint();
+	{
+		CAutoMutex autoMutex(&idleClientsMutex);
+		time_t now = time(NULL);
+		std::vector<CMDServices *>::iterator it = idleClients.begin();
+		while (it != idleClients.end()) {
+			CMDServices *idle = *it;
+			if (now - idle->m_lastUsed > CMD_IDLE_CLIENT_TIMEOUT) {
+				delete idle;
+				it = idleClients.erase(it);
+			} else if (client == NULL && idle->m_basicAuthUser == basicAuthUser &&
+					   idle->m_basicAuthPassword == basicAuthPassword && idle->m_applicationID == applicationId &&
+					   endpoint == idle->getEndPoint()) {
+				client = idle;
+				it = idleClients.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	if (client != NULL) {
+		MWLOG_DEBUG("Reusing CMD client connection");
+		client->resetSession();
+		return client;
+	}
+
+	return new CMDServices(basicAuthUser, basicAuthPassword, applicationId);
+}
+
+/*  *********************************************************
+ ***    CMDServices::release()                         ***
+ ********************************************************* */
+void CMDServices::release(CMDServices *client) {
+	if (client == NULL)
+		return;
+
+	soap *sp = client->getSoap();
+	if (sp == NULL) {
+		delete client;
+		return;
+	}
+
+	// Free the deserialized data of the last requests but keep the connection and TLS session
+	soap_destroy(sp);
+	soap_end(sp);
+	client->m_lastUsed = time(NULL);
+
+	CAutoMutex autoMutex(&idleClientsMutex);
+	if (idleClients.size() >= CMD_IDLE_CLIENTS_MAX) {
+		delete idleClients.front();
+		idleClients.erase(idleClients.begin());
+	}
+	idleClients.push_back(client);
+}
+
+/*  *********************************************************
+ ***    CMDServices::releaseIdleClients()              ***
+ ********************************************************* */
+void CMDServices::releaseIdleClients() {
+	CAutoMutex autoMutex(&idleClientsMutex);
+	for (size_t i = 0; i < idleClients.size(); i++)
+		delete idleClients[i];
+	idleClients.clear();
+}
+
+/*  *********************************************************
+ ***    CMDServices::setTestEndpoint()                 ***
+ ********************************************************* */
+void CMDServices::setTestEndpoint(const std::string &endpoint, const std::string &caFile) {
+	testEndpoint = endpoint;
+	testCaFile = caFile;
+}
+
 std::string CMDServices::getEndpoint() {
+	if (!testEndpoint.empty())
+		return testEndpoint;
 	std::string cmd_host = utilStringNarrow(CConfig::GetString(CConfig::EIDMW_CONFIG_PARAM_GENERAL_CMD_HOST));
 	std::string cmd_endpoint = "https://" + cmd_host + ENDPOINT_CC_MOVEL_SIGNATURE;
 	return cmd_endpoint;
 }
 
+/*  *********************************************************
+ ***    CMDServices::resetSession()                    ***
+ ********************************************************* */
+void CMDServices::resetSession() {
+	// Nothing of the previous CMD operation may leak into the next one, e.g. ValidateOtp() or forceSMS()
+	// sending the previous processId
+	setUserId(STR_EMPTY);
+	setProcessID(STR_EMPTY);
+
+	// A cancelled request leaves the context in error with its socket closed, gSOAP reconnects on the next request
+	soap *sp = getSoap();
+	sp->error = SOAP_OK;
+}
+
 /*  *********************************************************
  ***    CMDServices::init()                            ***
  ********************************************************* */
 bool CMDServices::init(int recv_timeout, int send_timeout, int connect_timeout, short mustUnderstand) {
-	soap *sp = soap_new2(SOAP_C_UTFSTRING, SOAP_C_UTFSTRING);
+	// Keep the connection open between requests (e.g. GetCertificate, CCMovelSign and ValidateOtp)
+	soap *sp = soap_new2(SOAP_C_UTFSTRING | SOAP_IO_KEEPALIVE, SOAP_C_UTFSTRING | SOAP_IO_KEEPALIVE);
 	if (sp == NULL) {
 		MWLOG_ERR("Null soap");
 		return false;
@@ -192,6 +321,10 @@ bool CMDServices::init(int recv_timeout, int send_timeout, int connect_timeout,
 #else
 	cacerts_file = utilStringNarrow(CConfig::GetString(CConfig::EIDMW_CONFIG_PARAM_GENERAL_CERTS_DIR)) + "/cacerts.pem";
 #endif
+	if (!testCaFile.empty()) {
+		ca_path = nullptr;
+		cacerts_file = testCaFile;
+	}
 
 	int ret = soap_ssl_client_context(
 		sp, SOAP_SSL_DEFAULT, NULL, NULL,
@@ -14,6 +14,7 @@
 // STD Library
 #include <iostream>
 #include <string>
+#include <ctime>
 #include <openssl/x509.h>
 #include "soapH.h"
 #include "ByteArray.h"
@@ -67,6 +68,22 @@ public:
 
 	static std::string getEndpoint();
 
+	/*
+		Returns an idle client left by a previous CMD operation with the same credentials, or a new one.
+		Reusing the gSOAP context keeps the HTTP keep-alive connection and the TLS session of the last request.
+		Clients obtained this way must be given back with release() instead of deleted.
+	*/
+	static CMDServices *acquire(std::string basicAuthUser, std::string basicAuthPassword, std::string applicationId);
+	static void release(CMDServices *client);
+	// Closes and frees the idle clients, e.g. when the SDK is released
+	static void releaseIdleClients();
+
+	/*
+		Test seam of mw_unit_test: the clients created afterwards use this endpoint instead of the configured CMD
+		host and trust only the certificates of caFile. An empty endpoint restores the configured host.
+	*/
+	static void setTestEndpoint(const std::string &endpoint, const std::string &caFile);
+
 protected:
 	soap *getSoap();
 	void setSoap(soap *);
@@ -93,8 +110,10 @@ private:
 	std::string m_basicAuthUser;
 	std::string m_basicAuthPassword;
 	const char *m_endpoint;
+	time_t m_lastUsed;
 
 	bool init(int recv_timeout, int send_timeout, int connect_timeout, short mustUnderstand);
+	void resetSession();
 
 	// CCMovelSign
 	_ns2__CCMovelSign *get_CCMovelSignRequest(soap *sp, std::string in_applicationID, std::string *docName,
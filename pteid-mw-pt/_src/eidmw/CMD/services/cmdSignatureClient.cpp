@@ -140,7 +140,9 @@ CByteArray &CMDSignatureClient::SignXades(const char *output_path, const char *c
 		sig.enableLongTermValidation();
 	}
 
-	CByteArray &signature = sig.signXades(input_paths, n_paths);
+	// Input files are written to the zip container while they are hashed
+	ASiCWriter asic(input_paths, n_paths, output_path);
+	CByteArray &signature = sig.signXades(input_paths, n_paths, asic);
 
 	if (sig.shouldThrowTimestampException()) {
 		throw CMWEXCEPTION(EIDMW_TIMESTAMP_ERROR);
@@ -153,7 +155,7 @@ CByteArray &CMDSignatureClient::SignXades(const char *output_path, const char *c
 	// Zero-out currently stored PIN
 	std::fill(m_pin.begin(), m_pin.end(), 0);
 
-	SigContainer::createASiC(signature, input_paths, n_paths, output_path);
+	asic.close(signature);
 	return signature;
 }
 
@@ -30,6 +30,10 @@ INSTALL_DIR_INCLUDE = $${PREFIX_DIR}/include
 
 CONFIG += c++17
 
+## Test builds only: "qmake CONFIG+=virtual_card" compiles the emulated card reader and the APDU recorder
+## of the card layer (cardlayer/VirtualCard.h and ApduTrace.h) used by the virtual card tests of mw_unit_test. It must not be enabled for release packages.
+virtual_card: DEFINES += PTEID_VIRTUAL_CARD
+
 ## link to relative path
 LINK_RELATIVE_PATH = ../lib
 
@@ -172,7 +172,9 @@ CByteArray &APL_Card::SignXades(const char **paths, unsigned int n_paths, const
 		sig.enableLongTermValidation();
 	}
 
-	CByteArray &signature = sig.signXades(paths, n_paths);
+	// Input files are written to the zip container while they are hashed
+	ASiCWriter asic(paths, n_paths, output_path);
+	CByteArray &signature = sig.signXades(paths, n_paths, asic);
 
 	if (sig.shouldThrowTimestampException()) {
 		throw CMWEXCEPTION(EIDMW_TIMESTAMP_ERROR);
@@ -182,9 +184,8 @@ CByteArray &APL_Card::SignXades(const char **paths, unsigned int n_paths, const
 		throw CMWEXCEPTION(EIDMW_LTV_ERROR);
 	}
 
-	SigContainer::createASiC(signature, paths, n_paths, output_path);
-
-	// Write zip container signature and referenced files in zip container
+	// Write signature file and finish the zip container
+	asic.close(signature);
 
 	return signature;
 }
@@ -247,7 +248,11 @@ void APL_Card::SignIndividual(const char **paths, unsigned int n_paths, const ch
 		CByteArray *ts_data = NULL;
 
 		files_to_sign[0] = paths[i];
-		CByteArray &signature = sig.signXades(files_to_sign, 1);
+		const char *output_file = generateFinalPath(output_dir, paths[i]);
+		ASiCWriter asic(files_to_sign, 1, output_file);
+		delete[] output_file;
+
+		CByteArray &signature = sig.signXades(files_to_sign, 1, asic);
 
 		if (sig.shouldThrowTimestampException())
 			throwTimestampException = true;
@@ -255,9 +260,7 @@ void APL_Card::SignIndividual(const char **paths, unsigned int n_paths, const ch
 		if (sig.shouldThrowLTVException())
 			throwLTVException = true;
 
-		const char *output_file = generateFinalPath(output_dir, paths[i]);
-		SigContainer::createASiC(signature, files_to_sign, 1, output_file);
-		delete[] output_file;
+		asic.close(signature);
 
 		// Set SSO on after first iteration to avoid more PinCmd() user interaction for the remaining
 		//  iterations
@@ -283,10 +286,10 @@ CByteArray &APL_Card::SignXadesT(const char **paths, unsigned int n_paths, const
 	XadesSignature sig(this);
 	sig.enableTimestamp();
 
-	CByteArray &signature = sig.signXades(paths, n_paths);
-
 	// Write zip container signature and referenced files in zip container
-	SigContainer::createASiC(signature, paths, n_paths, output_file);
+	ASiCWriter asic(paths, n_paths, output_file);
+	CByteArray &signature = sig.signXades(paths, n_paths, asic);
+	asic.close(signature);
 
 	if (sig.shouldThrowTimestampException())
 		throw CMWEXCEPTION(EIDMW_TIMESTAMP_ERROR);
@@ -301,10 +304,10 @@ CByteArray &APL_Card::SignXadesA(const char **paths, unsigned int n_paths, const
 	XadesSignature sig(this);
 	sig.enableLongTermValidation();
 
-	CByteArray &signature = sig.signXades(paths, n_paths);
-
 	// Write zip container signature and referenced files in zip container
-	SigContainer::createASiC(signature, paths, n_paths, output_file);
+	ASiCWriter asic(paths, n_paths, output_file);
+	CByteArray &signature = sig.signXades(paths, n_paths, asic);
+	asic.close(signature);
 
 	if (sig.shouldThrowTimestampException())
 		throw CMWEXCEPTION(EIDMW_TIMESTAMP_ERROR);
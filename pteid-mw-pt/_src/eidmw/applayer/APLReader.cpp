@@ -47,6 +47,7 @@
 #include "MWException.h"
 #include "cryptoFwkPteid.h"
 #include "CertStatusCache.h"
+#include "PDFOccupancy.h"
 
 #include "../_Builds/pteidversions.h"
 
@@ -61,6 +62,12 @@ APL_ReaderContext::APL_ReaderContext(const char *readerName) {
 	m_calreader = &AppLayer.getCardLayer()->getReader(readerName);
 	m_card = NULL;
 	m_cardid = 0;
+	m_status = CARD_NOT_PRESENT;
+	m_presenceGeneration = 0;
+
+	// Card insertions/removals are followed in the background so that the card
+	// status doesn't have to be asked to PCSC on every call
+	m_calreader->StartPresenceWatcher();
 
 	m_cal_lock = false;
 	m_transaction_lock = false;
@@ -110,8 +117,10 @@ bool APL_ReaderContext::isCardChanged(unsigned long &ulOldId) {
 }
 
 unsigned long APL_ReaderContext::getCardId() {
-	// if(!isCardPresent())		//Make too many connection to the card
-	//	return 0;
+	// Only reconnect if the presence watcher saw a card being removed or inserted
+	// since the last check (or isn't running), otherwise this is just two atomic reads
+	if (m_cardid != 0 && m_calreader->GetPresenceGeneration() != m_presenceGeneration)
+		connectCard();
 
 	if (m_status == CARD_STILL_PRESENT || m_status == CARD_INSERTED || m_status == CARD_OTHER)
 		return m_cardid;
@@ -175,8 +184,26 @@ bool APL_ReaderContext::isPinpad() { return m_calreader->IsPinpadReader(); }
 bool APL_ReaderContext::connectCard() {
 	CAutoMutex autoMutex(&m_newcardmutex);
 
+	// Nothing was inserted or removed since the last check: skip SCardStatus()/SCardGetStatusChange()
+	unsigned long presenceGeneration = m_calreader->GetPresenceGeneration();
+	if (presenceGeneration != 0 && presenceGeneration == m_presenceGeneration) {
+		if (m_card && (m_status == CARD_STILL_PRESENT || m_status == CARD_INSERTED || m_status == CARD_OTHER)) {
+			m_status = CARD_STILL_PRESENT;
+			return false;
+		}
+		if (!m_card && (m_status == CARD_NOT_PRESENT || m_status == CARD_REMOVED)) {
+			m_status = CARD_NOT_PRESENT;
+			return false;
+		}
+	}
+
 	try {
 		m_status = m_calreader->Status(true);
+		m_presenceGeneration = presenceGeneration;
+
+		// The reader is reachable again after the watcher stopped on an error
+		if (presenceGeneration == 0)
+			m_calreader->StartPresenceWatcher();
 	} catch (CMWException &e) {
 		unsigned long err = e.GetError();
 		if (err == EIDMW_ERR_CANT_CONNECT) {
@@ -315,6 +342,7 @@ CAppLayer::CAppLayer() {
 	m_readerCount = COUNT_UNDEF;
 
 	m_contextid = 0;
+	m_readersGeneration = 0;
 
 	m_Cal = NULL;
 	m_cryptoFwk = NULL;
@@ -357,6 +385,9 @@ void CAppLayer::release() {
 
 	delete m_instance;
 	m_instance = NULL;
+
+	// The prefetch threads must not outlive the library
+	PDFOccupancy::stopPrefetch();
 }
 
 void CAppLayer::releaseReaders() {
@@ -422,39 +453,48 @@ void CAppLayer::readerListRelease() {
 }
 
 void CAppLayer::readerListInit(bool bForceRefresh) {
+	if (!bForceRefresh && m_readerCount != COUNT_UNDEF)
+		return;
+
+	CAutoMutex autoMutex(&m_Mutex); // We lock for only one instantiation
+
+	// A single SCardListReaders() per refresh: the cardlayer keeps a generation counter
+	// of the PCSC reader list so the list is only rebuilt when readers were added or removed
 	CReadersInfo readersInfo;
-	if (bForceRefresh || m_readerCount == COUNT_UNDEF) {
-		if (isReadersChanged()) {
-			CAutoMutex autoMutex(&m_Mutex); // We lock for only one instantiation
-			if (isReadersChanged()) {
-				unsigned long nbrReader = 0;
-				try {
-					readersInfo = m_Cal->ListReaders();
-					nbrReader = readersInfo.ReaderCount();
-				} catch (...) {
-					nbrReader = 0;
-				}
+	unsigned long nbrReader = 0;
+	try {
+		readersInfo = m_Cal->ListReaders();
+		nbrReader = readersInfo.ReaderCount();
 
-				readerListRelease();
+		unsigned long generation = m_Cal->GetReadersGeneration();
+		if (m_readerCount != COUNT_UNDEF && generation == m_readersGeneration)
+			return;
 
-				m_readerList = new char *[nbrReader + 1];
+		m_readersGeneration = generation;
+	} catch (...) {
+		if (m_readerCount == 0)
+			return;
 
-				unsigned long i;
+		nbrReader = 0;
+	}
 
-				for (i = 0; i < nbrReader; i++) {
-					m_readerList[i] = new char[readersInfo.ReaderName(i).size() + 1];
-					strcpy_s(m_readerList[i], readersInfo.ReaderName(i).size() + 1, readersInfo.ReaderName(i).c_str());
-				}
+	readerListRelease();
 
-				// The last element must be NULL the make loop easy
-				m_readerList[i] = NULL;
+	m_readerList = new char *[nbrReader + 1];
 
-				m_readerCount = nbrReader;
+	unsigned long i;
 
-				m_contextid++;
-			}
-		}
+	for (i = 0; i < nbrReader; i++) {
+		m_readerList[i] = new char[readersInfo.ReaderName(i).size() + 1];
+		strcpy_s(m_readerList[i], readersInfo.ReaderName(i).size() + 1, readersInfo.ReaderName(i).c_str());
 	}
+
+	// The last element must be NULL the make loop easy
+	m_readerList[i] = NULL;
+
+	m_readerCount = nbrReader;
+
+	m_contextid++;
 }
 
 // Update the stored revision/build number
@@ -495,22 +535,15 @@ APL_CertStatusCache *CAppLayer::getCertStatusCache() const {
 
 bool CAppLayer::isReadersChanged() const {
 	try {
-		CReadersInfo info = m_Cal->ListReaders();
+		m_Cal->ListReaders();
 
-		if (m_readerCount != info.ReaderCount())
+		if (m_readerCount == COUNT_UNDEF)
 			return true;
 
-		unsigned long i;
-
-		for (i = 0; i < info.ReaderCount(); i++) {
-			if (strcmp(m_readerList[i], info.ReaderName(i).c_str()) != 0)
-				return true;
-		}
+		return m_Cal->GetReadersGeneration() != m_readersGeneration;
 	} catch (...) {
 		return (m_readerCount != 0);
 	}
-
-	return false;
 }
 
 unsigned long CAppLayer::getContextId(bool bForceRefresh) {
@@ -249,6 +249,7 @@ private:
 	unsigned long m_readerCount; /**< Keep the number of reader */
 
 	unsigned long m_contextid; /**< Incremented for each time a reader is add or remove */
+	unsigned long m_readersGeneration; /**< Reader list generation of the cardlayer when the list was last built */
 
 	CCardLayer *m_Cal;						/**< Pointer to cardlayer */
 	APL_CryptoFwkPteid *m_cryptoFwk;		/**< Pointer to APL_CryptoFwkPteid */
@@ -401,6 +402,8 @@ private:
 	std::string m_name;		/**< The name of the reader */
 	unsigned long m_cardid; /**< Incremented for each new connected card */
 
+	unsigned long m_presenceGeneration; /**< Reader presence generation when m_status was last checked */
+
 	friend APL_ReaderContext &
 	CAppLayer::getReader(const char *readerName); /**< This method must access protected constructor */
 };
@@ -31,6 +31,7 @@
 #include "MWException.h"
 #include "eidErrors.h"
 #include "Log.h"
+#include "Metrics.h"
 #include <errno.h>
 
 #ifndef WIN32
@@ -199,6 +200,21 @@ CSC_Status APL_CertStatusCache::getCertStatus(unsigned long ulUniqueID, const CS
 		} while (status == CSC_STATUS_WAIT);
 	}
 
+	static const char *LOOKUPS_HELP = "Certificate status lookups by result";
+	static CMetricCounter *hits =
+		CMetrics::GetInstance()->GetCounter("pteid_cert_status_cache_lookups_total", LOOKUPS_HELP, "result=\"hit\"");
+	static CMetricCounter *misses =
+		CMetrics::GetInstance()->GetCounter("pteid_cert_status_cache_lookups_total", LOOKUPS_HELP, "result=\"miss\"");
+	static CMetricCounter *bypassed = CMetrics::GetInstance()->GetCounter("pteid_cert_status_cache_lookups_total",
+																		  LOOKUPS_HELP, "result=\"bypass\"");
+
+	if (!useCache)
+		bypassed->Inc();
+	else if (status == CSC_STATUS_NONE)
+		misses->Inc();
+	else
+		hits->Inc();
+
 	// IF NOT YET IN THE CACHE
 	if (!useCache || status == CSC_STATUS_NONE) {
 
@@ -1,5 +1,8 @@
 #include <stdlib.h>
+#include <algorithm>
 #include <cassert>
+#include <climits>
+#include <thread>
 
 #include "J2KHelper.h"
 
@@ -202,15 +205,19 @@ void write_callback(png_structp png_ptr, png_bytep data, png_size_t length) {
 	assert(s_pointer->size + length <= ULONG_MAX);
 	unsigned long nsize = (unsigned long) (s_pointer->size + length);
 
-	/* allocate or grow buffer */
-	if (s_pointer->buffer) {
-		s_pointer->buffer = static_cast<unsigned char *>(realloc(s_pointer->buffer, nsize));
-	} else {
-		s_pointer->buffer = static_cast<unsigned char *>(malloc(nsize));
-	}
+	/* allocate or grow buffer, doubling its capacity to avoid a realloc per chunk */
+	if (nsize > s_pointer->capacity) {
+		unsigned long ncapacity = s_pointer->capacity ? s_pointer->capacity : 16384;
+		while (ncapacity < nsize) {
+			ncapacity *= 2;
+		}
 
-	if (!s_pointer->buffer) {
-		png_error(png_ptr, "Write Error");
+		unsigned char *nbuffer = static_cast<unsigned char *>(realloc(s_pointer->buffer, ncapacity));
+		if (!nbuffer) {
+			png_error(png_ptr, "Write Error");
+		}
+		s_pointer->buffer = nbuffer;
+		s_pointer->capacity = ncapacity;
 	}
 
 	/* copy new bytes to end of buffer */
@@ -227,7 +234,6 @@ int jp2_to_png(opj_image_t *image, unsigned char **buffer, unsigned long *image_
 	png_structp png = nullptr;
 	png_infop info = nullptr;
 	volatile png_bytep row_buf = nullptr;
-	png_bytepp row_pointers = nullptr;
 
 	int nr_comp, color_type;
 	volatile int prec;
@@ -235,6 +241,14 @@ int jp2_to_png(opj_image_t *image, unsigned char **buffer, unsigned long *image_
 	OPJ_INT32 const *planes[4];
 	int i;
 	OPJ_INT32 *volatile buffer32s = nullptr;
+	/* 8 bit unsigned gray or RGB: the card photo case. Samples are clamped and interleaved straight
+	   into the PNG row, skipping the generic clip/scale passes and the 32 bit intermediate buffer */
+	bool direct_8bit;
+
+	struct PNG_MEM_ENCODE state;
+	state.buffer = nullptr;
+	state.size = 0;
+	state.capacity = 0;
 
 	volatile int fails = 1;
 
@@ -266,10 +280,13 @@ int jp2_to_png(opj_image_t *image, unsigned char **buffer, unsigned long *image_
 		fprintf(stderr, "\tAborting\n");
 		return 1;
 	}
-	for (i = 0; i < nr_comp; ++i) {
+	direct_8bit = prec == 8 && !image->comps[0].sgnd && (nr_comp == 1 || nr_comp == 3);
+	for (i = 0; i < nr_comp && !direct_8bit; ++i) {
 		clip_component(&(image->comps[i]), image->comps[0].prec);
 	}
-	if (prec > 8 && prec < 16) {
+	if (direct_8bit) {
+		/* no conversion needed */
+	} else if (prec > 8 && prec < 16) {
 		for (i = 0; i < nr_comp; ++i) {
 			scale_component(&(image->comps[i]), 16);
 		}
@@ -323,11 +340,6 @@ int jp2_to_png(opj_image_t *image, unsigned char **buffer, unsigned long *image_
 
 	/* I/O initialization functions is REQUIRED
 	 */
-
-	struct PNG_MEM_ENCODE state;
-	state.buffer = nullptr;
-	state.size = 0;
-
 	png_set_write_fn(png, &state, write_callback, flush_callback);
 
 	/* Set the image information here.  Width and height are up to 2^31,
@@ -347,7 +359,9 @@ int jp2_to_png(opj_image_t *image, unsigned char **buffer, unsigned long *image_
 	 * color_type == PNG_COLOR_TYPE_RGB_ALPHA) && bit_depth < 8
 	 *
 	 */
-	png_set_compression_level(png, Z_BEST_COMPRESSION);
+	/* The photo is already lossy compressed: the best compression level costs several times the CPU
+	 * of the default one for a few percent smaller output */
+	png_set_compression_level(png, Z_DEFAULT_COMPRESSION);
 
 	if (nr_comp >= 3) { /* RGB(A) */
 		color_type = PNG_COLOR_TYPE_RGB;
@@ -387,9 +401,11 @@ int jp2_to_png(opj_image_t *image, unsigned char **buffer, unsigned long *image_
 			goto clean_up;
 		}
 
-		buffer32s = static_cast<OPJ_INT32 *>(malloc(
-			(static_cast<OPJ_SIZE_T>(image->comps[0].w * static_cast<OPJ_SIZE_T>(nr_comp) * sizeof(OPJ_INT32)))));
-		if (!buffer32s) {
+		if (!direct_8bit) {
+			buffer32s = static_cast<OPJ_INT32 *>(malloc((static_cast<OPJ_SIZE_T>(
+				image->comps[0].w * static_cast<OPJ_SIZE_T>(nr_comp) * sizeof(OPJ_INT32)))));
+		}
+		if (!direct_8bit && !buffer32s) {
 			fprintf(stderr, "Can't allocate memory for interleaved 32s row\n");
 			goto clean_up;
 		}
@@ -419,13 +435,20 @@ int jp2_to_png(opj_image_t *image, unsigned char **buffer, unsigned long *image_
 			break;
 		}
 
-		row_pointers = static_cast<png_bytepp>(png_malloc(png, image->comps[0].h * sizeof(png_uint_16 *)));
-
 		for (y = 0; y < image->comps[0].h; ++y) {
-			cvtPxToCx(planes, buffer32s_cpy, width, adjust);
-			cvt32sToPack(buffer32s_cpy, row_buf_cpy, width * static_cast<OPJ_SIZE_T>(nr_comp));
+			if (direct_8bit) {
+				png_bytep out = row_buf_cpy;
+				for (OPJ_SIZE_T x = 0; x < width; ++x) {
+					for (i = 0; i < nr_comp; ++i) {
+						OPJ_INT32 v = planes[i][x];
+						*out++ = static_cast<png_byte>(v < 0 ? 0 : (v > 255 ? 255 : v));
+					}
+				}
+			} else {
+				cvtPxToCx(planes, buffer32s_cpy, width, adjust);
+				cvt32sToPack(buffer32s_cpy, row_buf_cpy, width * static_cast<OPJ_SIZE_T>(nr_comp));
+			}
 			png_write_row(png, row_buf_cpy);
-			row_pointers[y] = row_buf_cpy;
 			planes[0] += width;
 			planes[1] += width;
 			planes[2] += width;
@@ -433,13 +456,9 @@ int jp2_to_png(opj_image_t *image, unsigned char **buffer, unsigned long *image_
 		}
 	}
 
-	png_set_rows(png, info, row_pointers);
+	/* The rows were written above, only the trailing chunks are missing */
+	png_write_end(png, info);
 
-#ifdef IS_BIG_ENDIAN
-	png_write_png(png, info, PNG_TRANSFORM_SWAP_ENDIAN, nullptr);
-#else
-	png_write_png(png, info, PNG_TRANSFORM_IDENTITY, nullptr);
-#endif
 	*image_len = state.size;
 	*buffer = static_cast<unsigned char *>(malloc(((*image_len) * sizeof(char))));
 	memcpy(*buffer, state.buffer, *image_len);
@@ -453,9 +472,6 @@ clean_up:
 		if (row_buf) {
 			free(row_buf);
 		}
-	if (row_pointers) {
-		free(row_pointers);
-	}
 	if (buffer32s) {
 		free(buffer32s);
 	}
@@ -466,7 +482,25 @@ clean_up:
 	return fails;
 }
 
-int load_jp2(PHOTO_STREAM *p_stream, opj_stream_t *stream, unsigned char **buffer, unsigned long *image_len) {
+/* Highest reduce factor accepted for the image: each component keeps at least its lowest resolution level */
+static unsigned int max_reduce_factor(opj_codec_t *codec) {
+	opj_codestream_info_v2_t *info = opj_get_cstr_info(codec);
+	if (!info) {
+		return 0;
+	}
+
+	unsigned int max_reduce = info->nbcomps > 0 ? UINT_MAX : 0;
+	for (OPJ_UINT32 i = 0; i < info->nbcomps; i++) {
+		OPJ_UINT32 numresolutions = info->m_default_tile_info.tccp_info[i].numresolutions;
+		max_reduce = std::min(max_reduce, numresolutions > 0 ? numresolutions - 1 : 0);
+	}
+
+	opj_destroy_cstr_info(&info);
+	return max_reduce;
+}
+
+int load_jp2(PHOTO_STREAM *p_stream, opj_stream_t *stream, unsigned char **buffer, unsigned long *image_len,
+			 unsigned int reduce) {
 	if (p_stream && stream) {
 		opj_codec_t *d_codec = nullptr; // handle to a decompressor
 		opj_dparameters_t parameters;	// decompression parameters
@@ -499,11 +533,26 @@ int load_jp2(PHOTO_STREAM *p_stream, opj_stream_t *stream, unsigned char **buffe
 				throw "Failed to setup the decoder\n";
 			}
 
+#if defined(OPJ_VERSION_MAJOR) && (OPJ_VERSION_MAJOR > 2 || (OPJ_VERSION_MAJOR == 2 && OPJ_VERSION_MINOR >= 3))
+			// code-blocks are decoded in parallel, fails harmlessly if openjpeg was built without thread support
+			unsigned int threads = std::thread::hardware_concurrency();
+			if (threads > 1) {
+				opj_codec_set_threads(d_codec, static_cast<int>(threads));
+			}
+#endif
+
 			// read the main header of the codestream and if necessary the JP2 boxes
 			if (!opj_read_header(d_stream, d_codec, &image)) {
 				throw "Failed to read the header\n";
 			}
 
+			// decode only up to the resolution level 1/2^reduce of the original size,
+			// the decoder rejects a reduce factor that removes all the resolution levels of a component
+			reduce = std::min(reduce, max_reduce_factor(d_codec));
+			if (reduce > 0 && !opj_set_decoded_resolution_factor(d_codec, reduce)) {
+				throw "Failed to set the resolution factor\n";
+			}
+
 			// decode the stream and fill the image structure
 			if (!(opj_decode(d_codec, d_stream, image) && opj_end_decompress(d_codec, d_stream))) {
 				throw "Failed to decode image!\n";
@@ -586,11 +635,11 @@ PHOTO_STREAM *load_memory(unsigned char *data, unsigned long size_in_bytes) {
 }
 
 void convert_to_png(unsigned char *data, unsigned long data_size, unsigned char **mem_buffer,
-					unsigned long *buffer_size) {
+					unsigned long *buffer_size, unsigned int reduce) {
 	PHOTO_STREAM *source = load_memory(data, data_size);
 	if (source && source->data) {
 		opj_stream_t *stream = opj_image_stream_create(source->data);
-		int i = load_jp2(source, stream, mem_buffer, buffer_size);
+		int i = load_jp2(source, stream, mem_buffer, buffer_size, reduce);
 		if (i < 0) {
 			fprintf(stderr, "Conversion between jp2 and png failed\n");
 		}
@@ -20,6 +20,7 @@
 struct PNG_MEM_ENCODE {
 	unsigned char *buffer;
 	unsigned long size;
+	unsigned long capacity;
 };
 
 struct PHOTO_STREAM {
@@ -62,4 +63,6 @@ enum IMAGE_FORMAT {
 	JP2 = 2
 };
 
-void convert_to_png(unsigned char *data, unsigned long size, unsigned char **buffer, unsigned long *buffer_size);
+/* reduce: decode at 1/2^reduce of the original resolution (0 for full size), e.g. for thumbnails */
+void convert_to_png(unsigned char *data, unsigned long size, unsigned char **buffer, unsigned long *buffer_size,
+					unsigned int reduce = 0);
@@ -18,7 +18,8 @@
 #include "TSAClient.h"
 #include "MiscUtil.h"
 #include "sign-pkcs7.h"
-#include "PKIFetcher.h"
+#include "Thread.h"
+#include "Metrics.h"
 #include "poppler/PDFDoc.h"
 
 #include <openssl/pkcs7.h>
@@ -27,9 +28,191 @@
 #include <cassert>
 
 namespace eIDMW {
-PAdESExtender::PAdESExtender(PDFSignature *signedPdfDoc) {
+
+// Lifetime of cached revocation data that doesn't include a nextUpdate date
+#define LTV_CACHE_DEFAULT_TTL 600
+#define LTV_CACHE_MAX_FETCH_THREADS 8
+
+LTVRevocationCache::LTVRevocationCache() {}
+
+std::string LTVRevocationCache::ocspKey(const CByteArray &cert, const CByteArray &issuer) {
+	APL_CryptoFwkPteid *cryptoFwk = AppLayer.getCryptoFwk();
+	CByteArray cert_hash, issuer_hash;
+	cryptoFwk->GetHashSha1(cert, &cert_hash);
+	cryptoFwk->GetHashSha1(issuer, &issuer_hash);
+
+	return cert_hash.ToString(false, false) + issuer_hash.ToString(false, false);
+}
+
+bool LTVRevocationCache::lookup(std::unordered_map<std::string, Entry> &entries, const std::string &key,
+								CByteArray &out) {
+	CAutoMutex autoMutex(&m_mutex);
+	auto it = entries.find(key);
+	if (it == entries.end())
+		return false;
+
+	if (it->second.expiry <= time(NULL)) {
+		entries.erase(it);
+		return false;
+	}
+
+	out = it->second.data;
+	return true;
+}
+
+void LTVRevocationCache::store(std::unordered_map<std::string, Entry> &entries, const std::string &key,
+							   const CByteArray &data, time_t expiry) {
+	if (expiry <= time(NULL))
+		return;
+
+	CAutoMutex autoMutex(&m_mutex);
+	Entry &entry = entries[key];
+	entry.data = data;
+	entry.expiry = expiry;
+}
+
+static time_t expiryFromNextUpdate(const ASN1_TIME *next_update) {
+	time_t now = time(NULL);
+	if (next_update == NULL)
+		return now + LTV_CACHE_DEFAULT_TTL;
+
+	int days = 0, secs = 0;
+	if (!ASN1_TIME_diff(&days, &secs, NULL, next_update))
+		return now + LTV_CACHE_DEFAULT_TTL;
+
+	return now + (time_t)days * 86400 + secs;
+}
+
+time_t LTVRevocationCache::ocspExpiry(const CByteArray &response) {
+	const unsigned char *p = response.GetBytes();
+	OCSP_RESPONSE *ocsp_resp = d2i_OCSP_RESPONSE(NULL, &p, response.Size());
+	OCSP_BASICRESP *basic_resp = ocsp_resp ? OCSP_response_get1_basic(ocsp_resp) : NULL;
+	ASN1_GENERALIZEDTIME *this_update = NULL, *next_update = NULL;
+	time_t expiry = time(NULL) + LTV_CACHE_DEFAULT_TTL;
+
+	if (basic_resp && OCSP_resp_count(basic_resp) > 0) {
+		int reason = 0;
+		OCSP_single_get0_status(OCSP_resp_get0(basic_resp, 0), &reason, NULL, &this_update, &next_update);
+		expiry = expiryFromNextUpdate(next_update);
+	}
+
+	OCSP_BASICRESP_free(basic_resp);
+	OCSP_RESPONSE_free(ocsp_resp);
+
+	return expiry;
+}
+
+time_t LTVRevocationCache::crlExpiry(const CByteArray &crl_data) {
+	const unsigned char *p = crl_data.GetBytes();
+	X509_CRL *crl = d2i_X509_CRL(NULL, &p, crl_data.Size());
+	if (crl == NULL) {
+		MWLOG(LEV_WARN, MOD_APL, "%s: Failed to decode CRL. It won't be cached", __FUNCTION__);
+		return 0;
+	}
+
+	time_t expiry = expiryFromNextUpdate(X509_CRL_get0_nextUpdate(crl));
+	X509_CRL_free(crl);
+
+	return expiry;
+}
+
+FWK_CertifStatus LTVRevocationCache::getOCSPResponse(const CByteArray &cert, const CByteArray &issuer,
+													 CByteArray &response) {
+	std::string key = ocspKey(cert, issuer);
+	if (lookup(m_ocspResponses, key, response)) {
+		MWLOG(LEV_DEBUG, MOD_APL, "%s: Using cached OCSP response", __FUNCTION__);
+		return FWK_CERTIF_STATUS_VALID;
+	}
+
+	APL_CryptoFwkPteid *cryptoFwk = AppLayer.getCryptoFwk();
+	response.ClearContents();
+	FWK_CertifStatus status = cryptoFwk->GetOCSPResponse(cert, issuer, &response, false);
+	if (status == FWK_CERTIF_STATUS_VALID)
+		store(m_ocspResponses, key, response, ocspExpiry(response));
+
+	return status;
+}
+
+bool LTVRevocationCache::getCrlData(const CByteArray &cert, CByteArray &crl) {
+	APL_CryptoFwkPteid *cryptoFwk = AppLayer.getCryptoFwk();
+	std::string url;
+	if (!cryptoFwk->GetCDPUrl(cert, url, NID_crl_distribution_points)) {
+		MWLOG(LEV_ERROR, MOD_APL, "Couldn't parse CRL URL from certificate");
+		return false;
+	}
+
+	if (lookup(m_crls, url, crl)) {
+		MWLOG(LEV_DEBUG, MOD_APL, "%s: Using cached CRL from %s", __FUNCTION__, url.c_str());
+		return true;
+	}
+
+	crl.ClearContents();
+	if (!cryptoFwk->GetCrlData(cert, crl))
+		return false;
+
+	store(m_crls, url, crl, crlExpiry(crl));
+	return true;
+}
+
+namespace {
+class OCSPFetchThread : public CThread {
+public:
+	OCSPFetchThread(LTVRevocationCache *cache, const CByteArray &cert, const CByteArray &issuer)
+		: m_cache(cache), m_cert(cert), m_issuer(issuer) {}
+
+	void Run() {
+		CByteArray response;
+		m_cache->getOCSPResponse(m_cert, m_issuer, response);
+	}
+
+private:
+	LTVRevocationCache *m_cache;
+	CByteArray m_cert;
+	CByteArray m_issuer;
+};
+} // namespace
+
+void LTVRevocationCache::prefetchOCSP(const std::vector<std::pair<CByteArray, CByteArray>> &certs) {
+	std::vector<std::unique_ptr<OCSPFetchThread>> threads;
+	std::unordered_set<std::string> pending;
+
+	for (const auto &cert_issuer : certs) {
+		if (cert_issuer.second.Size() == 0)
+			continue;
+
+		std::string key = ocspKey(cert_issuer.first, cert_issuer.second);
+		CByteArray cached;
+		if (pending.count(key) || lookup(m_ocspResponses, key, cached))
+			continue;
+		pending.insert(key);
+
+		if (threads.size() == LTV_CACHE_MAX_FETCH_THREADS) {
+			for (auto &thread : threads)
+				thread->WaitTillStopped();
+			threads.clear();
+		}
+
+		threads.emplace_back(new OCSPFetchThread(this, cert_issuer.first, cert_issuer.second));
+		if (threads.back()->Start() != 0) {
+			// Not fatal: the response will be requested sequentially by the caller
+			MWLOG(LEV_WARN, MOD_APL, "%s: Failed to start OCSP fetch thread", __FUNCTION__);
+			threads.pop_back();
+		}
+	}
+
+	for (auto &thread : threads)
+		thread->WaitTillStopped();
+}
+
+PAdESExtender::PAdESExtender(PDFSignature *signedPdfDoc, LTVRevocationCache *revocationCache) {
 	m_signedPdfDoc = signedPdfDoc;
 	m_calledFromLtaMethod = false;
+
+	if (revocationCache == NULL) {
+		m_ownedRevocationCache.reset(new LTVRevocationCache());
+		revocationCache = m_ownedRevocationCache.get();
+	}
+	m_revocationCache = revocationCache;
 }
 
     bool PAdESExtender::addT()
@@ -89,7 +272,7 @@ cleanup:
 		delete[] hexToken;
 
 	if (to_sign)
-		free(to_sign);
+		gfree(to_sign);
 
 	return success;
 }
@@ -160,31 +343,9 @@ ValidationDataElement *PAdESExtender::addValidationElement(ValidationDataElement
 	return newElem;
 }
 
-void PAdESExtender::removeValidationElement(ValidationDataElement *elem) {
-
-	if (elem->getType() == ValidationDataElement::CERT) {
-		assert(elem->getSize() <= INT_MAX);
-		signed long docCertId = getCertUniqueId(elem->getData(), (int) elem->getSize());
-		std::vector<ValidationDataElement *>::iterator it = m_validationData.begin();
-		while (it != m_validationData.end()) {
-			ValidationDataElement *newVde = *it;
-			if (newVde->getType() == ValidationDataElement::CERT) {
-				assert(newVde->getSize() <= INT_MAX);
-				signed long newVdeId = getCertUniqueId(newVde->getData(), (int) newVde->getSize());
-				if (newVdeId == docCertId) {
-					it = m_validationData.erase(it);
-					continue;
-				}
-			}
-			it++;
-		}
-	}
-}
-
 bool PAdESExtender::addCRLRevocationInfo(CByteArray &cert, std::unordered_set<std::string> vri_keys) {
 	CByteArray crl;
-	APL_CryptoFwkPteid *cryptoFwk = AppLayer.getCryptoFwk();
-	if (cryptoFwk->GetCrlData(cert, crl)) {
+	if (m_revocationCache->getCrlData(cert, crl)) {
 		ValidationDataElement crlElem(crl.GetBytes(), crl.Size(), ValidationDataElement::CRL, vri_keys);
 		addValidationElement(crlElem);
 
@@ -231,6 +392,8 @@ bool PAdESExtender::addLT() {
 	unsigned char *signatureContents = NULL;
 
 	std::vector<size_t> signerCerts_idx;
+	// Pairs of (signer certificate, issuer certificate), the issuer is empty if it was not found
+	std::vector<std::pair<CByteArray, CByteArray>> signerIssuers;
 	std::unordered_set<int> sigIndexes = doc->getSignaturesIndexesUntilLastTimestamp();
 
 	if (sigIndexes.empty()) {
@@ -320,11 +483,8 @@ bool PAdESExtender::addLT() {
 		}
 	}
 
-	// Add revocation info for all signer certificates preferably using OCSP
+	// Find the issuer of every signer certificate so that the OCSP requests can be sent concurrently
 	for (auto signer_cert_idx : signerCerts_idx) {
-		status = FWK_CERTIF_STATUS_UNCHECK;
-		CByteArray ocsp_response;
-		bool ocsp_check_revocation = false;
 		bool foundIssuer = false;
 		ValidationDataElement *vd_elem = m_validationData[signer_cert_idx];
 		assert(vd_elem->getSize() <= ULONG_MAX);
@@ -364,7 +524,26 @@ bool PAdESExtender::addLT() {
 		}
 
 		if (foundIssuer) {
-			status = cryptoFwk->GetOCSPResponse(signer_cert, issuerCertDataByteArray, &ocsp_response, false);
+			signerIssuers.push_back(std::make_pair(signer_cert, issuerCertDataByteArray));
+		} else {
+			signerIssuers.push_back(std::make_pair(signer_cert, CByteArray()));
+		}
+	}
+
+	m_revocationCache->prefetchOCSP(signerIssuers);
+
+	// Add revocation info for all signer certificates preferably using OCSP
+	for (size_t k = 0; k < signerCerts_idx.size(); k++) {
+		status = FWK_CERTIF_STATUS_UNCHECK;
+		CByteArray ocsp_response;
+		bool ocsp_check_revocation = false;
+		ValidationDataElement *vd_elem = m_validationData[signerCerts_idx[k]];
+		CByteArray &signer_cert = signerIssuers[k].first;
+		CByteArray &issuer_cert = signerIssuers[k].second;
+		bool foundIssuer = issuer_cert.Size() > 0;
+
+		if (foundIssuer) {
+			status = m_revocationCache->getOCSPResponse(signer_cert, issuer_cert, ocsp_response);
 
 		} else {
 			MWLOG(LEV_WARN, MOD_APL,
@@ -406,18 +585,16 @@ bool PAdESExtender::addLT() {
 
 	} // End of outer loop
 
-	/* Remove from m_validationData the certs already present in document DSS. */
+	/* The certificates, OCSP responses and CRLs already present in the DSS of any revision are referenced
+	   again instead of being embedded */
 	{
-		std::vector<ValidationDataElement *> certsAlreadyAdded;
-		doc->getCertsInDSS(&certsAlreadyAdded);
-
-		for (auto cert : certsAlreadyAdded) {
-			removeValidationElement(cert);
-			delete cert;
-		}
+		DSSUpdateStats stats = doc->addDSS(m_validationData);
+		MWLOG(LEV_INFO, MOD_APL, "%s: DSS update with %d new streams, reused %d streams (%lu bytes)", __FUNCTION__,
+			  stats.addedStreams, stats.reusedStreams, stats.reusedBytes);
+		static CMetricCounter *reusedBytes = CMetrics::GetInstance()->GetCounter(
+			"pteid_pdf_dss_reused_bytes_total", "Validation data already in the DSS that was not embedded again", "");
+		reusedBytes->Inc(stats.reusedBytes);
 	}
-
-	doc->addDSS(m_validationData);
 	m_signedPdfDoc->save();
 
 cleanup:
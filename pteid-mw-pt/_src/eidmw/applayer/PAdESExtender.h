@@ -14,13 +14,53 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <memory>
+#include <ctime>
 #include "PDFSignature.h"
+#include "cryptoFramework.h"
 
 /* Forward declaration of ValidationDataElement defined in pteid-poppler. */
 class ValidationDataElement;
 
 namespace eIDMW {
 
+/* Revocation data (OCSP responses and CRLs) downloaded while extending signatures to PAdES-LT/LTA.
+   The same instance is shared by every document of a batch signature so that the OCSP response for a given
+   certificate and the CRL of a given distribution point are only fetched once while they are still valid.
+   Only successful responses are cached. All methods are thread-safe.
+*/
+class LTVRevocationCache {
+public:
+	EIDMW_APL_API LTVRevocationCache();
+
+	/* Same semantics as APL_CryptoFwk::GetOCSPResponse() without response verification */
+	FWK_CertifStatus getOCSPResponse(const CByteArray &cert, const CByteArray &issuer, CByteArray &response);
+
+	/* Same semantics as APL_CryptoFwk::GetCrlData() */
+	bool getCrlData(const CByteArray &cert, CByteArray &crl);
+
+	/* Fetch concurrently the OCSP responses for the (certificate, issuer) pairs that are not cached yet */
+	void prefetchOCSP(const std::vector<std::pair<CByteArray, CByteArray>> &certs);
+
+private:
+	struct Entry {
+		CByteArray data;
+		time_t expiry;
+	};
+
+	std::string ocspKey(const CByteArray &cert, const CByteArray &issuer);
+	bool lookup(std::unordered_map<std::string, Entry> &entries, const std::string &key, CByteArray &out);
+	void store(std::unordered_map<std::string, Entry> &entries, const std::string &key, const CByteArray &data,
+			   time_t expiry);
+
+	static time_t ocspExpiry(const CByteArray &response);
+	static time_t crlExpiry(const CByteArray &crl);
+
+	CMutex m_mutex;
+	std::unordered_map<std::string, Entry> m_ocspResponses; // keyed by hash of (certificate, issuer)
+	std::unordered_map<std::string, Entry> m_crls;			// keyed by CRL distribution point URL
+};
+
 /* PAdESExtender allows to extend the level of an existing PAdES-B or PAdES-T signed document.
    This can be done in a incremental way without breaking the existing signature.
    Revocation information and related certificates are added to the /DSS dictionary in Catalog object
@@ -28,7 +68,8 @@ namespace eIDMW {
 */
 class PAdESExtender {
 public:
-	EIDMW_APL_API PAdESExtender(PDFSignature *signedPdfDoc);
+	/* If revocationCache is NULL a private cache is used, i.e. revocation data is only reused within this document */
+	EIDMW_APL_API PAdESExtender(PDFSignature *signedPdfDoc, LTVRevocationCache *revocationCache = NULL);
 
 	EIDMW_APL_API bool addT();
 	EIDMW_APL_API bool addLT();
@@ -39,15 +80,14 @@ private:
 	already present. It returns a pointer to the element in m_validationData */
 	ValidationDataElement *addValidationElement(ValidationDataElement &elem);
 
-	/* Remove vde from m_validationData. WARNING: ONLY IMPLEMENTED FOR TYPE CERT*/
-	void removeValidationElement(ValidationDataElement *vde);
-
 	bool findIssuerInEidStore(APL_CryptoFwkPteid *cryptoFwk, CByteArray &certif_ba, CByteArray &issuer_ba);
 	bool addOCSPCertToValidationData(CByteArray &ocsp_response_ba, CByteArray &out_ocsp_cert);
 	bool addCRLRevocationInfo(CByteArray &cert, std::unordered_set<std::string> vri_keys);
 	unsigned long getCertUniqueId(const unsigned char *data, int dataSize);
 
 	PDFSignature *m_signedPdfDoc;
+	LTVRevocationCache *m_revocationCache;
+	std::unique_ptr<LTVRevocationCache> m_ownedRevocationCache;
 	std::vector<ValidationDataElement *> m_validationData;
 	std::unordered_map<unsigned long, ValidationDataElement *>
 		m_certsInDoc; // used to avoid adding repeated certificates
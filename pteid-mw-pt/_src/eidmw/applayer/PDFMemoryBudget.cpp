@@ -0,0 +1,74 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+
+#include "poppler/XRef.h"
+#include "goo/gmem.h"
+
+#include "PDFMemoryBudget.h"
+#include "PDFSignature.h"
+#include "APLConfig.h"
+#include "Log.h"
+#include "Metrics.h"
+
+namespace eIDMW {
+
+size_t PDFMemoryBudget::getBudget() {
+	static size_t budget = []() {
+		APL_Config conf_budget(CConfig::EIDMW_CONFIG_PARAM_GENERAL_PDF_MEMORY_BUDGET);
+		long megabytes = conf_budget.getLong();
+		return megabytes > 0 ? (size_t)megabytes * 1024 * 1024 : 0;
+	}();
+	return budget;
+}
+
+size_t PDFMemoryBudget::getAllocated() { return gMemGetAllocated(); }
+
+void PDFMemoryBudget::enforce() {
+	static CMetricCounter *released = CMetrics::GetInstance()->GetCounter(
+		"pteid_pdf_object_streams_released_total", "Decoded PDF object streams released to fit the memory budget");
+
+	size_t budget = getBudget();
+	size_t allocated = gMemGetAllocated();
+	if (budget == 0 || allocated <= budget)
+		return;
+
+	int count = XRef::releaseObjStrCaches(budget);
+	released->Inc(count);
+
+	MWLOG(LEV_DEBUG, MOD_APL, "PDFMemoryBudget: %lu KB allocated, released %d object streams, %lu KB left",
+		  (unsigned long)(allocated / 1024), count, (unsigned long)(gMemGetAllocated() / 1024));
+}
+
+void PDFMemoryBudget::enforce(PDFSignature *prepared) {
+	static CMetricCounter *closed = CMetrics::GetInstance()->GetCounter(
+		"pteid_pdf_prepared_documents_closed_total", "Prepared PDF documents closed to fit the memory budget");
+
+	enforce();
+	size_t budget = getBudget();
+	if (budget == 0 || gMemGetAllocated() <= budget)
+		return;
+
+	if (prepared->closePreparedDocument())
+		closed->Inc();
+}
+
+PDFBatchMemoryReport::PDFBatchMemoryReport(const char *batchName, size_t documentCount)
+	: m_batchName(batchName), m_documentCount(documentCount) {
+	gMemResetPeak();
+	m_startAllocated = gMemGetAllocated();
+}
+
+PDFBatchMemoryReport::~PDFBatchMemoryReport() {
+	MWLOG(LEV_INFO, MOD_APL, "%s of %lu documents: peak PDF memory %lu KB, %lu KB at the start, budget %lu KB",
+		  m_batchName.c_str(), (unsigned long)m_documentCount, (unsigned long)(getPeak() / 1024),
+		  (unsigned long)(m_startAllocated / 1024), (unsigned long)(PDFMemoryBudget::getBudget() / 1024));
+}
+
+size_t PDFBatchMemoryReport::getPeak() const { return gMemGetPeak(); }
+
+} // namespace eIDMW
@@ -0,0 +1,67 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/**
+ * Memory budget for the PDF documents parsed by the signature code, "pdf_memory_budget" in MB.
+ *
+ * pteid-poppler accounts the memory it allocates through gmem. When it goes over the budget, the decoded
+ * object streams of the least recently used documents are released first, their objects are decoded again
+ * if they are needed. If that isn't enough, a document prepared for a signature that waits for signClose()
+ * (e.g. the batch of a CMD signature) is closed right after it is prepared. It only keeps the bytes of its
+ * incremental update, which signClose() appends to the original file. Only the PDFSignature that prepared
+ * a document closes it: the thread preparing a document never touches the documents of other threads.
+ *
+ * PDFBatchMemoryReport measures the peak of that memory over a batch signature. The accounting is
+ * process-wide, so concurrent batches see each other's documents.
+ */
+#pragma once
+
+#include "Export.h"
+
+#include <cstddef>
+#include <string>
+
+namespace eIDMW {
+
+class PDFSignature;
+
+class PDFMemoryBudget {
+public:
+	// Bytes, 0 if there is no limit
+	EIDMW_APL_API static size_t getBudget();
+
+	// Bytes currently allocated by pteid-poppler
+	EIDMW_APL_API static size_t getAllocated();
+
+	// Release the caches of the least recently used documents if the budget is exceeded, done before each
+	// document is opened
+	EIDMW_APL_API static void enforce();
+
+	// Called by a PDFSignature for the document it just prepared: after enforce(), the document is closed until
+	// signClose() if the budget is still exceeded
+	static void enforce(PDFSignature *prepared);
+};
+
+class PDFBatchMemoryReport {
+public:
+	// Starts a new peak measurement
+	EIDMW_APL_API PDFBatchMemoryReport(const char *batchName, size_t documentCount);
+	// Logs the peak
+	EIDMW_APL_API ~PDFBatchMemoryReport();
+
+	EIDMW_APL_API size_t getPeak() const;
+
+private:
+	PDFBatchMemoryReport(const PDFBatchMemoryReport &);
+	PDFBatchMemoryReport &operator=(const PDFBatchMemoryReport &);
+
+	std::string m_batchName;
+	size_t m_documentCount;
+	size_t m_startAllocated;
+};
+
+} // namespace eIDMW
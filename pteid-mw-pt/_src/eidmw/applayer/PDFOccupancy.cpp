@@ -0,0 +1,351 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+
+#include "poppler/PDFDoc.h"
+#include "poppler/Annot.h"
+#include "poppler/ErrorCodes.h"
+#include "poppler/XRef.h"
+
+#include "PDFOccupancy.h"
+#include "PDFProbe.h"
+#include "PDFSignature.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "MWException.h"
+#include "Mutex.h"
+#include "Thread.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <thread>
+
+namespace eIDMW {
+
+// Limit for the page tree, deeper trees are reported as broken
+#define OCCUPANCY_MAX_TREE_DEPTH 64
+// Entries kept in the cache, it's emptied when it grows beyond this
+#define OCCUPANCY_CACHE_SIZE 1024
+// Upper bound on the threads analyzing the files queued by prefetch()
+#define OCCUPANCY_MAX_PREFETCH_THREADS 4
+
+bool PDFPageOccupancy::isFree(double x1, double y1, double x2, double y2) const {
+	double left = std::min(x1, x2), right = std::max(x1, x2);
+	double bottom = std::min(y1, y2), top = std::max(y1, y2);
+
+	for (const PDFOccupiedArea &area : areas) {
+		if (left < area.x2 && area.x1 < right && bottom < area.y2 && area.y1 < top)
+			return false;
+	}
+	return true;
+}
+
+std::string PDFOccupancyMap::getOccupiedSectors(int page) const {
+	std::string sectors;
+	if (page < 1 || page > (int)pages.size())
+		return sectors;
+
+	for (const PDFOccupiedArea &area : pages[page - 1].areas) {
+		if (area.sector == 0)
+			continue;
+		if (!sectors.empty())
+			sectors += ",";
+		sectors += std::to_string(area.sector);
+	}
+	return sectors;
+}
+
+struct tOccupancyCacheEntry {
+	long long mtime;
+	long long size;
+	std::shared_ptr<const PDFOccupancyMap> map;
+};
+
+static CMutex occupancyCacheMutex;
+static std::map<std::string, tOccupancyCacheEntry> occupancyCache;
+
+static CMetricCounter *occupancyCacheLookups(bool hit) {
+	static CMetricCounter *hits = CMetrics::GetInstance()->GetCounter(
+		"pteid_pdf_occupancy_cache_lookups_total", "Lookups in the cache of PDF page occupancy maps", "result=\"hit\"");
+	static CMetricCounter *misses = CMetrics::GetInstance()->GetCounter(
+		"pteid_pdf_occupancy_cache_lookups_total", "Lookups in the cache of PDF page occupancy maps", "result=\"miss\"");
+	return hit ? hits : misses;
+}
+
+// Empty rectangles are used by invisible signatures
+static bool readRect(Object *rect, PDFOccupiedArea *area) {
+	if (!rect->isArray() || rect->arrayGetLength() != 4)
+		return false;
+
+	double coords[4];
+	for (int i = 0; i < 4; i++) {
+		Object coord;
+		rect->arrayGet(i, &coord);
+		bool isNum = coord.isNum();
+		coords[i] = isNum ? coord.getNum() : 0;
+		coord.free();
+		if (!isNum)
+			return false;
+	}
+	area->x1 = std::min(coords[0], coords[2]);
+	area->x2 = std::max(coords[0], coords[2]);
+	area->y1 = std::min(coords[1], coords[3]);
+	area->y2 = std::max(coords[1], coords[3]);
+	return area->x2 > area->x1 && area->y2 > area->y1;
+}
+
+// Widget with the /FT of its merged field or inherited from the parent field
+static bool isSignatureField(Object *annot) {
+	Object subtype, ft, parent;
+	bool isSig = false;
+	if (annot->dictLookup("Subtype", &subtype)->isName("Widget")) {
+		if (annot->dictLookup("FT", &ft)->isName())
+			isSig = ft.isName("Sig");
+		else
+			isSig = annot->dictLookup("Parent", &parent)->isDict() && parent.dictLookup("FT", &ft)->isName("Sig");
+	}
+	subtype.free();
+	ft.free();
+	parent.free();
+	return isSig;
+}
+
+static void readAnnots(Object *annots, PDFPageOccupancy *page) {
+	if (!annots->isArray())
+		return;
+
+	for (int i = 0; i < annots->arrayGetLength(); i++) {
+		Object annot, obj;
+		if (!annots->arrayGet(i, &annot)->isDict()) {
+			annot.free();
+			continue;
+		}
+
+		PDFOccupiedArea area = {0, 0, 0, 0, false, 0};
+		bool visible = readRect(annot.dictLookup("Rect", &obj), &area);
+		obj.free();
+		if (annot.dictLookup("Subtype", &obj)->isName("Popup"))
+			visible = false;
+		obj.free();
+		if (annot.dictLookup("F", &obj)->isInt() && (obj.getInt() & (Annot::flagHidden | Annot::flagNoView)))
+			visible = false;
+		obj.free();
+
+		area.signature = isSignatureField(&annot);
+		if (area.signature && annot.dictLookup("SigSector", &obj)->isInt())
+			area.sector = obj.getInt();
+		obj.free();
+		annot.free();
+
+		// Signatures placed by sector are reported even if they are not visible, like in PDFDoc::getOccupiedSectors()
+		if (visible || area.sector != 0)
+			page->areas.push_back(area);
+	}
+}
+
+/* Collect the annotations of the leaves of the page tree in the order of Catalog::cachePageTree(), /Annots is
+   not inherited. Like in PDFProbe a kid that is one of its ancestors or isn't a dictionary is skipped and
+   anything else stops the walk: returns false if the tree is broken */
+static bool walkPageTree(Object *node, int pageCount, std::vector<int> &ancestors, PDFOccupancyMap *map) {
+	Object kids;
+	if (!node->dictLookup("Kids", &kids)->isArray() || ancestors.size() > OCCUPANCY_MAX_TREE_DEPTH) {
+		kids.free();
+		return false;
+	}
+
+	bool ok = true;
+	for (int i = 0; ok && i < kids.arrayGetLength(); i++) {
+		Object kidRef, kid, annots;
+		if (!kids.arrayGetNF(i, &kidRef)->isRef()) {
+			ok = false;
+		} else if (std::find(ancestors.begin(), ancestors.end(), kidRef.getRefNum()) != ancestors.end()) {
+			MWLOG(LEV_WARN, MOD_APL, "PDFOccupancy: loop in the page tree");
+		} else if (kids.arrayGet(i, &kid)->isDict("Page") || (kid.isDict() && !kid.getDict()->hasKey("Kids"))) {
+			if ((int)map->pages.size() < pageCount) {
+				map->pages.push_back(PDFPageOccupancy());
+				readAnnots(kid.dictLookup("Annots", &annots), &map->pages.back());
+				annots.free();
+			} else {
+				ok = false;
+			}
+		} else if (kid.isDict()) {
+			ancestors.push_back(kidRef.getRefNum());
+			ok = walkPageTree(&kid, pageCount, ancestors, map);
+			ancestors.pop_back();
+		}
+		kidRef.free();
+		kid.free();
+	}
+	kids.free();
+	return ok;
+}
+
+std::shared_ptr<const PDFOccupancyMap> PDFOccupancy::analyzeDocument(PDFDoc *doc) {
+	PDFOccupancyMap *map = new PDFOccupancyMap();
+	std::shared_ptr<const PDFOccupancyMap> result(map);
+
+	map->errorCode = doc->getErrorCode();
+	if (!doc->isOk())
+		return result;
+
+	Object catDict, pages, obj;
+	if (doc->getXRef()->getCatalog(&catDict)->isDict() && catDict.dictLookup("Pages", &pages)->isDict()) {
+		int pageCount = 0;
+		if (pages.dictLookup("Count", &obj)->isNum())
+			pageCount = (int)obj.getNum();
+		obj.free();
+
+		std::vector<int> ancestors;
+		if (catDict.dictLookupNF("Pages", &obj)->isRef())
+			ancestors.push_back(obj.getRefNum());
+		obj.free();
+		if (!walkPageTree(&pages, pageCount, ancestors, map) || (int)map->pages.size() != pageCount)
+			MWLOG(LEV_WARN, MOD_APL, "PDFOccupancy: page tree has %d pages, expected %d", (int)map->pages.size(),
+				  pageCount);
+	}
+	pages.free();
+	catDict.free();
+	return result;
+}
+
+std::shared_ptr<const PDFOccupancyMap> PDFOccupancy::analyze(const char *utf8Filepath) {
+	std::string path = utf8Filepath;
+	long long mtime = 0, size = 0;
+	bool exists = statPDFFile(utf8Filepath, &mtime, &size);
+
+	if (exists) {
+		CAutoMutex autoMutex(&occupancyCacheMutex);
+		std::map<std::string, tOccupancyCacheEntry>::iterator it = occupancyCache.find(path);
+		if (it != occupancyCache.end() && it->second.mtime == mtime && it->second.size == size) {
+			occupancyCacheLookups(true)->Inc();
+			return it->second.map;
+		}
+	}
+	occupancyCacheLookups(false)->Inc();
+
+	if (!exists) {
+		PDFOccupancyMap *map = new PDFOccupancyMap();
+		map->errorCode = errOpenFile;
+		return std::shared_ptr<const PDFOccupancyMap>(map);
+	}
+
+	PDFDoc *doc = makePDFDoc(utf8Filepath);
+	std::shared_ptr<const PDFOccupancyMap> result = analyzeDocument(doc);
+	delete doc;
+
+	CAutoMutex autoMutex(&occupancyCacheMutex);
+	if (occupancyCache.size() >= OCCUPANCY_CACHE_SIZE)
+		occupancyCache.clear();
+	tOccupancyCacheEntry &entry = occupancyCache[path];
+	entry.mtime = mtime;
+	entry.size = size;
+	entry.map = result;
+	return result;
+}
+
+void PDFOccupancy::clearCache() {
+	CAutoMutex autoMutex(&occupancyCacheMutex);
+	occupancyCache.clear();
+}
+
+/* Files waiting for prefetch() and the threads analyzing them. Never destroyed so that threads still
+   running at exit, if stopPrefetch() wasn't called, don't use it after the static destructors */
+struct tPrefetchQueue {
+	CMutex mutex;
+	std::deque<std::string> paths;
+	std::vector<CThread *> threads;
+	size_t activeThreads; // threads that haven't found the queue empty yet
+
+	tPrefetchQueue() : activeThreads(0) {}
+};
+
+static tPrefetchQueue &prefetchQueue() {
+	static tPrefetchQueue *queue = new tPrefetchQueue();
+	return *queue;
+}
+
+namespace {
+
+// Analyzes the queued files until the queue is empty
+class OccupancyPrefetchThread : public CThread {
+public:
+	void Run() {
+		tPrefetchQueue &queue = prefetchQueue();
+		while (true) {
+			std::string path;
+			{
+				CAutoMutex autoMutex(&queue.mutex);
+				if (queue.paths.empty()) {
+					queue.activeThreads--;
+					return;
+				}
+				path = queue.paths.front();
+				queue.paths.pop_front();
+			}
+
+			try {
+				PDFOccupancy::analyze(path.c_str());
+			} catch (CMWException &e) {
+				MWLOG(LEV_WARN, MOD_APL, "PDFOccupancy: failed to analyze %s: 0x%08lx", path.c_str(), e.GetError());
+			}
+		}
+	}
+};
+
+} // namespace
+
+void PDFOccupancy::prefetch(const std::vector<std::string> &utf8Filepaths) {
+	tPrefetchQueue &queue = prefetchQueue();
+	CAutoMutex autoMutex(&queue.mutex);
+	queue.paths.insert(queue.paths.end(), utf8Filepaths.begin(), utf8Filepaths.end());
+
+	// Join the threads of previous batches that are done
+	for (std::vector<CThread *>::iterator it = queue.threads.begin(); it != queue.threads.end();) {
+		if ((*it)->IsRunning()) {
+			++it;
+		} else {
+			delete *it;
+			it = queue.threads.erase(it);
+		}
+	}
+
+	size_t threadCount = std::min<size_t>(queue.paths.size(), OCCUPANCY_MAX_PREFETCH_THREADS);
+	unsigned int cores = std::thread::hardware_concurrency();
+	if (cores > 0)
+		threadCount = std::min<size_t>(threadCount, cores);
+
+	while (queue.activeThreads < threadCount) {
+		CThread *thread = new OccupancyPrefetchThread();
+		if (thread->Start() != 0) {
+			// Not fatal: the files are analyzed by the threads already running or when they are needed
+			MWLOG(LEV_WARN, MOD_APL, "PDFOccupancy: Failed to start prefetch thread");
+			delete thread;
+			break;
+		}
+		queue.activeThreads++;
+		queue.threads.push_back(thread);
+	}
+}
+
+void PDFOccupancy::stopPrefetch() {
+	tPrefetchQueue &queue = prefetchQueue();
+	std::vector<CThread *> threads;
+	{
+		CAutoMutex autoMutex(&queue.mutex);
+		queue.paths.clear();
+		threads.swap(queue.threads);
+	}
+
+	// Without the lock, the threads take it to find the queue empty
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i]->WaitTillStopped();
+		delete threads[i];
+	}
+}
+
+} // namespace eIDMW
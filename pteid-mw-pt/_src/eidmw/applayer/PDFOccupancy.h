@@ -0,0 +1,70 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/**
+ * Areas of the pages of a PDF covered by existing annotations, used to place visible signatures.
+ *
+ * The annotations of all the pages are collected in a single pass over the page tree that only reads
+ * their /Rect, /F and signature field entries. No Page, Annots or Form objects are built, unlike
+ * PDFDoc::getOccupiedSectors() which builds them every time it's called for a page.
+ *
+ * Like PDFProbe the results are cached per path and invalidated when the modification time or the size
+ * of the file changes, so each revision of a document is analyzed once. prefetch() analyzes the files of
+ * a batch in background threads so that placing the seals doesn't wait for them, stopPrefetch() joins the
+ * threads when the SDK is released.
+ */
+#pragma once
+
+#include "Export.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class PDFDoc;
+
+namespace eIDMW {
+
+struct PDFOccupiedArea {
+	double x1, y1, x2, y2; // normalized /Rect in default user space, the page rotation is not applied
+	bool signature;		   // widget of a signature field
+	int sector;			   // /SigSector of signatures placed by sector, 0 otherwise
+};
+
+struct PDFPageOccupancy {
+	std::vector<PDFOccupiedArea> areas; // visible annotations and signatures placed by sector
+
+	// True if the rectangle doesn't overlap any of the areas
+	bool isFree(double x1, double y1, double x2, double y2) const;
+};
+
+struct PDFOccupancyMap {
+	int errorCode;						 // poppler error code (ErrorCodes.h), errNone if the document was parsed
+	std::vector<PDFPageOccupancy> pages; // shorter than the page count if the page tree is broken
+
+	bool isOk() const { return errorCode == 0; }
+	// Comma-separated sectors in the format of PDFDoc::getOccupiedSectors(), page is 1-based
+	std::string getOccupiedSectors(int page) const;
+};
+
+class PDFOccupancy {
+public:
+	EIDMW_APL_API static std::shared_ptr<const PDFOccupancyMap> analyze(const char *utf8Filepath);
+
+	// Not cached, for documents without a local file
+	EIDMW_APL_API static std::shared_ptr<const PDFOccupancyMap> analyzeDocument(PDFDoc *doc);
+
+	// Queue the files to be analyzed in background threads, returns immediately
+	EIDMW_APL_API static void prefetch(const std::vector<std::string> &utf8Filepaths);
+
+	// Drop the queued files and wait for the threads, which end after the file they are analyzing
+	EIDMW_APL_API static void stopPrefetch();
+
+	EIDMW_APL_API static void clearCache();
+};
+
+} // namespace eIDMW
@@ -0,0 +1,266 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+
+#include "poppler/PDFDoc.h"
+#include "poppler/ErrorCodes.h"
+#include "poppler/XRef.h"
+
+#include "PDFProbe.h"
+#include "PDFSignature.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "Mutex.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <sys/stat.h>
+
+namespace eIDMW {
+
+// Limit for the pages/fields trees, deeper trees are reported as broken
+#define PROBE_MAX_TREE_DEPTH 64
+// Entries kept in the cache, it's emptied when it grows beyond this
+#define PROBE_CACHE_SIZE 4096
+
+bool PDFProbeInfo::isLandscape(int page) const {
+	if (page < 1 || page > (int)pages.size())
+		return false;
+
+	const PDFProbePage &p = pages[page - 1];
+	if (p.rotate == 90 || p.rotate == 270)
+		return p.y2 > p.x2;
+	return p.x2 > p.y2;
+}
+
+struct tProbeCacheEntry {
+	long long mtime;
+	long long size;
+	std::shared_ptr<const PDFProbeInfo> info;
+};
+
+static CMutex probeCacheMutex;
+static std::map<std::string, tProbeCacheEntry> probeCache;
+
+static CMetricCounter *probeCacheLookups(bool hit) {
+	static CMetricCounter *hits = CMetrics::GetInstance()->GetCounter(
+		"pteid_pdf_probe_cache_lookups_total", "Lookups in the cache of PDF pre-flight probes", "result=\"hit\"");
+	static CMetricCounter *misses = CMetrics::GetInstance()->GetCounter(
+		"pteid_pdf_probe_cache_lookups_total", "Lookups in the cache of PDF pre-flight probes", "result=\"miss\"");
+	return hit ? hits : misses;
+}
+
+bool statPDFFile(const char *utf8Filepath, long long *mtime, long long *size) {
+#ifdef WIN32
+	struct _stat64 sb;
+	if (_wstat64(utilStringWiden(utf8Filepath).c_str(), &sb) != 0)
+		return false;
+#else
+	struct stat sb;
+	if (stat(utf8Filepath, &sb) != 0)
+		return false;
+#endif
+	*mtime = (long long)sb.st_mtime;
+	*size = (long long)sb.st_size;
+	return true;
+}
+
+// Same rules as PageAttrs::readBox(): an all-zero box is ignored and the box is normalized
+static void readMediaBox(Object *dict, PDFProbePage *page) {
+	Object box;
+	if (!dict->dictLookup("MediaBox", &box)->isArray() || box.arrayGetLength() != 4) {
+		box.free();
+		return;
+	}
+
+	double coords[4];
+	bool ok = true;
+	for (int i = 0; i < 4; i++) {
+		Object coord;
+		if (box.arrayGet(i, &coord)->isNum())
+			coords[i] = coord.getNum();
+		else
+			ok = false;
+		coord.free();
+	}
+	box.free();
+	if (!ok || (coords[0] == 0 && coords[1] == 0 && coords[2] == 0 && coords[3] == 0))
+		return;
+
+	page->x1 = coords[0] < coords[2] ? coords[0] : coords[2];
+	page->x2 = coords[0] < coords[2] ? coords[2] : coords[0];
+	page->y1 = coords[1] < coords[3] ? coords[1] : coords[3];
+	page->y2 = coords[1] < coords[3] ? coords[3] : coords[1];
+}
+
+// MediaBox and Rotate of a node of the page tree over the inherited ones, like in PageAttrs
+static void readPageAttrs(Object *dict, PDFProbePage *page) {
+	readMediaBox(dict, page);
+
+	Object obj;
+	if (dict->dictLookup("Rotate", &obj)->isInt()) {
+		int rotate = obj.getInt() % 360;
+		page->rotate = rotate < 0 ? rotate + 360 : rotate;
+	}
+	obj.free();
+}
+
+/* Collect the size and rotation of the leaves of the page tree in the order of Catalog::cachePageTree().
+   A kid that is one of its ancestors or isn't a dictionary is skipped, anything else stops the walk:
+   returns false if the tree is broken */
+static bool walkPageTree(Object *node, PDFProbePage attrs, std::vector<int> &ancestors, PDFProbeInfo *info) {
+	readPageAttrs(node, &attrs);
+
+	Object kids;
+	if (!node->dictLookup("Kids", &kids)->isArray() || ancestors.size() > PROBE_MAX_TREE_DEPTH) {
+		kids.free();
+		return false;
+	}
+
+	bool ok = true;
+	for (int i = 0; ok && i < kids.arrayGetLength(); i++) {
+		Object kidRef, kid;
+		if (!kids.arrayGetNF(i, &kidRef)->isRef()) {
+			ok = false;
+		} else if (std::find(ancestors.begin(), ancestors.end(), kidRef.getRefNum()) != ancestors.end()) {
+			MWLOG(LEV_WARN, MOD_APL, "PDFProbe: loop in the page tree");
+		} else if (kids.arrayGet(i, &kid)->isDict("Page") || (kid.isDict() && !kid.getDict()->hasKey("Kids"))) {
+			if ((int)info->pages.size() < info->pageCount) {
+				PDFProbePage page = attrs;
+				readPageAttrs(&kid, &page);
+				info->pages.push_back(page);
+			} else {
+				ok = false;
+			}
+		} else if (kid.isDict()) {
+			ancestors.push_back(kidRef.getRefNum());
+			ok = walkPageTree(&kid, attrs, ancestors, info);
+			ancestors.pop_back();
+		}
+		kidRef.free();
+		kid.free();
+	}
+	kids.free();
+	return ok;
+}
+
+// Count the signature fields with a value, /FT may be inherited from the parent field
+static void countSignatures(Object *fields, bool parentIsSig, int depth, PDFProbeInfo *info) {
+	if (!fields->isArray() || depth >= PROBE_MAX_TREE_DEPTH)
+		return;
+
+	for (int i = 0; i < fields->arrayGetLength(); i++) {
+		Object field, ft, kids, value;
+		if (!fields->arrayGet(i, &field)->isDict()) {
+			field.free();
+			continue;
+		}
+		bool isSig = field.dictLookup("FT", &ft)->isName() ? ft.isName("Sig") : parentIsSig;
+		if (isSig && field.dictLookup("V", &value)->isDict())
+			info->signatureCount++;
+		if (field.dictLookup("Kids", &kids)->isArray())
+			countSignatures(&kids, isSig, depth + 1, info);
+		ft.free();
+		kids.free();
+		value.free();
+		field.free();
+	}
+}
+
+static void probeDocument(PDFDoc *doc, PDFProbeInfo *info) {
+	XRef *xref = doc->getXRef();
+
+	info->errorCode = doc->getErrorCode();
+	info->encrypted = info->errorCode == errEncrypted || (xref && xref->isEncrypted());
+	info->permissions = xref && xref->isEncrypted() ? xref->getPermFlags() : 0;
+	if (!doc->isOk())
+		return;
+
+	// Validated like the page count used by PDFSignature
+	info->pageCount = doc->getNumPages();
+
+	Object catDict, pages, acroForm, obj;
+	if (!xref->getCatalog(&catDict)->isDict()) {
+		catDict.free();
+		return;
+	}
+
+	if (catDict.dictLookup("Pages", &pages)->isDict()) {
+		// US Letter if the document doesn't set it, like in PageAttrs
+		PDFProbePage defaults = {0, 0, 612, 792, 0};
+		std::vector<int> ancestors;
+		if (catDict.dictLookupNF("Pages", &obj)->isRef())
+			ancestors.push_back(obj.getRefNum());
+		obj.free();
+		if (!walkPageTree(&pages, defaults, ancestors, info) || (int)info->pages.size() != info->pageCount)
+			MWLOG(LEV_WARN, MOD_APL, "PDFProbe: page tree has %d pages, expected %d", (int)info->pages.size(),
+				  info->pageCount);
+	}
+	pages.free();
+
+	if (catDict.dictLookup("AcroForm", &acroForm)->isDict()) {
+		acroForm.dictLookup("XFA", &obj);
+		info->xfaForm = obj.isStream() || obj.isArray();
+		obj.free();
+
+		acroForm.dictLookup("Fields", &obj);
+		countSignatures(&obj, false, 0, info);
+		obj.free();
+	}
+	acroForm.free();
+	catDict.free();
+}
+
+std::shared_ptr<const PDFProbeInfo> PDFProbe::probe(const char *utf8Filepath) {
+	std::string path = utf8Filepath;
+	long long mtime = 0, size = 0;
+	bool exists = statPDFFile(utf8Filepath, &mtime, &size);
+
+	if (exists) {
+		CAutoMutex autoMutex(&probeCacheMutex);
+		std::map<std::string, tProbeCacheEntry>::iterator it = probeCache.find(path);
+		if (it != probeCache.end() && it->second.mtime == mtime && it->second.size == size) {
+			probeCacheLookups(true)->Inc();
+			return it->second.info;
+		}
+	}
+	probeCacheLookups(false)->Inc();
+
+	PDFProbeInfo *info = new PDFProbeInfo();
+	info->errorCode = errOpenFile;
+	info->encrypted = false;
+	info->permissions = 0;
+	info->xfaForm = false;
+	info->signatureCount = 0;
+	info->pageCount = 0;
+	std::shared_ptr<const PDFProbeInfo> result(info);
+
+	if (exists) {
+		PDFDoc *doc = makePDFDoc(utf8Filepath);
+		probeDocument(doc, info);
+		delete doc;
+
+		CAutoMutex autoMutex(&probeCacheMutex);
+		if (probeCache.size() >= PROBE_CACHE_SIZE)
+			probeCache.clear();
+		tProbeCacheEntry &entry = probeCache[path];
+		entry.mtime = mtime;
+		entry.size = size;
+		entry.info = result;
+	}
+
+	return result;
+}
+
+void PDFProbe::clearCache() {
+	CAutoMutex autoMutex(&probeCacheMutex);
+	probeCache.clear();
+}
+
+} // namespace eIDMW
@@ -0,0 +1,55 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/**
+ * Summary of a PDF file for the batch signature pre-flight: page count, page sizes and rotation,
+ * signatures and encryption, read in a single pass over the xref table, the trailer and the page tree.
+ * No Page, Annots or Form objects are built, unlike the PDFDoc used to sign the document.
+ *
+ * The results are cached per path and invalidated when the modification time or the size of the file
+ * changes, so the same file can be probed repeatedly (page count, then last page flag...) at no cost.
+ */
+#pragma once
+
+#include "Export.h"
+
+#include <memory>
+#include <vector>
+
+namespace eIDMW {
+
+struct PDFProbePage {
+	// MediaBox in points, normalized so that x1 <= x2 and y1 <= y2 like in PageAttrs
+	double x1, y1, x2, y2;
+	int rotate; // 0 to 359
+};
+
+struct PDFProbeInfo {
+	int errorCode;		// poppler error code (ErrorCodes.h), errNone if the document was parsed
+	bool encrypted;		// also true if the document could not be opened without a password
+	int permissions;	// /P value of the encryption dictionary, only meaningful if encrypted
+	bool xfaForm;
+	int signatureCount; // signature fields with a value
+	int pageCount;		// /Count of the page tree
+	std::vector<PDFProbePage> pages; // shorter than pageCount if the page tree is broken
+
+	bool isOk() const { return errorCode == 0; }
+	// Same rule as PDFSignature::isLandscapeFormat(), page is 1-based
+	bool isLandscape(int page) const;
+};
+
+class PDFProbe {
+public:
+	EIDMW_APL_API static std::shared_ptr<const PDFProbeInfo> probe(const char *utf8Filepath);
+
+	EIDMW_APL_API static void clearCache();
+};
+
+// Modification time and size of a file, the key of the PDFProbe and PDFOccupancy caches
+bool statPDFFile(const char *utf8Filepath, long long *mtime, long long *size);
+
+} // namespace eIDMW
@@ -14,8 +14,13 @@
 #include "poppler/PDFDoc.h"
 #include "poppler/Page.h"
 #include "poppler/ErrorCodes.h"
+#include "poppler/XRef.h"
 
 #include "PDFSignature.h"
+#include "PDFMemoryBudget.h"
+#include "PDFOccupancy.h"
+#include "PDFProbe.h"
+#include "RemotePDF.h"
 #include "MWException.h"
 #include "eidErrors.h"
 #include "MiscUtil.h"
@@ -35,14 +40,33 @@
 // For the setSSO calls
 #include "CardLayer.h"
 #include "goo/GooString.h"
+#include "goo/gmem.h"
 
 #include <openssl/bio.h>
 #include <openssl/x509.h>
+#include <openssl/sha.h>
 #include "sign-pkcs7.h"
 #include "TSAClient.h"
+#include "Metrics.h"
 
 namespace eIDMW {
 
+enum SignatureStage { STAGE_PREPARE, STAGE_HASH, STAGE_CARD_SIGN, STAGE_PKCS7, STAGE_SAVE, STAGE_LTV, STAGE_COUNT };
+
+// The histograms are registered once so that timing a stage only updates its atomics
+static CMetricHistogram *signatureStageDuration(SignatureStage stage) {
+	static CMetricHistogram **histograms = []() {
+		static const char *const stages[STAGE_COUNT] = {"prepare", "hash", "card_sign", "pkcs7", "save", "ltv"};
+		static CMetricHistogram *resolved[STAGE_COUNT];
+		for (int i = 0; i < STAGE_COUNT; i++)
+			resolved[i] = CMetrics::GetInstance()->GetHistogram("pteid_pdf_signature_stage_duration_seconds",
+																"Duration of the stages of PDF signatures",
+																std::string("stage=\"") + stages[i] + "\"");
+		return resolved;
+	}();
+	return histograms[stage];
+}
+
 #ifdef WIN32
 /* Generate a native Windows path capable of bypassing the MAX_PATH limit */
 std::string generatePrefixedNativePath(const std::string &path) {
@@ -62,7 +86,23 @@ std::string generatePrefixedNativePath(const std::string &path) {
 }
 #endif
 
+void configurePDFDocs() {
+	static bool configured = []() {
+		APL_Config conf_cache(CConfig::EIDMW_CONFIG_PARAM_GENERAL_PDF_OBJSTM_CACHE);
+		XRef::setObjStrCacheSize((int)conf_cache.getLong());
+		APL_Config conf_compressed(CConfig::EIDMW_CONFIG_PARAM_GENERAL_PDF_COMPRESSED_UPDATES);
+		PDFDoc::setCompressedUpdates(conf_compressed.getLong() != 0);
+		return true;
+	}();
+	(void)configured;
+
+	// Make room for the document about to be opened
+	PDFMemoryBudget::enforce();
+}
+
 PDFDoc *makePDFDoc(const char *utf8Filepath) {
+	configurePDFDocs();
+
 #ifdef WIN32
 	std::string utf8Filename(utf8Filepath);
 	std::wstring utf16Filename = utilStringWiden(generatePrefixedNativePath(utf8Filename));
@@ -93,7 +133,6 @@ void PDFSignature::setCustomSealSize(unsigned int width, unsigned int height) {
 }
 
 PDFSignature::~PDFSignature() {
-
 	free(m_citizen_fullname);
 	free(m_document_number);
 
@@ -131,6 +170,10 @@ void PDFSignature::resetMembers() {
 	m_pkcs7 = NULL;
 	m_outputName = NULL;
 	m_signStarted = false;
+	m_batchPeakMemory = 0;
+	m_closedSigPos = 0;
+	m_closedFileSize = 0;
+	m_closedFileMtime = 0;
 	m_isExternalCertificate = false;
 	m_isCC = true;
 }
@@ -138,12 +181,21 @@ void PDFSignature::resetMembers() {
 void PDFSignature::setFile(const char *pdf_file_path) {
 	m_batch_mode = false;
 	m_pdf_file_path = _strdup(pdf_file_path);
+	m_remote_file.reset();
 	m_doc = makePDFDoc(pdf_file_path);
 }
 
+void PDFSignature::setRemoteFile(const char *url) {
+	m_batch_mode = false;
+	m_pdf_file_path = url;
+	m_remote_file.reset(new RemotePDFFile(url));
+	m_doc = m_remote_file->open();
+}
+
 void PDFSignature::batchAddFile(char *file_path, bool last_page) {
 	m_batch_mode = true;
 	m_files_to_sign.push_back(std::make_pair(_strdup(file_path), last_page));
+	PDFOccupancy::prefetch(std::vector<std::string>(1, file_path));
 }
 
 void PDFSignature::enableTimestamp() { m_level = LEVEL_TIMESTAMP; }
@@ -168,11 +220,16 @@ void PDFSignature::setVisibleCoordinates(unsigned int page, double coord_x, doub
 void PDFSignature::setBatch_mode(bool batch_mode) { m_batch_mode = batch_mode; }
 
 bool PDFSignature::isLandscapeFormat() {
+	if (m_probe && m_page <= m_probe->pages.size())
+		return m_probe->isLandscape(m_page);
+
 	if (m_doc) {
 		if (!m_doc->isOk())
 			return false;
 
 		Page *p = m_doc->getPage(m_page);
+		if (p == NULL)
+			return false;
 		PDFRectangle *p_media = p->getMediaBox();
 
 		double height = p_media->y2, width = p_media->x2;
@@ -342,6 +399,12 @@ void PDFSignature::parseCitizenDataFromCert(CByteArray &certData) {
 }
 
 int PDFSignature::getPageCount() {
+	// A prepared document closed to fit the memory budget has the pages of the original file
+	if (m_doc == NULL && !m_closedUpdate.empty()) {
+		std::unique_ptr<PDFDoc> original(makePDFDoc(m_pdf_file_path.c_str()));
+		return original->isOk() ? original->getNumPages() : -1;
+	}
+
 	if (m_doc->getErrorCode() == errEncrypted) {
 		MWLOG(LEV_WARN, MOD_APL, "%s - Encrypted PDF needs user password: unsupported at the moment", __FUNCTION__);
 		return -2;
@@ -363,10 +426,43 @@ int PDFSignature::getPageCount() {
 }
 
 char *PDFSignature::getOccupiedSectors(int page) {
-	if (m_doc)
-		return m_doc->getOccupiedSectors(page);
-	else
-		return "";
+	std::shared_ptr<const PDFOccupancyMap> occupancy = getOccupancy();
+	if (occupancy->isOk() && page > (int)occupancy->pages.size())
+		return NULL;
+
+	std::string sectors = occupancy->getOccupiedSectors(page);
+	char *result = new char[sectors.size() + 1];
+	memcpy(result, sectors.c_str(), sectors.size() + 1);
+	return result;
+}
+
+std::shared_ptr<const PDFOccupancyMap> PDFSignature::getOccupancy() {
+	// Remote files and documents that were already changed are analyzed without the cache
+	if (m_doc && (m_remote_file || m_signStarted))
+		return PDFOccupancy::analyzeDocument(m_doc);
+
+	return PDFOccupancy::analyze(m_pdf_file_path.c_str());
+}
+
+bool PDFSignature::isAreaFree(const char *path, int page, double x1, double y1, double x2, double y2) {
+	std::shared_ptr<const PDFOccupancyMap> occupancy = path ? PDFOccupancy::analyze(path) : getOccupancy();
+	if (!occupancy->isOk()) {
+		MWLOG(LEV_ERROR, MOD_APL, "%s: failed to parse the document, error code: %d", __FUNCTION__,
+			  occupancy->errorCode);
+		throw CMWEXCEPTION(occupancy->errorCode == errOpenFile ? EIDMW_FILE_NOT_OPENED : EIDMW_PDF_INVALID_ERROR);
+	}
+	if (page < 1 || page > (int)occupancy->pages.size()) {
+		MWLOG(LEV_ERROR, MOD_APL, "%s: invalid page %d", __FUNCTION__, page);
+		throw CMWEXCEPTION(EIDMW_ERR_PARAM_RANGE);
+	}
+	return occupancy->pages[page - 1].isFree(x1, y1, x2, y2);
+}
+
+void PDFSignature::prefetchBatchOccupancy() {
+	std::vector<std::string> paths;
+	for (size_t i = 0; i < m_files_to_sign.size(); i++)
+		paths.push_back(m_files_to_sign[i].first);
+	PDFOccupancy::prefetch(paths);
 }
 
 #ifdef WIN32
@@ -423,7 +519,10 @@ PDFSignature *PDFSignature::getSpecialCopy(size_t batch_index) {
 	// Copy all the original signature members other than m_files_to_sign
 	my_clone->setSignatureLevel(m_level);
 	if (m_visible) {
-		// Apply last-page flag
+		// Apply last-page flag, the cached probe of the page count also gives the orientation of the pages
+		std::shared_ptr<const PDFProbeInfo> info = PDFProbe::probe(input_file);
+		if (info->isOk() && !info->encrypted)
+			my_clone->m_probe = info;
 		int current_file_page = m_files_to_sign.at(batch_index).second ? getOtherPageCount(input_file) : m_page;
 
 		my_clone->setVisibleCoordinates(current_file_page, location_x, location_y);
@@ -450,11 +549,15 @@ int PDFSignature::signFiles(const char *location, const char *reason, const char
 		bool throwTimestampError = false;
 		bool throwLTVError = false;
 		bool cachedPin = false;
+		preflightBatch();
+		PDFBatchMemoryReport memoryReport("Batch signature", m_files_to_sign.size());
 		for (unsigned int i = 0; i < m_files_to_sign.size(); i++) {
 			try {
 				char *current_file = m_files_to_sign.at(i).first;
 				std::string f = generateFinalPath(outfile_path, current_file);
 
+				// The document of setFile() or of a previous file that didn't reach signClose()
+				delete m_doc;
 				m_doc = makePDFDoc(current_file);
 				if (!m_doc->isOk()) {
 					int error_code = m_doc->getErrorCode();
@@ -496,6 +599,7 @@ int PDFSignature::signFiles(const char *location, const char *reason, const char
 			}
 		}
 		m_card->getCalReader()->setSSO(false);
+		m_batchPeakMemory = memoryReport.getPeak();
 
 		if (throwLTVError)
 			throw CMWEXCEPTION(EIDMW_LTV_ERROR);
@@ -507,27 +611,53 @@ int PDFSignature::signFiles(const char *location, const char *reason, const char
 	return rc;
 }
 
+void PDFSignature::preflightBatch() {
+	for (unsigned int i = 0; i < m_files_to_sign.size(); i++) {
+		std::shared_ptr<const PDFProbeInfo> info = PDFProbe::probe(m_files_to_sign.at(i).first);
+		long error = EIDMW_OK;
+
+		if (info->errorCode == errOpenFile)
+			error = EIDMW_FILE_NOT_OPENED;
+		else if (!info->isOk())
+			error = EIDMW_PDF_INVALID_ERROR;
+		else if (info->encrypted)
+			error = EIDMW_PDF_UNSUPPORTED_ERROR;
+		// The last page is always valid
+		else if (!m_files_to_sign.at(i).second && m_page > (unsigned int)info->pageCount)
+			error = EIDMW_PDF_INVALID_PAGE_ERROR;
+
+		if (error != EIDMW_OK) {
+			MWLOG(LEV_ERROR, MOD_APL, "Batch signature pre-flight: file index %u can't be signed, error 0x%08lx", i,
+				  error);
+			throw CBatchSignFailedException(error, i);
+		}
+	}
+}
+
 int PDFSignature::getOtherPageCount(const char *input_path) {
-	GooString filename(input_path);
-	PDFDoc *doc = makePDFDoc(input_path);
+	std::shared_ptr<const PDFProbeInfo> info = PDFProbe::probe(input_path);
 
-	if (doc->getErrorCode() == errEncrypted) {
+	if (info->errorCode == errEncrypted) {
 		MWLOG(LEV_ERROR, MOD_APL, "getOtherPageCount(): Encrypted PDFs are unsupported at the moment");
 		return -2;
 	}
-	if (!doc->isOk()) {
+	if (!info->isOk()) {
 		MWLOG(LEV_ERROR, MOD_APL, "getOtherPageCount(): Probably broken PDF...");
 		return -1;
 	}
 
-	int pages = doc->getNumPages();
-	delete doc;
-
-	return pages;
+	return info->pageCount;
 }
 
 int PDFSignature::signSingleFile(const char *location, const char *reason, const char *outfile_path, bool isCardSign) {
 
+	CMetricTimer prepareTimer(signatureStageDuration(STAGE_PREPARE));
+	// A new signature replaces the one prepared in a document closed to fit the memory budget
+	if (m_doc == NULL && !m_closedUpdate.empty()) {
+		std::vector<unsigned char>().swap(m_closedUpdate);
+		m_doc = makePDFDoc(m_pdf_file_path.c_str());
+	}
+
 	bool isLangPT = false;
 	bool showNIC = false;
 	bool showDate = false;
@@ -558,6 +688,13 @@ int PDFSignature::signSingleFile(const char *location, const char *reason, const
 		throw CMWEXCEPTION(EIDMW_PDF_UNSUPPORTED_ERROR);
 	}
 
+	// The DSS is added by saving the whole signed file again
+	if (m_remote_file && (m_level == LEVEL_LT || m_level == LEVEL_LTV)) {
+		MWLOG(LEV_ERROR, MOD_APL, "PAdES-LT/LTA signature of remote PDF: not supported");
+		delete outputName;
+		throw CMWEXCEPTION(EIDMW_PDF_UNSUPPORTED_ERROR);
+	}
+
 	if (m_page > (unsigned int)doc->getNumPages()) {
 		MWLOG(LEV_ERROR, MOD_APL, "Signature Page %u is out of bounds for PDF file", m_page);
 		throw CMWEXCEPTION(EIDMW_PDF_INVALID_PAGE_ERROR);
@@ -713,6 +850,7 @@ int PDFSignature::signSingleFile(const char *location, const char *reason, const
 		MWLOG(LEV_ERROR, MOD_APL, "%s: getSigByteArray failed! Invalid signature_offset.", __FUNCTION__);
 		throw CMWEXCEPTION(EIDMW_ERR_PDF_SIGNATURE_SANITY_CHECK);
 	}
+	prepareTimer.Stop();
 
 	int rc = 0;
 	try {
@@ -722,7 +860,9 @@ int PDFSignature::signSingleFile(const char *location, const char *reason, const
 			m_certificate = m_externCertificate;
 		}
 
+		CMetricTimer hashTimer(signatureStageDuration(STAGE_HASH));
 		computeHash(to_sign, len, m_certificate, m_ca_certificates, isCardSign);
+		hashTimer.Stop();
 
 		m_signStarted = true;
 	} catch (CMWException e) {
@@ -730,19 +870,27 @@ int PDFSignature::signSingleFile(const char *location, const char *reason, const
 		// and this document is "half-signed"...
 		if (e.GetError() == EIDMW_ERR_CARD_RESET) {
 			delete m_doc;
-			if (!m_batch_mode)
+			if (m_remote_file)
+				m_doc = m_remote_file->open();
+			else if (!m_batch_mode)
 				m_doc = makePDFDoc(m_pdf_file_path.c_str());
 		}
 		throw;
 	}
 
 	if (to_sign)
-		free(to_sign);
+		gfree(to_sign);
+
+	// The signature arrives later, meanwhile the document is closed if it doesn't fit the memory budget
+	if (m_isExternalCertificate)
+		PDFMemoryBudget::enforce(this);
 
 	if (!m_isExternalCertificate) {
 
 		/* Get card signature from card */
+		CMetricTimer cardTimer(signatureStageDuration(STAGE_CARD_SIGN));
 		CByteArray signature = PteidSign(m_card, m_hash);
+		cardTimer.Stop();
 		rc = signClose(signature);
 	}
 
@@ -787,13 +935,21 @@ void PDFSignature::computeHash(unsigned char *data, unsigned long dataLen, CByte
 
 	bool timestamp = (m_level == LEVEL_TIMESTAMP || m_level == LEVEL_LT || m_level == LEVEL_LTV);
 
-	CByteArray in_hash = computeHash_pkcs7(data, dataLen, certificate, certificate_cas, timestamp, m_pkcs7,
-										   &m_signerInfo, isCardSign ? m_card : NULL);
+	CByteArray in_hash;
+	if (m_remote_file) {
+		// data is only the incremental update, the original file is hashed while it's streamed
+		unsigned char digest[SHA256_DIGEST_LENGTH];
+		m_remote_file->digest(data, dataLen, digest);
+		in_hash = computeHashFromDigest_pkcs7(digest, certificate, certificate_cas, timestamp, m_pkcs7, &m_signerInfo,
+											  isCardSign ? m_card : NULL);
+	} else {
+		in_hash = computeHash_pkcs7(data, dataLen, certificate, certificate_cas, timestamp, m_pkcs7, &m_signerInfo,
+									isCardSign ? m_card : NULL);
+	}
 	setHash(in_hash);
 }
 
 int PDFSignature::signClose(CByteArray signature) {
-
 	if (!m_signStarted) {
 		MWLOG(LEV_DEBUG, MOD_APL, "signClose: Signature not started");
 		return -1;
@@ -801,7 +957,7 @@ int PDFSignature::signClose(CByteArray signature) {
 
 	const char *signature_contents = NULL;
 
-	if (NULL == m_doc) {
+	if (NULL == m_doc && m_closedUpdate.empty()) {
 		fprintf(stderr, "NULL m_doc\n");
 
 		if (m_pkcs7 != NULL)
@@ -811,17 +967,27 @@ int PDFSignature::signClose(CByteArray signature) {
 
 	bool timestamp = (m_level == LEVEL_TIMESTAMP || m_level == LEVEL_LT || m_level == LEVEL_LTV);
 
+	CMetricTimer pkcs7Timer(signatureStageDuration(STAGE_PKCS7));
 	int return_code = getSignedData_pkcs7((unsigned char *)signature.GetBytes(), signature.Size(), m_signerInfo,
 										  timestamp, m_pkcs7, &signature_contents);
 
+	pkcs7Timer.Stop();
+
 	// Don't report "unknown error" exception in the case of timestamp error
 	if (return_code > 1)
 		throw CMWEXCEPTION(EIDMW_ERR_UNKNOWN);
 
-	m_doc->closeSignature(signature_contents);
-	save();
+	if (m_doc)
+		m_doc->closeSignature(signature_contents);
+	CMetricTimer saveTimer(signatureStageDuration(STAGE_SAVE));
+	if (m_doc)
+		save();
+	else
+		saveClosedDocument(signature_contents);
+	saveTimer.Stop();
 
 	if (m_level == LEVEL_LT || m_level == LEVEL_LTV) {
+		CMetricTimer ltvTimer(signatureStageDuration(STAGE_LTV));
 		if (!addLtv()) {
 			return_code = 2;
 		}
@@ -851,6 +1017,11 @@ int PDFSignature::signClose(CByteArray signature) {
 }
 
 void PDFSignature::save() {
+	if (m_remote_file) {
+		saveRemoteUpdate();
+		return;
+	}
+
 	PDFWriteMode pdfWriteMode = writeForceIncremental;
 	// Create and save PDF to temp file to allow overwrite of original file
 	std::string utf8_outname(m_outputName->getCString());
@@ -944,8 +1115,133 @@ void PDFSignature::save() {
 	handleError(final_ret);
 }
 
+void PDFSignature::saveRemoteUpdate() {
+	unsigned char *update = NULL;
+	unsigned long len = m_doc->getIncrementalUpdate(&update);
+	if (len == 0) {
+		MWLOG(LEV_ERROR, MOD_APL, "%s: failed to write the incremental update", __FUNCTION__);
+		throw CMWEXCEPTION(EIDMW_ERR_UNKNOWN);
+	}
+
+#ifdef WIN32
+	std::string native_path = generatePrefixedNativePath(m_outputName->getCString());
+	FILE *f = _wfopen(utilStringWiden(native_path).c_str(), L"wb");
+#else
+	FILE *f = fopen(m_outputName->getCString(), "wb");
+#endif
+	if (f == NULL) {
+		MWLOG(LEV_ERROR, MOD_APL, "%s: failed to open the output file", __FUNCTION__);
+		gfree(update);
+		throw CMWEXCEPTION(EIDMW_FILE_NOT_OPENED);
+	}
+	bool written = fwrite(update, 1, len, f) == len;
+	written = fclose(f) == 0 && written;
+	gfree(update);
+	if (!written) {
+		MWLOG(LEV_ERROR, MOD_APL, "%s: failed to write the output file", __FUNCTION__);
+		throw CMWEXCEPTION(EIDMW_ERR_FILE_IO_ERROR);
+	}
+}
+
+bool PDFSignature::closePreparedDocument() {
+	// Remote documents only keep the parts they read, batch mode documents are signed as soon as they are prepared
+	if (!m_signStarted || m_doc == NULL || m_remote_file || m_batch_mode)
+		return false;
+
+	long long mtime = 0, size = 0;
+	if (!statPDFFile(m_pdf_file_path.c_str(), &mtime, &size) || (unsigned long long)size != m_doc->getFileSize())
+		return false;
+
+	unsigned char *update = NULL;
+	unsigned long len = m_doc->getIncrementalUpdate(&update);
+	unsigned long sigPos = m_doc->getSignatureOffset() - m_doc->getFileSize();
+	if (len == 0 || m_doc->getSignatureOffset() < m_doc->getFileSize() || sigPos + PLACEHOLDER_LEN + 2 > len ||
+		update[sigPos] != '<') {
+		MWLOG(LEV_WARN, MOD_APL, "%s: signature placeholder not found in the update of %s", __FUNCTION__,
+			  m_pdf_file_path.c_str());
+		gfree(update);
+		return false;
+	}
+
+	m_closedUpdate.assign(update, update + len);
+	gfree(update);
+	m_closedSigPos = sigPos;
+	m_closedFileSize = size;
+	m_closedFileMtime = mtime;
+
+	delete m_doc;
+	m_doc = NULL;
+	MWLOG(LEV_DEBUG, MOD_APL, "%s: closed %s, kept its update of %lu bytes", __FUNCTION__, m_pdf_file_path.c_str(),
+		  len);
+	return true;
+}
+
+static FILE *openUtf8File(const std::string &utf8Path, bool write) {
+#ifdef WIN32
+	return _wfopen(utilStringWiden(generatePrefixedNativePath(utf8Path)).c_str(), write ? L"wb" : L"rb");
+#else
+	return fopen(utf8Path.c_str(), write ? "wb" : "rb");
+#endif
+}
+
+void PDFSignature::saveClosedDocument(const char *signature_contents) {
+	// The hash covers the original file, which must not have changed since the document was prepared
+	long long mtime = 0, size = 0;
+	if (!statPDFFile(m_pdf_file_path.c_str(), &mtime, &size) || mtime != m_closedFileMtime ||
+		size != m_closedFileSize) {
+		MWLOG(LEV_ERROR, MOD_APL, "%s: %s was changed after the signature was prepared", __FUNCTION__,
+			  m_pdf_file_path.c_str());
+		throw CMWEXCEPTION(EIDMW_PDF_INVALID_ERROR);
+	}
+
+	size_t contentsLen = strlen(signature_contents);
+	if (contentsLen > PLACEHOLDER_LEN) {
+		MWLOG(LEV_ERROR, MOD_APL, "%s: signature of %lu bytes doesn't fit the placeholder", __FUNCTION__,
+			  (unsigned long)contentsLen);
+		throw CMWEXCEPTION(EIDMW_ERR_PDF_SIGNATURE_SANITY_CHECK);
+	}
+	// Like Catalog::closeSignature(), the rest of the placeholder stays filled with zeros
+	memcpy(&m_closedUpdate[m_closedSigPos + 1], signature_contents, contentsLen);
+
+	// Read before the output is opened, which may be the same file
+	std::vector<unsigned char> original((size_t)size);
+	FILE *f = openUtf8File(m_pdf_file_path, false);
+	bool ok = f != NULL && fread(original.data(), 1, original.size(), f) == original.size();
+	if (f)
+		fclose(f);
+	if (!ok) {
+		MWLOG(LEV_ERROR, MOD_APL, "%s: failed to read %s", __FUNCTION__, m_pdf_file_path.c_str());
+		throw CMWEXCEPTION(EIDMW_FILE_NOT_OPENED);
+	}
+
+	std::string utf8_outname(m_outputName->getCString());
+	f = openUtf8File(utf8_outname, true);
+	if (f == NULL) {
+		MWLOG(LEV_ERROR, MOD_APL, "%s: failed to open the output file", __FUNCTION__);
+		throw CMWEXCEPTION(EIDMW_FILE_NOT_OPENED);
+	}
+	bool written = fwrite(original.data(), 1, original.size(), f) == original.size() &&
+				   fwrite(m_closedUpdate.data(), 1, m_closedUpdate.size(), f) == m_closedUpdate.size();
+	written = fclose(f) == 0 && written;
+	std::vector<unsigned char>().swap(m_closedUpdate);
+	if (!written) {
+		MWLOG(LEV_ERROR, MOD_APL, "%s: failed to write the output file", __FUNCTION__);
+		throw CMWEXCEPTION(EIDMW_ERR_FILE_IO_ERROR);
+	}
+
+	// Like save(), PAdES-LT/LTA continue from the signed file
+	m_doc = makePDFDoc(utf8_outname.c_str());
+}
+
+void PDFSignature::setRevocationCache(std::shared_ptr<LTVRevocationCache> revocationCache) {
+	m_revocationCache = revocationCache;
+}
+
 bool PDFSignature::addLtv() {
-	PAdESExtender padesExtender(this);
+	if (!m_revocationCache)
+		m_revocationCache = std::make_shared<LTVRevocationCache>();
+
+	PAdESExtender padesExtender(this, m_revocationCache.get());
 	if (m_level == LEVEL_LT) {
 		return padesExtender.addLT();
 	} else if (m_level == LEVEL_LTV) {
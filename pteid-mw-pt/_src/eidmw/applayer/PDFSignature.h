@@ -16,6 +16,7 @@
 #include "Export.h"
 #include <vector>
 #include <utility>
+#include <memory>
 
 #include "ByteArray.h"
 #include "APLCard.h"
@@ -39,6 +40,16 @@ class GooString;
 namespace eIDMW {
 
 class CReader;
+class LTVRevocationCache;
+class RemotePDFFile;
+struct PDFOccupancyMap;
+struct PDFProbeInfo;
+
+/* Open a PDF document given its UTF-8 path, also on Windows */
+PDFDoc *makePDFDoc(const char *utf8Filepath);
+/* Apply the PDF parsing and saving options of the configuration and keep the parsed documents within
+   the memory budget (PDFMemoryBudget.h), done by makePDFDoc() */
+void configurePDFDocs();
 
 typedef struct {
 	unsigned char *img_data;
@@ -57,6 +68,9 @@ public:
 	EIDMW_APL_API ~PDFSignature();
 
 	EIDMW_APL_API void setFile(const char *pdf_file_path);
+	/* Sign a PDF served over HTTP(S) without downloading it, see RemotePDF.h. The output file of signFiles()
+	   gets only the incremental update, which must be appended to the remote file. Not supported for PAdES-LT/LTA */
+	EIDMW_APL_API void setRemoteFile(const char *url);
 	/* Batch signature operation (using in-memory PIN caching) */
 
 	EIDMW_APL_API void batchAddFile(char *file_path, bool last_page);
@@ -71,7 +85,17 @@ public:
 
 	EIDMW_APL_API void setVisible(unsigned int page, int sector);
 	EIDMW_APL_API void setVisibleCoordinates(unsigned int page, double coord_x, double coord_y);
+	/* Returns a string allocated with new[] */
 	EIDMW_APL_API char *getOccupiedSectors(int page);
+	/* Annotations of all the pages of the current file, see PDFOccupancy.h */
+	EIDMW_APL_API std::shared_ptr<const PDFOccupancyMap> getOccupancy();
+	/* True if the rectangle, in the default user space of page (1-based), doesn't overlap the annotations of the
+	   current file or, if path isn't NULL, of that file. Throws EIDMW_ERR_PARAM_RANGE if the page doesn't exist */
+	EIDMW_APL_API bool isAreaFree(const char *path, int page, double x1, double y1, double x2, double y2);
+	/* Analyze the files added with batchAddFile() in the background, so that isAreaFree() and
+	   getOccupiedSectors() find them in the cache when the seals of the batch are placed.
+	   batchAddFile() queues each file when it's added, this queues them all again to pick up changed files */
+	EIDMW_APL_API void prefetchBatchOccupancy();
 	EIDMW_APL_API int getPageCount();
 	EIDMW_APL_API int getOtherPageCount(const char *input_path);
 	void setCard(APL_Card *card) { m_card = card; };
@@ -87,6 +111,8 @@ public:
 	EIDMW_APL_API void enableSmallSignature();
 
 	EIDMW_APL_API void setBatch_mode(bool batch_mode);
+	/* Peak of the memory allocated by the PDF parser during the last batch signed by signFiles() */
+	EIDMW_APL_API size_t getBatchPeakMemory() { return m_batchPeakMemory; }
 
 	// Returns basename without extension as required by CMD services
 	EIDMW_APL_API std::string getDocName();
@@ -113,11 +139,20 @@ public:
 
 	EIDMW_APL_API int signClose(CByteArray signature);
 
+	/* Close the document prepared for signClose(), keeping only its incremental update, so that it doesn't count
+	   against the memory budget (PDFMemoryBudget.h). Like the other methods, it must not be called while another
+	   thread uses this object. Returns false if the document can't be closed */
+	bool closePreparedDocument();
+
 	EIDMW_APL_API void setSCAPAttributes(const char *citizenName, const char *citizenId, const char *attributeSupplier,
 										 const char *attributeName);
 
 	EIDMW_APL_API bool addLtv();
 
+	/* Share the OCSP/CRL data fetched for PAdES-LT/LTA with other PDFSignature objects of the same batch.
+	   Without this the cache is private to this object (which is still shared by all the files in batch mode) */
+	EIDMW_APL_API void setRevocationCache(std::shared_ptr<LTVRevocationCache> revocationCache);
+
 private:
 	void parseCitizenDataFromCert(CByteArray &certData);
 	CByteArray getCitizenCertificate();
@@ -125,7 +160,13 @@ private:
 	PDFRectangle computeSigLocationFromSector(double, double, int);
 	PDFRectangle computeSigLocationFromSectorLandscape(double, double, int);
 	int signSingleFile(const char *location, const char *reason, const char *outfile_path, bool isCardSign);
+	/* Check with PDFProbe that every file of the batch can be signed, before the first signature.
+	   Throws CBatchSignFailedException with the error signSingleFile() would report for the file */
+	void preflightBatch();
 	void save();
+	void saveRemoteUpdate();
+	/* Write the original file followed by the update kept by closePreparedDocument(), with the signature */
+	void saveClosedDocument(const char *signature_contents);
 	void resetMembers();
 
 	/* Certificate Data*/
@@ -135,6 +176,9 @@ private:
 	PDFDoc *m_doc;
 
 	std::string m_pdf_file_path;
+	std::unique_ptr<RemotePDFFile> m_remote_file;
+	// Probe of the file of a batch copy made by getSpecialCopy(), isLandscapeFormat() reads the pages from it
+	std::shared_ptr<const PDFProbeInfo> m_probe;
 
 	// Default values
 	unsigned int m_sig_height = SEAL_DEFAULT_HEIGHT;
@@ -163,8 +207,17 @@ private:
 	PKCS7_SIGNER_INFO *m_signerInfo;
 	GooString *m_outputName;
 	bool m_signStarted;
+	size_t m_batchPeakMemory;
+
+	/* Incremental update of the document closed by closePreparedDocument(), with the signature placeholder at
+	   m_closedSigPos, and the size and modification time of the original file it was prepared for */
+	std::vector<unsigned char> m_closedUpdate;
+	unsigned long m_closedSigPos;
+	long long m_closedFileSize;
+	long long m_closedFileMtime;
 	bool m_isExternalCertificate;
 	bool m_isCC;
+	std::shared_ptr<LTVRevocationCache> m_revocationCache;
 
 	/* Fields for SCAP signature */
 	const char *m_attributeSupplier;
@@ -15,6 +15,7 @@
 #include "MiscUtil.h"
 #include "Util.h"
 #include "Log.h"
+#include "Metrics.h"
 
 #ifdef WIN32
 #include <wincrypt.h>
@@ -22,11 +23,16 @@
 
 namespace eIDMW {
 
-CByteArray PKIFetcher::received_data = CByteArray();
+static CMetricHistogram *fetchDuration() {
+	static CMetricHistogram *histogram = CMetrics::GetInstance()->GetHistogram(
+		"pteid_pki_request_duration_seconds", "Duration of the requests to the PKI services", "service=\"pki\"");
+	return histogram;
+}
 
 size_t PKIFetcher::curl_write_data(char *ptr, size_t size, size_t nmemb, void *stream) {
 	size_t realsize = size * nmemb;
-	received_data.SafeAppend((const unsigned char *)ptr, realsize);
+	CByteArray *received_data = (CByteArray *)stream;
+	received_data->SafeAppend((const unsigned char *)ptr, realsize);
 
 	return realsize;
 }
@@ -36,6 +42,7 @@ CByteArray PKIFetcher::fetch_PKI_file(const char *url) {
 	CByteArray certData;
 	DWORD dwTimeout = 20 * 1000;
 	CRYPT_BLOB_ARRAY *file_ctx = NULL;
+	CMetricTimer timer(fetchDuration());
 
 	MWLOG(LEV_DEBUG, MOD_APL, "Downloading file %s using CryptRetrieveObjectByUrlA", url);
 
@@ -61,6 +68,9 @@ CByteArray PKIFetcher::fetch_PKI_file(const char *url) {
 	CURL *curl;
 	CURLcode res;
 	char error_buf[CURL_ERROR_SIZE] = { 0 };
+	// Reply buffer is local to each request so that several files can be fetched concurrently
+	CByteArray received_data;
+	CMetricTimer timer(fetchDuration());
 	std::string pac_proxy_host;
 	std::string pac_proxy_port;
 
@@ -77,10 +87,6 @@ CByteArray PKIFetcher::fetch_PKI_file(const char *url) {
 
 	MWLOG(LEV_DEBUG, MOD_APL, "Downloading PKI file: %s", url);
 
-	// Make sure the static array receiving the network reply
-	//  is zero'd out before each request
-	received_data.Chop(received_data.Size());
-
 	curl_global_init(CURL_GLOBAL_NOTHING);
 
 	curl = curl_easy_init();
@@ -124,6 +130,7 @@ CByteArray PKIFetcher::fetch_PKI_file(const char *url) {
 	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error_buf);
 
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &curl_write_data);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &received_data);
 
 	/* Perform the request, res will get the return code */
 	res = curl_easy_perform(curl);
@@ -142,6 +149,7 @@ CByteArray PKIFetcher::fetch_PKI_file(const char *url) {
 	}
 
 	curl_slist_free_all(headers);
+	curl_easy_cleanup(curl);
 
 	return received_data;
 }
@@ -15,7 +15,6 @@ public:
 
 private:
 	static size_t curl_write_data(char *, size_t, size_t, void *);
-	static CByteArray received_data;
 };
 
 } // namespace eIDMW
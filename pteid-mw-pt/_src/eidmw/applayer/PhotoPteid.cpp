@@ -16,11 +16,77 @@
 
 #include "PhotoPteid.h"
 #include <iostream>
+#include <list>
+#include <openssl/evp.h>
 #include "J2KHelper.h"
+#include "Mutex.h"
 
 namespace eIDMW {
 
-PhotoPteid::PhotoPteid() {}
+// Max number of converted photos kept by the process-wide conversion cache
+#define PHOTO_CACHE_MAX_ENTRIES 8
+
+/*
+	The JPEG-2000 decode is the expensive part of reading the photo and the same card photo
+	is converted again each time the card is read. Converted photos are kept in memory
+	keyed by the SHA-256 of the original photo and the reduce factor.
+*/
+static CMutex photoCacheMutex;
+static std::map<std::string, CByteArray> photoCache;
+static std::list<std::string> photoCacheOrder;
+
+static std::string photoCacheKey(const CByteArray &photo, unsigned int reduceFactor) {
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int digest_len = 0;
+	EVP_Digest(photo.GetBytes(), photo.Size(), digest, &digest_len, EVP_sha256(), NULL);
+
+	std::string key(reinterpret_cast<const char *>(digest), digest_len);
+	key += ":" + std::to_string(reduceFactor);
+	return key;
+}
+
+static CByteArray *convertPhoto(const CByteArray &photo, unsigned int reduceFactor) {
+	std::string key = photoCacheKey(photo, reduceFactor);
+	{
+		CAutoMutex autoMutex(&photoCacheMutex);
+		std::map<std::string, CByteArray>::iterator it = photoCache.find(key);
+		if (it != photoCache.end())
+			return new CByteArray(it->second);
+	}
+
+	unsigned char *mem_buffer = nullptr;
+	unsigned long size_in_bytes = 0;
+
+	convert_to_png(const_cast<unsigned char *>(photo.GetBytes()), photo.Size(), &mem_buffer, &size_in_bytes,
+				   reduceFactor);
+	CByteArray *png = new CByteArray(mem_buffer, size_in_bytes);
+	if (mem_buffer) {
+		free(mem_buffer);
+	}
+
+	if (png->Size() > 0) {
+		CAutoMutex autoMutex(&photoCacheMutex);
+		if (photoCache.find(key) == photoCache.end()) {
+			if (photoCacheOrder.size() >= PHOTO_CACHE_MAX_ENTRIES) {
+				photoCache.erase(photoCacheOrder.front());
+				photoCacheOrder.pop_front();
+			}
+			photoCache[key] = *png;
+			photoCacheOrder.push_back(key);
+		}
+	}
+
+	return png;
+}
+
+PhotoPteid::PhotoPteid() {
+	photoRAW = NULL;
+	cbeff = NULL;
+	facialrechdr = NULL;
+	facialinfo = NULL;
+	imageinfo = NULL;
+	photoPNG = NULL;
+}
 
 PhotoPteid::PhotoPteid(CByteArray &_photo, CByteArray &_cbeff, CByteArray &_facialrechdr, CByteArray &_facialinfo,
 					   CByteArray &_imageinfo) {
@@ -45,6 +111,9 @@ PhotoPteid::PhotoPteid(CByteArray &_photo) {
 PhotoPteid::~PhotoPteid() {
 	if (photoPNG)
 		delete photoPNG;
+	for (std::map<unsigned int, CByteArray *>::iterator it = photoPNGReduced.begin(); it != photoPNGReduced.end();
+		 ++it)
+		delete it->second;
 	if (photoRAW)
 		delete photoRAW;
 	if (cbeff)
@@ -60,18 +129,22 @@ PhotoPteid::~PhotoPteid() {
 CByteArray *PhotoPteid::getPhotoPNG() {
 
 	if (!photoPNG) {
-		unsigned char *mem_buffer = nullptr;
-		unsigned long size_in_bytes = 0;
-
-		convert_to_png(photoRAW->GetBytes(), photoRAW->Size(), &mem_buffer, &size_in_bytes);
-		photoPNG = new CByteArray(const_cast<unsigned char *>(mem_buffer), static_cast<unsigned long>(size_in_bytes));
-		if (mem_buffer) {
-			free(mem_buffer);
-		}
+		photoPNG = convertPhoto(*photoRAW, 0);
 	}
 	return photoPNG;
 }
 
+CByteArray *PhotoPteid::getPhotoPNG(unsigned int reduceFactor) {
+	if (reduceFactor == 0)
+		return getPhotoPNG();
+
+	CByteArray *&reduced = photoPNGReduced[reduceFactor];
+	if (!reduced) {
+		reduced = convertPhoto(*photoRAW, reduceFactor);
+	}
+	return reduced;
+}
+
 CByteArray *PhotoPteid::getPhotoRaw() { return photoRAW; }
 
 CByteArray *PhotoPteid::getCbeff() { return cbeff; }
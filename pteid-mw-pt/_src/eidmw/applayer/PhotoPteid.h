@@ -21,6 +21,8 @@
 #include "Export.h"
 #include "ByteArray.h"
 
+#include <map>
+
 namespace eIDMW {
 
 class PhotoPteid {
@@ -31,6 +33,9 @@ public:
 	EIDMW_APL_API PhotoPteid(CByteArray &photo);
 	EIDMW_APL_API virtual ~PhotoPteid();
 	EIDMW_APL_API CByteArray *getPhotoPNG(); /**< Return field Photo in png format */
+	EIDMW_APL_API CByteArray *getPhotoPNG(
+		unsigned int reduceFactor); /**< Return field Photo in png format at 1/2^reduceFactor of its resolution,
+									   reduceFactor is limited to the resolution levels of the photo */
 	EIDMW_APL_API CByteArray *getPhotoRaw(); /**< Return field Photo in the original jp2 format */
 	EIDMW_APL_API CByteArray *getCbeff();
 	EIDMW_APL_API CByteArray *getFacialrechdr();
@@ -47,6 +52,7 @@ private:
 	CByteArray *imageinfo;
 	CByteArray *photoPNG;
 	CByteArray *photoRAW;
+	std::map<unsigned int, CByteArray *> photoPNGReduced;
 };
 
 } /* namespace eIDMW */
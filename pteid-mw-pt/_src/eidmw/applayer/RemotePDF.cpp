@@ -0,0 +1,342 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+
+#include "poppler/PDFDoc.h"
+#include "poppler/CachedFile.h"
+#include "goo/GooString.h"
+
+#include "RemotePDF.h"
+#include "PDFSignature.h"
+#include "CurlUtil.h"
+#include "Log.h"
+#include "MiscUtil.h"
+#include "MWException.h"
+#include "Mutex.h"
+#include "eidErrors.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <curl/curl.h>
+#include <openssl/evp.h>
+
+namespace eIDMW {
+
+// Seconds to wait for the connection, transfers are only aborted if they stall for as long
+#define REMOTE_PDF_TIMEOUT 20L
+
+// Chunks separated by at most this many bytes are fetched by the same range request
+#define REMOTE_PDF_MAX_RANGE_GAP (8 * CachedFileChunkSize)
+
+// Chunks fetched after the ones the parser reads, most of the objects it needs are stored next to each other
+#define REMOTE_PDF_READ_AHEAD_CHUNKS 7
+
+// libcurl handle of a remote file, reused by all its requests so that the connection is kept alive
+class RemotePDFConnection {
+public:
+	RemotePDFConnection(const std::string &url) : m_url(url), m_headers(NULL), m_rangesIgnored(false) {
+		m_curl = curl_easy_init();
+		if (m_curl == NULL) {
+			MWLOG(LEV_ERROR, MOD_APL, "RemotePDF: curl_easy_init() failed");
+			throw CMWEXCEPTION(EIDMW_ERR_CANT_CONNECT);
+		}
+	}
+
+	~RemotePDFConnection() {
+		curl_slist_free_all(m_headers);
+		curl_easy_cleanup(m_curl);
+	}
+
+	// Conditional header sent with every request after the first one
+	void setValidator(const std::string &header) { m_headers = curl_slist_append(m_headers, header.c_str()); }
+
+	const std::string &getUrl() { return m_url; }
+
+	// Set when the server answered a range request with the whole file, no more ranges are requested
+	bool rangesIgnored() { return m_rangesIgnored; }
+	void setRangesIgnored() { m_rangesIgnored = true; }
+
+private:
+	friend class RemotePDFRequest;
+
+	std::string m_url;
+	CURL *m_curl;
+	struct curl_slist *m_headers;
+	bool m_rangesIgnored;
+	CMutex m_mutex; // serializes the requests on m_curl
+};
+
+// Request on the handle of a remote file, with the options shared by all the requests for the file
+class RemotePDFRequest {
+public:
+	RemotePDFRequest(RemotePDFConnection &connection) : m_connection(connection), m_lock(&connection.m_mutex) {
+		// Clears the options of the previous request, the open connection is kept
+		curl_easy_reset(m_connection.m_curl);
+
+		CURL *curl = m_connection.m_curl;
+		curl_easy_setopt(curl, CURLOPT_URL, m_connection.m_url.c_str());
+		curl_easy_setopt(curl, CURLOPT_USERAGENT, PTEID_USER_AGENT_VALUE);
+		curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+		curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, REMOTE_PDF_TIMEOUT);
+		curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+		curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, REMOTE_PDF_TIMEOUT);
+		applyProxyConfigToCurl(curl, m_connection.m_url);
+
+		if (m_connection.m_headers)
+			curl_easy_setopt(curl, CURLOPT_HTTPHEADER, m_connection.m_headers);
+	}
+
+	CURL *get() { return m_connection.m_curl; }
+
+	// Returns the HTTP status or 0 if the transfer failed
+	long perform() {
+		long httpCode = 0;
+		CURLcode res = curl_easy_perform(get());
+		if (res != CURLE_OK) {
+			MWLOG(LEV_ERROR, MOD_APL, "RemotePDF: request to %s failed: %s", m_connection.m_url.c_str(),
+				  curl_easy_strerror(res));
+			return 0;
+		}
+		curl_easy_getinfo(get(), CURLINFO_RESPONSE_CODE, &httpCode);
+		if (httpCode == 412)
+			MWLOG(LEV_ERROR, MOD_APL, "RemotePDF: %s was changed on the server", m_connection.m_url.c_str());
+		return httpCode;
+	}
+
+private:
+	RemotePDFConnection &m_connection;
+	CAutoMutex m_lock;
+};
+
+struct tValidators {
+	std::string etag;
+	std::string lastModified;
+};
+
+// Value of the header if its name matches, without the surrounding whitespace
+static bool headerValue(const std::string &header, const char *name, std::string &value) {
+	size_t nameLen = strlen(name);
+	if (header.size() <= nameLen || header[nameLen] != ':')
+		return false;
+	std::string headerName = header.substr(0, nameLen);
+	std::transform(headerName.begin(), headerName.end(), headerName.begin(), ::tolower);
+	if (headerName != name)
+		return false;
+
+	size_t start = header.find_first_not_of(" \t", nameLen + 1);
+	size_t end = header.find_last_not_of(" \t\r\n");
+	if (start == std::string::npos || end < start)
+		return false;
+	value = header.substr(start, end - start + 1);
+	return true;
+}
+
+static size_t validators_header_cb(char *buffer, size_t size, size_t nitems, void *userdata) {
+	tValidators *validators = (tValidators *)userdata;
+	std::string header(buffer, size * nitems);
+	std::string value;
+	// If-Match only accepts strong validators
+	if (headerValue(header, "etag", value) && value.compare(0, 2, "W/") != 0)
+		validators->etag = value;
+	else if (headerValue(header, "last-modified", value))
+		validators->lastModified = value;
+	return size * nitems;
+}
+
+RemotePDFFile::RemotePDFFile(const char *url) : m_url(url), m_length(0) {
+	m_connection = std::make_shared<RemotePDFConnection>(m_url);
+
+	tValidators validators;
+	long httpCode = 0;
+	curl_off_t length = -1;
+	{
+		RemotePDFRequest request(*m_connection);
+		curl_easy_setopt(request.get(), CURLOPT_NOBODY, 1L);
+		curl_easy_setopt(request.get(), CURLOPT_HEADERFUNCTION, validators_header_cb);
+		curl_easy_setopt(request.get(), CURLOPT_HEADERDATA, &validators);
+
+		httpCode = request.perform();
+		curl_easy_getinfo(request.get(), CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+	}
+	if (httpCode != 200 || length <= 0) {
+		MWLOG(LEV_ERROR, MOD_APL, "RemotePDF: can't get the length of %s (HTTP status %ld)", url, httpCode);
+		throw CMWEXCEPTION(EIDMW_ERR_CANT_CONNECT);
+	}
+	m_length = (unsigned long)length;
+
+	if (!validators.etag.empty()) {
+		m_connection->setValidator("If-Match: " + validators.etag);
+	} else if (!validators.lastModified.empty()) {
+		// Only detects changes a second or more apart, which is what the server can tell us
+		MWLOG(LEV_WARN, MOD_APL, "RemotePDF: %s has no strong ETag, using If-Unmodified-Since: %s", url,
+			  validators.lastModified.c_str());
+		m_connection->setValidator("If-Unmodified-Since: " + validators.lastModified);
+	} else {
+		MWLOG(LEV_ERROR, MOD_APL, "RemotePDF: %s has neither a strong ETag nor Last-Modified, changes on the server "
+			  "can't be detected", url);
+		throw CMWEXCEPTION(EIDMW_PDF_UNSUPPORTED_ERROR);
+	}
+	MWLOG(LEV_DEBUG, MOD_APL, "RemotePDF: %s has %lu bytes, ETag: %s, Last-Modified: %s", url, m_length,
+		  validators.etag.c_str(), validators.lastModified.c_str());
+}
+
+RemotePDFFile::~RemotePDFFile() {}
+
+// Fetches the chunks of the CachedFile with range requests
+class RemotePDFLoader : public CachedFileLoader {
+public:
+	RemotePDFLoader(const std::shared_ptr<RemotePDFConnection> &connection, unsigned long length)
+		: m_connection(connection), m_length(length) {}
+
+	size_t init(GooString *uri, CachedFile *cachedFile) { return m_length; }
+
+	// The ranges are in ascending order, those with small gaps between them share one request
+	int load(const std::vector<ByteRange> &ranges, CachedFileWriter *writer) {
+		// Otherwise the parser, which reconstructs the xref table a few bytes at a time, would fetch the whole
+		// file again for each of its reads
+		if (m_connection->rangesIgnored())
+			return 1;
+
+		size_t first = 0;
+		while (first < ranges.size()) {
+			size_t last = first;
+			while (last + 1 < ranges.size() &&
+				   ranges[last + 1].offset <= ranges[last].offset + ranges[last].length + REMOTE_PDF_MAX_RANGE_GAP)
+				last++;
+
+			RemotePDFRequest request(*m_connection);
+			char range[64];
+			snprintf(range, sizeof(range), "%lu-%lu", (unsigned long)ranges[first].offset,
+					 (unsigned long)(ranges[last].offset + ranges[last].length - 1));
+
+			tLoadState state = {request.get(), writer, &ranges, last + 1, first, ranges[first].offset, false};
+			curl_easy_setopt(request.get(), CURLOPT_RANGE, range);
+			curl_easy_setopt(request.get(), CURLOPT_WRITEFUNCTION, load_cb);
+			curl_easy_setopt(request.get(), CURLOPT_WRITEDATA, &state);
+
+			if (request.perform() != 206) {
+				MWLOG(LEV_ERROR, MOD_APL, "RemotePDF: failed to get range %s of %s%s", range,
+					  m_connection->getUrl().c_str(), state.rangeIgnored ? ", the server ignores range requests" : "");
+				if (state.rangeIgnored)
+					m_connection->setRangesIgnored();
+				return 1;
+			}
+			first = last + 1;
+		}
+		return 0;
+	}
+
+private:
+	struct tLoadState {
+		CURL *curl;
+		CachedFileWriter *writer;
+		const std::vector<ByteRange> *ranges;
+		size_t end;	   // one past the last range of the request
+		size_t next;   // range that receives the next bytes
+		size_t offset; // file offset of the next bytes
+		bool rangeIgnored; // the server sent the whole file
+	};
+
+	// Passes the bytes of the ranges to the writer and skips the gaps between them
+	static size_t load_cb(char *ptr, size_t size, size_t nmemb, void *data) {
+		tLoadState *state = (tLoadState *)data;
+		long httpCode = 0;
+		// A server ignoring the range would overwrite the chunks with the start of the file
+		curl_easy_getinfo(state->curl, CURLINFO_RESPONSE_CODE, &httpCode);
+		if (httpCode != 206) {
+			state->rangeIgnored = httpCode == 200;
+			return 0;
+		}
+
+		size_t len = size * nmemb;
+		size_t done = 0;
+		while (done < len && state->next < state->end) {
+			const ByteRange &range = (*state->ranges)[state->next];
+			size_t pos = state->offset + done;
+			size_t count;
+			if (pos < range.offset) {
+				count = std::min(range.offset - pos, len - done);
+			} else {
+				count = std::min(range.offset + range.length - pos, len - done);
+				if (state->writer->write(ptr + done, count) != count)
+					return 0;
+				if (pos + count == range.offset + range.length)
+					state->next++;
+			}
+			done += count;
+		}
+		state->offset += len;
+		return len;
+	}
+
+	std::shared_ptr<RemotePDFConnection> m_connection;
+	unsigned long m_length;
+};
+
+PDFDoc *RemotePDFFile::open() {
+	configurePDFDocs();
+
+	Object obj;
+	CachedFile *cachedFile =
+		new CachedFile(new RemotePDFLoader(m_connection, m_length), new GooString(m_url.c_str()));
+	cachedFile->setReadAhead(REMOTE_PDF_READ_AHEAD_CHUNKS);
+
+	obj.initNull();
+	BaseStream *str = new CachedFileStream(cachedFile, 0, gFalse, cachedFile->getLength(), &obj);
+
+	PDFDoc *doc = new PDFDoc(str);
+	doc->setIncrementalOnly(gTrue);
+	return doc;
+}
+
+struct tDigestState {
+	EVP_MD_CTX *ctx;
+	unsigned long received;
+	unsigned long length;
+};
+
+static size_t digest_cb(char *ptr, size_t size, size_t nmemb, void *data) {
+	tDigestState *state = (tDigestState *)data;
+	size_t len = size * nmemb;
+	if (state->received + len > state->length)
+		return 0;
+	EVP_DigestUpdate(state->ctx, ptr, len);
+	state->received += len;
+	return len;
+}
+
+void RemotePDFFile::digest(const unsigned char *suffix, unsigned long suffixLen, unsigned char *digest) {
+	EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+	EVP_DigestInit_ex(ctx, EVP_sha256(), NULL);
+
+	tDigestState state = {ctx, 0, m_length};
+	long httpCode = 0;
+	{
+		RemotePDFRequest request(*m_connection);
+		char range[64];
+		snprintf(range, sizeof(range), "0-%lu", m_length - 1);
+		curl_easy_setopt(request.get(), CURLOPT_RANGE, range);
+		curl_easy_setopt(request.get(), CURLOPT_WRITEFUNCTION, digest_cb);
+		curl_easy_setopt(request.get(), CURLOPT_WRITEDATA, &state);
+
+		httpCode = request.perform();
+	}
+	if ((httpCode != 200 && httpCode != 206) || state.received != m_length) {
+		MWLOG(LEV_ERROR, MOD_APL, "RemotePDF: failed to read %s: got %lu of %lu bytes (HTTP status %ld)",
+			  m_url.c_str(), state.received, m_length, httpCode);
+		EVP_MD_CTX_free(ctx);
+		throw CMWEXCEPTION(httpCode == 412 ? EIDMW_PDF_INVALID_ERROR : EIDMW_ERR_CANT_CONNECT);
+	}
+
+	EVP_DigestUpdate(ctx, suffix, suffixLen);
+	EVP_DigestFinal_ex(ctx, digest, NULL);
+	EVP_MD_CTX_free(ctx);
+}
+
+} // namespace eIDMW
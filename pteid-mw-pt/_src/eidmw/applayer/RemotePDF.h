@@ -0,0 +1,57 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/**
+ * PDF document served over HTTP(S), signed by PDFSignature::setRemoteFile() without downloading it to a
+ * local file.
+ *
+ * The parser reads the document through a poppler CachedFile whose chunks are fetched with HTTP range
+ * requests, so only the xref table, the trailer and the objects it needs are downloaded. The signature
+ * digest covers the whole original file: it's computed by streaming the file once, without keeping it,
+ * followed by the signed bytes of the incremental update. The requests carry the ETag of the first
+ * response in If-Match, or its Last-Modified date in If-Unmodified-Since if the server gives no strong ETag,
+ * so that a file changed on the server in the meantime is not signed.
+ *
+ * All the requests for a file share one libcurl handle, which keeps the connection alive between them, and
+ * the chunks of the CachedFile that are close to each other are fetched with a single range request.
+ *
+ * The server must report the file length and answer range requests with 206 Partial Content.
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+
+class PDFDoc;
+
+namespace eIDMW {
+
+class RemotePDFConnection;
+
+class RemotePDFFile {
+public:
+	/* Get the length and validator of the file, throws EIDMW_ERR_CANT_CONNECT if the length is not available
+	   and EIDMW_PDF_UNSUPPORTED_ERROR if the server gives neither a strong ETag nor a Last-Modified date */
+	RemotePDFFile(const char *url);
+	~RemotePDFFile();
+
+	// Open the document, saves of its incremental updates leave out the original file
+	PDFDoc *open();
+
+	// SHA-256 digest of the remote file followed by suffix, digest must hold 32 bytes
+	void digest(const unsigned char *suffix, unsigned long suffixLen, unsigned char *digest);
+
+	unsigned long getLength() { return m_length; }
+
+private:
+	std::string m_url;
+	// Shared with the loaders of the opened documents, which may outlive this object
+	std::shared_ptr<RemotePDFConnection> m_connection;
+	unsigned long m_length;
+};
+
+} // namespace eIDMW
@@ -12,11 +12,14 @@
 #include "SigContainer.h"
 
 #include <fstream>
+#include <memory>
 #include <cstring>
 #include <sys/types.h>
 #include <sys/stat.h>
 
 #include <zip.h>
+#include <zlib.h>
+#include <openssl/evp.h>
 
 #include "ByteArray.h"
 #include "eidErrors.h"
@@ -69,15 +72,11 @@ int zip_buffer_put_uint32(zip_uint8_t *data, zip_uint32_t i) {
 #define stat _stat
 #endif
 
-// Add Unix extended timestamp field to each zip entry for compatibility with MacOS Archive Utility
-static void addEntryExtendedTimestamp(zip_t *asic, zip_int64_t index, const char *new_file) {
-
-	zip_uint16_t extra_field_id = 0x5455;
+// Fill an Unix extended timestamp extra field with mtime, atime and ctime of new_file or the current time
+// if new_file is NULL. Returns the modification time used
+static time_t fillExtendedTimestamp(const char *new_file, zip_uint8_t *extra_field_data) {
 	time_t current_time = time(NULL);
 
-	// This represents an Extended Timestamp field with mtime, atime and ctime
-	zip_uint8_t extra_field_data[13] = {0};
-
 	/* Bit flags mean modification, acess and creation time are present
 	   Documented in proginfo/extrafld.txt from zip package source */
 	extra_field_data[0] = 0x07;
@@ -109,30 +108,10 @@ static void addEntryExtendedTimestamp(zip_t *asic, zip_int64_t index, const char
 	zip_buffer_put_uint32(&extra_field_data[1 + 4], (zip_uint32_t)atime);
 	zip_buffer_put_uint32(&extra_field_data[1 + 8], (zip_uint32_t)ctime);
 
-	if (zip_file_extra_field_set(asic, index, extra_field_id, 0, extra_field_data,
-								 (zip_uint16_t)sizeof(extra_field_data), ZIP_FL_CENTRAL | ZIP_FL_LOCAL) < 0) {
-		MWLOG(LEV_ERROR, MOD_APL, "Failed to add extra timestamp field to file!");
-	}
-}
-
-static void addReadme(zip_t *asic) {
-	zip_int64_t index;
-	zip_source_t *source = zip_source_buffer(asic, README, strlen(README), 0);
-	if (source == NULL || (index = zip_file_add(asic, "META-INF/README.txt", source, ZIP_FL_ENC_GUESS)) < 0) {
-		zip_source_free(source);
-		MWLOG(LEV_ERROR, MOD_APL, "Failed to add README.txt to zip container");
-		throw CMWEXCEPTION(EIDMW_XADES_UNKNOWN_ERROR);
-	}
-	addEntryExtendedTimestamp(asic, index, NULL);
+	return mtime;
 }
 
-static void addManifest(zip_t *asic, const char **paths, int path_count) {
-	// don't include manifest file for asic-s containers
-	if (path_count == 1) {
-		return;
-	}
-	zip_int64_t index;
-
+static CByteArray *buildManifest(const char **paths, int path_count) {
 	XMLPlatformUtils::Initialize();
 
 	XMLCh *manifest_prefix = XMLString::transcode("manifest");
@@ -166,114 +145,11 @@ static void addManifest(zip_t *asic, const char **paths, int path_count) {
 		rootElem->appendChild(element);
 	}
 
-	std::unique_ptr<CByteArray> xml_ba(DOMDocumentToByteArray(doc));
+	CByteArray *xml_ba = DOMDocumentToByteArray(doc);
 	doc->release();
 	XMLPlatformUtils::Terminate();
 
-	// xml_manifest is freed by libzip when it is no longer needed
-	const char *xml_manifest = _strdup((char *)xml_ba->GetBytes());
-	zip_source_t *source = zip_source_buffer(asic, xml_manifest, strlen(xml_manifest), 1);
-	if (source == NULL || (index = zip_file_add(asic, "META-INF/manifest.xml", source, ZIP_FL_ENC_GUESS)) < 0) {
-		zip_source_free(source);
-		MWLOG(LEV_ERROR, MOD_APL, "Failed to add manifest.xml to zip container");
-		throw CMWEXCEPTION(EIDMW_XADES_UNKNOWN_ERROR);
-	}
-
-	addEntryExtendedTimestamp(asic, index, NULL);
-}
-
-/*
- * Add a mimetype file as defined in the ASIC standard ETSI TS 102 918.
- * It needs to be stored first in the archive and uncompressed so it can be used as a kind of magic
- * number for systems that use them
- */
-static void addMimetype(zip_t *asic, int path_count) {
-	zip_int64_t index;
-	const char *mimetype = path_count > 1 ? MIMETYPE_ASIC_E : MIMETYPE_ASIC_S;
-
-	zip_source_t *source = zip_source_buffer(asic, mimetype, strlen(mimetype), 0);
-	if (source == NULL || (index = zip_file_add(asic, "mimetype", source, ZIP_FL_ENC_GUESS)) < 0) {
-		zip_source_free(source);
-		MWLOG(LEV_ERROR, MOD_APL, "Failed to add mimetype file to zip container");
-		throw CMWEXCEPTION(EIDMW_XADES_UNKNOWN_ERROR);
-	}
-
-	if (zip_set_file_compression(asic, index, ZIP_CM_STORE, 0) < 0) {
-		MWLOG(LEV_ERROR, MOD_APL, "Failed to set store compression on mimetype file");
-	}
-
-	addEntryExtendedTimestamp(asic, index, NULL);
-}
-
-void SigContainer::createASiC(CByteArray &sig, const char **paths, unsigned int path_count, const char *output_file) {
-	if (path_count < 1) {
-		MWLOG(LEV_ERROR, MOD_APL, "ASiC container must have at least one input file / data object");
-		throw CMWEXCEPTION(EIDMW_ERR_PARAM_BAD);
-	}
-
-	// MWLOG(LEV_DEBUG, MOD_APL, "createASiC() called with output_file = %s", output_file);
-
-	int status;
-	zip_int64_t file_index;
-	zip_t *asic = NULL;
-	if ((asic = zip_open(output_file, ZIP_CREATE | ZIP_TRUNCATE, &status)) == NULL) {
-		zip_error_t error;
-		zip_error_init_with_code(&error, status);
-		MWLOG(LEV_ERROR, MOD_APL, "createASiC(): failed to create container '%s'. Error: %s", output_file,
-			  zip_error_strerror(&error));
-		throw CMWEXCEPTION(EIDMW_PERMISSION_DENIED);
-	}
-
-	addMimetype(asic, path_count);
-	addReadme(asic);
-	addManifest(asic, paths, path_count);
-
-	// solve duplicate input filenames
-	std::vector<std::string> input_filenames;
-	for (unsigned int i = 0; i < path_count; ++i) {
-		input_filenames.push_back(Basename((char *)paths[i]));
-	}
-
-	std::vector<std::string *> unique_filenames_ptrs;
-	for (unsigned int i = 0; i < path_count; ++i) {
-		unique_filenames_ptrs.push_back(&input_filenames[i]);
-	}
-	CPathUtil::generate_unique_filenames("", unique_filenames_ptrs);
-
-	// add input files
-	for (unsigned int i = 0; i < path_count; ++i) {
-		// MWLOG(LEV_DEBUG, MOD_APL, "Adding file %s to archive", paths[i]);
-
-		const char *zip_entry_name = input_filenames[i].c_str();
-		zip_source_t *source = zip_source_file(asic, paths[i], 0, -1);
-		if (source == NULL || (file_index = zip_file_add(asic, zip_entry_name, source, ZIP_FL_ENC_GUESS)) < 0) {
-			zip_source_free(source);
-			zip_discard(asic);
-			MWLOG(LEV_ERROR, MOD_APL, "Failed to add %s to zip container", zip_entry_name);
-			throw CMWEXCEPTION(EIDMW_XADES_UNKNOWN_ERROR);
-		}
-		addEntryExtendedTimestamp(asic, file_index, paths[i]);
-	}
-
-	// add signature file
-	// signature contains a NULL-terminated string
-	zip_source_t *source = zip_source_buffer(asic, sig.GetBytes(), sig.Size() - 1, 0);
-	if (source == NULL || (file_index = zip_file_add(asic, SIG_INTERNAL_PATH, source, ZIP_FL_ENC_GUESS)) < 0) {
-		zip_source_free(source);
-		zip_discard(asic);
-		MWLOG(LEV_ERROR, MOD_APL, "Failed to add signature to zip container");
-		throw CMWEXCEPTION(EIDMW_XADES_UNKNOWN_ERROR);
-	}
-
-	addEntryExtendedTimestamp(asic, file_index, NULL);
-
-	if (zip_close(asic) < 0) {
-		MWLOG(LEV_ERROR, MOD_APL, "zip_close() failed with error msg: %s", zip_error_strerror(zip_get_error(asic)));
-		free(asic);
-		throw CMWEXCEPTION(EIDMW_PERMISSION_DENIED);
-	}
-
-	MWLOG(LEV_DEBUG, MOD_APL, "createASiC() finished successfully");
+	return xml_ba;
 }
 
 static bool check_mimetype(zip_t *container) {
@@ -482,4 +358,489 @@ bool SigContainer::isValidASiC(const char *filename) {
 	return isASiCContainer;
 }
 
+/*****************************************************************************************
+------------------------------------- ASiCWriter -----------------------------------------
+*****************************************************************************************/
+
+static const size_t ASIC_IO_BUFSIZE = 256 * 1024;
+static const unsigned int SHA256_DIGEST_LEN = 32;
+
+static const zip_uint32_t ZIP_LOCAL_HEADER_SIGNATURE = 0x04034b50;
+static const zip_uint32_t ZIP_CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+static const zip_uint32_t ZIP_EOCD_SIGNATURE = 0x06054b50;
+static const zip_uint32_t ZIP64_EOCD_SIGNATURE = 0x06064b50;
+static const zip_uint32_t ZIP64_EOCD_LOCATOR_SIGNATURE = 0x07064b50;
+static const zip_uint16_t ZIP_METHOD_STORE = 0;
+static const zip_uint16_t ZIP_METHOD_DEFLATE = 8;
+static const zip_uint16_t ZIP_FLAG_UTF8 = 0x0800;
+static const zip_uint16_t ZIP_VERSION_DEFAULT = 20;
+static const zip_uint16_t ZIP_VERSION_ZIP64 = 45;
+static const zip_uint32_t ZIP_UINT32_LIMIT = 0xFFFFFFFF;
+// Inputs bigger than this get a Zip64 extended information field in their local header
+// This leaves room for the deflate overhead of incompressible data
+static const unsigned long long ZIP64_LOCAL_THRESHOLD = 0xFF000000ULL;
+
+static void put16(std::vector<unsigned char> &buf, zip_uint16_t v) {
+	buf.push_back((unsigned char)(v & 0xff));
+	buf.push_back((unsigned char)((v >> 8) & 0xff));
+}
+
+static void put32(std::vector<unsigned char> &buf, zip_uint32_t v) {
+	for (int i = 0; i < 4; i++)
+		buf.push_back((unsigned char)((v >> (8 * i)) & 0xff));
+}
+
+static void put64(std::vector<unsigned char> &buf, zip_uint64_t v) {
+	for (int i = 0; i < 8; i++)
+		buf.push_back((unsigned char)((v >> (8 * i)) & 0xff));
+}
+
+static zip_uint32_t clamp32(unsigned long long v) {
+	return v >= ZIP_UINT32_LIMIT ? ZIP_UINT32_LIMIT : (zip_uint32_t)v;
+}
+
+static bool isAsciiName(const std::string &name) {
+	for (size_t i = 0; i < name.size(); i++) {
+		if ((unsigned char)name[i] >= 0x80)
+			return false;
+	}
+	return true;
+}
+
+static void toDosDateTime(time_t t, unsigned short *dos_time, unsigned short *dos_date) {
+	struct tm timeinfo;
+#ifdef WIN32
+	localtime_s(&timeinfo, &t);
+#else
+	localtime_r(&t, &timeinfo);
+#endif
+	if (timeinfo.tm_year < 80) {
+		// DOS dates start in 1980
+		*dos_time = 0;
+		*dos_date = (1 << 5) | 1;
+		return;
+	}
+	*dos_time = (unsigned short)((timeinfo.tm_hour << 11) | (timeinfo.tm_min << 5) | (timeinfo.tm_sec >> 1));
+	*dos_date = (unsigned short)(((timeinfo.tm_year - 80) << 9) | ((timeinfo.tm_mon + 1) << 5) | timeinfo.tm_mday);
+}
+
+static FILE *openFile(const std::string &path, const char *mode) {
+#ifdef WIN32
+	return _wfopen(utilStringWiden(path).c_str(), utilStringWiden(mode).c_str());
+#else
+	return fopen(path.c_str(), mode);
+#endif
+}
+
+static int seekFile(FILE *fp, unsigned long long offset) {
+#ifdef WIN32
+	return _fseeki64(fp, (__int64)offset, SEEK_SET);
+#else
+	return fseeko(fp, (off_t)offset, SEEK_SET);
+#endif
+}
+
+static bool statInputFile(const std::string &path, unsigned long long *size) {
+#ifdef WIN32
+	struct _stat64 sb;
+	if (_wstat64(utilStringWiden(path).c_str(), &sb) != 0)
+		return false;
+#else
+	struct stat sb;
+	if (stat(path.c_str(), &sb) != 0)
+		return false;
+#endif
+	if (sb.st_mode & S_IFDIR) {
+		MWLOG(LEV_ERROR, MOD_APL, "ASiCWriter: The path provided is a directory");
+		return false;
+	}
+	*size = (unsigned long long)sb.st_size;
+	return true;
+}
+
+static void removeFile(const std::string &path) {
+#ifdef WIN32
+	_wremove(utilStringWiden(path).c_str());
+#else
+	remove(path.c_str());
+#endif
+}
+
+static bool renameFile(const std::string &from, const std::string &to) {
+#ifdef WIN32
+	// _wrename() fails if the destination file already exists
+	_wremove(utilStringWiden(to).c_str());
+	return _wrename(utilStringWiden(from).c_str(), utilStringWiden(to).c_str()) == 0;
+#else
+	return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+ASiCWriter::ASiCWriter(const char **paths, unsigned int path_count, const char *output_file)
+	: m_output_file(output_file), m_fp(NULL), m_offset(0) {
+	if (path_count < 1) {
+		MWLOG(LEV_ERROR, MOD_APL, "ASiC container must have at least one input file / data object");
+		throw CMWEXCEPTION(EIDMW_ERR_PARAM_BAD);
+	}
+
+	// solve duplicate input filenames
+	for (unsigned int i = 0; i < path_count; ++i) {
+		m_paths.push_back(paths[i]);
+		m_entry_names.push_back(Basename((char *)paths[i]));
+	}
+
+	std::vector<std::string *> unique_filenames_ptrs;
+	for (unsigned int i = 0; i < path_count; ++i) {
+		unique_filenames_ptrs.push_back(&m_entry_names[i]);
+	}
+	CPathUtil::generate_unique_filenames("", unique_filenames_ptrs);
+
+	m_tmp_file = m_output_file + ".tmp";
+	if ((m_fp = openFile(m_tmp_file, "wb")) == NULL) {
+		MWLOG(LEV_ERROR, MOD_APL, "ASiCWriter: failed to create container '%s'. Error: %s", output_file,
+			  strerror(errno));
+		throw CMWEXCEPTION(EIDMW_PERMISSION_DENIED);
+	}
+
+	try {
+		// The mimetype file needs to be stored first in the archive and uncompressed (ETSI TS 102 918)
+		const char *mimetype = path_count > 1 ? MIMETYPE_ASIC_E : MIMETYPE_ASIC_S;
+		addBuffer("mimetype", (const unsigned char *)mimetype, strlen(mimetype), false);
+		addBuffer("META-INF/README.txt", (const unsigned char *)README, strlen(README), true);
+
+		// don't include manifest file for asic-s containers
+		if (path_count > 1) {
+			// the manifest lists the names of the entries, not the input paths which can have the same name
+			std::vector<const char *> entry_names;
+			for (unsigned int i = 0; i < path_count; ++i) {
+				entry_names.push_back(m_entry_names[i].c_str());
+			}
+			std::unique_ptr<CByteArray> manifest(buildManifest(&entry_names[0], path_count));
+			const unsigned char *xml_manifest = manifest->GetBytes();
+			addBuffer("META-INF/manifest.xml", xml_manifest, strlen((const char *)xml_manifest), true);
+		}
+	} catch (...) {
+		discard();
+		throw;
+	}
+}
+
+ASiCWriter::~ASiCWriter() {
+	if (m_fp != NULL) {
+		discard();
+	}
+}
+
+void ASiCWriter::discard() {
+	fclose(m_fp);
+	m_fp = NULL;
+	removeFile(m_tmp_file);
+}
+
+void ASiCWriter::write(const void *data, size_t len) {
+	if (len == 0)
+		return;
+
+	if (fwrite(data, 1, len, m_fp) != len) {
+		MWLOG(LEV_ERROR, MOD_APL, "ASiCWriter: I/O error writing container. Detail: %s", strerror(errno));
+		throw CMWEXCEPTION(EIDMW_XADES_UNKNOWN_ERROR);
+	}
+	m_offset += len;
+}
+
+void ASiCWriter::writeLocalHeader(const Entry &entry) {
+	std::vector<unsigned char> header;
+	bool zip64 = entry.zip64_local;
+
+	put32(header, ZIP_LOCAL_HEADER_SIGNATURE);
+	put16(header, zip64 ? ZIP_VERSION_ZIP64 : ZIP_VERSION_DEFAULT);
+	put16(header, isAsciiName(entry.name) ? 0 : ZIP_FLAG_UTF8);
+	put16(header, entry.method);
+	put16(header, entry.dos_time);
+	put16(header, entry.dos_date);
+	put32(header, (zip_uint32_t)entry.crc);
+	put32(header, zip64 ? ZIP_UINT32_LIMIT : (zip_uint32_t)entry.compressed_size);
+	put32(header, zip64 ? ZIP_UINT32_LIMIT : (zip_uint32_t)entry.size);
+	put16(header, (zip_uint16_t)entry.name.size());
+	put16(header, (zip_uint16_t)((zip64 ? 20 : 0) + 4 + sizeof(entry.timestamps)));
+	header.insert(header.end(), entry.name.begin(), entry.name.end());
+
+	if (zip64) {
+		put16(header, 0x0001);
+		put16(header, 16);
+		put64(header, entry.size);
+		put64(header, entry.compressed_size);
+	}
+	put16(header, 0x5455);
+	put16(header, (zip_uint16_t)sizeof(entry.timestamps));
+	header.insert(header.end(), entry.timestamps, entry.timestamps + sizeof(entry.timestamps));
+
+	write(&header[0], header.size());
+}
+
+// Rewrite the local header of an entry whose data was streamed, now that its CRC and sizes are known
+void ASiCWriter::finishEntry(Entry &entry) {
+	if (!entry.zip64_local && (entry.size >= ZIP_UINT32_LIMIT || entry.compressed_size >= ZIP_UINT32_LIMIT)) {
+		MWLOG(LEV_ERROR, MOD_APL, "ASiCWriter: entry %s grew beyond the size reserved in its header",
+			  entry.name.c_str());
+		throw CMWEXCEPTION(EIDMW_XADES_UNKNOWN_ERROR);
+	}
+
+	unsigned long long end_offset = m_offset;
+	if (seekFile(m_fp, entry.offset) != 0) {
+		MWLOG(LEV_ERROR, MOD_APL, "ASiCWriter: failed to seek in container. Detail: %s", strerror(errno));
+		throw CMWEXCEPTION(EIDMW_XADES_UNKNOWN_ERROR);
+	}
+	m_offset = entry.offset;
+	writeLocalHeader(entry);
+
+	if (seekFile(m_fp, end_offset) != 0) {
+		MWLOG(LEV_ERROR, MOD_APL, "ASiCWriter: failed to seek in container. Detail: %s", strerror(errno));
+		throw CMWEXCEPTION(EIDMW_XADES_UNKNOWN_ERROR);
+	}
+	m_offset = end_offset;
+
+	m_entries.push_back(entry);
+}
+
+void ASiCWriter::addBuffer(const char *name, const unsigned char *data, size_t len, bool compress) {
+	Entry entry;
+	entry.name = name;
+	entry.method = compress ? ZIP_METHOD_DEFLATE : ZIP_METHOD_STORE;
+	toDosDateTime(fillExtendedTimestamp(NULL, entry.timestamps), &entry.dos_time, &entry.dos_date);
+	entry.crc = crc32(crc32(0L, Z_NULL, 0), data, (uInt)len);
+	entry.size = len;
+	entry.offset = m_offset;
+	entry.zip64_local = false;
+
+	std::vector<unsigned char> compressed;
+	if (compress) {
+		z_stream zs;
+		memset(&zs, 0, sizeof(zs));
+		if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			MWLOG(LEV_ERROR, MOD_APL, "ASiCWriter: deflateInit2() failed");
+			throw CMWEXCEPTION(EIDMW_XADES_UNKNOWN_ERROR);
+		}
+		compressed.resize(deflateBound(&zs, (uLong)len));
+		zs.next_in = (Bytef *)data;
+		zs.avail_in = (uInt)len;
+		zs.next_out = &compressed[0];
+		zs.avail_out = (uInt)compressed.size();
+		int ret = deflate(&zs, Z_FINISH);
+		compressed.resize(compressed.size() - zs.avail_out);
+		deflateEnd(&zs);
+		if (ret != Z_STREAM_END) {
+			MWLOG(LEV_ERROR, MOD_APL, "ASiCWriter: deflate() failed for entry %s", name);
+			throw CMWEXCEPTION(EIDMW_XADES_UNKNOWN_ERROR);
+		}
+		data = compressed.empty() ? NULL : &compressed[0];
+		len = compressed.size();
+	}
+	entry.compressed_size = len;
+
+	writeLocalHeader(entry);
+	write(data, len);
+	m_entries.push_back(entry);
+}
+
+CByteArray ASiCWriter::addInputFile(unsigned int index, EVP_MD_CTX *digest_state) {
+	if (m_fp == NULL || index >= m_paths.size()) {
+		throw CMWEXCEPTION(EIDMW_ERR_PARAM_BAD);
+	}
+	const std::string &path = m_paths[index];
+
+	unsigned long long input_size = 0;
+	if (!statInputFile(path, &input_size)) {
+		MWLOG(LEV_ERROR, MOD_APL, "ASiCWriter::addInputFile: Failed to stat input file");
+		return CByteArray();
+	}
+
+	FILE *fp = openFile(path, "rb");
+	if (!fp) {
+		MWLOG(LEV_ERROR, MOD_APL, "ASiCWriter::addInputFile: Error opening file");
+		return CByteArray();
+	}
+
+	Entry entry;
+	entry.name = m_entry_names[index];
+	entry.method = ZIP_METHOD_DEFLATE;
+	toDosDateTime(fillExtendedTimestamp(path.c_str(), entry.timestamps), &entry.dos_time, &entry.dos_date);
+	entry.crc = crc32(0L, Z_NULL, 0);
+	entry.size = 0;
+	entry.compressed_size = 0;
+	entry.offset = m_offset;
+	entry.zip64_local = input_size >= ZIP64_LOCAL_THRESHOLD;
+
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		MWLOG(LEV_ERROR, MOD_APL, "ASiCWriter::addInputFile: deflateInit2() failed");
+		fclose(fp);
+		throw CMWEXCEPTION(EIDMW_XADES_UNKNOWN_ERROR);
+	}
+
+	EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+	EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL);
+
+	std::vector<unsigned char> in_buffer(ASIC_IO_BUFSIZE);
+	std::vector<unsigned char> out_buffer(ASIC_IO_BUFSIZE);
+	bool read_error = false;
+
+	try {
+		// Placeholder header: CRC and sizes are filled in by finishEntry()
+		writeLocalHeader(entry);
+
+		int flush = Z_NO_FLUSH;
+		do {
+			size_t read = fread(&in_buffer[0], 1, in_buffer.size(), fp);
+			if (ferror(fp)) {
+				MWLOG(LEV_ERROR, MOD_APL, "ASiCWriter::addInputFile: Failed while reading file");
+				read_error = true;
+				break;
+			}
+			EVP_DigestUpdate(mdctx, &in_buffer[0], read);
+			if (digest_state) {
+				EVP_DigestUpdate(digest_state, &in_buffer[0], read);
+			}
+			entry.crc = crc32(entry.crc, &in_buffer[0], (uInt)read);
+			entry.size += read;
+
+			flush = feof(fp) ? Z_FINISH : Z_NO_FLUSH;
+			zs.next_in = &in_buffer[0];
+			zs.avail_in = (uInt)read;
+			do {
+				zs.next_out = &out_buffer[0];
+				zs.avail_out = (uInt)out_buffer.size();
+				deflate(&zs, flush);
+				size_t have = out_buffer.size() - zs.avail_out;
+				write(&out_buffer[0], have);
+				entry.compressed_size += have;
+			} while (zs.avail_out == 0);
+		} while (flush != Z_FINISH);
+
+		if (!read_error) {
+			finishEntry(entry);
+		}
+	} catch (...) {
+		deflateEnd(&zs);
+		EVP_MD_CTX_free(mdctx);
+		fclose(fp);
+		throw;
+	}
+
+	deflateEnd(&zs);
+	fclose(fp);
+
+	unsigned char md_value[EVP_MAX_MD_SIZE];
+	unsigned int md_len;
+	EVP_DigestFinal_ex(mdctx, md_value, &md_len);
+	EVP_MD_CTX_free(mdctx);
+
+	if (read_error) {
+		return CByteArray();
+	}
+
+	return CByteArray(md_value, SHA256_DIGEST_LEN);
+}
+
+void ASiCWriter::close(const CByteArray &signature) {
+	if (m_fp == NULL) {
+		MWLOG(LEV_ERROR, MOD_APL, "ASiCWriter::close() called on a finished container");
+		throw CMWEXCEPTION(EIDMW_ERR_CHECK);
+	}
+
+	// signature contains a NULL-terminated string
+	addBuffer(SIG_INTERNAL_PATH, signature.GetBytes(), signature.Size() - 1, true);
+
+	std::vector<unsigned char> cd;
+	for (size_t i = 0; i < m_entries.size(); i++) {
+		const Entry &entry = m_entries[i];
+		bool size_overflow = entry.size >= ZIP_UINT32_LIMIT;
+		bool csize_overflow = entry.compressed_size >= ZIP_UINT32_LIMIT;
+		bool offset_overflow = entry.offset >= ZIP_UINT32_LIMIT;
+		zip_uint16_t zip64_len = (size_overflow ? 8 : 0) + (csize_overflow ? 8 : 0) + (offset_overflow ? 8 : 0);
+		zip_uint16_t version = zip64_len > 0 || entry.zip64_local ? ZIP_VERSION_ZIP64 : ZIP_VERSION_DEFAULT;
+
+		put32(cd, ZIP_CENTRAL_HEADER_SIGNATURE);
+		// version made by: Unix
+		put16(cd, (zip_uint16_t)((3 << 8) | version));
+		put16(cd, version);
+		put16(cd, isAsciiName(entry.name) ? 0 : ZIP_FLAG_UTF8);
+		put16(cd, entry.method);
+		put16(cd, entry.dos_time);
+		put16(cd, entry.dos_date);
+		put32(cd, (zip_uint32_t)entry.crc);
+		put32(cd, clamp32(entry.compressed_size));
+		put32(cd, clamp32(entry.size));
+		put16(cd, (zip_uint16_t)entry.name.size());
+		put16(cd, (zip_uint16_t)((zip64_len > 0 ? 4 + zip64_len : 0) + 4 + sizeof(entry.timestamps)));
+		put16(cd, 0); // comment length
+		put16(cd, 0); // disk number start
+		put16(cd, 0); // internal attributes
+		put32(cd, 0100644u << 16);
+		put32(cd, clamp32(entry.offset));
+		cd.insert(cd.end(), entry.name.begin(), entry.name.end());
+
+		if (zip64_len > 0) {
+			put16(cd, 0x0001);
+			put16(cd, zip64_len);
+			if (size_overflow)
+				put64(cd, entry.size);
+			if (csize_overflow)
+				put64(cd, entry.compressed_size);
+			if (offset_overflow)
+				put64(cd, entry.offset);
+		}
+		put16(cd, 0x5455);
+		put16(cd, (zip_uint16_t)sizeof(entry.timestamps));
+		cd.insert(cd.end(), entry.timestamps, entry.timestamps + sizeof(entry.timestamps));
+	}
+
+	unsigned long long cd_offset = m_offset;
+	unsigned long long cd_size = cd.size();
+	unsigned long long entry_count = m_entries.size();
+
+	std::vector<unsigned char> eocd;
+	if (cd_offset >= ZIP_UINT32_LIMIT || cd_size >= ZIP_UINT32_LIMIT || entry_count >= 0xFFFF) {
+		unsigned long long zip64_eocd_offset = cd_offset + cd_size;
+		put32(eocd, ZIP64_EOCD_SIGNATURE);
+		put64(eocd, 44);
+		put16(eocd, (zip_uint16_t)((3 << 8) | ZIP_VERSION_ZIP64));
+		put16(eocd, ZIP_VERSION_ZIP64);
+		put32(eocd, 0);
+		put32(eocd, 0);
+		put64(eocd, entry_count);
+		put64(eocd, entry_count);
+		put64(eocd, cd_size);
+		put64(eocd, cd_offset);
+
+		put32(eocd, ZIP64_EOCD_LOCATOR_SIGNATURE);
+		put32(eocd, 0);
+		put64(eocd, zip64_eocd_offset);
+		put32(eocd, 1);
+	}
+	put32(eocd, ZIP_EOCD_SIGNATURE);
+	put16(eocd, 0);
+	put16(eocd, 0);
+	put16(eocd, entry_count >= 0xFFFF ? 0xFFFF : (zip_uint16_t)entry_count);
+	put16(eocd, entry_count >= 0xFFFF ? 0xFFFF : (zip_uint16_t)entry_count);
+	put32(eocd, clamp32(cd_size));
+	put32(eocd, clamp32(cd_offset));
+	put16(eocd, 0);
+
+	write(&cd[0], cd.size());
+	write(&eocd[0], eocd.size());
+
+	int ret = fclose(m_fp);
+	m_fp = NULL;
+	if (ret != 0 || !renameFile(m_tmp_file, m_output_file)) {
+		MWLOG(LEV_ERROR, MOD_APL, "ASiCWriter::close() failed to write container '%s'. Error: %s",
+			  m_output_file.c_str(), strerror(errno));
+		removeFile(m_tmp_file);
+		throw CMWEXCEPTION(EIDMW_PERMISSION_DENIED);
+	}
+
+	MWLOG(LEV_DEBUG, MOD_APL, "ASiCWriter::close() finished successfully");
+}
+
 }; // namespace eIDMW
@@ -13,9 +13,12 @@
 
 #include <vector>
 #include <string>
+#include <cstdio>
 
 #include "ByteArray.h"
 
+typedef struct evp_md_ctx_st EVP_MD_CTX;
+
 namespace eIDMW {
 
 /*
@@ -27,12 +30,6 @@ class SigContainer {
 public:
 	EIDMW_APL_API SigContainer(const char *path) : m_path(path) {};
 
-	/*
-	 * Create and save to disk ASiC container with signature file and associated signed files
-	 */
-	EIDMW_APL_API static void createASiC(CByteArray &sig, const char **paths, unsigned int num_paths,
-										 const char *output_file);
-
 	/*
 	 * Return the filenames of the input files in this container
 	 */
@@ -55,6 +52,63 @@ private:
 	// std::vector<std::string> m_ContainerFiles;
 };
 
+/*
+ * Single-pass ASiC-S/ASiC-E container writer.
+ * Each input file is read only once: the same buffer feeds the SHA-256 reference digest and the deflate
+ * stream of the zip entry. The mimetype, README and manifest entries are written on construction and the
+ * signature XML and central directory are appended by close().
+ * The container is written to a temporary file next to output_file and only renamed to the final path
+ * in close(), so destroying an unfinished writer leaves no partial container behind.
+ */
+class ASiCWriter {
+public:
+	EIDMW_APL_API ASiCWriter(const char **paths, unsigned int num_paths, const char *output_file);
+	EIDMW_APL_API ~ASiCWriter();
+
+	/*
+	 * Compress input file at position `index` into the container and return its SHA-256 digest.
+	 * If digest_state is not NULL the file contents are also fed into it
+	 */
+	CByteArray addInputFile(unsigned int index, EVP_MD_CTX *digest_state);
+
+	/*
+	 * Append the signature file and the zip central directory and move the container to its final path
+	 */
+	EIDMW_APL_API void close(const CByteArray &signature);
+
+private:
+	struct Entry {
+		std::string name;
+		unsigned short method;
+		unsigned short dos_time;
+		unsigned short dos_date;
+		unsigned long crc;
+		unsigned long long compressed_size;
+		unsigned long long size;
+		unsigned long long offset;
+		bool zip64_local;
+		unsigned char timestamps[13];
+	};
+
+	ASiCWriter(const ASiCWriter &) = delete;
+	void operator=(const ASiCWriter &) = delete;
+
+	void addBuffer(const char *name, const unsigned char *data, size_t len, bool compress);
+	void writeLocalHeader(const Entry &entry);
+	void finishEntry(Entry &entry);
+	void write(const void *data, size_t len);
+	void discard();
+
+	std::vector<std::string> m_paths;
+	std::vector<std::string> m_entry_names;
+	std::vector<Entry> m_entries;
+	std::string m_output_file;
+	std::string m_tmp_file;
+	FILE *m_fp;
+	unsigned long long m_offset;
+};
+
+
 } // namespace eIDMW
 
 #endif
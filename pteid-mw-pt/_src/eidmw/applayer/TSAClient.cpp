@@ -19,6 +19,7 @@
 #include "CurlUtil.h"
 #include "Util.h"
 #include "Log.h"
+#include "Metrics.h"
 #include "TSAClient.h"
 
 namespace eIDMW {
@@ -80,6 +81,10 @@ void TSAClient::timestamp_data(const unsigned char *input, unsigned int data_len
 	unsigned char *ts_request = timestamp_asn1_request;
 	size_t post_size = sizeof(timestamp_asn1_request);
 
+	static CMetricHistogram *duration = CMetrics::GetInstance()->GetHistogram(
+		"pteid_pki_request_duration_seconds", "Duration of the requests to the PKI services", "service=\"tsa\"");
+	CMetricTimer timer(duration);
+
 	// Make sure the static array receiving the network reply
 	//  is zero'd out before each request
 	received_data.Chop(received_data.Size());
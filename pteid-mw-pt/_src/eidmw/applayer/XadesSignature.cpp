@@ -186,61 +186,6 @@ static CByteArray hashFileInContainer(zip_t *container, const char *filename, EV
 	return CByteArray(md_value, SHA256_LEN);
 }
 
-static CByteArray hashFile(const char *filename, EVP_MD_CTX *digest_state) {
-#ifdef WIN32
-	struct _stat64 sb;
-	std::wstring utf16FileName = utilStringWiden(std::string(filename));
-	_wstat64(utf16FileName.c_str(), &sb);
-#else
-	struct stat sb;
-	stat(filename, &sb);
-#endif
-
-	if (sb.st_mode & S_IFDIR) {
-		// it's a directory
-		MWLOG(LEV_ERROR, MOD_APL, L"XadesSignature::hashFile: The path provided is a directory");
-		return CByteArray();
-	}
-
-#ifdef WIN32
-	FILE *fp = _wfopen(utf16FileName.c_str(), L"rb");
-#else
-	FILE *fp = fopen(filename, "rb");
-#endif
-	if (!fp) {
-		MWLOG(LEV_ERROR, MOD_APL, L"XadesSignature::hashFile: Error opening file");
-		return CByteArray();
-	}
-
-	OpenSSL_add_all_digests();
-
-	EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
-	EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL);
-
-	const int BUFSIZE = 4 * 1024;
-	char buffer[BUFSIZE];
-	do {
-		size_t read = fread(buffer, 1, BUFSIZE, fp);
-		if (ferror(fp)) {
-			MWLOG(LEV_ERROR, MOD_APL, L"XadesSignature::hashFile: Failed while reading file");
-			return CByteArray();
-		}
-		EVP_DigestUpdate(mdctx, buffer, read);
-		if (digest_state) {
-			EVP_DigestUpdate(digest_state, buffer, read);
-		}
-	} while (!feof(fp));
-
-	fclose(fp);
-
-	unsigned char md_value[EVP_MAX_MD_SIZE];
-	unsigned int md_len;
-	EVP_DigestFinal_ex(mdctx, md_value, &md_len);
-	EVP_MD_CTX_free(mdctx);
-
-	return CByteArray(md_value, SHA256_LEN);
-}
-
 static std::string x509GetSerialAsString(X509 *cert) {
 	std::string serial;
 
@@ -823,7 +768,7 @@ static void setReferenceHash(XMLByte *hash, unsigned int hash_len, int ref_index
 	free(base64Hash);
 }
 
-CByteArray &XadesSignature::sign(const char **paths, unsigned int pathCount, zip_t *container) {
+CByteArray &XadesSignature::sign(const char **paths, unsigned int pathCount, zip_t *container, ASiCWriter *asic) {
 	XSECProvider prov;
 	DSIGSignature *sig;
 
@@ -871,12 +816,8 @@ CByteArray &XadesSignature::sign(const char **paths, unsigned int pathCount, zip
 
 			MWLOG(LEV_DEBUG, MOD_APL, "SignXades(): Hashing file %s", path);
 
-			CByteArray fileHash;
-			if (container) {
-				fileHash = hashFileInContainer(container, paths[i], digest_state);
-			} else {
-				fileHash = hashFile(paths[i], digest_state);
-			}
+			CByteArray fileHash = container ? hashFileInContainer(container, paths[i], digest_state)
+											: asic->addInputFile(i, digest_state);
 
 			if (fileHash.Size() == 0) {
 				throw CMWEXCEPTION(EIDMW_XADES_UNKNOWN_ERROR);
@@ -999,9 +940,9 @@ CByteArray &XadesSignature::sign(const char **paths, unsigned int pathCount, zip
 	return *xml_output;
 }
 
-CByteArray &XadesSignature::signXades(const char **paths, unsigned int pathCount) {
+CByteArray &XadesSignature::signXades(const char **paths, unsigned int pathCount, ASiCWriter &asic) {
 	initXMLUtils();
-	CByteArray &result = sign(paths, pathCount);
+	CByteArray &result = sign(paths, pathCount, NULL, &asic);
 	terminateXMLUtils();
 
 	return result;
@@ -1031,7 +972,7 @@ void XadesSignature::signASiC(const char *path) {
 
 	initXMLUtils();
 	assert(paths.size() <= UINT_MAX);
-	CByteArray &sigXml = sign(&paths[0], (unsigned int) paths.size(), container);
+	CByteArray &sigXml = sign(&paths[0], (unsigned int) paths.size(), container, NULL);
 	terminateXMLUtils();
 
 	const char *uniqueFileName = NULL;
@@ -24,6 +24,7 @@ namespace eIDMW {
 class CByteArray;
 class APL_Card;
 class APL_Certifs;
+class ASiCWriter;
 
 class XadesSignature {
 public:
@@ -31,7 +32,12 @@ public:
 	EIDMW_APL_API XadesSignature(APL_Certifs *certs, std::function<CByteArray(const CByteArray &)> callback)
 		: m_cmdCertificates(certs), m_signCallback(callback) {};
 
-	EIDMW_APL_API CByteArray &signXades(const char **paths, unsigned int pathCount);
+	/*
+	 * Sign the input files while streaming them into an ASiC container: each file is read only once
+	 * to compute the reference digest and write the zip entry. The caller should finish the container
+	 * with ASiCWriter::close() after checking the timestamp/LTV exception flags.
+	 */
+	EIDMW_APL_API CByteArray &signXades(const char **paths, unsigned int pathCount, ASiCWriter &asic);
 	EIDMW_APL_API void signASiC(const char *path);
 
 	void enableTimestamp() { m_doTimestamp = true; };
@@ -42,7 +48,8 @@ public:
 	bool shouldThrowLTVException() { return m_throwLTVException; };
 
 private:
-	CByteArray &sign(const char **paths, unsigned int pathCount, zip_t *container = NULL);
+	// The files are read from container if it isn't NULL, otherwise they are added to asic
+	CByteArray &sign(const char **paths, unsigned int pathCount, zip_t *container, ASiCWriter *asic);
 
 	APL_Card *m_pcard = NULL;
 	APL_Certifs *m_cmdCertificates = NULL;
@@ -105,6 +105,10 @@ HEADERS += \
 	PAdESExtender.h \
 	J2KHelper.h \
 	PDFSignature.h \
+	PDFProbe.h \
+	PDFOccupancy.h \
+	PDFMemoryBudget.h \
+	RemotePDF.h \
 	CurlUtil.h \
 	proxyinfo.h \
 	asn1_idfile.h
@@ -137,6 +141,10 @@ SOURCES += \
 	cJSON.c \
 	PKIFetcher.cpp \
 	PDFSignature.cpp \
+	PDFProbe.cpp \
+	PDFOccupancy.cpp \
+	PDFMemoryBudget.cpp \
+	RemotePDF.cpp \
 	PAdESExtender.cpp \
 	MutualAuthentication.cpp \
 	PNGConverter.cpp \
@@ -36,6 +36,7 @@
 #include "PKIFetcher.h"
 
 #include "MiscUtil.h"
+#include "Metrics.h"
 #include "Thread.h"
 
 #ifdef WIN32
@@ -720,6 +721,10 @@ FWK_CertifStatus APL_CryptoFwk::GetOCSPResponse(const char *pUrlResponder, OCSP_
 	if (!pCertID)
 		throw CMWEXCEPTION(EIDMW_ERR_CHECK);
 
+	static CMetricHistogram *duration = CMetrics::GetInstance()->GetHistogram(
+		"pteid_pki_request_duration_seconds", "Duration of the requests to the PKI services", "service=\"ocsp\"");
+	CMetricTimer timer(duration);
+
 	BIO *pBio = 0;
 
 	// OCSP connection socket, we will use async I/O on it
@@ -428,6 +428,32 @@ void addExternalCertificateChain(PKCS7 *p7, std::vector<CByteArray> ca_certifica
 CByteArray computeHash_pkcs7(unsigned char *data, unsigned long dataLen, CByteArray certificate,
 							 std::vector<CByteArray> &ca_certificates, bool timestamp, PKCS7 *p7,
 							 PKCS7_SIGNER_INFO **out_signer_info, APL_Card *card) {
+	unsigned char digest[SHA256_LEN];
+
+	if (out_signer_info)
+		*out_signer_info = NULL;
+
+	if (NULL == data) {
+		TRACE_ERR("Null data");
+		return CByteArray();
+	}
+
+	if (0 == dataLen) {
+		TRACE_ERR("Invalid dataLen");
+		return CByteArray();
+	}
+
+	SHA256_Wrapper(data, dataLen, digest);
+
+	return computeHashFromDigest_pkcs7(digest, certificate, ca_certificates, timestamp, p7, out_signer_info, card);
+}
+
+/*  *********************************************************
+ ***          computeHashFromDigest_pkcs7()          ***
+ ********************************************************* */
+CByteArray computeHashFromDigest_pkcs7(const unsigned char *content_digest, CByteArray certificate,
+									   std::vector<CByteArray> &ca_certificates, bool timestamp, PKCS7 *p7,
+									   PKCS7_SIGNER_INFO **out_signer_info, APL_Card *card) {
 	CByteArray outHash;
 	bool isError = false;
 	unsigned char *attr_buf = NULL;
@@ -443,20 +469,6 @@ CByteArray computeHash_pkcs7(unsigned char *data, unsigned long dataLen, CByteAr
 	if (out_signer_info)
 		*out_signer_info = NULL;
 
-	if (NULL == data) {
-		TRACE_ERR("Null data");
-		isError = true;
-
-		goto err_hashCalculate;
-	}
-
-	if (0 == dataLen) {
-		TRACE_ERR("Invalid dataLen");
-		isError = true;
-
-		goto err_hashCalculate;
-	}
-
 	if (NULL == p7) {
 		TRACE_ERR("Null p7");
 
@@ -516,7 +528,7 @@ CByteArray computeHash_pkcs7(unsigned char *data, unsigned long dataLen, CByteAr
 
 	PKCS7_set_detached(p7, 1);
 
-	hash_fn(data, dataLen, out);
+	memcpy(out, content_digest, SHA256_LEN);
 
 	/* Add the signing time and digest authenticated attributes */
 	// With authenticated attributes
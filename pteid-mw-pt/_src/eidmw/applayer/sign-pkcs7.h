@@ -27,6 +27,11 @@ CByteArray computeHash_pkcs7(unsigned char *data, unsigned long dataLen, CByteAr
 							 std::vector<CByteArray> &ca_certificates, bool timestamp, PKCS7 *p7,
 							 PKCS7_SIGNER_INFO **out_signer_info, APL_Card *card);
 
+// Same as computeHash_pkcs7() with the SHA-256 digest of the signed data computed by the caller
+CByteArray computeHashFromDigest_pkcs7(const unsigned char *content_digest, CByteArray certificate,
+									   std::vector<CByteArray> &ca_certificates, bool timestamp, PKCS7 *p7,
+									   PKCS7_SIGNER_INFO **out_signer_info, APL_Card *card);
+
 int getSignedData_pkcs7(unsigned char *signature, unsigned int signatureLen, PKCS7_SIGNER_INFO *signer_info,
 						bool timestamp, PKCS7 *p7, const char **signature_contents);
 
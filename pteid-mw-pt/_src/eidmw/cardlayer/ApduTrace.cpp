@@ -0,0 +1,167 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+
+#ifdef PTEID_VIRTUAL_CARD
+
+#include "ApduTrace.h"
+#include "Config.h"
+#include "Log.h"
+#include "Thread.h"
+#include "Util.h"
+
+#include <cstring>
+
+namespace eIDMW {
+
+static const char APDU_TRACE_MAGIC[] = {'P', 'T', 'A', 'T'};
+static const unsigned char APDU_TRACE_VERSION = 1;
+
+static void PutLE(unsigned char *pucBuf, unsigned long ulValue, int iLen) {
+	for (int i = 0; i < iLen; i++)
+		pucBuf[i] = (unsigned char)((ulValue >> (8 * i)) & 0xFF);
+}
+
+static bool GetLE(FILE *f, unsigned long &ulValue, int iLen) {
+	unsigned char tucBuf[4];
+	if (fread(tucBuf, 1, iLen, f) != (size_t)iLen)
+		return false;
+	ulValue = 0;
+	for (int i = 0; i < iLen; i++)
+		ulValue |= (unsigned long)tucBuf[i] << (8 * i);
+	return true;
+}
+
+static bool GetBytes(FILE *f, CByteArray &oData) {
+	unsigned long ulLen = 0;
+	if (!GetLE(f, ulLen, 2))
+		return false;
+	std::vector<unsigned char> buf(ulLen);
+	if (ulLen > 0 && fread(buf.data(), 1, ulLen, f) != ulLen)
+		return false;
+	oData.ClearContents();
+	oData.Append(buf.data(), ulLen);
+	return true;
+}
+
+bool IsApduTracePinCommand(const CByteArray &oCmdAPDU) {
+	if (oCmdAPDU.Size() <= 5)
+		return false;
+	unsigned char ucINS = oCmdAPDU.GetByte(1);
+	return ucINS == 0x20 || ucINS == 0x24 || ucINS == 0x2C;
+}
+
+bool ReadApduTrace(const std::string &csPath, std::vector<tApduTraceRecord> &records) {
+	FILE *f = fopen(csPath.c_str(), "rb");
+	if (f == NULL) {
+		MWLOG(LEV_ERROR, MOD_CAL, "Failed to open APDU trace %s", csPath.c_str());
+		return false;
+	}
+
+	char tcMagic[sizeof(APDU_TRACE_MAGIC)];
+	unsigned char ucVersion = 0;
+	if (fread(tcMagic, 1, sizeof(tcMagic), f) != sizeof(tcMagic) ||
+		memcmp(tcMagic, APDU_TRACE_MAGIC, sizeof(tcMagic)) != 0 || fread(&ucVersion, 1, 1, f) != 1 ||
+		ucVersion != APDU_TRACE_VERSION) {
+		MWLOG(LEV_ERROR, MOD_CAL, "%s is not a supported APDU trace", csPath.c_str());
+		fclose(f);
+		return false;
+	}
+
+	records.clear();
+	while (true) {
+		tApduTraceRecord record;
+		if (fread(&record.ucType, 1, 1, f) != 1 || !GetLE(f, record.ulDuration, 4) || !GetBytes(f, record.oCommand) ||
+			!GetBytes(f, record.oResponse))
+			break;
+		records.push_back(record);
+	}
+
+	fclose(f);
+	return true;
+}
+
+// Each process writes its own trace: the PID is added before the file extension, e.g. trace_1234.bin
+static std::string TracePathForProcess(const std::string &csPath) {
+	std::string csPid = "_" + std::to_string(CThread::getCurrentPid());
+	size_t dot = csPath.find_last_of('.');
+	size_t separator = csPath.find_last_of("/\\");
+	if (dot == std::string::npos || (separator != std::string::npos && dot < separator))
+		return csPath + csPid;
+	return csPath.substr(0, dot) + csPid + csPath.substr(dot);
+}
+
+CApduTraceWriter *CApduTraceWriter::GetInstance() {
+	static CApduTraceWriter *instance = []() -> CApduTraceWriter * {
+		std::string csPath =
+			utilStringNarrow(CConfig::GetString(CConfig::EIDMW_CONFIG_PARAM_GENERAL_APDU_TRACE_FILE));
+		if (csPath.empty())
+			return NULL;
+		return new CApduTraceWriter(TracePathForProcess(csPath));
+	}();
+	return instance;
+}
+
+CApduTraceWriter::CApduTraceWriter(const std::string &csPath) {
+	m_file = fopen(csPath.c_str(), "wb");
+	if (m_file == NULL) {
+		MWLOG(LEV_ERROR, MOD_CAL, "Failed to create APDU trace %s", csPath.c_str());
+		return;
+	}
+
+	MWLOG(LEV_WARN, MOD_CAL, "APDU capture enabled: the card data will be written to %s", csPath.c_str());
+	fwrite(APDU_TRACE_MAGIC, 1, sizeof(APDU_TRACE_MAGIC), m_file);
+	fwrite(&APDU_TRACE_VERSION, 1, 1, m_file);
+	fflush(m_file);
+}
+
+CApduTraceWriter::~CApduTraceWriter() {
+	if (m_file != NULL)
+		fclose(m_file);
+}
+
+void CApduTraceWriter::WriteATR(const CByteArray &oATR) { WriteRecord(APDU_TRACE_ATR, 0, oATR, CByteArray()); }
+
+void CApduTraceWriter::WriteExchange(const CByteArray &oCmdAPDU, const CByteArray &oResp, unsigned long ulDuration) {
+	if (!IsApduTracePinCommand(oCmdAPDU)) {
+		WriteRecord(APDU_TRACE_EXCHANGE, ulDuration, oCmdAPDU, oResp);
+		return;
+	}
+
+	// Keep the header and length of PIN commands only
+	CByteArray oMasked = oCmdAPDU.GetBytes(0, 5);
+	for (unsigned long i = 5; i < oCmdAPDU.Size(); i++)
+		oMasked.Append(0xFF);
+	WriteRecord(APDU_TRACE_EXCHANGE, ulDuration, oMasked, oResp);
+}
+
+void CApduTraceWriter::WriteRecord(unsigned char ucType, unsigned long ulDuration, const CByteArray &oData1,
+								   const CByteArray &oData2) {
+	if (m_file == NULL)
+		return;
+
+	unsigned char tucHeader[5];
+	tucHeader[0] = ucType;
+	PutLE(tucHeader + 1, ulDuration, 4);
+
+	unsigned char tucLen1[2], tucLen2[2];
+	PutLE(tucLen1, oData1.Size(), 2);
+	PutLE(tucLen2, oData2.Size(), 2);
+
+	CAutoMutex autoMutex(&m_mutex);
+	fwrite(tucHeader, 1, sizeof(tucHeader), m_file);
+	fwrite(tucLen1, 1, sizeof(tucLen1), m_file);
+	fwrite(oData1.GetBytes(), 1, oData1.Size(), m_file);
+	fwrite(tucLen2, 1, sizeof(tucLen2), m_file);
+	fwrite(oData2.GetBytes(), 1, oData2.Size(), m_file);
+	// Keep the trace usable if the process doesn't exit cleanly
+	fflush(m_file);
+}
+
+} // namespace eIDMW
+
+#endif // PTEID_VIRTUAL_CARD
@@ -0,0 +1,75 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/**
+ * Binary trace of the APDUs exchanged with the card, written by CPCSC when the
+ * "apdu_trace_file" configuration value is set and replayed by CVirtualCard when
+ * "apdu_replay_file" is set. Like the virtual card, it is only compiled in test builds with
+ * PTEID_VIRTUAL_CARD defined (qmake CONFIG+=virtual_card). Each process writes its own
+ * trace: the process ID is added to the configured file name, e.g. trace.bin is written as trace_1234.bin.
+ *
+ * File format (integers are little-endian):
+ *   header: "PTAT" + 1 byte format version
+ *   record: 1 byte type | 4 bytes duration in microseconds | 2 bytes length + command | 2 bytes length + response
+ * ATR records (APDU_TRACE_ATR) store the ATR as command and have an empty response.
+ * Exchange records (APDU_TRACE_EXCHANGE) store the full response APDU including SW1-SW2.
+ *
+ * The PIN values in VERIFY, CHANGE REFERENCE DATA and RESET RETRY COUNTER commands are masked
+ * but the trace still contains all the other data read from the card, including personal data.
+ */
+#pragma once
+
+#ifdef PTEID_VIRTUAL_CARD
+
+#include "ByteArray.h"
+#include "Export.h"
+#include "Mutex.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace eIDMW {
+
+const unsigned char APDU_TRACE_ATR = 0x01;
+const unsigned char APDU_TRACE_EXCHANGE = 0x02;
+
+struct tApduTraceRecord {
+	unsigned char ucType;
+	unsigned long ulDuration; // microseconds
+	CByteArray oCommand;
+	CByteArray oResponse;
+};
+
+// Commands that carry PIN values, these are masked in the trace and matched without their data on replay
+EIDMW_CAL_API bool IsApduTracePinCommand(const CByteArray &oCmdAPDU);
+
+// Returns false if the file can't be opened or isn't an APDU trace, a truncated last record is ignored
+EIDMW_CAL_API bool ReadApduTrace(const std::string &csPath, std::vector<tApduTraceRecord> &records);
+
+class EIDMW_CAL_API CApduTraceWriter {
+public:
+	// Returns the trace writer configured for this process or NULL if capture is not enabled
+	static CApduTraceWriter *GetInstance();
+
+	CApduTraceWriter(const std::string &csPath);
+	~CApduTraceWriter();
+
+	void WriteATR(const CByteArray &oATR);
+	void WriteExchange(const CByteArray &oCmdAPDU, const CByteArray &oResp, unsigned long ulDuration);
+
+private:
+	void WriteRecord(unsigned char ucType, unsigned long ulDuration, const CByteArray &oData1,
+					 const CByteArray &oData2);
+
+	CMutex m_mutex;
+	FILE *m_file;
+};
+
+} // namespace eIDMW
+
+#endif // PTEID_VIRTUAL_CARD
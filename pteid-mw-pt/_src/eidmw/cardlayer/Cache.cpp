@@ -26,6 +26,7 @@
 #include "Cache.h"
 #include "Util.h"
 #include "Config.h"
+#include "Metrics.h"
 
 #include <unordered_set>
 #include <algorithm>
@@ -76,6 +77,14 @@ std::string CCache::GetSimpleName(const std::string &csSerialNr, const std::stri
 
 CByteArray CCache::GetFile(const std::string &csName, bool &bFileFound, bool &bFromDisk, unsigned long ulOffset,
 						   unsigned long ulMaxLen) {
+	static const char *LOOKUPS_HELP = "Lookups of card files in the cache by result";
+	static CMetricCounter *memoryHits =
+		CMetrics::GetInstance()->GetCounter("pteid_card_cache_lookups_total", LOOKUPS_HELP, "result=\"memory\"");
+	static CMetricCounter *diskHits =
+		CMetrics::GetInstance()->GetCounter("pteid_card_cache_lookups_total", LOOKUPS_HELP, "result=\"disk\"");
+	static CMetricCounter *misses =
+		CMetrics::GetInstance()->GetCounter("pteid_card_cache_lookups_total", LOOKUPS_HELP, "result=\"miss\"");
+
 	CByteArray oData = MemGetFile(csName);
 
 	// If not present in Memory, then try to get it from Disk
@@ -91,6 +100,12 @@ CByteArray CCache::GetFile(const std::string &csName, bool &bFileFound, bool &bF
 		bFromDisk = false;
 
 	bFileFound = oData.Size() != 0;
+	if (!bFileFound)
+		misses->Inc();
+	else if (bFromDisk)
+		diskHits->Inc();
+	else
+		memoryHits->Inc();
 
 	if (!bFileFound || (ulOffset == 0 && ulMaxLen == FULL_FILE))
 		return oData;
@@ -24,7 +24,9 @@
 **************************************************************************** */
 #include "Card.h"
 #include "Log.h"
+#include "Metrics.h"
 
+#include <atomic>
 #include <limits.h>
 
 #include "PaceAuthentication.h"
@@ -295,9 +297,35 @@ CByteArray CCard::Sign(const tPrivKey &key, const tPin &Pin, unsigned long algo,
 
 CByteArray CCard::GetRandom(unsigned long ulLen) { throw CMWEXCEPTION(EIDMW_ERR_NOT_SUPPORTED); }
 
+static void RecordAPDUMetrics(const CByteArray &oCmdAPDU, const CByteArray &oResp, unsigned long long ullDuration) {
+	static CMetricCounter *apdus = CMetrics::GetInstance()->GetCounter("pteid_card_apdus_total", "APDUs sent to the card");
+	static CMetricCounter *bytesSent =
+		CMetrics::GetInstance()->GetCounter("pteid_card_sent_bytes_total", "Bytes of the APDUs sent to the card");
+	static CMetricCounter *bytesReceived =
+		CMetrics::GetInstance()->GetCounter("pteid_card_received_bytes_total", "Bytes of the card responses");
+	// Registered on first use of each instruction
+	static std::atomic<CMetricHistogram *> durationByINS[256];
+
+	unsigned char ucINS = oCmdAPDU.Size() > 1 ? oCmdAPDU.GetByte(1) : 0;
+	CMetricHistogram *duration = durationByINS[ucINS].load(std::memory_order_acquire);
+	if (duration == NULL) {
+		char csLabels[16];
+		snprintf(csLabels, sizeof(csLabels), "ins=\"%02X\"", ucINS);
+		duration = CMetrics::GetInstance()->GetHistogram("pteid_card_apdu_duration_seconds",
+														 "Duration of the APDU exchanges by instruction", csLabels);
+		durationByINS[ucINS].store(duration, std::memory_order_release);
+	}
+
+	apdus->Inc();
+	bytesSent->Inc(oCmdAPDU.Size());
+	bytesReceived->Inc(oResp.Size());
+	duration->ObserveMicroseconds(ullDuration);
+}
+
 CByteArray CCard::handleSendAPDUSecurity(const CByteArray &oCmdAPDU, SCARDHANDLE &hCard, long &lRetVal,
 										 const void *param_structure) {
 	CByteArray result;
+	auto start = std::chrono::steady_clock::now();
 	bool isAlreadySM = oCmdAPDU.GetByte(0) & 0x0C || cleartext_next;
 	if (isAlreadySM && m_pace.get()) {
 		MWLOG(LEV_DEBUG, MOD_CAL, "This message is already secure and will not use PACE module! Message: %s",
@@ -309,6 +337,9 @@ CByteArray CCard::handleSendAPDUSecurity(const CByteArray &oCmdAPDU, SCARDHANDLE
 		result = m_poContext->m_oPCSC.Transmit(m_hCard, oCmdAPDU, &lRetVal, param_structure);
 		cleartext_next = false;
 	}
+
+	auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+	RecordAPDUMetrics(oCmdAPDU, result, duration.count());
 	return result;
 }
 
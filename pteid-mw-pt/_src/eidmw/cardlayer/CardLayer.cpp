@@ -22,11 +22,13 @@
 **************************************************************************** */
 #include "CardLayer.h"
 #include "Cache.h"
+#include "Log.h"
 
 namespace eIDMW {
 
 CCardLayer::CCardLayer(void) {
 	m_ulReaderCount = 0;
+	m_ulReadersGeneration = 0;
 	for (unsigned long i = 0; i < MAX_READERS; i++)
 		m_tpReaders[i] = NULL;
 }
@@ -73,12 +75,15 @@ CReadersInfo CCardLayer::ListReaders() {
 		oReaders = m_oContext.m_oPCSC.ListReaders();
 	} catch (CMWException &e) {
 		unsigned long err = e.GetError();
-		if (err == EIDMW_ERR_NO_READER)
+		if (err == EIDMW_ERR_NO_READER) {
+			UpdateReaderRegistry(CByteArray());
 			return theReadersInfo;
+		}
 
 		throw;
 	}
 
+	UpdateReaderRegistry(oReaders);
 	theReadersInfo = CReadersInfo(&m_oContext.m_oPCSC, oReaders);
 
 	if (oReaders.Size() != 0) {
@@ -88,6 +93,46 @@ CReadersInfo CCardLayer::ListReaders() {
 	return theReadersInfo;
 }
 
+unsigned long CCardLayer::GetReadersGeneration() {
+	CAutoMutex autoMutex(&m_oReadersMutex);
+	return m_ulReadersGeneration;
+}
+
+/**
+ * Keep track of the reader multistring last returned by PCSC: if it changed
+ * bump the generation counter and drop the cached capabilities (pinpad features,
+ * device info) of the CReader objects whose reader was unplugged.
+ */
+void CCardLayer::UpdateReaderRegistry(const CByteArray &oReaders) {
+	CAutoMutex autoMutex(&m_oReadersMutex);
+	if (m_ulReadersGeneration != 0 && oReaders.Equals(m_oLastReaders))
+		return;
+
+	m_ulReadersGeneration++;
+	m_oLastReaders = oReaders;
+	MWLOG(LEV_DEBUG, MOD_CAL, "Reader list changed (generation %lu)", m_ulReadersGeneration);
+
+	for (unsigned long i = 0; i < MAX_READERS; i++) {
+		if (m_tpReaders[i] == NULL)
+			continue;
+
+		bool bStillPresent = false;
+		const char *csReaders = (const char *)m_oLastReaders.GetBytes();
+		size_t offset = 0;
+		while (csReaders != NULL && offset < m_oLastReaders.Size() && csReaders[offset] != '\0') {
+			std::string csName = csReaders + offset;
+			if (csName == m_tpReaders[i]->GetReaderName()) {
+				bStillPresent = true;
+				break;
+			}
+			offset += csName.size() + 1;
+		}
+
+		if (!bStillPresent)
+			m_tpReaders[i]->InvalidateCapabilities();
+	}
+}
+
 CReader &CCardLayer::getReader(const std::string &csReaderName) {
 	// Do an SCardEstablishContext() if not done yet
 	m_oContext.m_oPCSC.EstablishContext();
@@ -101,6 +146,8 @@ CReader &CCardLayer::getReader(const std::string &csReaderName) {
 
 	// std::cout << "pcsReaderName = " << *pcsReaderName <<"\n";
 
+	CAutoMutex autoMutex(&m_oReadersMutex);
+
 	// First check if the reader doesn't exist already
 	for (unsigned long i = 0; i < MAX_READERS; i++) {
 		if (m_tpReaders[i] != NULL) {
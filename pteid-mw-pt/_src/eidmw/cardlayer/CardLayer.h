@@ -27,6 +27,7 @@
 #include "ReadersInfo.h"
 #include "Context.h"
 #include "CardLayerConst.h"
+#include "Mutex.h"
 #include "../dialogs/dialogs.h"
 
 namespace eIDMW {
@@ -60,6 +61,12 @@ public:
 	 */
 	CReadersInfo ListReaders();
 
+	/**
+	 * Incremented each time ListReaders() finds a different list of readers,
+	 * so that callers can skip rebuilding their own reader list.
+	 */
+	unsigned long GetReadersGeneration();
+
 	/**
 	 * Get a CReader object for the reader with name csReaderName;
 	 * no connection is made yet to the card that might be present
@@ -81,12 +88,18 @@ private:
 	CCardLayer(const CCardLayer &oCardLayer);
 	CCardLayer &operator=(const CCardLayer &oCardLayer);
 	std::string *GetDefaultReader();
+	void UpdateReaderRegistry(const CByteArray &oReaders);
 
 	CContext m_oContext;
 
 	std::string m_szDefaultReaderName;
 	unsigned long m_ulReaderCount;
 	CReader *m_tpReaders[MAX_READERS];
+
+	// Protects the reader registry below and m_tpReaders
+	CMutex m_oReadersMutex;
+	unsigned long m_ulReadersGeneration;
+	CByteArray m_oLastReaders;
 };
 
 } // namespace eIDMW
@@ -22,15 +22,23 @@
 **************************************************************************** */
 #include "Context.h"
 #include "Config.h"
+#include "Log.h"
 
 namespace eIDMW {
 CContext::CContext() {
 	m_bSSO = false;
+	m_poPresenceWatcher = new CCardPresenceWatcher();
 
 	m_ulConnectionDelay = CConfig::GetLong(CConfig::EIDMW_CONFIG_PARAM_GENERAL_CARDCONNDELAY);
 }
 
 CContext::~CContext() {
+	// Don't block (e.g. while the library is unloaded) on a watcher stuck in PCSC, leave it running instead
+	if (m_poPresenceWatcher->StopWatching())
+		delete m_poPresenceWatcher;
+	else
+		MWLOG(LEV_WARN, MOD_CAL, L"Card presence watcher didn't stop");
+
 	m_oThreadPool.FinishThreads();
 
 	m_oPCSC.ReleaseContext();
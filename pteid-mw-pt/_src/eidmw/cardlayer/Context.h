@@ -36,6 +36,7 @@ public:
 
 	CPCSC m_oPCSC;
 	CThreadPool m_oThreadPool;
+	CCardPresenceWatcher *m_poPresenceWatcher; // shared by all the readers
 
 	bool m_bSSO; // force Single Sign-On
 	unsigned long m_ulConnectionDelay;
@@ -37,12 +37,22 @@
 // cardlayer headers
 #include "PCSC.h"
 #include "InternalConst.h"
+#ifdef PTEID_VIRTUAL_CARD
+#include "ApduTrace.h"
+#include "VirtualCard.h"
+#endif
 
+#include <chrono>
 #include <exception>
 #include <utility>
 
 namespace eIDMW {
 
+#ifdef PTEID_VIRTUAL_CARD
+// Handle returned by Connect() for the emulated card, it's never handed out by SCardConnect()
+static const SCARDHANDLE VIRTUAL_CARD_HANDLE = (SCARDHANDLE)0x7EEDCA4D;
+#endif
+
 CPCSC::CPCSC() {
 	CConfig config;
 
@@ -50,10 +60,22 @@ CPCSC::CPCSC() {
 	m_hContext = 0;
 	m_iTimeoutCount = 0;
 	m_iListReadersCount = 0;
+#ifdef PTEID_VIRTUAL_CARD
+	m_poVirtualCard = CVirtualCard::GetInstance();
+	m_poTraceWriter = CApduTraceWriter::GetInstance();
+#endif
 }
 
 CPCSC::~CPCSC(void) { ReleaseContext(); }
 
+#ifdef PTEID_VIRTUAL_CARD
+bool CPCSC::IsVirtualReader(const std::string &csReader) {
+	return m_poVirtualCard != NULL && csReader == VIRTUAL_READER_NAME;
+}
+
+bool CPCSC::IsVirtualCard(SCARDHANDLE hCard) { return m_poVirtualCard != NULL && hCard == VIRTUAL_CARD_HANDLE; }
+#endif
+
 void CPCSC::EstablishContext() {
 	if (m_hContext == 0) {
 		SCARDCONTEXT hCtx = 0;
@@ -61,8 +83,16 @@ void CPCSC::EstablishContext() {
 
 		m_hContext = hCtx;
 		MWLOG(LEV_DEBUG, MOD_CAL, L"    SCardEstablishContext(): 0x%0x", lRet);
-		if (SCARD_S_SUCCESS != lRet)
+		if (SCARD_S_SUCCESS != lRet) {
+#ifdef PTEID_VIRTUAL_CARD
+			// The emulated reader doesn't need the PCSC service
+			if (m_poVirtualCard != NULL) {
+				m_hContext = 0;
+				return;
+			}
+#endif
 			throw CMWEXCEPTION(PcscToErr(lRet));
+		}
 	}
 }
 
@@ -77,6 +107,19 @@ CByteArray CPCSC::ListReaders() {
 	char csReaders[1024];
 	DWORD dwReadersLen = sizeof(csReaders);
 
+#ifdef PTEID_VIRTUAL_CARD
+	if (m_poVirtualCard != NULL) {
+		// Add the emulated reader at the end of the multistring
+		CByteArray oReaders;
+		if (m_hContext != 0 && SCardListReaders(m_hContext, NULL, csReaders, &dwReadersLen) == SCARD_S_SUCCESS &&
+			dwReadersLen > 1)
+			oReaders.Append((unsigned char *)csReaders, dwReadersLen - 1);
+		oReaders.Append((const unsigned char *)VIRTUAL_READER_NAME, sizeof(VIRTUAL_READER_NAME));
+		oReaders.Append(0x00);
+		return oReaders;
+	}
+#endif
+
 	LONG lRet = SCardListReaders(m_hContext, NULL, csReaders, &dwReadersLen);
 	if (SCARD_S_SUCCESS != lRet && m_iListReadersCount < 6) {
 		MWLOG(LEV_DEBUG, MOD_CAL, L"    SCardListReaders(): 0x%0x try: %d", lRet, m_iListReadersCount);
@@ -99,15 +142,45 @@ bool CPCSC::GetStatusChange(unsigned long ulTimeout, tReaderInfo *pReaderInfos,
 
 	SCARD_READERSTATEA txReaderStates[MAX_READERS];
 	DWORD tChangedState[MAX_READERS];
+	tReaderInfo *tpReaderInfos[MAX_READERS];
+	unsigned long ulAllReaders = ulReaderCount;
 
 	// Convert from tReaderInfo[] -> SCARD_READERSTATE array
-	for (DWORD i = 0; i < ulReaderCount; i++) {
-		txReaderStates[i].szReader = pReaderInfos[i].csReader.c_str();
-		txReaderStates[i].dwCurrentState = pReaderInfos[i].ulEventState;
-		txReaderStates[i].cbAtr = 0;
-		txReaderStates[i].pvUserData = 0;
+	// The emulated reader isn't known to PCSC: it always has a card so it only changes the first time it's checked
+	ulReaderCount = 0;
+	for (DWORD i = 0; i < ulAllReaders; i++) {
+#ifdef PTEID_VIRTUAL_CARD
+		if (IsVirtualReader(pReaderInfos[i].csReader)) {
+			bool bVirtualChanged = (pReaderInfos[i].ulEventState & SCARD_STATE_PRESENT) == 0;
+			pReaderInfos[i].ulCurrentState = pReaderInfos[i].ulEventState;
+			pReaderInfos[i].ulEventState = SCARD_STATE_PRESENT | (bVirtualChanged ? SCARD_STATE_CHANGED : 0);
+			bChanged |= bVirtualChanged;
+			continue;
+		}
+#endif
+		tpReaderInfos[ulReaderCount] = &pReaderInfos[i];
+		txReaderStates[ulReaderCount].szReader = pReaderInfos[i].csReader.c_str();
+		txReaderStates[ulReaderCount].dwCurrentState = pReaderInfos[i].ulEventState;
+		txReaderStates[ulReaderCount].cbAtr = 0;
+		txReaderStates[ulReaderCount].pvUserData = 0;
+		ulReaderCount++;
 	}
 
+#ifdef PTEID_VIRTUAL_CARD
+	if (ulReaderCount < ulAllReaders && (bChanged || ulReaderCount == 0)) {
+		// Wait for the timeout as PCSC would do if there's nothing to report
+		if (!bChanged && ulTimeout != 0) {
+			while (ulTimeout != 0) {
+				unsigned long ulDelay = ulTimeout > 250 ? 250 : ulTimeout;
+				if (ulTimeout != TIMEOUT_INFINITE)
+					ulTimeout -= ulDelay;
+				CThread::SleepMillisecs(ulDelay);
+			}
+		}
+		return bChanged;
+	}
+#endif
+
 wait_again:
 	LONG lRet = SCardGetStatusChange(m_hContext, ulTimeout, txReaderStates, ulReaderCount);
 	if (SCARD_E_TIMEOUT != lRet) {
@@ -150,9 +223,10 @@ wait_again:
 
 		// Update the event states in pReaderInfos
 		for (DWORD i = 0; i < ulReaderCount; i++) {
-			pReaderInfos[i].ulCurrentState = pReaderInfos[i].ulEventState;
+			tpReaderInfos[i]->ulCurrentState = tpReaderInfos[i]->ulEventState;
 			// Clear and SCARD_STATE_CHANGED flag, and use tChangedState instead
-			pReaderInfos[i].ulEventState = (txReaderStates[i].dwEventState & ~SCARD_STATE_CHANGED) | tChangedState[i];
+			tpReaderInfos[i]->ulEventState =
+				(txReaderStates[i].dwEventState & ~SCARD_STATE_CHANGED) | tChangedState[i];
 		}
 
 		// Sometimes, it seems we're getting here even without a status change,
@@ -172,6 +246,11 @@ wait_again:
 }
 
 bool CPCSC::Status(const std::string &csReader) {
+#ifdef PTEID_VIRTUAL_CARD
+	if (IsVirtualReader(csReader))
+		return true;
+#endif
+
 	SCARD_READERSTATEA xReaderState;
 	xReaderState.szReader = csReader.c_str();
 	xReaderState.dwCurrentState = 0;
@@ -189,6 +268,14 @@ std::pair<SCARDHANDLE, DWORD> CPCSC::Connect(const std::string &csReader, unsign
 	DWORD dwActiveProtocol;
 	SCARDHANDLE hCard = 0;
 
+#ifdef PTEID_VIRTUAL_CARD
+	if (IsVirtualReader(csReader)) {
+		m_poVirtualCard->Reset();
+		MWLOG(LEV_DEBUG, MOD_CAL, L"    Connected to the virtual card");
+		return std::make_pair(VIRTUAL_CARD_HANDLE, (DWORD)SCARD_PROTOCOL_T1);
+	}
+#endif
+
 	LONG lRet =
 		SCardConnect(m_hContext, csReader.c_str(), ulShareMode, ulPreferredProtocols, &hCard, &dwActiveProtocol);
 
@@ -213,6 +300,20 @@ std::pair<SCARDHANDLE, DWORD> CPCSC::Connect(const std::string &csReader, unsign
 void CPCSC::Disconnect(SCARDHANDLE hCard, tDisconnectMode disconnectMode) {
 	DWORD dwDisposition = disconnectMode == DISCONNECT_RESET_CARD ? SCARD_RESET_CARD : SCARD_LEAVE_CARD;
 
+#ifdef PTEID_VIRTUAL_CARD
+	if (IsVirtualCard(hCard)) {
+		tVirtualCardStats stats = m_poVirtualCard->GetStats();
+		MWLOG(LEV_INFO, MOD_CAL,
+			  L"    Virtual card disconnected: %lu APDUs, %lu bytes sent, %lu bytes received, modelled latency %lu us, "
+			  L"%lu replay misses",
+			  stats.ulApduCount, stats.ulBytesSent, stats.ulBytesReceived, stats.ulModelledLatency,
+			  stats.ulReplayMisses);
+		if (disconnectMode == DISCONNECT_RESET_CARD)
+			m_poVirtualCard->Reset();
+		return;
+	}
+#endif
+
 	LONG lRet = SCardDisconnect(hCard, dwDisposition);
 	MWLOG(LEV_DEBUG, MOD_CAL, L"    SCardDisconnect(0x%0x): 0x%0x ; mode: %d", hCard, lRet, dwDisposition);
 	if (SCARD_S_SUCCESS != lRet)
@@ -225,18 +326,37 @@ CByteArray CPCSC::GetATR(SCARDHANDLE hCard) {
 	unsigned char tucATR[64];
 	DWORD dwATRLen = sizeof(tucATR);
 
-	LONG lRet = SCardStatus(hCard, NULL, &dwReaderLen, &dwState, &dwProtocol, tucATR, &dwATRLen);
-	MWLOG(LEV_DEBUG, MOD_CAL, L"    SCardStatus(0x%0x): 0x%0x", hCard, lRet);
-	if (SCARD_S_SUCCESS != lRet)
-		throw CMWEXCEPTION(PcscToErr(lRet));
+	CByteArray oATR;
+#ifdef PTEID_VIRTUAL_CARD
+	if (IsVirtualCard(hCard)) {
+		oATR = m_poVirtualCard->GetATR();
+	} else
+#endif
+	{
+		LONG lRet = SCardStatus(hCard, NULL, &dwReaderLen, &dwState, &dwProtocol, tucATR, &dwATRLen);
+		MWLOG(LEV_DEBUG, MOD_CAL, L"    SCardStatus(0x%0x): 0x%0x", hCard, lRet);
+		if (SCARD_S_SUCCESS != lRet)
+			throw CMWEXCEPTION(PcscToErr(lRet));
+		oATR = CByteArray(tucATR, dwATRLen);
+	}
 
-	return CByteArray(tucATR, dwATRLen);
+#ifdef PTEID_VIRTUAL_CARD
+	if (m_poTraceWriter != NULL)
+		m_poTraceWriter->WriteATR(oATR);
+#endif
+
+	return oATR;
 }
 
 CByteArray CPCSC::GetIFDVersion(SCARDHANDLE hCard) {
 	unsigned char tucIFDVers[4] = {0, 0, 0, 0};
 	DWORD dwIFDVersLen = sizeof(tucIFDVers);
 
+#ifdef PTEID_VIRTUAL_CARD
+	if (IsVirtualCard(hCard))
+		return CByteArray(tucIFDVers, dwIFDVersLen);
+#endif
+
 	LONG lRet = SCardGetAttrib(hCard, SCARD_ATTR_VENDOR_IFD_VERSION, tucIFDVers, &dwIFDVersLen);
 	MWLOG(LEV_DEBUG, MOD_CAL, L"    SCardGetAttrib(0x%0x): 0x%0x", hCard, lRet);
 
@@ -250,6 +370,11 @@ bool CPCSC::Status(SCARDHANDLE hCard) {
 	DWORD dwATRLen = sizeof(tucATR);
 	static int iStatusCount = 0;
 
+#ifdef PTEID_VIRTUAL_CARD
+	if (IsVirtualCard(hCard))
+		return true;
+#endif
+
 	LONG lRet = SCardStatus(hCard, NULL, &dwReaderLen, &dwState, &dwProtocol, tucATR, &dwATRLen);
 
 	// lRet = 0;
@@ -286,6 +411,20 @@ CByteArray CPCSC::Transmit(SCARDHANDLE hCard, const CByteArray &inputAPDU, long
 
 	MWLOG(LEV_DEBUG, MOD_CAL, L"      SCardTransmit(%ls)", oCmdAPDU.ToWString(true, true, 0, ulLen).c_str());
 
+#ifdef PTEID_VIRTUAL_CARD
+	if (IsVirtualCard(hCard)) {
+		// The emulated card applies its own configured latency instead of m_ulCardTxDelay
+		unsigned long ulLatency = m_poVirtualCard->GetStats().ulModelledLatency;
+		CByteArray oResp = m_poVirtualCard->Transmit(oCmdAPDU);
+		*plRetVal = SCARD_S_SUCCESS;
+		if (m_poTraceWriter != NULL)
+			m_poTraceWriter->WriteExchange(oCmdAPDU, oResp, m_poVirtualCard->GetStats().ulModelledLatency - ulLatency);
+		MWLOG(LEV_DEBUG, MOD_CAL, L"        SCardTransmit(): SW12 = %02X %02X Len = %ld",
+			  oResp.GetByte(oResp.Size() - 2), oResp.GetByte(oResp.Size() - 1), oResp.Size());
+		return oResp;
+	}
+#endif
+
 	// On Windows we can't send APDUs with Le byte on T=0 cards so the implemented change to support T=1 is not
 	// backwards-compatible !!
 	if (pioSendPci->dwProtocol == SCARD_PROTOCOL_T0) {
@@ -301,6 +440,10 @@ CByteArray CPCSC::Transmit(SCARDHANDLE hCard, const CByteArray &inputAPDU, long
 	// It seems to be fixed when adding a delay before sending something to the card...
 	CThread::SleepMillisecs(m_ulCardTxDelay);
 
+#ifdef PTEID_VIRTUAL_CARD
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#endif
+
 #ifdef __APPLE__
 	int iRetryCount = 0;
 try_again:
@@ -321,6 +464,10 @@ try_again:
 
 		throw CMWEXCEPTION(PcscToErr(lRet));
 	}
+#ifdef PTEID_VIRTUAL_CARD
+	std::chrono::microseconds duration =
+		std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+#endif
 
 	// Don't log the full response for privacy reasons, only SW1-SW2
 	MWLOG(LEV_DEBUG, MOD_CAL, L"        SCardTransmit(): SW12 = %02X %02X Len = %ld", tucRecv[dwRecvLen - 2],
@@ -333,7 +480,13 @@ try_again:
 		CThread::SleepMillisecs(25);
 	}
 
-	return CByteArray(tucRecv, (unsigned long)dwRecvLen);
+	CByteArray oResp(tucRecv, (unsigned long)dwRecvLen);
+#ifdef PTEID_VIRTUAL_CARD
+	if (m_poTraceWriter != NULL)
+		m_poTraceWriter->WriteExchange(oCmdAPDU, oResp, (unsigned long)duration.count());
+#endif
+
+	return oResp;
 }
 
 void CPCSC::Recover(SCARDHANDLE hCard, unsigned long *pulLockCount) {
@@ -343,6 +496,11 @@ void CPCSC::Recover(SCARDHANDLE hCard, unsigned long *pulLockCount) {
 	int i = 0;
 	LONG lRet = SCARD_F_INTERNAL_ERROR;
 
+#ifdef PTEID_VIRTUAL_CARD
+	if (IsVirtualCard(hCard))
+		return;
+#endif
+
 	MWLOG(LEV_WARN, MOD_CAL, L"Card is not responding properly, trying to recover...");
 
 	for (i = 0; (i < 10) && (lRet != SCARD_S_SUCCESS); i++) {
@@ -373,6 +531,12 @@ CByteArray CPCSC::Control(SCARDHANDLE hCard, unsigned long ulControl, const CByt
 	MWLOG(LEV_DEBUG, MOD_CAL, L"      SCardControl(ctrl=0x%0x, %ls)", ulControl,
 		  oCmd.ToWString(true, true, 0, 5).c_str());
 
+#ifdef PTEID_VIRTUAL_CARD
+	// The emulated reader has no pinpad or other reader features
+	if (IsVirtualCard(hCard))
+		return CByteArray();
+#endif
+
 	/* Full message: it might include prebuilt APDU with PUK and/or PIN
 	// Commented out for security
 	MWLOG(LEV_DEBUG, MOD_CAL, L"      SCardControl(ctrl=0x%0x, %ls)",
@@ -415,6 +579,11 @@ CByteArray CPCSC::Control(SCARDHANDLE hCard, unsigned long ulControl, const CByt
 }
 
 void CPCSC::BeginTransaction(SCARDHANDLE hCard) {
+#ifdef PTEID_VIRTUAL_CARD
+	if (IsVirtualCard(hCard))
+		return;
+#endif
+
 	LONG lRet = SCardBeginTransaction(hCard);
 	MWLOG(LEV_DEBUG, MOD_CAL, L"    SCardBeginTransaction(0x%0x): 0x%0x", hCard, lRet);
 	if (SCARD_S_SUCCESS != lRet)
@@ -422,6 +591,11 @@ void CPCSC::BeginTransaction(SCARDHANDLE hCard) {
 }
 
 void CPCSC::EndTransaction(SCARDHANDLE hCard) {
+#ifdef PTEID_VIRTUAL_CARD
+	if (IsVirtualCard(hCard))
+		return;
+#endif
+
 	LONG lRet = SCardEndTransaction(hCard, SCARD_LEAVE_CARD);
 	MWLOG(LEV_DEBUG, MOD_CAL, L"    SCardEndTransaction(0x%0x): 0x%0x", hCard, lRet);
 
@@ -62,6 +62,11 @@ Takes care of
 
 namespace eIDMW {
 
+#ifdef PTEID_VIRTUAL_CARD
+class CVirtualCard;
+class CApduTraceWriter;
+#endif
+
 // Copied from PCSC
 #define EIDMW_STATE_CHANGED 0x00000002
 #define EIDMW_STATE_PRESENT 0x00000020
@@ -131,6 +136,11 @@ public:
 private:
 	long PcscToErr(unsigned long lRet);
 
+#ifdef PTEID_VIRTUAL_CARD
+	bool IsVirtualReader(const std::string &csReader);
+	bool IsVirtualCard(SCARDHANDLE hCard);
+#endif
+
 	// unsigned long m_hContext;
 	SCARDCONTEXT m_hContext;
 
@@ -140,6 +150,14 @@ private:
 	int m_iListReadersCount;
 
 	unsigned long m_ulCardTxDelay; // delay before each transmission to a smartcard; in millie-seconds, default 1
+
+#ifdef PTEID_VIRTUAL_CARD
+	// Emulated card reader shared by all CPCSC objects, NULL unless EIDMW_CONFIG_PARAM_GENERAL_VIRTUAL_CARD_DIR is set
+	CVirtualCard *m_poVirtualCard;
+
+	// APDU capture shared by all CPCSC objects, NULL unless EIDMW_CONFIG_PARAM_GENERAL_APDU_TRACE_FILE is set
+	CApduTraceWriter *m_poTraceWriter;
+#endif
 };
 
 } // namespace eIDMW
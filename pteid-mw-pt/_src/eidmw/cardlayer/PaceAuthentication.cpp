@@ -1,4 +1,5 @@
 #include "PaceAuthentication.h"
+#include "SecureMessaging.h"
 
 #include "ByteArray.h"
 #include "Log.h"
@@ -8,7 +9,7 @@
 #include "eac/eac.h"
 #include "eac/pace.h"
 
-#include "Log.h"
+#include <openssl/evp.h>
 
 #include <mutex>
 
@@ -17,14 +18,18 @@
 
 namespace eIDMW {
 
-class PaceAuthenticationImpl {
+/* Session keys of the EAC context, must be called after EAC_CTX_set_encryption_ctx(), which also resets the
+   send sequence counter */
+static bool initCodec(SecureMessagingCodec &codec, const KA_CTX *keyCtx) {
+	if (!keyCtx || !keyCtx->k_enc || !keyCtx->k_mac || !keyCtx->cipher || EVP_CIPHER_block_size(keyCtx->cipher) != 16) {
+		MWLOG(LEV_ERROR, MOD_CAL, "Secure messaging: unsupported PACE session cipher");
+		return false;
+	}
+	return codec.init((const unsigned char *)keyCtx->k_enc->data, keyCtx->k_enc->length,
+					  (const unsigned char *)keyCtx->k_mac->data, keyCtx->k_mac->length);
+}
 
-	const unsigned char Tcg = 0x87;
-	const unsigned char TcgOdd = 0x85;
-	const unsigned char Tcc = 0x8E;
-	const unsigned char Tle = 0x97;
-	const unsigned char paddingIndicator = 0x01;
-	const unsigned char controlByte = 0x0C;
+class PaceAuthenticationImpl {
 
 	BUF_MEM *findObjectMem(const CByteArray &array, long tag) {
 		long size = 0;
@@ -44,275 +49,32 @@ public:
 	explicit PaceAuthenticationImpl(CContext *poContext)
 		: m_context(poContext), m_secret(NULL), m_ctx(NULL), m_secretLen(0) {}
 
-	BUF_MEM *bufMemFromByteArray(const CByteArray &array) {
-		BUF_MEM *buf = BUF_MEM_new();
-		if (buf == NULL) {
-			// no memory
-			return NULL;
-		}
-
-		buf->data = (char *)malloc(array.Size() * sizeof(char));
-		if (buf->data == NULL) {
-			// no memory
-			return NULL;
-		}
-		memcpy(buf->data, (char *)array.GetBytes(), array.Size());
-		buf->length = array.Size();
-		buf->max = buf->length;
-
-		return buf;
-	}
-
-	CByteArray arrayFromBufMem(BUF_MEM *mem) {
-		assert(mem->length <= ULONG_MAX);
-		return CByteArray((unsigned char *)mem->data, (unsigned long) mem->length); 
-	}
-
 	CByteArray formatAPDU(const CByteArray &plainAPDU) {
-		CByteArray encryptedAPDU;
-		CByteArray responseEncryptedAPDU;
-		CByteArray inputForMac;
-		CByteArray mac;
-		CByteArray TlvLe;
-		int lc = plainAPDU.GetByte(4);
-		bool isInsOdd = plainAPDU.GetByte(1) & 1;
-
-		CByteArray command_header(plainAPDU.GetBytes(0, 4));
-		command_header.SetByte(command_header.GetByte(0) | controlByte, 0);
-		BUF_MEM *memCommandHeader = bufMemFromByteArray(command_header);
-		BUF_MEM *memPaddedCommandHeader = EAC_add_iso_pad(m_ctx, memCommandHeader);
-		CByteArray paddedCommandHeader = arrayFromBufMem(memPaddedCommandHeader);
-		inputForMac.Append(paddedCommandHeader);
-
-		if ((command_header.Size() + lc + 2 == plainAPDU.Size()) || plainAPDU.Size() == 5) {
-			TlvLe.Append((unsigned char)Tle);
-			TlvLe.Append((unsigned char)0x01);
-			TlvLe.Append((unsigned char)plainAPDU.GetByte(plainAPDU.Size() - 1));
-		}
-
-		// Pre-increment SSC
-		EAC_increment_ssc(m_ctx);
-
-		if (plainAPDU.Size() > 5) {
-			BUF_MEM *memInputData = NULL;
-			BUF_MEM *paddedMemInputData = NULL;
-			CByteArray inputData(plainAPDU.GetBytes(5, plainAPDU.Size() - 5 - (TlvLe.Size() > 0 ? 1 : 0)));
-			memInputData = bufMemFromByteArray(inputData);
-			paddedMemInputData = EAC_add_iso_pad(m_ctx, memInputData);
-
-			BUF_MEM *memEncrytedInput = EAC_encrypt(m_ctx, paddedMemInputData);
-			CByteArray encryptedInput = arrayFromBufMem(memEncrytedInput);
-			CByteArray paddedInputArray = arrayFromBufMem(paddedMemInputData);
-			// LCg = Len(Cg) + Len(PI = 1)
-			size_t lcg = encryptedInput.Size() + (isInsOdd ? 0 : 1);
-
-			CByteArray paddedCryptogram;
-			paddedCryptogram.Append(isInsOdd ? TcgOdd : Tcg);
-			// This is safe because Lcg will be always lower than
-			assert(lcg <= UCHAR_MAX);
-			paddedCryptogram.Append((unsigned char)lcg);
-			if (!isInsOdd)
-				paddedCryptogram.Append(paddingIndicator);
-			paddedCryptogram.Append(encryptedInput);
-			if (TlvLe.Size() > 0)
-				paddedCryptogram.Append(TlvLe);
-
-			BUF_MEM *memCryptogram = bufMemFromByteArray(paddedCryptogram);
-
-			BUF_MEM *memPaddedCryptogram = EAC_add_iso_pad(m_ctx, memCryptogram);
-
-			paddedCryptogram = arrayFromBufMem(memPaddedCryptogram);
-
-			// [Tcg Lcg PI,CG]
-			inputForMac.Append(paddedCryptogram);
-
-			BUF_MEM *memInputForMac = bufMemFromByteArray(inputForMac);
-			BUF_MEM *memMac = EAC_authenticate(m_ctx, memInputForMac);
-
-			mac = arrayFromBufMem(memMac);
-
-			size_t lc_final =
-				mac.Size() + 2 + encryptedInput.Size() + 3 + TlvLe.Size() - (isInsOdd ? 1 : 0); // CG + Tcg + Lcg + PI
-			encryptedAPDU.Append(command_header);
-			assert(lc_final <= UCHAR_MAX);
-			encryptedAPDU.Append((unsigned char)lc_final);
-			encryptedAPDU.Append(isInsOdd ? TcgOdd : Tcg);
-			encryptedAPDU.Append((unsigned char)lcg);
-			if (!isInsOdd)
-				encryptedAPDU.Append(paddingIndicator);
-			encryptedAPDU.Append(encryptedInput);
-
-			if (TlvLe.Size())
-				encryptedAPDU.Append(TlvLe);
-			if (memMac)
-				BUF_MEM_clear_free(memMac);
-			if (memInputForMac)
-				BUF_MEM_clear_free(memInputForMac);
-			if (memPaddedCryptogram)
-				BUF_MEM_clear_free(memPaddedCryptogram);
-			if (memCryptogram)
-				BUF_MEM_clear_free(memCryptogram);
-			if (memEncrytedInput)
-				BUF_MEM_clear_free(memEncrytedInput);
-			if (paddedMemInputData)
-				BUF_MEM_clear_free(paddedMemInputData);
-			if (memInputData)
-				BUF_MEM_clear_free(memInputData);
-		} else {
-			BUF_MEM *memTlvLe = bufMemFromByteArray(TlvLe);
-
-			BUF_MEM *paddedTlvLe = EAC_add_iso_pad(m_ctx, memTlvLe);
-			assert(paddedTlvLe->length <= ULONG_MAX);
-			inputForMac.Append((unsigned char *)paddedTlvLe->data, (unsigned long) paddedTlvLe->length);
-			BUF_MEM *inputMac = bufMemFromByteArray(inputForMac);
-
-			BUF_MEM *memMac = EAC_authenticate(m_ctx, inputMac);
-			mac = arrayFromBufMem(memMac);
-
-			int lc_final = mac.Size() + 2 + TlvLe.Size();
-			encryptedAPDU.Append(command_header);
-			encryptedAPDU.Append((unsigned char)lc_final);
-			encryptedAPDU.Append(TlvLe);
-
-			if (memTlvLe)
-				BUF_MEM_clear_free(memTlvLe);
-			if (paddedTlvLe)
-				BUF_MEM_clear_free(paddedTlvLe);
-			if (inputMac)
-				BUF_MEM_clear_free(inputMac);
-			if (memMac)
-				BUF_MEM_clear_free(memMac);
-		}
-
-		encryptedAPDU.Append(Tcc);
-		assert(mac.Size() <= UCHAR_MAX);
-		encryptedAPDU.Append((unsigned char) mac.Size()); // Lcc
-		encryptedAPDU.Append(mac);
-		encryptedAPDU.Append(0x00);
-
-		EAC_increment_ssc(m_ctx);
-
-		if (memCommandHeader)
-			BUF_MEM_clear_free(memCommandHeader);
-		if (memPaddedCommandHeader)
-			BUF_MEM_clear_free(memPaddedCommandHeader);
-
-		return encryptedAPDU;
-	}
-
-	BUF_MEM *copyFromArray(const CByteArray &array, long index, long length) {
-		BUF_MEM *copiedMem = BUF_MEM_new();
-		copiedMem->data = (char *)malloc(length * sizeof(char));
-		memcpy(copiedMem->data, array.GetBytes(index, length).GetBytes(), length);
-		copiedMem->length = length;
-		copiedMem->max = copiedMem->length;
-		return copiedMem;
+		CByteArray protectedAPDU;
+		const unsigned char *apdu = plainAPDU.GetBytes();
+		size_t apduLen = plainAPDU.Size();
+		size_t lc = plainAPDU.GetByte(4);
+		// Header + Le or header + Lc + data + Le
+		bool hasLe = apduLen == 5 || apduLen == 4 + 1 + lc + 1;
+		size_t dataLen = apduLen > 5 ? apduLen - 5 - (hasLe ? 1 : 0) : 0;
+
+		if (!m_codec.wrap(apdu, apdu + 5, dataLen, apdu + apduLen - 1, hasLe ? 1 : 0, hasLe, false, protectedAPDU))
+			throw CMWEXCEPTION(EIDMW_PACE_ERR_UNKNOWN);
+
+		return protectedAPDU;
 	}
 
 	CByteArray decryptAPDU(const CByteArray &encryptedAPDU) {
-		CByteArray decryptedResponse;
-		CByteArray encryptedResponseToAuthenticate;
-		BUF_MEM *encryptedResponse = NULL;
-		BUF_MEM *encryptedResponseContent = NULL;
-		BUF_MEM *macAPDUResponse = NULL;
-		BUF_MEM *unpadDecryptedResponse = NULL;
-		bool isOdd = encryptedAPDU.GetByte(0) == TcgOdd;
-		ptrdiff_t startOfData = 0;
-
 		if (encryptedAPDU.Size() <= 2) // Secure Messaging Error
 			return encryptedAPDU;
 
-		if (encryptedAPDU.GetByte(0) == Tcg || isOdd) {
-			const unsigned char *descData = encryptedAPDU.GetBytes();
-			long sizeData;
-			int xclass = 0;
-			int ans1Tag = 0;
-			int stepsToskip = 0;
-
-			ASN1_get_object(&descData, &sizeData, &ans1Tag, &xclass, encryptedAPDU.Size());
-			const char *result = strstr(reinterpret_cast<const char *>(encryptedAPDU.GetBytes()),
-										reinterpret_cast<const char *>(descData));
-			
-			startOfData = static_cast<long>(reinterpret_cast<const unsigned char *>(result) - encryptedAPDU.GetBytes());
-			assert(LONG_MIN <= startOfData <= LONG_MAX);
-			encryptedResponseContent = copyFromArray(encryptedAPDU, (long) startOfData, sizeData);
-		}
-		size_t indexStatusCode = 2 + (encryptedResponseContent ? (encryptedResponseContent->length + (startOfData)) : 0);
-		assert(LONG_MIN <= indexStatusCode <= LONG_MAX);
-		encryptedResponse = copyFromArray(encryptedAPDU, (long) indexStatusCode, 2);
-
-		if (encryptedResponseContent != NULL) {
-			encryptedResponseToAuthenticate.Append(encryptedAPDU.GetBytes(0, (unsigned long) startOfData));
-			encryptedResponseToAuthenticate.Append(arrayFromBufMem(encryptedResponseContent));
-		}
-
-		if (encryptedResponse != NULL) {
-			encryptedResponseToAuthenticate.Append(0x99);
-			assert(encryptedResponse->length <= UCHAR_MAX);
-			encryptedResponseToAuthenticate.Append((unsigned char) encryptedResponse->length);
-			encryptedResponseToAuthenticate.Append(arrayFromBufMem(encryptedResponse));
-		}
-
-		BUF_MEM *memResponseToAuthenticate = bufMemFromByteArray(encryptedResponseToAuthenticate);
-
-		BUF_MEM *paddedResponse = EAC_add_iso_pad(m_ctx, memResponseToAuthenticate);
-		BUF_MEM *authenticateResponse = EAC_authenticate(m_ctx, paddedResponse);
-		long macIndex = encryptedResponseToAuthenticate.Size() + 2;
-		macAPDUResponse = copyFromArray(encryptedAPDU, macIndex, (long)encryptedAPDU.GetByte(macIndex - 1));
-
-		if (!macAPDUResponse || !authenticateResponse || (authenticateResponse->length != macAPDUResponse->length) ||
-			memcmp(macAPDUResponse->data, authenticateResponse->data, macAPDUResponse->length) != 0) {
+		CByteArray decryptedResponse;
+		if (!m_codec.unwrap(encryptedAPDU, decryptedResponse)) {
 			MWLOG(LEV_ERROR, MOD_CAL, "Response from encrypted APDU is invalid! APDU: %s",
 				  encryptedAPDU.ToString().c_str());
-			decryptedResponse.Append(encryptedAPDU);
-			goto err;
-		}
-		if (encryptedResponseContent != NULL) {
-			BUF_MEM *decryptResponseRemovePadding = BUF_MEM_new();
-			decryptResponseRemovePadding->length =
-				encryptedResponseContent->length -
-				(isOdd ? 0 : 1); // first byte of an encrypted message is padding indicator unless odd INS
-			decryptResponseRemovePadding->data = (char *)malloc(decryptResponseRemovePadding->length * sizeof(char));
-			memcpy(decryptResponseRemovePadding->data, &encryptedResponseContent->data[isOdd ? 0 : 1],
-				   decryptResponseRemovePadding->length);
-			decryptResponseRemovePadding->max = decryptResponseRemovePadding->length;
-			BUF_MEM *paddedEncryptedResponse = NULL;
-			if (decryptResponseRemovePadding->length % 16) {
-				paddedEncryptedResponse = EAC_add_iso_pad(m_ctx, decryptResponseRemovePadding);
-			} else {
-				paddedEncryptedResponse = decryptResponseRemovePadding;
-				decryptResponseRemovePadding = NULL;
-			}
-
-			BUF_MEM *memDecryptedResponse = EAC_decrypt(m_ctx, paddedEncryptedResponse);
-			unpadDecryptedResponse = EAC_remove_iso_pad(memDecryptedResponse);
-			decryptedResponse.Append(arrayFromBufMem(unpadDecryptedResponse));
-
-			if (unpadDecryptedResponse)
-				BUF_MEM_clear_free(unpadDecryptedResponse);
-			if (decryptResponseRemovePadding)
-				BUF_MEM_clear_free(decryptResponseRemovePadding);
-			if (paddedEncryptedResponse)
-				BUF_MEM_clear_free(paddedEncryptedResponse);
-			if (memDecryptedResponse)
-				BUF_MEM_clear_free(memDecryptedResponse);
+			return encryptedAPDU;
 		}
 
-		decryptedResponse.Append(arrayFromBufMem(encryptedResponse));
-	err:
-		if (macAPDUResponse)
-			BUF_MEM_clear_free(macAPDUResponse);
-		if (encryptedResponseContent)
-			BUF_MEM_clear_free(encryptedResponseContent);
-		if (encryptedResponse)
-			BUF_MEM_clear_free(encryptedResponse);
-		if (memResponseToAuthenticate)
-			BUF_MEM_clear_free(memResponseToAuthenticate);
-		if (paddedResponse)
-			BUF_MEM_clear_free(paddedResponse);
-		if (authenticateResponse)
-			BUF_MEM_clear_free(authenticateResponse);
-
 		return decryptedResponse;
 	}
 
@@ -443,7 +205,7 @@ public:
 			goto err;
 		}
 
-		if (!EAC_CTX_set_encryption_ctx(m_ctx, EAC_ID_PACE)) {
+		if (!EAC_CTX_set_encryption_ctx(m_ctx, EAC_ID_PACE) || !initCodec(m_codec, m_ctx->key_ctx)) {
 			MWLOG(LEV_ERROR, MOD_CAL, "Couldn't initialize encryption");
 			r = -1;
 		}
@@ -474,6 +236,7 @@ public:
 			BUF_MEM_clear_free(cardToken);
 		}
 		if (r < 0) {
+			m_codec.reset();
 			EAC_CTX_clear_free(m_ctx);
 			m_ctx = NULL;
 			EAC_cleanup();
@@ -486,7 +249,8 @@ public:
 	}
 
 	CByteArray sendAPDU(const CByteArray &plainAPDU, SCARDHANDLE &hCard, long &lRetVal, const void *param_structure) {
-		if (m_ctx == NULL) {
+		std::lock_guard<std::mutex> guard(m_mutex);
+		if (m_ctx == NULL || !m_codec.isReady()) {
 			throw CMWEXCEPTION(EIDMW_PACE_ERR_NOT_INITIALIZED);
 		}
 		CByteArray encryptedAPDU = formatAPDU(plainAPDU);
@@ -496,118 +260,22 @@ public:
 	}
 
 	CByteArray formatAPDU(const APDU &apdu) {
-		CByteArray encryptedAPDU;
-		CByteArray command_header = apdu.getHeader();
-		CByteArray inputForMac;
-		CByteArray TlvLe;
-		CByteArray mac;
-		CByteArray encryptedInput;
-		size_t lcg = 0;
-
-		command_header.SetByte(apdu.cls() | controlByte, 0);
-		BUF_MEM *memCommandHeader = bufMemFromByteArray(command_header);
-		BUF_MEM *memPaddedCommandHeader = EAC_add_iso_pad(m_ctx, memCommandHeader);
-		CByteArray paddedCommandHeader = arrayFromBufMem(memPaddedCommandHeader);
-		inputForMac.Append(paddedCommandHeader);
+		CByteArray protectedAPDU;
+		CByteArray header = apdu.getHeader();
+		CByteArray data = apdu.data();
 		CByteArray le = apdu.getLe(true);
 
-		bool isInsOdd = apdu.ins() & 1;
-
-		EAC_increment_ssc(m_ctx);
-
-		if (le.Size() >= 0) {
-			{
-				TlvLe.Append((unsigned char)Tle);
-				TlvLe.Append((unsigned char)le.Size());
-				TlvLe.Append(le);
-			}
-		}
-		CByteArray paddedCryptogram;
-		int lc_final = 0;
-		if (apdu.dataExists()) {
-			BUF_MEM *memInputData = bufMemFromByteArray(apdu.data());
-			BUF_MEM *paddedMemInputData = EAC_add_iso_pad(m_ctx, memInputData);
-			BUF_MEM *memEncryptedInput = EAC_encrypt(m_ctx, paddedMemInputData);
-			encryptedInput = arrayFromBufMem(memEncryptedInput);
-
-			lcg = memEncryptedInput->length + (isInsOdd ? 0 : 1);
-			paddedCryptogram.Append(isInsOdd ? TcgOdd : Tcg);
-			paddedCryptogram.Append((unsigned char)lcg);
-			if (!isInsOdd)
-				paddedCryptogram.Append(paddingIndicator);
-
-			paddedCryptogram.Append(encryptedInput);
-
-			if (memInputData != NULL)
-				BUF_MEM_clear_free(memInputData);
-			if (paddedMemInputData != NULL)
-				BUF_MEM_clear_free(paddedMemInputData);
-			if (memEncryptedInput != NULL)
-				BUF_MEM_clear_free(memEncryptedInput);
-		}
-		if (TlvLe.Size() > 0)
-			paddedCryptogram.Append(TlvLe);
-
-		BUF_MEM *memCryptogram = bufMemFromByteArray(paddedCryptogram);
-		BUF_MEM *finalToEncrypt = EAC_add_iso_pad(m_ctx, memCryptogram);
-		inputForMac.Append(arrayFromBufMem(finalToEncrypt));
+		if (!m_codec.wrap(header.GetBytes(), data.GetBytes(), data.Size(), le.GetBytes(), le.Size(), true,
+						  apdu.isExtended(), protectedAPDU))
+			throw CMWEXCEPTION(EIDMW_PACE_ERR_UNKNOWN);
 
-		BUF_MEM *inputMac = bufMemFromByteArray(inputForMac);
-
-		BUF_MEM *memMac = EAC_authenticate(m_ctx, inputMac);
-		mac = arrayFromBufMem(memMac);
-
-		lc_final += mac.Size() + 2; // CG + Tcg + Lcg + PI
-		if (lcg > 0) {
-			lc_final += encryptedInput.Size() + 3 - (isInsOdd ? 1 : 0);
-		}
-		lc_final += TlvLe.Size();
-		encryptedAPDU.Append(command_header);
-		if (apdu.isExtended() && !apdu.dataExists() && apdu.getLe().Size() > 0) {
-			encryptedAPDU.Append(0x00);
-			encryptedAPDU.Append(0x00);
-		}
-		encryptedAPDU.Append(lc_final);
-		if (lcg > 0) {
-			encryptedAPDU.Append(isInsOdd ? TcgOdd : Tcg);
-			assert(lcg <= UCHAR_MAX);
-			encryptedAPDU.Append((unsigned char)lcg);
-			if (!isInsOdd)
-				encryptedAPDU.Append(paddingIndicator);
-			encryptedAPDU.Append(encryptedInput);
-		}
-
-		if (TlvLe.Size())
-			encryptedAPDU.Append(TlvLe);
-
-		encryptedAPDU.Append(Tcc);
-		assert(mac.Size() <= UCHAR_MAX);
-		encryptedAPDU.Append((unsigned char) mac.Size()); // Lcc
-		encryptedAPDU.Append(mac);
-		encryptedAPDU.Append(0x00);
-		if (apdu.isExtended())
-			encryptedAPDU.Append(0x00);
-
-		EAC_increment_ssc(m_ctx);
-
-		if (memMac != NULL)
-			BUF_MEM_clear_free(memMac);
-		if (inputMac != NULL)
-			BUF_MEM_clear_free(inputMac);
-		if (finalToEncrypt != NULL)
-			BUF_MEM_clear_free(finalToEncrypt);
-		if (memCryptogram != NULL)
-			BUF_MEM_clear_free(memCryptogram);
-		if (memPaddedCommandHeader != NULL)
-			BUF_MEM_clear_free(memPaddedCommandHeader);
-		if (memCommandHeader != NULL)
-			BUF_MEM_clear_free(memCommandHeader);
-		return encryptedAPDU;
+		return protectedAPDU;
 	}
 
 	void setAuthentication(const char *secret, size_t secretLen, PaceSecretType secretType) {
 		if (m_secret) {
 			free((void *)m_secret);
+			m_codec.reset();
 			EAC_CTX_clear_free(m_ctx);
 			m_ctx = NULL;
 			EAC_cleanup();
@@ -619,7 +287,8 @@ public:
 	}
 
 	CByteArray sendAPDU(const APDU &apdu, SCARDHANDLE &hCard, long &lRetVal, const void *param_structure) {
-		if (m_ctx == NULL) {
+		std::lock_guard<std::mutex> guard(m_mutex);
+		if (m_ctx == NULL || !m_codec.isReady()) {
 			throw CMWEXCEPTION(EIDMW_PACE_ERR_NOT_INITIALIZED);
 		}
 		CByteArray encryptedAPDU = formatAPDU(apdu);
@@ -629,6 +298,7 @@ public:
 	}
 
 	~PaceAuthenticationImpl() {
+		m_codec.reset();
 		free(m_secret);
 		if (m_ctx) {
 			EAC_CTX_clear_free(m_ctx);
@@ -643,6 +313,7 @@ private:
 	friend class PaceAuthentication;
 	CContext *m_context;
 	EAC_CTX *m_ctx;
+	SecureMessagingCodec m_codec;
 	std::mutex m_mutex;
 };
 
@@ -39,6 +39,12 @@ namespace eIDMW {
 CPinpad::CPinpad(CContext *poContext, const std::string &csReader) {
 	m_poContext = poContext;
 	m_csReader = csReader;
+	m_bCanVerifyUnlock = false;
+	m_bCanChangeUnlock = false;
+	m_bFeaturesValid = false;
+	m_ioctlVerifyStart = m_ioctlVerifyFinish = m_ioctlVerifyDirect = 0;
+	m_ioctlChangeStart = m_ioctlChangeFinish = m_ioctlChangeDirect = 0;
+	m_ioctlTlvProperties = 0;
 }
 
 // Factory method for Pinpad Implementations, detection is based on reader name
@@ -86,6 +92,9 @@ CByteArray CPinpad::PinpadControl(unsigned long ulControl, const CByteArray &oCm
 		ioctl = 256 * (256 * ((256 * feature[2]) + feature[3]) + feature[4]) + feature[5];
 
 void CPinpad::GetFeatureList() {
+	if (m_bFeaturesValid)
+		return;
+
 	m_bCanVerifyUnlock = false;
 	m_bCanChangeUnlock = false;
 	int properties_in_tlv_ioctl = 0;
@@ -117,6 +126,7 @@ void CPinpad::GetFeatureList() {
 			m_bCanVerifyUnlock = (m_ioctlVerifyStart && m_ioctlVerifyFinish) || m_ioctlVerifyDirect;
 			m_bCanChangeUnlock = (m_ioctlChangeStart && m_ioctlChangeFinish) || m_ioctlChangeDirect;
 		}
+		m_bFeaturesValid = true;
 	} catch (const CMWException &e) {
 		// very likely CCID_IOCTL_GET_FEATURE_REQUEST isn't supported
 		// by this reader -> nothing to do
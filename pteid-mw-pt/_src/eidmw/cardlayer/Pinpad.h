@@ -48,6 +48,8 @@ public:
 
 	bool UsePinpad();
 	void Init(SCARDHANDLE hCard);
+	/** Forget the cached feature list, it will be queried again on the next UsePinpad() */
+	void InvalidateFeatures() { m_bFeaturesValid = false; }
 	int getTlvPropertiesIoctl() { return m_ioctlTlvProperties; }
 	GenericPinpad *getPinpadHandler();
 
@@ -63,6 +65,7 @@ protected:
 
 	bool m_bCanVerifyUnlock; // Can do operations with 1 PIN
 	bool m_bCanChangeUnlock; // Can do operations with 2 PINs
+	bool m_bFeaturesValid;	 // The feature list doesn't change while the reader stays connected
 
 	unsigned long m_ioctlVerifyStart;
 	unsigned long m_ioctlVerifyFinish;
@@ -55,6 +55,8 @@ CReader::CReader(const std::string &csReader, CContext *poContext)
 	m_poCard = NULL;
 	m_bIgnoreRemoval = false;
 	m_oPinpad = new CPinpad(m_poContext, m_csReader);
+	m_bDeviceInfoValid = false;
+	m_deviceInfo = ReaderDeviceInfo();
 }
 
 CReader::~CReader(void) {
@@ -86,6 +88,10 @@ void CReader::StopEventCallback(unsigned long ulHandle) {
 	MWLOG(LEV_INFO, MOD_CAL, L"    Stopped event callback thread %d", ulHandle);
 }
 
+void CReader::StartPresenceWatcher() { m_poContext->m_poPresenceWatcher->Watch(m_csReader); }
+
+unsigned long CReader::GetPresenceGeneration() { return m_poContext->m_poPresenceWatcher->GetGeneration(m_csReader); }
+
 // Use for logging in Status()
 static const inline wchar_t *Status2String(tCardStatus status) {
 	switch (status) {
@@ -208,6 +214,39 @@ void CReader::readerDeviceInfo(SCARDHANDLE hCard, ReaderDeviceInfo *deviceInfo,
 	}
 }
 
+/* The device info is only queried on the first connection to this reader: on Windows the SetupAPI enumeration
+   and on other platforms the TLV properties IOCTL are slow and the result only changes if the reader is replaced */
+void CReader::logReaderDevice() {
+	if (!m_bDeviceInfoValid) {
+#ifdef WIN32
+		// Get info on all connected readers using Win32 SetupAPI as TLV Properties Control command is not available for
+		// all readers
+		std::vector<ReaderDeviceInfo> readerDevices = win32ReaderDevices();
+		for (auto dev : readerDevices) {
+			MWLOG(LEV_INFO, MOD_CAL, "Windows reader: %s %s (vendorID: %04x, productID: %04x) Driver: %s",
+				  dev.manufacturer.c_str(), dev.name.c_str(), dev.vendorID, dev.productID, dev.driver.c_str());
+		}
+#else
+		readerDeviceInfo(m_poCard->m_hCard, &m_deviceInfo, m_oPinpad->getTlvPropertiesIoctl());
+#endif
+		m_bDeviceInfoValid = true;
+	}
+
+#ifdef WIN32
+	MWLOG(LEV_INFO, MOD_CAL, L" Connected to %ls card in reader %ls", Type2String(m_poCard->GetType()),
+		  m_wsReader.c_str());
+#else
+	MWLOG(LEV_INFO, MOD_CAL, L" Connected to %ls card in reader %ls (vendorID: %04x, productID: %04x)",
+		  Type2String(m_poCard->GetType()), m_wsReader.c_str(), m_deviceInfo.vendorID, m_deviceInfo.productID);
+#endif
+}
+
+void CReader::InvalidateCapabilities() {
+	m_bDeviceInfoValid = false;
+	m_deviceInfo = ReaderDeviceInfo();
+	m_oPinpad->InvalidateFeatures();
+}
+
 void CReader::UseHandle(SCARDHANDLE hCard) {
 	if (m_poCard) {
 		// reset last application incase card was reset
@@ -237,22 +276,7 @@ bool CReader::Connect(SCARDHANDLE hCard, DWORD protocol) {
 		} else
 			MWLOG(LEV_DEBUG, MOD_CAL, L"Using non-pinpad reader. pinpadEnabled=%ld", pinpadEnabled);
 
-#ifdef WIN32
-		// Get info on all connected readers using Win32 SetupAPI as TLV Properties Control command is not available for
-		// all readers
-		std::vector<ReaderDeviceInfo> readerDevices = win32ReaderDevices();
-		for (auto dev : readerDevices) {
-			MWLOG(LEV_INFO, MOD_CAL, "Windows reader: %s %s (vendorID: %04x, productID: %04x) Driver: %s",
-				  dev.manufacturer.c_str(), dev.name.c_str(), dev.vendorID, dev.productID, dev.driver.c_str());
-		}
-		MWLOG(LEV_INFO, MOD_CAL, L" Connected to %ls card in reader %ls", Type2String(m_poCard->GetType()),
-			  m_wsReader.c_str());
-#else
-		ReaderDeviceInfo device_info = {0};
-		readerDeviceInfo(m_poCard->m_hCard, &device_info, m_oPinpad->getTlvPropertiesIoctl());
-		MWLOG(LEV_INFO, MOD_CAL, L" Connected to %ls card in reader %ls (vendorID: %04x, productID: %04x)",
-			  Type2String(m_poCard->GetType()), m_wsReader.c_str(), device_info.vendorID, device_info.productID);
-#endif
+		logReaderDevice();
 	}
 
 	return true;
@@ -278,22 +302,7 @@ bool CReader::Connect() {
 		} else
 			MWLOG(LEV_DEBUG, MOD_CAL, L"Using non-pinpad reader. pinpadEnabled=%ld", pinpadEnabled);
 
-#ifdef WIN32
-		// Get info on all connected readers using Win32 SetupAPI as TLV Properties Control command is not available for
-		// all readers
-		std::vector<ReaderDeviceInfo> readerDevices = win32ReaderDevices();
-		for (auto dev : readerDevices) {
-			MWLOG(LEV_INFO, MOD_CAL, "Windows reader: %s %s (vendorID: %04x, productID: %04x) Driver: %s",
-				  dev.manufacturer.c_str(), dev.name.c_str(), dev.vendorID, dev.productID, dev.driver.c_str());
-		}
-		MWLOG(LEV_INFO, MOD_CAL, L" Connected to %ls card in reader %ls", Type2String(m_poCard->GetType()),
-			  m_wsReader.c_str());
-#else
-		ReaderDeviceInfo device_info = {0};
-		readerDeviceInfo(m_poCard->m_hCard, &device_info, m_oPinpad->getTlvPropertiesIoctl());
-		MWLOG(LEV_INFO, MOD_CAL, L" Connected to %ls card in reader %ls (vendorID: %04x, productID: %04x)",
-			  Type2String(m_poCard->GetType()), m_wsReader.c_str(), device_info.vendorID, device_info.productID);
-#endif
+		logReaderDevice();
 	}
 
 	return m_poCard != NULL;
@@ -26,6 +26,7 @@
 
 #include "PKCS15.h"
 #include "Pinpad.h"
+#include "ReaderDeviceInfo.h"
 #include "Hash.h"
 
 namespace eIDMW {
@@ -53,6 +54,14 @@ public:
 	/** To tell that the callbacks are not longer needed. */
 	void StopEventCallback(unsigned long ulHandle);
 
+	/** Start following card insertions/removals in this reader in the background thread
+	 * shared by all readers; it's safe to call this function multiple times. */
+	void StartPresenceWatcher();
+	/** Incremented each time a card is inserted in or removed from this reader,
+	 * 0 if the reader isn't being watched (see StartPresenceWatcher()).
+	 * If it didn't change, Status() would return the same as in the last call. */
+	unsigned long GetPresenceGeneration();
+
 	/**
 	 * Get the status w.r.t. a card being present in the reader
 	 * \retval #CARD_INSERTED      a card has been inserted
@@ -186,6 +195,11 @@ private:
 	CReader &operator=(const CReader &oReader);
 
 	void readerDeviceInfo(SCARDHANDLE hCard, ReaderDeviceInfo *deviceInfo, int ioctl_get_features);
+	void logReaderDevice();
+
+	/** Called by CCardLayer when the reader is no longer listed by PCSC so that a different device
+	 * that shows up later with the same name doesn't reuse the cached capabilities */
+	void InvalidateCapabilities();
 
 	bool m_bIgnoreRemoval;
 	std::string m_csReader;
@@ -194,6 +208,8 @@ private:
 	CPKCS15 m_oPKCS15;
 	CPinpad *m_oPinpad;
 	bool m_isContactless;
+	ReaderDeviceInfo m_deviceInfo;
+	bool m_bDeviceInfoValid;
 
 	friend class CCardLayer; // calls the CReader constructor
 
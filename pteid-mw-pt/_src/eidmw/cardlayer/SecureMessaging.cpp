@@ -0,0 +1,326 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+
+#include "SecureMessaging.h"
+#include "Log.h"
+
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
+#include <openssl/opensslv.h>
+#include <openssl/params.h>
+
+#include <climits>
+#include <cstring>
+
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+#error "Secure messaging needs the EVP_MAC API of OpenSSL 3.0 or later"
+#endif
+
+namespace eIDMW {
+
+static const EVP_CIPHER *aesCipher(size_t keyLength, bool cbc) {
+	switch (keyLength) {
+	case 16:
+		return cbc ? EVP_aes_128_cbc() : EVP_aes_128_ecb();
+	case 24:
+		return cbc ? EVP_aes_192_cbc() : EVP_aes_192_ecb();
+	case 32:
+		return cbc ? EVP_aes_256_cbc() : EVP_aes_256_ecb();
+	default:
+		return NULL;
+	}
+}
+
+static const char *aesCipherName(size_t keyLength) {
+	switch (keyLength) {
+	case 16:
+		return "AES-128-CBC";
+	case 24:
+		return "AES-192-CBC";
+	case 32:
+		return "AES-256-CBC";
+	default:
+		return NULL;
+	}
+}
+
+// ISO/IEC 9797-1 padding method 2
+static void addPadding(std::vector<unsigned char> &buffer, size_t blockSize) {
+	buffer.push_back(0x80);
+	while (buffer.size() % blockSize)
+		buffer.push_back(0x00);
+}
+
+static void appendLength(std::vector<unsigned char> &buffer, size_t len) {
+	if (len > 0xFF) {
+		buffer.push_back(0x82);
+		buffer.push_back((unsigned char)(len >> 8));
+	} else if (len > 0x7F) {
+		buffer.push_back(0x81);
+	}
+	buffer.push_back((unsigned char)len);
+}
+
+static bool parseLength(const unsigned char *buffer, size_t bufferLen, size_t &pos, size_t &len) {
+	if (pos >= bufferLen)
+		return false;
+
+	unsigned char first = buffer[pos++];
+	if (first < 0x80) {
+		len = first;
+	} else if (first == 0x81 && pos + 1 <= bufferLen) {
+		len = buffer[pos++];
+	} else if (first == 0x82 && pos + 2 <= bufferLen) {
+		len = (buffer[pos] << 8) | buffer[pos + 1];
+		pos += 2;
+	} else {
+		return false;
+	}
+
+	return len <= bufferLen - pos;
+}
+
+SecureMessagingCodec::SecureMessagingCodec()
+	: m_ivCtx(NULL), m_encCtx(NULL), m_decCtx(NULL), m_mac(NULL), m_macCtx(NULL) {
+	memset(m_ssc, 0, sizeof(m_ssc));
+}
+
+SecureMessagingCodec::~SecureMessagingCodec() { reset(); }
+
+void SecureMessagingCodec::reset() {
+	EVP_CIPHER_CTX_free(m_ivCtx);
+	EVP_CIPHER_CTX_free(m_encCtx);
+	EVP_CIPHER_CTX_free(m_decCtx);
+	EVP_MAC_CTX_free(m_macCtx);
+	EVP_MAC_free(m_mac);
+	m_ivCtx = m_encCtx = m_decCtx = NULL;
+	m_macCtx = NULL;
+	m_mac = NULL;
+	memset(m_ssc, 0, sizeof(m_ssc));
+	OPENSSL_cleanse(m_plain.data(), m_plain.size());
+	m_plain.clear();
+}
+
+bool SecureMessagingCodec::init(const unsigned char *kEnc, size_t kEncLen, const unsigned char *kMac,
+								size_t kMacLen) {
+	reset();
+	const EVP_CIPHER *ecb = aesCipher(kEncLen, false);
+	const EVP_CIPHER *cbc = aesCipher(kEncLen, true);
+	const char *macCipher = aesCipherName(kMacLen);
+	if (!kEnc || !kMac || !ecb || !cbc || !macCipher) {
+		MWLOG(LEV_ERROR, MOD_CAL, "Secure messaging: unsupported session key length");
+		return false;
+	}
+
+	m_ivCtx = EVP_CIPHER_CTX_new();
+	m_encCtx = EVP_CIPHER_CTX_new();
+	m_decCtx = EVP_CIPHER_CTX_new();
+	m_mac = EVP_MAC_fetch(NULL, OSSL_MAC_NAME_CMAC, NULL);
+	m_macCtx = m_mac ? EVP_MAC_CTX_new(m_mac) : NULL;
+
+	OSSL_PARAM params[] = {OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_CIPHER, (char *)macCipher, 0),
+						   OSSL_PARAM_construct_end()};
+
+	if (!m_ivCtx || !m_encCtx || !m_decCtx || !m_macCtx || !EVP_EncryptInit_ex(m_ivCtx, ecb, NULL, kEnc, NULL) ||
+		!EVP_CIPHER_CTX_set_padding(m_ivCtx, 0) || !EVP_EncryptInit_ex(m_encCtx, cbc, NULL, kEnc, NULL) ||
+		!EVP_CIPHER_CTX_set_padding(m_encCtx, 0) || !EVP_DecryptInit_ex(m_decCtx, cbc, NULL, kEnc, NULL) ||
+		!EVP_CIPHER_CTX_set_padding(m_decCtx, 0) || !EVP_MAC_init(m_macCtx, kMac, kMacLen, params)) {
+		MWLOG(LEV_ERROR, MOD_CAL, "Secure messaging: failed to initialize cipher/MAC contexts");
+		reset();
+		return false;
+	}
+
+	m_macInput.reserve(512);
+	m_plain.reserve(512);
+	return true;
+}
+
+void SecureMessagingCodec::incrementSSC() {
+	for (int i = blockSize - 1; i >= 0; i--) {
+		if (++m_ssc[i] != 0)
+			break;
+	}
+}
+
+bool SecureMessagingCodec::wrap(const unsigned char *header, const unsigned char *data, size_t dataLen,
+								const unsigned char *le, size_t leLen, bool includeLe, bool extended,
+								CByteArray &protectedAPDU) {
+	bool isInsOdd = header[1] & 1;
+
+	// Pre-increment SSC
+	incrementSSC();
+
+	m_macInput.clear();
+	m_macInput.push_back(header[0] | controlByte);
+	m_macInput.insert(m_macInput.end(), header + 1, header + 4);
+	addPadding(m_macInput, blockSize);
+	size_t dosStart = m_macInput.size();
+
+	if (dataLen > 0) {
+		m_plain.assign(data, data + dataLen);
+		addPadding(m_plain, blockSize);
+
+		// LCg = Len(Cg) + Len(PI = 1)
+		size_t cryptogramStart;
+		m_macInput.push_back(isInsOdd ? TcgOdd : Tcg);
+		appendLength(m_macInput, m_plain.size() + (isInsOdd ? 0 : 1));
+		if (!isInsOdd)
+			m_macInput.push_back(paddingIndicator);
+		cryptogramStart = m_macInput.size();
+		m_macInput.resize(cryptogramStart + m_plain.size());
+
+		if (!cbcCrypt(m_encCtx, m_plain.data(), m_plain.size(), &m_macInput[cryptogramStart]))
+			return false;
+	}
+
+	if (includeLe) {
+		m_macInput.push_back(Tle);
+		appendLength(m_macInput, leLen);
+		m_macInput.insert(m_macInput.end(), le, le + leLen);
+	}
+	// Without data objects the MAC covers the padded header only
+	size_t dosEnd = m_macInput.size();
+	if (dosEnd > dosStart)
+		addPadding(m_macInput, blockSize);
+
+	unsigned char mac[EVP_MAX_BLOCK_LENGTH];
+	if (!computeMac(m_macInput.data(), m_macInput.size(), mac))
+		return false;
+
+	size_t lcFinal = (dosEnd - dosStart) + 2 + macLength;
+	if (lcFinal > (extended ? 0xFFFF : UCHAR_MAX)) {
+		MWLOG(LEV_ERROR, MOD_CAL, "Secure messaging: command data too long (%lu)", (unsigned long)lcFinal);
+		return false;
+	}
+
+	protectedAPDU = CByteArray((unsigned long)(4 + 3 + lcFinal + 2));
+	protectedAPDU.Append(&m_macInput[0], 4);
+	if (extended) {
+		protectedAPDU.Append(0x00);
+		protectedAPDU.Append((unsigned char)(lcFinal >> 8));
+	}
+	protectedAPDU.Append((unsigned char)lcFinal);
+	protectedAPDU.Append(&m_macInput[dosStart], (unsigned long)(dosEnd - dosStart));
+	protectedAPDU.Append(Tcc);
+	protectedAPDU.Append((unsigned char)macLength); // Lcc
+	protectedAPDU.Append(mac, macLength);
+	protectedAPDU.Append(0x00);
+	if (extended)
+		protectedAPDU.Append(0x00);
+
+	incrementSSC();
+	return true;
+}
+
+bool SecureMessagingCodec::unwrap(const CByteArray &response, CByteArray &plainResponse) {
+	if (response.Size() < 2)
+		return false;
+
+	const unsigned char *resp = response.GetBytes();
+	size_t bodyLen = response.Size() - 2;
+	const unsigned char *cryptogram = NULL, *statusWord = resp + bodyLen, *mac = NULL;
+	size_t cryptogramLen = 0, macDOStart = 0;
+	bool isOdd = false;
+
+	size_t pos = 0;
+	while (pos < bodyLen && mac == NULL) {
+		size_t doStart = pos;
+		unsigned char tag = resp[pos++];
+		size_t len = 0;
+		if (!parseLength(resp, bodyLen, pos, len))
+			return false;
+
+		const unsigned char *value = resp + pos;
+		pos += len;
+
+		switch (tag) {
+		case Tcg:
+		case TcgOdd:
+			isOdd = tag == TcgOdd;
+			// first byte of an encrypted message is padding indicator unless odd INS
+			if (!isOdd && (len == 0 || value[0] != paddingIndicator))
+				return false;
+			cryptogram = isOdd ? value : value + 1;
+			cryptogramLen = isOdd ? len : len - 1;
+			break;
+		case Tsw:
+			if (len != 2)
+				return false;
+			statusWord = value;
+			break;
+		case Tcc:
+			if (len != macLength)
+				return false;
+			mac = value;
+			macDOStart = doStart;
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (mac == NULL)
+		return false;
+
+	m_macInput.assign(resp, resp + macDOStart);
+	addPadding(m_macInput, blockSize);
+
+	unsigned char computedMac[EVP_MAX_BLOCK_LENGTH];
+	if (!computeMac(m_macInput.data(), m_macInput.size(), computedMac) ||
+		CRYPTO_memcmp(computedMac, mac, macLength) != 0)
+		return false;
+
+	plainResponse = CByteArray((unsigned long)(cryptogramLen + 2));
+	if (cryptogram != NULL) {
+		if (cryptogramLen == 0 || cryptogramLen % blockSize != 0)
+			return false;
+
+		m_plain.resize(cryptogramLen);
+		if (!cbcCrypt(m_decCtx, cryptogram, cryptogramLen, m_plain.data()))
+			return false;
+
+		size_t plainLen = cryptogramLen;
+		while (plainLen > 0 && m_plain[plainLen - 1] == 0x00)
+			plainLen--;
+		if (plainLen == 0 || m_plain[plainLen - 1] != 0x80)
+			return false;
+
+		plainResponse.Append(m_plain.data(), (unsigned long)(plainLen - 1));
+		OPENSSL_cleanse(m_plain.data(), m_plain.size());
+	}
+	plainResponse.Append(statusWord, 2);
+
+	return true;
+}
+
+// AES-CBC with IV = E(KSenc, SSC), the context keeps the key schedule of the session key
+bool SecureMessagingCodec::cbcCrypt(EVP_CIPHER_CTX *ctx, const unsigned char *in, size_t inLen, unsigned char *out) {
+	unsigned char iv[blockSize];
+	int outLen = 0;
+	if (!EVP_EncryptUpdate(m_ivCtx, iv, &outLen, m_ssc, blockSize) || outLen != blockSize ||
+		!EVP_CipherInit_ex(ctx, NULL, NULL, NULL, iv, -1) || !EVP_CipherUpdate(ctx, out, &outLen, in, (int)inLen) ||
+		(size_t)outLen != inLen) {
+		MWLOG(LEV_ERROR, MOD_CAL, "Secure messaging: cipher operation failed");
+		return false;
+	}
+	return true;
+}
+
+// AES-CMAC over SSC || input, truncated to macLength bytes
+bool SecureMessagingCodec::computeMac(const unsigned char *in, size_t inLen, unsigned char *mac) {
+	size_t outLen = 0;
+	if (!EVP_MAC_init(m_macCtx, NULL, 0, NULL) || !EVP_MAC_update(m_macCtx, m_ssc, blockSize) ||
+		!EVP_MAC_update(m_macCtx, in, inLen) || !EVP_MAC_final(m_macCtx, mac, &outLen, EVP_MAX_BLOCK_LENGTH) ||
+		outLen < macLength) {
+		MWLOG(LEV_ERROR, MOD_CAL, "Secure messaging: MAC computation failed");
+		return false;
+	}
+	return true;
+}
+
+} // namespace eIDMW
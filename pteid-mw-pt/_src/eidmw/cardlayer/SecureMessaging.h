@@ -0,0 +1,95 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/**
+ * Secure messaging codec (ICAO 9303 / BSI TR-03110) for the AES session established by PACE.
+ * The cipher and CMAC contexts are created once from the session keys and kept for the whole
+ * session, re-initialized only with a new IV for each APDU. The scratch buffers are reused
+ * between APDUs so wrapping/unwrapping doesn't allocate after the first few commands.
+ *
+ * The send sequence counter starts at 0 after init() and is incremented before each command and
+ * after it, so a response is unwrapped with the counter of its command + 1.
+ *
+ * Needs the EVP_MAC API of OpenSSL 3.0 or later.
+ */
+#pragma once
+
+#include "ByteArray.h"
+#include "Export.h"
+
+#include <openssl/evp.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace eIDMW {
+
+class EIDMW_CAL_API SecureMessagingCodec {
+public:
+	enum : unsigned char {
+		Tcg = 0x87,
+		TcgOdd = 0x85,
+		Tcc = 0x8E,
+		Tle = 0x97,
+		Tsw = 0x99,
+		paddingIndicator = 0x01,
+		controlByte = 0x0C
+	};
+	enum { macLength = 8 };
+
+	SecureMessagingCodec();
+	~SecureMessagingCodec();
+
+	bool isReady() const { return m_macCtx != NULL; }
+
+	void reset();
+
+	/* AES session keys KSenc and KSmac of 16, 24 or 32 bytes, the send sequence counter is reset to 0 */
+	bool init(const unsigned char *kEnc, size_t kEncLen, const unsigned char *kMac, size_t kMacLen);
+
+	/*
+		Builds the protected command for header (CLA INS P1 P2), command data and Le.
+		DO'97 is included if includeLe is set even if le is empty, as some callers always send it.
+		Extended commands get a 3-byte Lc and a 2-byte Le.
+	*/
+	bool wrap(const unsigned char *header, const unsigned char *data, size_t dataLen, const unsigned char *le,
+			  size_t leLen, bool includeLe, bool extended, CByteArray &protectedAPDU);
+
+	/*
+		Verifies and decrypts a protected response: [DO'87|DO'85] [DO'99] DO'8E SW1 SW2.
+		Returns the plain response data followed by the status word.
+	*/
+	bool unwrap(const CByteArray &response, CByteArray &plainResponse);
+
+private:
+	enum { blockSize = 16 };
+
+	SecureMessagingCodec(const SecureMessagingCodec &);
+	SecureMessagingCodec &operator=(const SecureMessagingCodec &);
+
+	void incrementSSC();
+	bool cbcCrypt(EVP_CIPHER_CTX *ctx, const unsigned char *in, size_t inLen, unsigned char *out);
+	bool computeMac(const unsigned char *in, size_t inLen, unsigned char *mac);
+
+	unsigned char m_ssc[blockSize];
+	EVP_CIPHER_CTX *m_ivCtx;
+	EVP_CIPHER_CTX *m_encCtx;
+	EVP_CIPHER_CTX *m_decCtx;
+	EVP_MAC *m_mac;
+	EVP_MAC_CTX *m_macCtx;
+#ifdef WIN32
+#pragma warning(push)
+#pragma warning(disable : 4251)
+#endif
+	std::vector<unsigned char> m_macInput;
+	std::vector<unsigned char> m_plain;
+#ifdef WIN32
+#pragma warning(pop)
+#endif
+};
+
+} // namespace eIDMW
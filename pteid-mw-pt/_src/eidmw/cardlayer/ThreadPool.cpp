@@ -20,12 +20,21 @@
 
 **************************************************************************** */
 #include "ThreadPool.h"
+#include "Log.h"
+#include "Util.h"
+
+#include <vector>
 
 using namespace eIDMW;
 
 static bool g_bStop = true;
 
 #define MAX_THREAD_WAIT_LOOP 100
+// SCardGetStatusChange() timeout of CCardPresenceWatcher, it's interrupted with SCardCancel() when
+// readers are added or the watcher is stopped so this only bounds the wait with the virtual reader
+#define PRESENCE_WATCH_TIMEOUT 2000
+// StopWatching() gives up after 2.5 times the timeout rather than blocking the caller
+#define PRESENCE_STOP_WAIT_LOOPS 500
 
 CEventCallbackThread::CEventCallbackThread() {}
 
@@ -77,6 +86,163 @@ bool CEventCallbackThread::HasStopped() { return !m_bRunning; }
 
 ////////////////////////////////////////////////////////////////
 
+CCardPresenceWatcher::CCardPresenceWatcher() : m_bStop(false), m_bReadersAdded(false), m_hContext(0) {}
+
+void CCardPresenceWatcher::Watch(const std::string &csReader) {
+	CAutoMutex oAutoMutex(&m_mutex);
+
+	if (m_bStop || m_readers.count(csReader) != 0 || m_readers.size() >= MAX_READERS)
+		return;
+
+	tWatchedReader tReader = {0, 0, 0};
+	m_readers[csReader] = tReader;
+	m_bReadersAdded = true;
+
+	if (m_hContext != 0) {
+		// Wake up the loop so that it waits on the new reader too
+		SCardCancel(m_hContext);
+	} else if (!IsRunning() && Start() != 0) {
+		MWLOG(LEV_WARN, MOD_CAL, L"    Couldn't start card presence watcher");
+		m_readers.clear();
+	}
+}
+
+unsigned long CCardPresenceWatcher::GetGeneration(const std::string &csReader) {
+	CAutoMutex oAutoMutex(&m_mutex);
+
+	std::map<std::string, tWatchedReader>::const_iterator it = m_readers.find(csReader);
+	return it != m_readers.end() ? it->second.ulGeneration : 0;
+}
+
+bool CCardPresenceWatcher::StopWatching() {
+	{
+		CAutoMutex oAutoMutex(&m_mutex);
+		m_bStop = true;
+		if (m_hContext != 0)
+			SCardCancel(m_hContext);
+	}
+
+	for (int i = 0; i < PRESENCE_STOP_WAIT_LOOPS && IsRunning(); i++)
+		CThread::SleepMillisecs(MAX_THREAD_WAIT_LOOP / 10);
+
+	return !IsRunning();
+}
+
+void CCardPresenceWatcher::Run() {
+	while (true) {
+		bool bIdle;
+		{
+			CAutoMutex oAutoMutex(&m_mutex);
+			if (m_bStop)
+				break;
+			bIdle = m_readers.empty();
+		}
+
+		// The readers are dropped after a PCSC error, Watch() adds them back
+		if (bIdle) {
+			CThread::SleepMillisecs(MAX_THREAD_WAIT_LOOP);
+			continue;
+		}
+
+		try {
+			CPCSC t_pcsc_context;
+			t_pcsc_context.EstablishContext();
+			WatchReaders(t_pcsc_context);
+		} catch (const CMWException &e) {
+			MWLOG(LEV_DEBUG, MOD_CAL, L"Card presence watcher stopped: 0x%0x", e.GetError());
+		} catch (...) {
+		}
+
+		CAutoMutex oAutoMutex(&m_mutex);
+		m_hContext = 0;
+		m_readers.clear();
+	}
+}
+
+/* Only insertions and removals count, not the other changes such as SCARD_STATE_INUSE.
+ * A card swapped between two SCardGetStatusChange() calls leaves the reader PRESENT, so the
+ * event counter that PCSC increments on each insertion and removal is compared too. Readers
+ * whose counter stays 0 don't support it: a SCARD_STATE_CHANGED that isn't only a change of
+ * the INUSE/EXCLUSIVE/UNPOWERED flags is taken as a card event. */
+bool CCardPresenceWatcher::IsCardEvent(const tReaderInfo &tInfo, const tWatchedReader &tReader,
+									   unsigned long ulPresence, unsigned long ulEvents) {
+	if (ulPresence != tReader.ulPresence)
+		return true;
+	if (ulEvents != 0 || tReader.ulEvents != 0)
+		return ulEvents != tReader.ulEvents;
+	if ((tInfo.ulEventState & SCARD_STATE_CHANGED) == 0 || ulPresence != SCARD_STATE_PRESENT)
+		return false;
+
+	unsigned long ulDiff = (tInfo.ulCurrentState ^ tInfo.ulEventState) & 0xFFFF & ~SCARD_STATE_CHANGED;
+	return ulDiff == 0 || (ulDiff & ~(SCARD_STATE_INUSE | SCARD_STATE_EXCLUSIVE | SCARD_STATE_UNPOWERED)) != 0;
+}
+
+void CCardPresenceWatcher::WatchReaders(CPCSC &oPCSC) {
+	std::vector<tReaderInfo> tInfos;
+
+	{
+		CAutoMutex oAutoMutex(&m_mutex);
+		m_hContext = oPCSC.GetContext();
+	}
+
+	while (true) {
+		{
+			CAutoMutex oAutoMutex(&m_mutex);
+			if (m_bStop)
+				break;
+
+			// ulEventState = 0 (SCARD_STATE_UNAWARE): the new readers' current state is returned immediately
+			std::map<std::string, tWatchedReader>::const_iterator it;
+			for (it = m_readers.begin(); it != m_readers.end(); it++) {
+				size_t i = 0;
+				while (i < tInfos.size() && tInfos[i].csReader != it->first)
+					i++;
+				if (i == tInfos.size()) {
+					tReaderInfo tInfo = {it->first, 0, 0};
+					tInfos.push_back(tInfo);
+				}
+			}
+			m_bReadersAdded = false;
+		}
+
+		bool bChanged;
+		try {
+			bChanged = oPCSC.GetStatusChange(PRESENCE_WATCH_TIMEOUT, &tInfos[0], (unsigned long)tInfos.size());
+		} catch (const CMWException &) {
+			// Interrupted by SCardCancel() from Watch() or StopWatching()
+			CAutoMutex oAutoMutex(&m_mutex);
+			if (m_bStop || m_bReadersAdded)
+				continue;
+			m_hContext = 0;
+			throw;
+		}
+
+		if (!bChanged)
+			continue;
+
+		CAutoMutex oAutoMutex(&m_mutex);
+		for (size_t i = 0; i < tInfos.size(); i++) {
+			unsigned long ulPresence = tInfos[i].ulEventState & (SCARD_STATE_PRESENT | SCARD_STATE_EMPTY);
+			unsigned long ulEvents = (tInfos[i].ulEventState >> 16) & 0xFFFF;
+			tWatchedReader &tReader = m_readers[tInfos[i].csReader];
+			if (ulPresence == 0)
+				continue;
+			if (!IsCardEvent(tInfos[i], tReader, ulPresence, ulEvents))
+				continue;
+
+			tReader.ulPresence = ulPresence;
+			tReader.ulEvents = ulEvents;
+			if (++tReader.ulGeneration == 0)
+				tReader.ulGeneration = 1;
+		}
+	}
+
+	CAutoMutex oAutoMutex(&m_mutex);
+	m_hContext = 0;
+}
+
+////////////////////////////////////////////////////////////////
+
 CThreadPool::CThreadPool() {
 	m_ulCurrentHandle = 0;
 	g_bStop = false;
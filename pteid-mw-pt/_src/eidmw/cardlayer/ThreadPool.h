@@ -55,6 +55,52 @@ private:
 	void *m_pvRef;
 };
 
+/** Thread that follows the state of all the watched readers with a single SCardGetStatusChange()
+ * loop and increments a per-reader generation counter each time a card is inserted or removed,
+ * so that callers can tell that nothing changed without any PCSC call of their own. */
+class EIDMW_CAL_API CCardPresenceWatcher : public CThread {
+public:
+	CCardPresenceWatcher();
+
+	void Run();
+
+	/** Add a reader to the loop, the thread is started by the first one; it's safe to call
+	 * this function multiple times for the same reader */
+	void Watch(const std::string &csReader);
+
+	/** 0 until the initial reader state is known, or if the reader isn't watched because the
+	 * loop stopped on a PCSC error (in which case the caller must check the card status itself) */
+	unsigned long GetGeneration(const std::string &csReader);
+
+	/** Interrupt the loop and wait a bounded time for the thread to end,
+	 * returns false if it's still running */
+	bool StopWatching();
+
+private:
+	struct tWatchedReader {
+		unsigned long ulPresence; // SCARD_STATE_PRESENT or SCARD_STATE_EMPTY, 0 until known
+		unsigned long ulEvents;	  // event counter of the reader state (upper 16 bits), 0 if not supported
+		unsigned long ulGeneration;
+	};
+
+	static bool IsCardEvent(const tReaderInfo &tInfo, const tWatchedReader &tReader, unsigned long ulPresence,
+							unsigned long ulEvents);
+	void WatchReaders(CPCSC &oPCSC);
+
+	CMutex m_mutex; // protects everything below
+	bool m_bStop;
+	bool m_bReadersAdded;
+	SCARDCONTEXT m_hContext; // context of the running loop, for SCardCancel()
+#ifdef WIN32
+#pragma warning(push)
+#pragma warning(disable : 4251)
+#endif
+	std::map<std::string, tWatchedReader> m_readers;
+#ifdef WIN32
+#pragma warning(pop)
+#endif
+};
+
 ////////////////////////////////////////////////////////////////
 
 class EIDMW_CAL_API CThreadPool {
@@ -0,0 +1,670 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+
+#ifdef PTEID_VIRTUAL_CARD
+
+#include "VirtualCard.h"
+#include "CardLayerConst.h"
+#include "Config.h"
+#include "Log.h"
+#include "Thread.h"
+#include "Util.h"
+
+#include <openssl/bio.h>
+#include <openssl/bn.h>
+#include <openssl/ecdsa.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <openssl/rsa.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+namespace eIDMW {
+
+// ATR of a PTEID IAS v4 card, used if atr.bin is not present
+static const unsigned char DEFAULT_ATR[] = {0x3B, 0x7D, 0x95, 0x00, 0x00, 0x80, 0x31, 0x80, 0x65,
+											0xB0, 0x83, 0x11, 0xC0, 0xA9, 0x83, 0x00, 0x90, 0x00};
+static const char DEFAULT_PIN[] = "1234";
+static const char APPLET_VERSION[] = "1.0.0.0";
+static const unsigned long PIN_MAX_TRIES = 3;
+static const unsigned long CPLC_LEN = 0x2D;
+static const unsigned long MAX_RESPONSE_LEN = 256;
+
+static CByteArray SW(unsigned long ulSW12) {
+	CByteArray oResp(2);
+	oResp.Append((unsigned char)(ulSW12 >> 8));
+	oResp.Append((unsigned char)(ulSW12 & 0xFF));
+	return oResp;
+}
+
+static std::string ToHex(const unsigned char *pucData, unsigned long ulLen) {
+	static const char HEX[] = "0123456789ABCDEF";
+	std::string csHex;
+	for (unsigned long i = 0; i < ulLen; i++) {
+		csHex += HEX[pucData[i] >> 4];
+		csHex += HEX[pucData[i] & 0x0F];
+	}
+	return csHex;
+}
+
+// IAS DFs have file IDs 3F00, 5FXX or DFXX
+static bool IsDFPath(const std::string &csPath) {
+	if (csPath == "3F00")
+		return true;
+	std::string csFID = csPath.substr(csPath.size() - 4);
+	return csFID.compare(0, 2, "5F") == 0 || csFID.compare(0, 2, "DF") == 0;
+}
+
+static const EVP_MD *DigestForAlgo(unsigned char ucAlgo) {
+	switch (ucAlgo >> 4) {
+	case 0x1:
+		return EVP_sha1();
+	case 0x4:
+		return EVP_sha256();
+	case 0x5:
+		return EVP_sha384();
+	case 0x6:
+		return EVP_sha512();
+	}
+	return NULL;
+}
+
+CVirtualCard *CVirtualCard::GetInstance() {
+	static CVirtualCard *instance = []() -> CVirtualCard * {
+		std::string csReplay =
+			utilStringNarrow(CConfig::GetString(CConfig::EIDMW_CONFIG_PARAM_GENERAL_APDU_REPLAY_FILE));
+		if (!csReplay.empty()) {
+			CVirtualCard *card = new CVirtualCard("", 0);
+			if (card->LoadReplay(csReplay))
+				return card;
+			delete card;
+		}
+
+		std::string csDirectory =
+			utilStringNarrow(CConfig::GetString(CConfig::EIDMW_CONFIG_PARAM_GENERAL_VIRTUAL_CARD_DIR));
+		if (csDirectory.empty())
+			return NULL;
+		return new CVirtualCard(csDirectory, CConfig::GetLong(CConfig::EIDMW_CONFIG_PARAM_GENERAL_VIRTUAL_CARD_LATENCY));
+	}();
+	return instance;
+}
+
+CVirtualCard::CVirtualCard(const std::string &csDirectory, unsigned long ulLatency)
+	: m_csDirectory(csDirectory), m_ulLatency(ulLatency), m_ucKeyRef(0), m_ucAlgo(0), m_bReplay(false),
+	  m_replayCursor(0) {
+	ResetStats();
+	Reset();
+	if (!csDirectory.empty())
+		MWLOG(LEV_INFO, MOD_CAL, "Virtual card enabled, files: %s latency per APDU: %lu ms", csDirectory.c_str(),
+			  ulLatency);
+}
+
+bool CVirtualCard::LoadReplay(const std::string &csTrace) {
+	CAutoMutex autoMutex(&m_mutex);
+
+	if (!ReadApduTrace(csTrace, m_replay))
+		return false;
+
+	m_bReplay = true;
+	m_replayCursor = 0;
+	MWLOG(LEV_INFO, MOD_CAL, "Virtual card replaying %lu records from %s", (unsigned long)m_replay.size(),
+		  csTrace.c_str());
+	return true;
+}
+
+CByteArray CVirtualCard::GetATR() {
+	CAutoMutex autoMutex(&m_mutex);
+
+	if (m_bReplay) {
+		for (size_t i = 0; i < m_replay.size(); i++) {
+			if (m_replay[i].ucType == APDU_TRACE_ATR)
+				return m_replay[i].oCommand;
+		}
+		return CByteArray(DEFAULT_ATR, sizeof(DEFAULT_ATR));
+	}
+
+	const CByteArray *poATR = GetFile("atr");
+	if (poATR != NULL)
+		return *poATR;
+	return CByteArray(DEFAULT_ATR, sizeof(DEFAULT_ATR));
+}
+
+void CVirtualCard::Reset() {
+	CAutoMutex autoMutex(&m_mutex);
+
+	m_csCurrentDF = "3F00";
+	m_csCurrentEF.clear();
+	m_oPendingResponse.ClearContents();
+	m_verifiedPins.clear();
+	m_ucKeyRef = 0;
+	m_ucAlgo = 0;
+	m_oHash.ClearContents();
+}
+
+tVirtualCardStats CVirtualCard::GetStats() {
+	CAutoMutex autoMutex(&m_mutex);
+	return m_stats;
+}
+
+void CVirtualCard::ResetStats() {
+	CAutoMutex autoMutex(&m_mutex);
+	m_stats.ulApduCount = 0;
+	m_stats.ulBytesSent = 0;
+	m_stats.ulBytesReceived = 0;
+	m_stats.ulModelledLatency = 0;
+	m_stats.ulReplayMisses = 0;
+}
+
+CByteArray CVirtualCard::Transmit(const CByteArray &oCmdAPDU) {
+	CAutoMutex autoMutex(&m_mutex);
+
+	if (m_bReplay) {
+		CByteArray oResp = Replay(oCmdAPDU);
+		m_stats.ulApduCount++;
+		m_stats.ulBytesSent += oCmdAPDU.Size();
+		m_stats.ulBytesReceived += oResp.Size();
+		return oResp;
+	}
+
+	// The emulated card, like a real one, processes one APDU at a time so the latency is applied with the lock held
+	if (m_ulLatency != 0)
+		CThread::SleepMillisecs((int)m_ulLatency);
+	m_stats.ulModelledLatency += m_ulLatency * 1000;
+
+	CByteArray oResp = Process(oCmdAPDU);
+
+	m_stats.ulApduCount++;
+	m_stats.ulBytesSent += oCmdAPDU.Size();
+	m_stats.ulBytesReceived += oResp.Size();
+
+	return oResp;
+}
+
+CByteArray CVirtualCard::Process(const CByteArray &oCmdAPDU) {
+	if (oCmdAPDU.Size() < 4)
+		return SW(0x6700);
+
+	unsigned char ucCLA = oCmdAPDU.GetByte(0);
+	unsigned char ucINS = oCmdAPDU.GetByte(1);
+	unsigned char ucP1 = oCmdAPDU.GetByte(2);
+	unsigned char ucP2 = oCmdAPDU.GetByte(3);
+
+	// Short APDUs only: CLA INS P1 P2 [Lc data] [Le]
+	CByteArray oData;
+	unsigned long ulLe = 0;
+	if (oCmdAPDU.Size() == 5) {
+		ulLe = oCmdAPDU.GetByte(4) == 0 ? 256 : oCmdAPDU.GetByte(4);
+	} else if (oCmdAPDU.Size() > 5) {
+		unsigned long ulLc = oCmdAPDU.GetByte(4);
+		if (oCmdAPDU.Size() < 5 + ulLc)
+			return SW(0x6700);
+		oData = oCmdAPDU.GetBytes(5, ulLc);
+		if (oCmdAPDU.Size() > 5 + ulLc)
+			ulLe = oCmdAPDU.GetByte(5 + ulLc) == 0 ? 256 : oCmdAPDU.GetByte(5 + ulLc);
+	}
+
+	if (ucCLA & 0x0C)
+		return SW(0x6882); // Secure messaging not supported
+
+	if (ucINS != 0xC0)
+		m_oPendingResponse.ClearContents();
+
+	switch (ucINS) {
+	case 0xA4:
+		return Select(ucP1, ucP2, oData);
+	case 0xB0:
+		return ReadBinary(ucP1, ucP2, ulLe);
+	case 0xC0:
+		return GetResponse(ulLe);
+	case 0x20:
+		// VERIFY without data (Lc = 0 sent as P3) only returns the PIN status
+		return Verify(ucP2, oData);
+	case 0x24:
+		return ChangePin(ucP1, ucP2, oData);
+	case 0x22:
+		if (ucP1 == 0x41 && ucP2 == 0xB6)
+			return ManageSecurityEnv(oData);
+		return SW(0x6A86);
+	case 0x2A:
+		if (ucP1 == 0x90 && ucP2 == 0xA0) {
+			// PSO:HASH with the data object 90 <len> <hash>
+			if (oData.Size() < 2 || oData.GetByte(0) != 0x90 || oData.GetByte(1) != oData.Size() - 2)
+				return SW(0x6A80);
+			m_oHash = oData.GetBytes(2);
+			return SW(0x9000);
+		}
+		if (ucP1 == 0x9E && ucP2 == 0x9A)
+			return ComputeSignature();
+		return SW(0x6A86);
+	case 0x84: {
+		CByteArray oChallenge(ulLe);
+		unsigned char tucRandom[256];
+		if (RAND_bytes(tucRandom, (int)ulLe) != 1)
+			return SW(0x6F00);
+		oChallenge.Append(tucRandom, ulLe);
+		return Respond(oChallenge);
+	}
+	case 0xCA:
+		return GetData(ucP1, ucP2);
+	default:
+		return SW(0x6D00);
+	}
+}
+
+bool CVirtualCard::ReplayMatches(const tApduTraceRecord &record, const CByteArray &oCmdAPDU) {
+	if (record.ucType != APDU_TRACE_EXCHANGE || record.oCommand.Size() != oCmdAPDU.Size())
+		return false;
+
+	unsigned long ulLen = IsApduTracePinCommand(oCmdAPDU) ? 5 : oCmdAPDU.Size();
+	return memcmp(record.oCommand.GetBytes(), oCmdAPDU.GetBytes(), ulLen) == 0;
+}
+
+CByteArray CVirtualCard::Replay(const CByteArray &oCmdAPDU) {
+	for (size_t n = 0; n < m_replay.size(); n++) {
+		size_t i = (m_replayCursor + n) % m_replay.size();
+		if (ReplayMatches(m_replay[i], oCmdAPDU)) {
+			m_replayCursor = i + 1;
+			m_stats.ulModelledLatency += m_replay[i].ulDuration;
+			return m_replay[i].oResponse;
+		}
+	}
+
+	m_stats.ulReplayMisses++;
+	MWLOG(LEV_WARN, MOD_CAL, "Virtual card: command not found in the replayed trace: %s",
+		  oCmdAPDU.ToString(true, true, 0, 5).c_str());
+	return SW(0x6D00);
+}
+
+CByteArray CVirtualCard::Select(unsigned char ucP1, unsigned char ucP2, const CByteArray &oData) {
+	if (ucP1 == 0x04) {
+		if (oData.Size() == sizeof(PTEID_1_APPLET_AID) &&
+			memcmp(oData.GetBytes(), PTEID_1_APPLET_AID, sizeof(PTEID_1_APPLET_AID)) == 0) {
+			m_csCurrentDF = "3F00";
+			m_csCurrentEF.clear();
+			return SW(0x9000);
+		}
+		return SW(0x6A82);
+	}
+
+	if (oData.Size() == 0 || oData.Size() % 2 != 0)
+		return SW(0x6A87);
+
+	std::string csFIDs = ToHex(oData.GetBytes(), oData.Size());
+	std::vector<std::string> candidates;
+	switch (ucP1) {
+	case 0x00:
+		// Select by file ID: DFs are children of the MF, EFs are looked up in the current DF and then in the MF
+		if (csFIDs == "3F00") {
+			candidates.push_back(csFIDs);
+		} else if (IsDFPath(csFIDs)) {
+			candidates.push_back("3F00" + csFIDs);
+		} else {
+			candidates.push_back(m_csCurrentDF + csFIDs);
+			candidates.push_back("3F00" + csFIDs);
+		}
+		break;
+	case 0x02:
+		candidates.push_back(m_csCurrentDF + csFIDs);
+		break;
+	case 0x08:
+		candidates.push_back("3F00" + csFIDs);
+		break;
+	default:
+		return SW(0x6A86);
+	}
+
+	for (size_t i = 0; i < candidates.size(); i++) {
+		const std::string &csPath = candidates[i];
+		const unsigned char *pucFID = oData.GetBytes() + oData.Size() - 2;
+
+		if (IsDFPath(csPath)) {
+			m_csCurrentDF = csPath;
+			m_csCurrentEF.clear();
+			if (ucP2 == 0x0C)
+				return SW(0x9000);
+
+			CByteArray oFCI(8);
+			const unsigned char tucFCI[] = {0x6F, 0x04, 0x83, 0x02};
+			oFCI.Append(tucFCI, sizeof(tucFCI));
+			oFCI.Append(pucFID, 2);
+			return Respond(oFCI);
+		}
+
+		const CByteArray *poFile = GetFile(csPath);
+		if (poFile == NULL)
+			continue;
+
+		m_csCurrentDF = csPath.substr(0, csPath.size() - 4);
+		m_csCurrentEF = csPath;
+		if (ucP2 == 0x0C)
+			return SW(0x9000);
+
+		// FCI with the file size in tag 81 as returned by the IAS eID applet
+		CByteArray oFCI(16);
+		const unsigned char tucFCI[] = {0x6F, 0x0B, 0x81, 0x02};
+		oFCI.Append(tucFCI, sizeof(tucFCI));
+		oFCI.Append((unsigned char)(poFile->Size() >> 8));
+		oFCI.Append((unsigned char)(poFile->Size() & 0xFF));
+		const unsigned char tucDesc[] = {0x82, 0x01, 0x01, 0x83, 0x02};
+		oFCI.Append(tucDesc, sizeof(tucDesc));
+		oFCI.Append(pucFID, 2);
+		return Respond(oFCI);
+	}
+
+	return SW(0x6A82);
+}
+
+CByteArray CVirtualCard::ReadBinary(unsigned char ucP1, unsigned char ucP2, unsigned long ulLe) {
+	unsigned long ulOffset;
+	if (ucP1 & 0x80) {
+		// Short EF identifier: EFXX in the current DF with XX = SFI
+		char csFID[5];
+		snprintf(csFID, sizeof(csFID), "EF%02X", ucP1 & 0x1F);
+		std::string csPath = m_csCurrentDF + csFID;
+		if (GetFile(csPath) == NULL)
+			return SW(0x6A82);
+		m_csCurrentEF = csPath;
+		ulOffset = ucP2;
+	} else {
+		ulOffset = ((unsigned long)ucP1 << 8) | ucP2;
+	}
+
+	if (m_csCurrentEF.empty())
+		return SW(0x6986);
+
+	const CByteArray *poFile = GetFile(m_csCurrentEF);
+	if (poFile == NULL)
+		return SW(0x6A82);
+	if (ulOffset >= poFile->Size())
+		return SW(0x6B00);
+
+	unsigned long ulLen = (std::min)(ulLe == 0 ? 256 : ulLe, poFile->Size() - ulOffset);
+	CByteArray oResp = poFile->GetBytes(ulOffset, ulLen);
+	oResp.Append(0x90);
+	oResp.Append(0x00);
+	return oResp;
+}
+
+CByteArray CVirtualCard::GetResponse(unsigned long ulLe) {
+	if (m_oPendingResponse.Size() == 0)
+		return SW(0x6985);
+
+	CByteArray oPending = m_oPendingResponse;
+	m_oPendingResponse.ClearContents();
+
+	unsigned long ulLen = (std::min)(ulLe == 0 ? 256 : ulLe, oPending.Size());
+	CByteArray oResp = oPending.GetBytes(0, ulLen);
+	if (ulLen < oPending.Size()) {
+		m_oPendingResponse = oPending.GetBytes(ulLen);
+		unsigned long ulRemaining = m_oPendingResponse.Size();
+		oResp.Append(0x61);
+		oResp.Append((unsigned char)(ulRemaining >= 256 ? 0x00 : ulRemaining));
+	} else {
+		oResp.Append(0x90);
+		oResp.Append(0x00);
+	}
+	return oResp;
+}
+
+CByteArray CVirtualCard::Respond(const CByteArray &oData) {
+	if (oData.Size() <= MAX_RESPONSE_LEN) {
+		CByteArray oResp(oData);
+		oResp.Append(0x90);
+		oResp.Append(0x00);
+		return oResp;
+	}
+
+	CByteArray oResp = oData.GetBytes(0, MAX_RESPONSE_LEN);
+	m_oPendingResponse = oData.GetBytes(MAX_RESPONSE_LEN);
+	unsigned long ulRemaining = m_oPendingResponse.Size();
+	oResp.Append(0x61);
+	oResp.Append((unsigned char)(ulRemaining >= 256 ? 0x00 : ulRemaining));
+	return oResp;
+}
+
+CByteArray CVirtualCard::Verify(unsigned char ucPinRef, const CByteArray &oData) {
+	std::string csPin = GetPin(ucPinRef);
+	unsigned long &ulTries = m_pinTries[ucPinRef];
+
+	if (ulTries == 0)
+		return SW(0x6983);
+
+	if (oData.Size() == 0)
+		return m_verifiedPins[ucPinRef] ? SW(0x9000) : SW(0x63C0 | ulTries);
+
+	// Remove the padding added by CPkiCard::MakePinBuf()
+	unsigned long ulLen = oData.Size();
+	while (ulLen > 0 && (oData.GetByte(ulLen - 1) == 0xFF || oData.GetByte(ulLen - 1) == 0x00))
+		ulLen--;
+
+	if (std::string((const char *)oData.GetBytes(), ulLen) == csPin) {
+		ulTries = PIN_MAX_TRIES;
+		m_verifiedPins[ucPinRef] = true;
+		return SW(0x9000);
+	}
+
+	ulTries--;
+	m_verifiedPins[ucPinRef] = false;
+	return ulTries == 0 ? SW(0x6983) : SW(0x63C0 | ulTries);
+}
+
+CByteArray CVirtualCard::ChangePin(unsigned char ucP1, unsigned char ucPinRef, const CByteArray &oData) {
+	CByteArray oNewPin;
+	if (ucP1 == 0x00) {
+		// Current and new PIN, both padded to the same length
+		if (oData.Size() == 0 || oData.Size() % 2 != 0)
+			return SW(0x6A80);
+		unsigned long ulHalf = oData.Size() / 2;
+		CByteArray oResp = Verify(ucPinRef, oData.GetBytes(0, ulHalf));
+		if (oResp.GetByte(0) != 0x90)
+			return oResp;
+		oNewPin = oData.GetBytes(ulHalf);
+	} else if (ucP1 == 0x01) {
+		// New PIN only, the current one must have been verified
+		if (!m_verifiedPins[ucPinRef])
+			return SW(0x6982);
+		oNewPin = oData;
+	} else {
+		return SW(0x6A86);
+	}
+
+	unsigned long ulLen = oNewPin.Size();
+	while (ulLen > 0 && (oNewPin.GetByte(ulLen - 1) == 0xFF || oNewPin.GetByte(ulLen - 1) == 0x00))
+		ulLen--;
+	m_pins[ucPinRef] = std::string((const char *)oNewPin.GetBytes(), ulLen);
+
+	return SW(0x9000);
+}
+
+CByteArray CVirtualCard::ManageSecurityEnv(const CByteArray &oData) {
+	m_ucKeyRef = 0;
+	m_ucAlgo = 0;
+	m_oHash.ClearContents();
+
+	// Control reference template with 1-byte data objects: 80 (algorithm) and 84 (key reference)
+	unsigned long i = 0;
+	while (i + 1 < oData.Size()) {
+		unsigned char ucTag = oData.GetByte(i);
+		unsigned char ucLen = oData.GetByte(i + 1);
+		if (ucLen != 1 || i + 2 >= oData.Size())
+			return SW(0x6A80);
+		if (ucTag == 0x80)
+			m_ucAlgo = oData.GetByte(i + 2);
+		else if (ucTag == 0x84)
+			m_ucKeyRef = oData.GetByte(i + 2);
+		i += 2 + ucLen;
+	}
+
+	if (m_ucKeyRef == 0 || DigestForAlgo(m_ucAlgo) == NULL)
+		return SW(0x6A80);
+
+	return SW(0x9000);
+}
+
+CByteArray CVirtualCard::ComputeSignature() {
+	if (m_ucKeyRef == 0 || m_oHash.Size() == 0)
+		return SW(0x6985);
+
+	bool bVerified = false;
+	for (std::map<unsigned char, bool>::iterator it = m_verifiedPins.begin(); it != m_verifiedPins.end(); ++it)
+		bVerified |= it->second;
+	if (!bVerified)
+		return SW(0x6982);
+
+	const EVP_MD *md = DigestForAlgo(m_ucAlgo);
+	if ((unsigned long)EVP_MD_size(md) != m_oHash.Size())
+		return SW(0x6A80);
+
+	char csKeyName[16];
+	snprintf(csKeyName, sizeof(csKeyName), "key_%02X.pem", m_ucKeyRef);
+	std::string csKeyPath = m_csDirectory + "/" + csKeyName;
+
+	BIO *bio = BIO_new_file(csKeyPath.c_str(), "r");
+	if (bio == NULL) {
+		MWLOG(LEV_WARN, MOD_CAL, "Virtual card: no key file %s", csKeyPath.c_str());
+		return SW(0x6A88);
+	}
+	EVP_PKEY *pkey = PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL);
+	BIO_free(bio);
+	if (pkey == NULL)
+		return SW(0x6A88);
+
+	CByteArray oSignature;
+	EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new(pkey, NULL);
+	bool bEC = EVP_PKEY_base_id(pkey) == EVP_PKEY_EC;
+	size_t sigLen = 0;
+
+	bool bOK = ctx != NULL && EVP_PKEY_sign_init(ctx) > 0 && EVP_PKEY_CTX_set_signature_md(ctx, md) > 0;
+	if (bOK && !bEC) {
+		// Low nibble of the algorithm reference: 2 for PKCS#1 v1.5 and 5 for PSS
+		bool bPSS = (m_ucAlgo & 0x0F) == 0x05;
+		bOK = EVP_PKEY_CTX_set_rsa_padding(ctx, bPSS ? RSA_PKCS1_PSS_PADDING : RSA_PKCS1_PADDING) > 0;
+		if (bOK && bPSS)
+			bOK = EVP_PKEY_CTX_set_rsa_pss_saltlen(ctx, RSA_PSS_SALTLEN_DIGEST) > 0;
+	}
+	if (bOK)
+		bOK = EVP_PKEY_sign(ctx, NULL, &sigLen, m_oHash.GetBytes(), m_oHash.Size()) > 0;
+
+	if (bOK) {
+		std::vector<unsigned char> sig(sigLen);
+		bOK = EVP_PKEY_sign(ctx, sig.data(), &sigLen, m_oHash.GetBytes(), m_oHash.Size()) > 0;
+
+		if (bOK && bEC) {
+			// The card returns the plain r || s concatenation instead of the DER encoded ECDSA-Sig-Value
+			const unsigned char *p = sig.data();
+			ECDSA_SIG *ecSig = d2i_ECDSA_SIG(NULL, &p, (long)sigLen);
+			bOK = ecSig != NULL;
+			if (bOK) {
+				const BIGNUM *r, *s;
+				ECDSA_SIG_get0(ecSig, &r, &s);
+				int fieldLen = (EVP_PKEY_bits(pkey) + 7) / 8;
+				std::vector<unsigned char> rs(2 * fieldLen);
+				BN_bn2binpad(r, rs.data(), fieldLen);
+				BN_bn2binpad(s, rs.data() + fieldLen, fieldLen);
+				oSignature.Append(rs.data(), (unsigned long)rs.size());
+				ECDSA_SIG_free(ecSig);
+			}
+		} else if (bOK) {
+			oSignature.Append(sig.data(), (unsigned long)sigLen);
+		}
+	}
+
+	EVP_PKEY_CTX_free(ctx);
+	EVP_PKEY_free(pkey);
+	m_oHash.ClearContents();
+
+	if (!bOK) {
+		MWLOG(LEV_ERROR, MOD_CAL, "Virtual card: signature with key %02X failed", m_ucKeyRef);
+		return SW(0x6F00);
+	}
+
+	return Respond(oSignature);
+}
+
+CByteArray CVirtualCard::GetData(unsigned char ucP1, unsigned char ucP2) {
+	if (ucP1 == 0x9F && ucP2 == 0x7F) {
+		const CByteArray *poCPLC = GetFile("cplc");
+		if (poCPLC != NULL)
+			return Respond(*poCPLC);
+
+		// 9F 7F 2A followed by the CPLC data, the IC serial number starts at offset 13
+		CByteArray oCPLC(CPLC_LEN);
+		oCPLC.Append(0x9F);
+		oCPLC.Append(0x7F);
+		oCPLC.Append((unsigned char)(CPLC_LEN - 3));
+		for (unsigned long i = 3; i < CPLC_LEN; i++)
+			oCPLC.Append((unsigned char)(i >= 13 && i < 21 ? i - 12 : 0x00));
+		return Respond(oCPLC);
+	}
+	if (ucP1 == 0xDF && ucP2 == 0x30) {
+		CByteArray oVersion(3 + sizeof(APPLET_VERSION));
+		oVersion.Append(0xDF);
+		oVersion.Append(0x30);
+		oVersion.Append((unsigned char)(sizeof(APPLET_VERSION) - 1));
+		oVersion.Append((const unsigned char *)APPLET_VERSION, sizeof(APPLET_VERSION) - 1);
+		return Respond(oVersion);
+	}
+	return SW(0x6A88);
+}
+
+const CByteArray *CVirtualCard::GetFile(const std::string &csPath) {
+	std::map<std::string, CByteArray>::iterator it = m_files.find(csPath);
+	if (it != m_files.end())
+		return &it->second;
+	if (m_missingFiles.find(csPath) != m_missingFiles.end())
+		return NULL;
+
+	std::string csFile = m_csDirectory + "/" + csPath + ".bin";
+	std::ifstream file(csFile.c_str(), std::ios::binary);
+	if (!file) {
+		m_missingFiles[csPath] = true;
+		return NULL;
+	}
+
+	std::vector<char> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	CByteArray &oFile = m_files[csPath];
+	oFile.Append((const unsigned char *)contents.data(), (unsigned long)contents.size());
+	return &oFile;
+}
+
+std::string CVirtualCard::GetPin(unsigned char ucPinRef) {
+	std::map<unsigned char, std::string>::iterator it = m_pins.find(ucPinRef);
+	if (it != m_pins.end())
+		return it->second;
+
+	char csName[16];
+	snprintf(csName, sizeof(csName), "pin_%02X.txt", ucPinRef);
+	std::string csPin = ReadTextFile(csName);
+	if (csPin.empty())
+		csPin = DEFAULT_PIN;
+
+	m_pins[ucPinRef] = csPin;
+	m_pinTries[ucPinRef] = PIN_MAX_TRIES;
+	return csPin;
+}
+
+std::string CVirtualCard::ReadTextFile(const std::string &csName) {
+	std::ifstream file((m_csDirectory + "/" + csName).c_str());
+	std::string csLine;
+	if (file)
+		std::getline(file, csLine);
+
+	while (!csLine.empty() && (csLine[csLine.size() - 1] == '\r' || csLine[csLine.size() - 1] == ' '))
+		csLine.erase(csLine.size() - 1);
+	return csLine;
+}
+
+} // namespace eIDMW
+
+#endif // PTEID_VIRTUAL_CARD
@@ -0,0 +1,125 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/**
+ * In-process emulation of a PTEID IAS v4 card (CARD_PTEID_IAS07) used to exercise the
+ * card layer without a physical reader. It is only compiled in test builds with PTEID_VIRTUAL_CARD
+ * defined (qmake CONFIG+=virtual_card). It is enabled by setting the "virtual_card_dir"
+ * configuration value and is then exposed by CPCSC as an extra reader named VIRTUAL_READER_NAME.
+ *
+ * The card contents are read from that directory:
+ *  - <PATH>.bin: contents of the EF with the given absolute path, e.g. 3F005F00EF02.bin for EF.ID
+ *    or 3F000003.bin for EF.Trace
+ *  - atr.bin: card ATR (optional)
+ *  - cplc.bin: CPLC data returned by GET DATA 9F7F, the card serial number is at offset 13 (optional)
+ *  - pin_<REF>.txt: value of the PIN as plain digits, e.g. 1234, with the PIN reference <REF> in hex
+ *    in the file name, e.g. pin_81.txt (default "1234")
+ *  - key_<REF>.pem: private key used by PSO:CDS when the key reference <REF> is set with MSE:SET
+ *
+ * Supported commands: SELECT (by AID, FID and path), READ BINARY (including short EF identifiers),
+ * GET RESPONSE, VERIFY, CHANGE REFERENCE DATA, MSE:SET, PSO:HASH, PSO:CDS, GET CHALLENGE and the GET DATA
+ * objects used by CPteidCard. Secure messaging is not emulated.
+ *
+ * If "apdu_replay_file" is set the card answers from an APDU trace recorded by CPCSC (see ApduTrace.h)
+ * instead: each command gets the response of the next recorded command with the same bytes, searching
+ * from the last match onwards and then from the start of the trace. PIN commands are matched without
+ * their data as they are masked in the trace. The recorded card time is added to the modelled latency
+ * but isn't waited for, so a replay is deterministic and fast.
+ */
+#pragma once
+
+#include "ApduTrace.h"
+#include "ByteArray.h"
+#include "Export.h"
+#include "Mutex.h"
+
+#include <map>
+#include <string>
+
+namespace eIDMW {
+
+#define VIRTUAL_READER_NAME "PTEID Virtual Card Reader"
+
+struct tVirtualCardStats {
+	unsigned long ulApduCount;
+	unsigned long ulBytesSent;
+	unsigned long ulBytesReceived;
+	unsigned long ulModelledLatency; // card time in microseconds: the configured latency or the recorded one on replay
+	unsigned long ulReplayMisses;	 // commands not found in the replayed trace
+};
+
+class EIDMW_CAL_API CVirtualCard {
+public:
+	// Returns the emulated card configured for this process or NULL if it's not enabled
+	static CVirtualCard *GetInstance();
+
+	CVirtualCard(const std::string &csDirectory, unsigned long ulLatency);
+
+	// Answer from the given APDU trace instead of emulating the card file system
+	bool LoadReplay(const std::string &csTrace);
+
+	CByteArray GetATR();
+
+	// Power-on reset: clears the selected file, verified PINs and security environment
+	void Reset();
+
+	// Process one command APDU and return the response APDU (data + SW1 SW2)
+	CByteArray Transmit(const CByteArray &oCmdAPDU);
+
+	tVirtualCardStats GetStats();
+	void ResetStats();
+
+private:
+	CByteArray Process(const CByteArray &oCmdAPDU);
+	CByteArray Replay(const CByteArray &oCmdAPDU);
+	bool ReplayMatches(const tApduTraceRecord &record, const CByteArray &oCmdAPDU);
+
+	CByteArray Select(unsigned char ucP1, unsigned char ucP2, const CByteArray &oData);
+	CByteArray ReadBinary(unsigned char ucP1, unsigned char ucP2, unsigned long ulLe);
+	CByteArray GetResponse(unsigned long ulLe);
+	CByteArray Verify(unsigned char ucPinRef, const CByteArray &oData);
+	CByteArray ChangePin(unsigned char ucP1, unsigned char ucPinRef, const CByteArray &oData);
+	CByteArray ManageSecurityEnv(const CByteArray &oData);
+	CByteArray ComputeSignature();
+	CByteArray GetData(unsigned char ucP1, unsigned char ucP2);
+
+	// Returns data followed by SW 9000, or 61XX with the data kept for GET RESPONSE if it doesn't fit
+	CByteArray Respond(const CByteArray &oData);
+
+	const CByteArray *GetFile(const std::string &csPath);
+	std::string GetPin(unsigned char ucPinRef);
+	std::string ReadTextFile(const std::string &csName);
+
+	std::string m_csDirectory;
+	unsigned long m_ulLatency;
+
+	CMutex m_mutex;
+
+	// Files loaded from m_csDirectory keyed by absolute path; paths without a file are remembered as well
+	std::map<std::string, CByteArray> m_files;
+	std::map<std::string, bool> m_missingFiles;
+
+	std::string m_csCurrentDF;
+	std::string m_csCurrentEF;
+	CByteArray m_oPendingResponse;
+
+	std::map<unsigned char, std::string> m_pins;
+	std::map<unsigned char, unsigned long> m_pinTries;
+	std::map<unsigned char, bool> m_verifiedPins;
+
+	unsigned char m_ucKeyRef;
+	unsigned char m_ucAlgo;
+	CByteArray m_oHash;
+
+	bool m_bReplay;
+	std::vector<tApduTraceRecord> m_replay;
+	size_t m_replayCursor;
+
+	tVirtualCardStats m_stats;
+};
+
+} // namespace eIDMW
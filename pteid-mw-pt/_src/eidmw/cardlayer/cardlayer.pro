@@ -47,6 +47,7 @@ unix:!macx:  DEFINES += __UNIX__
 # Input
 HEADERS += \
            APDU.h \
+           ApduTrace.h \
            Cache.h \
            Card.h \
            CardFactory.h \
@@ -65,8 +66,10 @@ HEADERS += \
            PkiCard.h \
            Reader.h \
            ReadersInfo.h \
+           SecureMessaging.h \
            ThreadPool.h \
            UnknownCard.h \
+           VirtualCard.h \
            pinpad2.h \
            GempcPinpad.h \
            ACR83Pinpad.h \
@@ -75,6 +78,7 @@ HEADERS += \
 
 SOURCES += \
            APDU.cpp \
+           ApduTrace.cpp \
            Cache.cpp \
            Card.cpp \
            CardFactory.cpp \
@@ -90,9 +94,11 @@ SOURCES += \
            PkiCard.cpp \
            Reader.cpp \
            ReadersInfo.cpp \
+           SecureMessaging.cpp \
            ThreadPool.cpp \
            GempcPinpad.cpp \
            ACR83Pinpad.cpp \
            PteidCard.cpp \
-           UnknownCard.cpp
+           UnknownCard.cpp \
+           VirtualCard.cpp
 
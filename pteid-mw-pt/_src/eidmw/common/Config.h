@@ -171,6 +171,28 @@ not exist.
 #define EIDMW_CNF_GENERAL_OAUTH_PORT L"oauth_port"
 #define EIDMW_CNF_GENERAL_OAUTH_CLIENTID L"oauth_clientid"
 #define EIDMW_CNF_GENERAL_PINPAD_ENABLED L"use_pinpad"
+// The APDU recorder and the emulated card reader only exist in test builds (qmake CONFIG+=virtual_card)
+#ifdef PTEID_VIRTUAL_CARD
+#define EIDMW_CNF_GENERAL_APDU_TRACE_FILE                                                                              \
+	L"apdu_trace_file" // string, file where the APDUs exchanged with the cards are recorded with the process ID
+					   // added to the name, empty to disable it
+#define EIDMW_CNF_GENERAL_VIRTUAL_CARD_DIR                                                                             \
+	L"virtual_card_dir" // string, directory with the files of the emulated card reader, empty to disable it
+#define EIDMW_CNF_GENERAL_VIRTUAL_CARD_LATENCY                                                                         \
+	L"virtual_card_latency" // number, delay added to each APDU sent to the emulated card, in mili-seconds
+#define EIDMW_CNF_GENERAL_APDU_REPLAY_FILE                                                                             \
+	L"apdu_replay_file" // string, APDU trace replayed by the emulated card reader instead of virtual_card_dir
+#endif
+#define EIDMW_CNF_GENERAL_METRICS_FILE                                                                                 \
+	L"metrics_file" // string, file where the internal metrics are written periodically, empty to disable it
+#define EIDMW_CNF_GENERAL_METRICS_INTERVAL                                                                             \
+	L"metrics_interval" // number, seconds between two writes of metrics_file
+#define EIDMW_CNF_GENERAL_PDF_OBJSTM_CACHE                                                                             \
+	L"pdf_object_stream_cache" // number, decoded PDF object streams kept in memory for each document
+#define EIDMW_CNF_GENERAL_PDF_COMPRESSED_UPDATES                                                                       \
+	L"pdf_compressed_updates" // number, 1 to save the signatures of PDF 1.5+ files with xref and object streams
+#define EIDMW_CNF_GENERAL_PDF_MEMORY_BUDGET                                                                            \
+	L"pdf_memory_budget" // number, MB of parsed PDF data kept in memory before releasing caches, 0 for no limit
 
 #define EIDMW_CNF_SECTION_LOGGING L"logging" // section with the logging parameters
 #define EIDMW_CNF_LOGGING_DIRNAME                                                                                      \
@@ -356,6 +378,17 @@ public:
 	static const struct Param_Num EIDMW_CONFIG_PARAM_GENERAL_CARDCONNDELAY;
 	static const struct Param_Num EIDMW_CONFIG_PARAM_GENERAL_BUILDNBR;
 	static const struct Param_Num EIDMW_CONFIG_PARAM_GENERAL_PINPAD_ENABLED;
+#ifdef PTEID_VIRTUAL_CARD
+	static const struct Param_Str EIDMW_CONFIG_PARAM_GENERAL_APDU_TRACE_FILE;
+	static const struct Param_Str EIDMW_CONFIG_PARAM_GENERAL_VIRTUAL_CARD_DIR;
+	static const struct Param_Num EIDMW_CONFIG_PARAM_GENERAL_VIRTUAL_CARD_LATENCY;
+	static const struct Param_Str EIDMW_CONFIG_PARAM_GENERAL_APDU_REPLAY_FILE;
+#endif
+	static const struct Param_Str EIDMW_CONFIG_PARAM_GENERAL_METRICS_FILE;
+	static const struct Param_Num EIDMW_CONFIG_PARAM_GENERAL_METRICS_INTERVAL;
+	static const struct Param_Num EIDMW_CONFIG_PARAM_GENERAL_PDF_OBJSTM_CACHE;
+	static const struct Param_Num EIDMW_CONFIG_PARAM_GENERAL_PDF_COMPRESSED_UPDATES;
+	static const struct Param_Num EIDMW_CONFIG_PARAM_GENERAL_PDF_MEMORY_BUDGET;
 	static const struct Param_Str EIDMW_CONFIG_PARAM_GENERAL_SCAP_HOST;
 	static const struct Param_Str EIDMW_CONFIG_PARAM_GENERAL_SCAP_PORT;
 	static const struct Param_Str EIDMW_CONFIG_PARAM_GENERAL_SCAP_APIKEY;
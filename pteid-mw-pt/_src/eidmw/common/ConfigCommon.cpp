@@ -84,6 +84,26 @@ const struct CConfig::Param_Num CConfig::EIDMW_CONFIG_PARAM_GENERAL_BUILDNBR = {
 																				EIDMW_CNF_GENERAL_BUILDNBR, 0};
 const struct CConfig::Param_Num CConfig::EIDMW_CONFIG_PARAM_GENERAL_PINPAD_ENABLED = {
 	EIDMW_CNF_SECTION_GENERAL, EIDMW_CNF_GENERAL_PINPAD_ENABLED, 1};
+#ifdef PTEID_VIRTUAL_CARD
+const struct CConfig::Param_Str CConfig::EIDMW_CONFIG_PARAM_GENERAL_APDU_TRACE_FILE = {
+	EIDMW_CNF_SECTION_GENERAL, EIDMW_CNF_GENERAL_APDU_TRACE_FILE, L""};
+const struct CConfig::Param_Str CConfig::EIDMW_CONFIG_PARAM_GENERAL_VIRTUAL_CARD_DIR = {
+	EIDMW_CNF_SECTION_GENERAL, EIDMW_CNF_GENERAL_VIRTUAL_CARD_DIR, L""};
+const struct CConfig::Param_Num CConfig::EIDMW_CONFIG_PARAM_GENERAL_VIRTUAL_CARD_LATENCY = {
+	EIDMW_CNF_SECTION_GENERAL, EIDMW_CNF_GENERAL_VIRTUAL_CARD_LATENCY, 0};
+const struct CConfig::Param_Str CConfig::EIDMW_CONFIG_PARAM_GENERAL_APDU_REPLAY_FILE = {
+	EIDMW_CNF_SECTION_GENERAL, EIDMW_CNF_GENERAL_APDU_REPLAY_FILE, L""};
+#endif
+const struct CConfig::Param_Str CConfig::EIDMW_CONFIG_PARAM_GENERAL_METRICS_FILE = {
+	EIDMW_CNF_SECTION_GENERAL, EIDMW_CNF_GENERAL_METRICS_FILE, L""};
+const struct CConfig::Param_Num CConfig::EIDMW_CONFIG_PARAM_GENERAL_METRICS_INTERVAL = {
+	EIDMW_CNF_SECTION_GENERAL, EIDMW_CNF_GENERAL_METRICS_INTERVAL, 10};
+const struct CConfig::Param_Num CConfig::EIDMW_CONFIG_PARAM_GENERAL_PDF_OBJSTM_CACHE = {
+	EIDMW_CNF_SECTION_GENERAL, EIDMW_CNF_GENERAL_PDF_OBJSTM_CACHE, 64};
+const struct CConfig::Param_Num CConfig::EIDMW_CONFIG_PARAM_GENERAL_PDF_COMPRESSED_UPDATES = {
+	EIDMW_CNF_SECTION_GENERAL, EIDMW_CNF_GENERAL_PDF_COMPRESSED_UPDATES, 0};
+const struct CConfig::Param_Num CConfig::EIDMW_CONFIG_PARAM_GENERAL_PDF_MEMORY_BUDGET = {
+	EIDMW_CNF_SECTION_GENERAL, EIDMW_CNF_GENERAL_PDF_MEMORY_BUDGET, 1024};
 
 // LOGGING
 const struct CConfig::Param_Str CConfig::EIDMW_CONFIG_PARAM_LOGGING_DIRNAME = {EIDMW_CNF_SECTION_LOGGING,
@@ -31,6 +31,8 @@ unsigned long CHash::GetHashLength(tHashAlgo algo) {
 	switch (algo) {
 	case ALGO_SHA1:
 		return 20;
+	case ALGO_SHA224:
+		return 28;
 	case ALGO_SHA256:
 		return 32;
 	case ALGO_SHA384:
@@ -55,6 +57,9 @@ void CHash::Init(tHashAlgo algo) {
 	case ALGO_SHA1:
 		sha1_init(&m_md1);
 		break;
+	case ALGO_SHA224:
+		sha224_init(&m_md1);
+		break;
 	case ALGO_SHA256:
 		sha256_init(&m_md1);
 		break;
@@ -75,16 +80,21 @@ void CHash::Init(tHashAlgo algo) {
 void CHash::Update(const CByteArray &data) { Update(data, 0, data.Size()); }
 
 void CHash::Update(const CByteArray &data, unsigned long ulOffset, unsigned long ulLen) {
+	Update(data.GetBytes() + ulOffset, ulLen);
+}
+
+void CHash::Update(const unsigned char *pucData, unsigned long ulLen) {
 	if (!m_bInitialized)
 		throw CMWEXCEPTION(EIDMW_ERR_PARAM_BAD);
 
 	if (ulLen != 0) {
-		const unsigned char *pucData = data.GetBytes() + ulOffset;
-
 		switch (m_Algo) {
 		case ALGO_SHA1:
 			sha1_process(&m_md1, pucData, ulLen);
 			break;
+		case ALGO_SHA224:
+			sha224_process(&m_md1, pucData, ulLen);
+			break;
 		case ALGO_SHA256:
 			sha256_process(&m_md1, pucData, ulLen);
 			break;
@@ -113,6 +123,9 @@ CByteArray CHash::GetHash() {
 	case ALGO_SHA1:
 		sha1_done(&m_md1, tucHash);
 		break;
+	case ALGO_SHA224:
+		sha224_done(&m_md1, tucHash);
+		break;
 	case ALGO_SHA256:
 		sha256_done(&m_md1, tucHash);
 		break;
@@ -56,7 +56,8 @@ enum tHashAlgo {
 	ALGO_SHA1 = 1,	 // 20-byte hash
 	ALGO_SHA256 = 3, // 32-byte hash
 	ALGO_SHA384 = 4, // 48-byte hash
-	ALGO_SHA512 = 5	 // 64-byte hash
+	ALGO_SHA512 = 5, // 64-byte hash
+	ALGO_SHA224 = 6	 // 28-byte hash
 };
 
 class EIDMW_CMN_API CHash {
@@ -72,6 +73,8 @@ public:
 	void Init(tHashAlgo algo);
 	void Update(const CByteArray &data);
 	void Update(const CByteArray &data, unsigned long ulOffset, unsigned long ulLen);
+	// Hash the data in place, without copying it to a CByteArray first
+	void Update(const unsigned char *pucData, unsigned long ulLen);
 	CByteArray GetHash();
 
 private:
@@ -0,0 +1,218 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+
+#include "Metrics.h"
+#include "Config.h"
+#include "Log.h"
+#include "MWException.h"
+#include "Thread.h"
+#include "Util.h"
+#include "eidErrors.h"
+
+#include <cstdio>
+
+namespace eIDMW {
+
+const double CMetricHistogram::BUCKET_BOUNDS[BUCKET_COUNT] = {0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+															  0.1,	  0.25,	 0.5,	 1,		2.5,  10,	 60};
+
+CMetricHistogram::CMetricHistogram() : m_count(0), m_sum(0) {
+	for (int i = 0; i <= BUCKET_COUNT; i++)
+		m_buckets[i].store(0, std::memory_order_relaxed);
+}
+
+void CMetricHistogram::ObserveMicroseconds(unsigned long long ullDuration) {
+	double seconds = ullDuration / 1000000.0;
+	int i = 0;
+	while (i < BUCKET_COUNT && seconds > BUCKET_BOUNDS[i])
+		i++;
+
+	m_buckets[i].fetch_add(1, std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(ullDuration, std::memory_order_relaxed);
+}
+
+CMetricTimer::CMetricTimer(CMetricHistogram *poHistogram)
+	: m_poHistogram(poHistogram), m_start(std::chrono::steady_clock::now()) {}
+
+CMetricTimer::~CMetricTimer() { Stop(); }
+
+void CMetricTimer::Stop() {
+	if (m_poHistogram == NULL)
+		return;
+	auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start);
+	m_poHistogram->ObserveMicroseconds(duration.count());
+	m_poHistogram = NULL;
+}
+
+// Rewrites the metrics file every metrics_interval seconds until it is stopped
+class CMetricsFileWriter : public CThread {
+public:
+	CMetricsFileWriter(CMetrics *poMetrics, const std::string &csPath, long lInterval)
+		: m_poMetrics(poMetrics), m_csPath(csPath), m_lInterval(lInterval > 0 ? lInterval : 10) {}
+
+	void Run() {
+		while (!m_bStopRequest) {
+			for (long i = 0; i < m_lInterval * 10 && !m_bStopRequest; i++)
+				CThread::SleepMillisecs(100);
+			m_poMetrics->WriteFile(m_csPath);
+		}
+	}
+
+private:
+	CMetrics *m_poMetrics;
+	std::string m_csPath;
+	long m_lInterval;
+};
+
+CMetrics *CMetrics::GetInstance() {
+	static CMetrics *instance = []() {
+		CMetrics *poMetrics = new CMetrics();
+		poMetrics->StartFileWriter();
+		return poMetrics;
+	}();
+	return instance;
+}
+
+void CMetrics::StartFileWriter() {
+	CAutoMutex autoMutex(&m_writerMutex);
+	if (m_poWriter != NULL)
+		return;
+
+	std::string csPath = utilStringNarrow(CConfig::GetString(CConfig::EIDMW_CONFIG_PARAM_GENERAL_METRICS_FILE));
+	if (csPath.empty())
+		return;
+
+	long lInterval = CConfig::GetLong(CConfig::EIDMW_CONFIG_PARAM_GENERAL_METRICS_INTERVAL);
+	MWLOG(LEV_INFO, MOD_LIB, "Writing metrics to %s every %ld seconds", csPath.c_str(), lInterval);
+	m_poWriter = new CMetricsFileWriter(this, csPath, lInterval);
+	if (m_poWriter->Start() != 0) {
+		MWLOG(LEV_ERROR, MOD_LIB, "Failed to start the metrics file writer");
+		delete m_poWriter;
+		m_poWriter = NULL;
+	}
+}
+
+void CMetrics::StopFileWriter() {
+	CAutoMutex autoMutex(&m_writerMutex);
+	if (m_poWriter == NULL)
+		return;
+
+	m_poWriter->Stop();
+	delete m_poWriter;
+	m_poWriter = NULL;
+}
+
+CMetrics::tFamily &CMetrics::GetFamily(const char *csName, const char *csHelp, bool bHistogram) {
+	std::map<std::string, tFamily>::iterator it = m_families.find(csName);
+	if (it == m_families.end()) {
+		tFamily &family = m_families[csName];
+		family.csHelp = csHelp;
+		family.bHistogram = bHistogram;
+		return family;
+	}
+
+	if (it->second.bHistogram != bHistogram) {
+		MWLOG(LEV_ERROR, MOD_LIB, "Metric %s registered with different types", csName);
+		throw CMWEXCEPTION(EIDMW_ERR_PARAM_BAD);
+	}
+	return it->second;
+}
+
+CMetricCounter *CMetrics::GetCounter(const char *csName, const char *csHelp, const std::string &csLabels) {
+	CAutoMutex autoMutex(&m_mutex);
+	std::unique_ptr<CMetricCounter> &counter = GetFamily(csName, csHelp, false).counters[csLabels];
+	if (!counter)
+		counter.reset(new CMetricCounter());
+	return counter.get();
+}
+
+CMetricHistogram *CMetrics::GetHistogram(const char *csName, const char *csHelp, const std::string &csLabels) {
+	CAutoMutex autoMutex(&m_mutex);
+	std::unique_ptr<CMetricHistogram> &histogram = GetFamily(csName, csHelp, true).histograms[csLabels];
+	if (!histogram)
+		histogram.reset(new CMetricHistogram());
+	return histogram.get();
+}
+
+static std::string LabelSet(const std::string &csLabels, const std::string &csExtra = "") {
+	if (csLabels.empty() && csExtra.empty())
+		return "";
+	if (csLabels.empty() || csExtra.empty())
+		return "{" + csLabels + csExtra + "}";
+	return "{" + csLabels + "," + csExtra + "}";
+}
+
+std::string CMetrics::Export() {
+	CAutoMutex autoMutex(&m_mutex);
+	std::string csOut;
+	char csValue[64];
+
+	for (std::map<std::string, tFamily>::iterator it = m_families.begin(); it != m_families.end(); ++it) {
+		const std::string &csName = it->first;
+		tFamily &family = it->second;
+
+		csOut += "# HELP " + csName + " " + family.csHelp + "\n";
+		csOut += "# TYPE " + csName + (family.bHistogram ? " histogram\n" : " counter\n");
+
+		for (auto &counter : family.counters) {
+			snprintf(csValue, sizeof(csValue), " %llu\n", counter.second->Get());
+			csOut += csName + LabelSet(counter.first) + csValue;
+		}
+
+		for (auto &entry : family.histograms) {
+			const CMetricHistogram &histogram = *entry.second;
+			// Read the count first so that the cumulated buckets never exceed it
+			unsigned long long ullCount = histogram.GetCount();
+			unsigned long long ullCumulated = 0;
+			for (int i = 0; i < CMetricHistogram::BUCKET_COUNT; i++) {
+				ullCumulated += histogram.GetBucket(i);
+				if (ullCumulated > ullCount)
+					ullCumulated = ullCount;
+				snprintf(csValue, sizeof(csValue), "le=\"%g\"", CMetricHistogram::BUCKET_BOUNDS[i]);
+				std::string csLe = csValue;
+				snprintf(csValue, sizeof(csValue), " %llu\n", ullCumulated);
+				csOut += csName + "_bucket" + LabelSet(entry.first, csLe) + csValue;
+			}
+			snprintf(csValue, sizeof(csValue), " %llu\n", ullCount);
+			csOut += csName + "_bucket" + LabelSet(entry.first, "le=\"+Inf\"") + csValue;
+			snprintf(csValue, sizeof(csValue), " %.6f\n", histogram.GetSumMicroseconds() / 1000000.0);
+			csOut += csName + "_sum" + LabelSet(entry.first) + csValue;
+			snprintf(csValue, sizeof(csValue), " %llu\n", ullCount);
+			csOut += csName + "_count" + LabelSet(entry.first) + csValue;
+		}
+	}
+
+	return csOut;
+}
+
+bool CMetrics::WriteFile(const std::string &csPath) {
+	std::string csText = Export();
+	std::string csTmpPath = csPath + ".tmp";
+
+	FILE *f = fopen(csTmpPath.c_str(), "wb");
+	if (f == NULL) {
+		MWLOG(LEV_ERROR, MOD_LIB, "Failed to write metrics file %s", csTmpPath.c_str());
+		return false;
+	}
+	bool bOk = fwrite(csText.c_str(), 1, csText.size(), f) == csText.size();
+	bOk = fclose(f) == 0 && bOk;
+
+#ifdef WIN32
+	// rename() doesn't replace an existing file on Windows
+	remove(csPath.c_str());
+#endif
+	if (!bOk || rename(csTmpPath.c_str(), csPath.c_str()) != 0) {
+		MWLOG(LEV_ERROR, MOD_LIB, "Failed to write metrics file %s", csPath.c_str());
+		remove(csTmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+} // namespace eIDMW
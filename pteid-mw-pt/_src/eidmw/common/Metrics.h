@@ -0,0 +1,134 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/**
+ * In-process registry of counters and latency histograms, exported in the Prometheus
+ * text format by CMetrics::Export() and, if the "metrics_file" configuration value is set,
+ * written periodically to that file.
+ *
+ * Metrics are registered once by name and label set and never removed, so the pointers
+ * returned by the registry can be kept by the caller (typically in a static local). Updating
+ * a metric is lock-free; only the registration and the export take the registry lock.
+ *
+ * The file writer thread is started with the registry and must be stopped with StopFileWriter()
+ * before the library that owns it is unloaded (C_Finalize for the PKCS#11 module, PTEID_ReleaseSDK for the SDK).
+ *
+ * Usage:
+ *   static CMetricHistogram *duration = CMetrics::GetInstance()->GetHistogram(
+ *       "pteid_tsa_request_duration_seconds", "Duration of the timestamp requests");
+ *   CMetricTimer timer(duration);
+ */
+#pragma once
+
+#include "Export.h"
+#include "Mutex.h"
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace eIDMW {
+
+class CMetricsFileWriter;
+
+class EIDMW_CMN_API CMetricCounter {
+public:
+	CMetricCounter() : m_value(0) {}
+
+	void Inc(unsigned long long ullValue = 1) { m_value.fetch_add(ullValue, std::memory_order_relaxed); }
+	unsigned long long Get() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<unsigned long long> m_value;
+};
+
+// Histogram of durations with fixed buckets from 0.5 ms to 60 s
+class EIDMW_CMN_API CMetricHistogram {
+public:
+	static const int BUCKET_COUNT = 14;
+	static const double BUCKET_BOUNDS[BUCKET_COUNT]; // upper bounds in seconds, an extra bucket holds the rest
+
+	CMetricHistogram();
+
+	void ObserveMicroseconds(unsigned long long ullDuration);
+
+	unsigned long long GetBucket(int i) const { return m_buckets[i].load(std::memory_order_relaxed); }
+	unsigned long long GetCount() const { return m_count.load(std::memory_order_relaxed); }
+	unsigned long long GetSumMicroseconds() const { return m_sum.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<unsigned long long> m_buckets[BUCKET_COUNT + 1];
+	std::atomic<unsigned long long> m_count;
+	std::atomic<unsigned long long> m_sum;
+};
+
+// Observes the time elapsed between its construction and destruction, a NULL histogram is ignored
+class EIDMW_CMN_API CMetricTimer {
+public:
+	CMetricTimer(CMetricHistogram *poHistogram);
+	~CMetricTimer();
+
+	// Observe the elapsed time now rather than on destruction
+	void Stop();
+
+private:
+	CMetricTimer(const CMetricTimer &);
+	CMetricTimer &operator=(const CMetricTimer &);
+
+	CMetricHistogram *m_poHistogram;
+	std::chrono::steady_clock::time_point m_start;
+};
+
+class EIDMW_CMN_API CMetrics {
+public:
+	static CMetrics *GetInstance();
+
+	/**
+	 * Return the metric with the given name and labels, registering it on first use.
+	 * csLabels is the content of the Prometheus label set, e.g. "ins=\"A4\"", or "" for none.
+	 * The help text of the first registration of a name is kept.
+	 */
+	CMetricCounter *GetCounter(const char *csName, const char *csHelp, const std::string &csLabels = "");
+	CMetricHistogram *GetHistogram(const char *csName, const char *csHelp, const std::string &csLabels = "");
+
+	// All the metrics in the Prometheus text exposition format
+	std::string Export();
+
+	// Write Export() to csPath, replacing the file atomically where the platform allows it
+	bool WriteFile(const std::string &csPath);
+
+	// Start the periodic write of "metrics_file" if it is configured and the writer isn't running
+	void StartFileWriter();
+
+	// Stop the file writer and wait for it to end, the file is written one last time
+	void StopFileWriter();
+
+private:
+	CMetrics() : m_poWriter(NULL) {}
+	CMetrics(const CMetrics &);
+	CMetrics &operator=(const CMetrics &);
+
+	struct tFamily {
+		std::string csHelp;
+		bool bHistogram;
+		std::map<std::string, std::unique_ptr<CMetricCounter>> counters;
+		std::map<std::string, std::unique_ptr<CMetricHistogram>> histograms;
+	};
+
+	tFamily &GetFamily(const char *csName, const char *csHelp, bool bHistogram);
+
+	CMutex m_mutex;
+	std::map<std::string, tFamily> m_families;
+
+	// Not protected by m_mutex as the writer takes it to export the metrics
+	CMutex m_writerMutex;
+	CMetricsFileWriter *m_poWriter;
+};
+
+} // namespace eIDMW
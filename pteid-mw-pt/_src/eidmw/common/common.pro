@@ -65,6 +65,7 @@ HEADERS += ByteArray.h \
            Hash.h \
            Log.h \
            LogBase.h \
+           Metrics.h \
            Mutex.h \
            MWException.h \
            Thread.h \
@@ -85,6 +86,7 @@ SOURCES += ByteArray.cpp \
            Hash.cpp \
            Log.cpp \
            LogBase.cpp \
+           Metrics.cpp \
            Mutex.cpp \
            MWException.cpp \
            Thread.cpp \
@@ -92,6 +94,7 @@ SOURCES += ByteArray.cpp \
            StringOps.cpp \
            MyriadFontGlyphWidths.cpp \
            libtomcrypt/sha1.c \
+           libtomcrypt/sha224.c \
            libtomcrypt/sha256.c \
            libtomcrypt/sha384.c \
            libtomcrypt/sha512.c
@@ -106,6 +106,10 @@ HEADERS += \
 	../applayer/PAdESExtender.h \
 	../applayer/J2KHelper.h \
 	../applayer/PDFSignature.h \
+	../applayer/PDFMemoryBudget.h \
+	../applayer/PDFProbe.h \
+	../applayer/PDFOccupancy.h \
+	../applayer/RemotePDF.h \
 	../applayer/CurlUtil.h \
 	../applayer/proxyinfo.h 
 
@@ -137,6 +141,10 @@ SOURCES += \
 	../applayer/cJSON.c \
 	../applayer/PKIFetcher.cpp \
 	../applayer/PDFSignature.cpp \
+	../applayer/PDFMemoryBudget.cpp \
+	../applayer/PDFProbe.cpp \
+	../applayer/PDFOccupancy.cpp \
+	../applayer/RemotePDF.cpp \
 	../applayer/PAdESExtender.cpp \
 	../applayer/MutualAuthentication.cpp \
 	../applayer/PNGConverter.cpp \
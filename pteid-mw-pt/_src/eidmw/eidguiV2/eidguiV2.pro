@@ -22,7 +22,8 @@ SOURCES += main.cpp \
     singleapplication_p.cpp \
     singleapplication.cpp \
     can_cache.cpp \
-    concurrent.cpp
+    concurrent.cpp \
+    pdfpreviewrenderer.cpp
 
 INCLUDEPATH += /usr/include/poppler/qt5/
 INCLUDEPATH += ../CMD/services
@@ -148,4 +149,5 @@ HEADERS += \
     singleapplication.h \
     singleapplication_p.h \
     concurrent.h \
+    pdfpreviewrenderer.h \
     eidguiV2Credentials.h
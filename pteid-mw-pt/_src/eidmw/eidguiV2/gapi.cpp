@@ -2222,103 +2222,34 @@ void GAPI::doSignBatchPDF(SignParams &params) {
 	END_TRY_CATCH
 }
 
-QPixmap PDFPreviewImageProvider::requestPixmap(const QString &id, QSize *size, const QSize &requestedSize) {
+QQuickImageResponse *PDFPreviewImageProvider::requestImageResponse(const QString &id, const QSize &requestedSize) {
 	qDebug() << "PDFPreviewImageProvider received request for (width height): " << requestedSize.width() << " - "
 			 << requestedSize.height();
 	QStringList strList = id.split("?");
 
 	QString pdf_path = QUrl::fromPercentEncoding(strList.at(0).toUtf8());
-	m_filePath = pdf_path.toStdString();
+	{
+		QMutexLocker locker(&m_filePathMutex);
+		m_filePath = pdf_path;
+	}
 
 	// URL param ?page=xx
 	unsigned int page = (unsigned int)strList.at(1).split("=").at(1).toInt();
 
-	if (m_docs.find(m_filePath) == m_docs.end()) {
-
-		Poppler::Document *newdoc = Poppler::Document::load(pdf_path);
-		if (!newdoc) {
-			qDebug() << "Failed to load PDF file";
-			return QPixmap();
-		}
-		m_docs.insert(std::pair<std::string, Poppler::Document *>(m_filePath, newdoc));
-
-		newdoc->setRenderHint(Poppler::Document::TextAntialiasing, true);
-		newdoc->setRenderHint(Poppler::Document::Antialiasing, true);
-		newdoc->setRenderBackend(Poppler::Document::RenderBackend::SplashBackend);
-	}
-
-	if (m_file_id != id) {
-		m_cache = renderPDFPage(page);
-		m_file_id = id;
-	}
-
-	QPixmap scaled =
-		m_cache.scaled(requestedSize.width(), requestedSize.height(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
-	size->setHeight(scaled.height());
-	size->setWidth(scaled.width());
-
-	emit signalPdfSourceChanged(m_cache.width());
-
-	return scaled;
+	return m_renderer.requestPage(pdf_path, page, requestedSize);
 }
 
 QSize PDFPreviewImageProvider::getPageSize(int page) {
-	Poppler::Page *popplerPage = m_docs.at(m_filePath)->page(page - 1);
-	return popplerPage->pageSize();
-}
-
-QPixmap PDFPreviewImageProvider::renderPDFPage(unsigned int page) {
-	renderMutex.lock();
-	if (m_docs.empty()) {
-		qDebug() << "Pdf to be rendered was unloaded!";
-		return QPixmap();
-	}
-	// Document starts at page 0 in the poppler-qt5 API
-	Poppler::Page *popplerPage = m_docs.at(m_filePath)->page(page - 1);
-
-	if (popplerPage == NULL) {
-		qDebug() << "Failed to get page object: " << page;
-		return QPixmap();
-	}
-
-	const double resX = 300.0;
-	const double resY = 300.0;
-	QImage image = popplerPage->renderToImage(resX, resY);
-
-	delete popplerPage;
-	renderMutex.unlock();
-
-	if (!image.isNull()) {
-		return QPixmap::fromImage(image);
-	} else {
-		qDebug() << "Error rendering PDF page to image!";
-		return QPixmap();
+	QString filePath;
+	{
+		QMutexLocker locker(&m_filePathMutex);
+		filePath = m_filePath;
 	}
+	return m_renderer.pageSize(filePath, page).toSize();
 }
 
-void PDFPreviewImageProvider::closeDoc(QString filePath) {
-	Concurrent::run(this, &PDFPreviewImageProvider::doCloseDoc, filePath);
-}
-void PDFPreviewImageProvider::closeAllDocs() { Concurrent::run(this, &PDFPreviewImageProvider::doCloseAllDocs); }
-void PDFPreviewImageProvider::doCloseDoc(QString filePath) {
-	renderMutex.lock();
-	std::string filePathStd = filePath.toStdString();
-	if (m_docs.find(filePathStd) != m_docs.end()) {
-		delete m_docs.at(filePathStd);
-		m_docs.erase(filePathStd);
-	}
-	renderMutex.unlock();
-}
-void PDFPreviewImageProvider::doCloseAllDocs() {
-	renderMutex.lock();
-	std::unordered_map<std::string, Poppler::Document *>::iterator it = m_docs.begin();
-	while (it != m_docs.end()) {
-		delete it->second;
-		it++;
-	}
-	m_docs.clear();
-	renderMutex.unlock();
-}
+void PDFPreviewImageProvider::closeDoc(QString filePath) { m_renderer.closeDoc(filePath); }
+void PDFPreviewImageProvider::closeAllDocs() { m_renderer.closeAllDocs(); }
 
 bool GAPI::isNotesSupported() {
 	BEGIN_TRY_CATCH;
@@ -2410,16 +2341,7 @@ void GAPI::signScapWithCMD(QList<QString> inputPDFs, QString outputPDF, QList<QS
 }
 
 static std::vector<ScapAttribute> get_attributes_by_ids(const std::vector<std::string> &ids) {
-	const auto all_attributes = ScapClient::readAttributeCache().data();
-
-	std::vector<ScapAttribute> result;
-	for (const ScapAttribute &a : all_attributes) {
-		if (std::find(ids.begin(), ids.end(), a.unique_id) != ids.end()) {
-			result.push_back(a);
-		}
-	}
-
-	return result;
+	return find_cached_attributes(ids).data();
 }
 
 const std::string SCAP_FUNCIONARIOS_ENTITY_NAME = "SCAP Funcionários";
@@ -58,6 +58,7 @@
 
 #include "CMDSignature.h"
 #include "scapclient.h"
+#include "pdfpreviewrenderer.h"
 #include "cmdErrors.h"
 
 #include "../dialogs/dialogs.h"
@@ -191,12 +192,14 @@ struct WindowGeometry {
 	int height;
 };
 
-class PDFPreviewImageProvider : public QObject, public QQuickImageProvider {
+class PDFPreviewImageProvider : public QObject, public QQuickAsyncImageProvider {
 	Q_OBJECT
 public:
-	PDFPreviewImageProvider() : QQuickImageProvider(QQuickImageProvider::Pixmap) {}
+	PDFPreviewImageProvider() {
+		connect(&m_renderer, &PDFPreviewRenderer::pageReady, this, &PDFPreviewImageProvider::signalPdfSourceChanged);
+	}
 
-	QPixmap requestPixmap(const QString &id, QSize *size, const QSize &requestedSize);
+	QQuickImageResponse *requestImageResponse(const QString &id, const QSize &requestedSize) override;
 	// Returns page size in postscript points
 	QSize getPageSize(int page);
 
@@ -206,14 +209,9 @@ signals:
 	Q_SIGNAL void signalPdfSourceChanged(double original_width);
 
 private:
-	void doCloseDoc(QString filePath);
-	void doCloseAllDocs();
-	QPixmap renderPDFPage(unsigned int page);
-	std::unordered_map<std::string, Poppler::Document *> m_docs; // all loaded pdfs (remain open)
-	std::string m_filePath;										 // file in preview
-	QString m_file_id;											 // file and page in preview
-	QMutex renderMutex;
-	QPixmap m_cache;
+	PDFPreviewRenderer m_renderer;
+	QString m_filePath; // file in preview
+	QMutex m_filePathMutex;
 };
 
 const QString MAIN_QML_PATH("qrc:/main.qml");
@@ -0,0 +1,400 @@
+/*-****************************************************************************
+
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+
+#include "pdfpreviewrenderer.h"
+
+#include <QDebug>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QQuickTextureFactory>
+#include <QThread>
+#include <cmath>
+
+#include "Config.h"
+
+/*
+	We are not interested in these warnings due to being an external library
+*/
+#ifdef WIN32
+	#pragma warning(push)
+	#pragma warning(disable: 4700)
+	#pragma warning(disable: 4996)
+#else
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+	#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#endif
+
+#include <poppler-qt5.h>
+
+#ifdef WIN32
+	#pragma warning(pop)
+#else
+	#pragma GCC diagnostic pop
+#endif
+
+// Resolution used by the previous synchronous renderer; the QML seal geometry is computed against it
+static const double REFERENCE_DPI = 300.0;
+// Render resolutions are rounded up to multiples of this value so that small resizes still hit the cache
+static const int DPI_STEP = 24;
+static const int MAX_RENDER_THREADS = 4;
+static const int PREFETCH_RADIUS = 2;
+static const int CACHE_BUDGET_BYTES = 256 * 1024 * 1024;
+// Documents kept open between renders, the least recently used one is closed first
+static const int MAX_IDLE_DOCS = MAX_RENDER_THREADS;
+
+// A quarter of pdf_memory_budget, the rest is left to the documents being signed
+static int previewCacheBudget() {
+	long budget_mb = eIDMW::CConfig::GetLong(eIDMW::CConfig::EIDMW_CONFIG_PARAM_GENERAL_PDF_MEMORY_BUDGET);
+	if (budget_mb <= 0) {
+		return CACHE_BUDGET_BYTES;
+	}
+	return (int)qMin<qint64>((qint64)budget_mb * 1024 * 1024 / 4, CACHE_BUDGET_BYTES);
+}
+
+QQuickTextureFactory *PDFPageResponse::textureFactory() const {
+	return QQuickTextureFactory::textureFactoryForImage(m_image);
+}
+
+void PDFPageResponse::finish(const QImage &image, const QString &error) {
+	m_image = image;
+	m_error = error;
+	emit finished();
+}
+
+PDFPreviewRenderer::PDFPreviewRenderer(QObject *parent)
+	: QObject(parent), m_globalEpoch(0), m_currentPage(0), m_shuttingDown(false) {
+	m_pool.setMaxThreadCount(qBound(1, QThread::idealThreadCount(), MAX_RENDER_THREADS));
+	m_cache.setMaxCost(previewCacheBudget());
+}
+
+PDFPreviewRenderer::~PDFPreviewRenderer() {
+	m_mutex.lock();
+	m_shuttingDown = true;
+	m_mutex.unlock();
+	// Queued tasks still run so that every pending response is finished, they return early
+	m_pool.waitForDone();
+
+	for (DocEntry &entry : m_idleDocs) {
+		delete entry.doc;
+	}
+}
+
+static QString pageKey(const QString &filePath, const QDateTime &lastModified, int page) {
+	return QString("%1|%2|%3").arg(filePath).arg(lastModified.toMSecsSinceEpoch()).arg(page);
+}
+
+static QString renderKey(const QString &page_key, int dpi) { return QString("%1|%2").arg(page_key).arg(dpi); }
+
+// Lowest resolution that still fills the requested size, capped to the reference resolution
+static int previewDpi(const QSizeF &pageSizePts, const QSize &requestedSize) {
+	if (pageSizePts.isEmpty() || (requestedSize.width() <= 0 && requestedSize.height() <= 0)) {
+		return (int)REFERENCE_DPI;
+	}
+
+	double scaleX = requestedSize.width() > 0 ? requestedSize.width() / pageSizePts.width() : 0;
+	double scaleY = requestedSize.height() > 0 ? requestedSize.height() / pageSizePts.height() : 0;
+	double scale = scaleX > 0 && scaleY > 0 ? qMin(scaleX, scaleY) : qMax(scaleX, scaleY);
+
+	int dpi = (int)std::ceil(72.0 * scale / DPI_STEP) * DPI_STEP;
+	return qBound(DPI_STEP, dpi, (int)REFERENCE_DPI);
+}
+
+QImage PDFPreviewRenderer::fitToRequest(const QImage &image, const QSize &requestedSize) {
+	if (image.isNull() || requestedSize.width() <= 0 || requestedSize.height() <= 0) {
+		return image;
+	}
+	return image.scaled(requestedSize.width(), requestedSize.height(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+}
+
+QImage PDFPreviewRenderer::lookup(const QString &key) {
+	QMutexLocker locker(&m_mutex);
+	QImage *image = m_cache.object(key);
+	return image ? *image : QImage();
+}
+
+void PDFPreviewRenderer::insert(const QString &key, const QImage &image) {
+	QMutexLocker locker(&m_mutex);
+	m_cache.insert(key, new QImage(image), (int)qMin<qint64>(image.sizeInBytes(), m_cache.maxCost()));
+}
+
+PDFPageResponse *PDFPreviewRenderer::requestPage(const QString &filePath, int page, const QSize &requestedSize) {
+	PDFPageResponse *response = new PDFPageResponse();
+	QFileInfo fileInfo(filePath);
+	QString page_key = pageKey(filePath, fileInfo.lastModified(), page);
+
+	QImage cached;
+	double original_width = 0;
+	{
+		QMutexLocker locker(&m_mutex);
+		m_currentFile = filePath;
+		m_currentPage = page;
+
+		QHash<QString, QSizeF>::const_iterator size_it = m_pageSizes.constFind(page_key);
+		if (size_it != m_pageSizes.constEnd()) {
+			QImage *image = m_cache.object(renderKey(page_key, previewDpi(size_it.value(), requestedSize)));
+			if (image) {
+				cached = *image;
+				original_width = qRound(size_it.value().width() * REFERENCE_DPI / 72.0);
+			}
+		}
+	}
+
+	if (!cached.isNull()) {
+		emit pageReady(original_width);
+		QImage result = fitToRequest(cached, requestedSize);
+		// The engine only connects to finished() after this function returns
+		QMetaObject::invokeMethod(response, [response, result]() { response->finish(result); }, Qt::QueuedConnection);
+		schedulePrefetch(filePath, page, requestedSize);
+		return response;
+	}
+
+	m_pool.start(new RenderTask(this, filePath, page, requestedSize, response), 1);
+	return response;
+}
+
+void PDFPreviewRenderer::schedulePrefetch(const QString &filePath, int page, const QSize &requestedSize) {
+	int page_count = 0;
+	{
+		QMutexLocker locker(&m_mutex);
+		page_count = m_pageCounts.value(filePath, 0);
+	}
+
+	const int neighbours[] = {page + 1, page - 1, page + 2};
+	for (int neighbour : neighbours) {
+		if (neighbour >= 1 && neighbour <= page_count) {
+			m_pool.start(new RenderTask(this, filePath, neighbour, requestedSize, nullptr), 0);
+		}
+	}
+}
+
+bool PDFPreviewRenderer::isStalePrefetch(const QString &filePath, int page) {
+	QMutexLocker locker(&m_mutex);
+	return m_shuttingDown || filePath != m_currentFile || qAbs(page - m_currentPage) > PREFETCH_RADIUS;
+}
+
+// Takes an idle copy of the document or loads a new one, the caller has exclusive use of it until releaseDocument()
+bool PDFPreviewRenderer::acquireDocument(const QString &filePath, const QDateTime &lastModified, qint64 fileSize,
+										 DocEntry *entry) {
+	QList<Poppler::Document *> closed;
+	{
+		QMutexLocker locker(&m_mutex);
+		QList<DocEntry>::iterator it = m_idleDocs.begin();
+		while (it != m_idleDocs.end()) {
+			if (it->filePath != filePath) {
+				++it;
+			} else if (it->lastModified == lastModified && it->fileSize == fileSize) {
+				*entry = *it;
+				m_idleDocs.erase(it);
+				break;
+			} else {
+				// Modified on disk since it was loaded
+				closed.append(it->doc);
+				it = m_idleDocs.erase(it);
+			}
+		}
+		if (entry->doc == nullptr) {
+			entry->filePath = filePath;
+			entry->lastModified = lastModified;
+			entry->fileSize = fileSize;
+			entry->globalEpoch = m_globalEpoch;
+			entry->fileEpoch = m_fileEpochs.value(filePath, 0);
+		}
+	}
+	qDeleteAll(closed);
+
+	if (entry->doc) {
+		return true;
+	}
+
+	Poppler::Document *doc = Poppler::Document::load(filePath);
+	if (!doc) {
+		qDebug() << "Failed to load PDF file";
+		return false;
+	}
+	doc->setRenderHint(Poppler::Document::TextAntialiasing, true);
+	doc->setRenderHint(Poppler::Document::Antialiasing, true);
+	doc->setRenderBackend(Poppler::Document::RenderBackend::SplashBackend);
+	entry->doc = doc;
+
+	QMutexLocker locker(&m_mutex);
+	m_pageCounts.insert(filePath, doc->numPages());
+	return true;
+}
+
+// Returns the document to the pool, or closes it if the GUI closed it meanwhile
+void PDFPreviewRenderer::releaseDocument(const DocEntry &entry) {
+	Poppler::Document *closed = nullptr;
+	{
+		QMutexLocker locker(&m_mutex);
+		if (m_shuttingDown || entry.globalEpoch != m_globalEpoch ||
+			entry.fileEpoch != m_fileEpochs.value(entry.filePath, 0)) {
+			closed = entry.doc;
+		} else {
+			m_idleDocs.append(entry);
+			if (m_idleDocs.size() > MAX_IDLE_DOCS) {
+				closed = m_idleDocs.takeFirst().doc;
+			}
+		}
+	}
+	delete closed;
+}
+
+void PDFPreviewRenderer::render(const QString &filePath, int page, const QSize &requestedSize,
+								PDFPageResponse *response) {
+	bool shuttingDown;
+	{
+		QMutexLocker locker(&m_mutex);
+		shuttingDown = m_shuttingDown;
+	}
+
+	if (response == nullptr && isStalePrefetch(filePath, page)) {
+		return;
+	}
+	if (response && (shuttingDown || response->isCancelled())) {
+		response->finish(QImage(), "Request cancelled");
+		return;
+	}
+
+	QFileInfo fileInfo(filePath);
+	QDateTime lastModified = fileInfo.lastModified();
+	QString page_key = pageKey(filePath, lastModified, page);
+
+	DocEntry entry;
+	// Document starts at page 0 in the poppler-qt5 API
+	Poppler::Page *popplerPage = nullptr;
+	if (acquireDocument(filePath, lastModified, fileInfo.size(), &entry)) {
+		popplerPage = entry.doc->page(page - 1);
+		if (popplerPage == nullptr) {
+			releaseDocument(entry);
+		}
+	}
+	if (popplerPage == nullptr) {
+		qDebug() << "Failed to get page object: " << page;
+		if (response) {
+			response->finish(QImage(), "Failed to load PDF page");
+		}
+		return;
+	}
+
+	QSizeF pageSizePts = popplerPage->pageSizeF();
+	{
+		QMutexLocker locker(&m_mutex);
+		m_pageSizes.insert(page_key, pageSizePts);
+	}
+
+	int dpi = previewDpi(pageSizePts, requestedSize);
+	QString key = renderKey(page_key, dpi);
+	QImage image = lookup(key);
+
+	if (image.isNull() && !(response && response->isCancelled())) {
+		image = popplerPage->renderToImage(dpi, dpi);
+		if (!image.isNull()) {
+			insert(key, image);
+		} else {
+			qDebug() << "Error rendering PDF page to image!";
+		}
+	}
+	delete popplerPage;
+	releaseDocument(entry);
+
+	if (response == nullptr) {
+		return;
+	}
+
+	if (response->isCancelled()) {
+		response->finish(QImage(), "Request cancelled");
+		return;
+	}
+
+	if (!image.isNull()) {
+		emit pageReady(qRound(pageSizePts.width() * REFERENCE_DPI / 72.0));
+	}
+	response->finish(fitToRequest(image, requestedSize), image.isNull() ? "Error rendering PDF page" : QString());
+
+	schedulePrefetch(filePath, page, requestedSize);
+}
+
+QSizeF PDFPreviewRenderer::pageSize(const QString &filePath, int page) {
+	QFileInfo fileInfo(filePath);
+	QString page_key = pageKey(filePath, fileInfo.lastModified(), page);
+	{
+		QMutexLocker locker(&m_mutex);
+		QHash<QString, QSizeF>::const_iterator it = m_pageSizes.constFind(page_key);
+		if (it != m_pageSizes.constEnd()) {
+			return it.value();
+		}
+	}
+
+	// The document is returned to the pool so that it is not left open in the calling thread
+	DocEntry entry;
+	if (!acquireDocument(filePath, fileInfo.lastModified(), fileInfo.size(), &entry)) {
+		return QSizeF();
+	}
+	Poppler::Page *popplerPage = entry.doc->page(page - 1);
+	QSizeF size = popplerPage ? popplerPage->pageSizeF() : QSizeF();
+	delete popplerPage;
+	releaseDocument(entry);
+	if (size.isEmpty()) {
+		return size;
+	}
+
+	QMutexLocker locker(&m_mutex);
+	m_pageSizes.insert(page_key, size);
+	return size;
+}
+
+void PDFPreviewRenderer::closeDoc(const QString &filePath) {
+	QList<Poppler::Document *> closed;
+	QMutexLocker locker(&m_mutex);
+	// Copies being rendered are closed when the render finishes
+	m_fileEpochs[filePath]++;
+	m_pageCounts.remove(filePath);
+
+	QList<DocEntry>::iterator doc_it = m_idleDocs.begin();
+	while (doc_it != m_idleDocs.end()) {
+		if (doc_it->filePath == filePath) {
+			closed.append(doc_it->doc);
+			doc_it = m_idleDocs.erase(doc_it);
+		} else {
+			++doc_it;
+		}
+	}
+
+	const QString prefix = filePath + "|";
+	for (const QString &key : m_cache.keys()) {
+		if (key.startsWith(prefix)) {
+			m_cache.remove(key);
+		}
+	}
+	QHash<QString, QSizeF>::iterator it = m_pageSizes.begin();
+	while (it != m_pageSizes.end()) {
+		if (it.key().startsWith(prefix)) {
+			it = m_pageSizes.erase(it);
+		} else {
+			++it;
+		}
+	}
+	locker.unlock();
+	qDeleteAll(closed);
+}
+
+void PDFPreviewRenderer::closeAllDocs() {
+	QList<Poppler::Document *> closed;
+	QMutexLocker locker(&m_mutex);
+	m_globalEpoch++;
+	m_cache.clear();
+	m_pageSizes.clear();
+	m_pageCounts.clear();
+	m_currentFile.clear();
+
+	for (DocEntry &entry : m_idleDocs) {
+		closed.append(entry.doc);
+	}
+	m_idleDocs.clear();
+	locker.unlock();
+	qDeleteAll(closed);
+}
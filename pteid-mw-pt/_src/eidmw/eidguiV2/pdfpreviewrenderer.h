@@ -0,0 +1,130 @@
+/*-****************************************************************************
+
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+
+#ifndef PDFPREVIEWRENDERER_H
+#define PDFPREVIEWRENDERER_H
+
+#include <QCache>
+#include <QDateTime>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QQuickImageResponse>
+#include <QRunnable>
+#include <QSize>
+#include <QList>
+#include <QThreadPool>
+#include <atomic>
+
+namespace Poppler {
+class Document;
+}
+
+/*
+	Response object handed to the QML engine for each preview request.
+	It is completed from a worker thread of PDFPreviewRenderer or immediately on a cache hit.
+*/
+class PDFPageResponse : public QQuickImageResponse {
+	Q_OBJECT
+public:
+	PDFPageResponse() : m_cancelled(false) {}
+
+	QQuickTextureFactory *textureFactory() const override;
+	QString errorString() const override { return m_error; }
+
+	// Called by the engine when the image is no longer needed (e.g. the user already moved to another page)
+	void cancel() override { m_cancelled = true; }
+	bool isCancelled() const { return m_cancelled; }
+
+	void finish(const QImage &image, const QString &error = QString());
+
+private:
+	QImage m_image;
+	QString m_error;
+	std::atomic<bool> m_cancelled;
+};
+
+/*
+	Asynchronous PDF page renderer used by the signature page preview.
+	- Rendering runs in a small thread pool. poppler-qt5 documents can't be used by two threads at once so
+	  each render takes a loaded Poppler::Document out of a shared pool and returns it when done. Only the
+	  most recently used documents stay open, closeDoc() and closeAllDocs() close them right away.
+	- Rendered pages are kept in a byte-bounded LRU cache keyed by (file, modification time, page, dpi).
+	  Its budget is a share of the "pdf_memory_budget" setting.
+	  The render resolution is derived from the requested preview size instead of always using 300 dpi.
+	- After each request the neighbouring pages are prefetched with low priority so that page flips
+	  are served from the cache. Prefetches that are no longer close to the page in view are dropped.
+*/
+class PDFPreviewRenderer : public QObject {
+	Q_OBJECT
+public:
+	explicit PDFPreviewRenderer(QObject *parent = nullptr);
+	~PDFPreviewRenderer();
+
+	// Pages are 1-based as in the QML preview URLs
+	PDFPageResponse *requestPage(const QString &filePath, int page, const QSize &requestedSize);
+
+	// Returns page size in postscript points
+	QSizeF pageSize(const QString &filePath, int page);
+
+	void closeDoc(const QString &filePath);
+	void closeAllDocs();
+
+signals:
+	// Width in pixels of the page rendered at the reference resolution of 300 dpi
+	void pageReady(double original_width);
+
+private:
+	class RenderTask : public QRunnable {
+	public:
+		RenderTask(PDFPreviewRenderer *renderer, const QString &filePath, int page, const QSize &requestedSize,
+				   PDFPageResponse *response)
+			: m_renderer(renderer), m_filePath(filePath), m_page(page), m_requestedSize(requestedSize),
+			  m_response(response) {}
+		void run() override { m_renderer->render(m_filePath, m_page, m_requestedSize, m_response); }
+
+	private:
+		PDFPreviewRenderer *m_renderer;
+		QString m_filePath;
+		int m_page;
+		QSize m_requestedSize;
+		PDFPageResponse *m_response; // NULL for prefetch requests
+	};
+
+	struct DocEntry {
+		Poppler::Document *doc = nullptr;
+		QString filePath;
+		QDateTime lastModified;
+		qint64 fileSize = 0;
+		quint64 fileEpoch = 0;
+		quint64 globalEpoch = 0;
+	};
+
+	void render(const QString &filePath, int page, const QSize &requestedSize, PDFPageResponse *response);
+	void schedulePrefetch(const QString &filePath, int page, const QSize &requestedSize);
+	bool isStalePrefetch(const QString &filePath, int page);
+	bool acquireDocument(const QString &filePath, const QDateTime &lastModified, qint64 fileSize, DocEntry *entry);
+	void releaseDocument(const DocEntry &entry);
+	QImage lookup(const QString &key);
+	void insert(const QString &key, const QImage &image);
+	QImage fitToRequest(const QImage &image, const QSize &requestedSize);
+
+	QThreadPool m_pool;
+
+	QMutex m_mutex; // protects everything below
+	QList<DocEntry> m_idleDocs; // documents not used by any thread, the least recently used first
+	QCache<QString, QImage> m_cache;
+	QHash<QString, QSizeF> m_pageSizes; // page size in points keyed by (file, modification time, page)
+	QHash<QString, int> m_pageCounts;
+	QHash<QString, quint64> m_fileEpochs;
+	quint64 m_globalEpoch;
+	QString m_currentFile;
+	int m_currentPage;
+	bool m_shuttingDown;
+};
+
+#endif // PDFPREVIEWRENDERER_H
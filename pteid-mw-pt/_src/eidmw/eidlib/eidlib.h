@@ -251,6 +251,7 @@ public:
 
 	PTEIDSDK_API PTEID_ByteArray & getphotoRAW(); /**< Retrieve the byte contents of the photo as stored in the card in JPEG-2000 format */
 	PTEIDSDK_API PTEID_ByteArray & getphoto(); /**< Retrieve the byte contents of the photo converted to PNG format for maximum compatibility */
+	PTEIDSDK_API PTEID_ByteArray & getphotoThumbnail(unsigned int reduceFactor = 1); /**< Same as getphoto() but decoded at 1/2^reduceFactor of the original resolution, faster to obtain. reduceFactor is limited to the resolution levels of the photo */
 	PTEIDSDK_API PTEID_ByteArray &getphotoCbeff();
 	PTEIDSDK_API PTEID_ByteArray &getphotoFacialrechdr();
 	PTEIDSDK_API PTEID_ByteArray &getphotoFacialinfo();
@@ -965,6 +966,18 @@ public:
 	 *  Set the PDF file to sign - it can be supplied either with this method or through the class constructor
 	 **/
 	PTEIDSDK_API void setFileSigning(char *input_path);
+	/**
+	 * Set a PDF file served over HTTP(S) to sign, without downloading the whole file.
+	 *
+	 * Only the parts of the file needed for the signature are fetched, with HTTP range requests. The output file of
+	 * the signature gets only the incremental update, which must be appended to the remote file.
+	 * The server must report the file length, support range requests and send a strong ETag or a Last-Modified
+	 * date, which are used to detect changes to the file during the signature.
+	 * PAdES-LT and PAdES-LTA signatures are not supported for remote files.
+	 *
+	 * @param url: URL of the PDF file
+	 **/
+	PTEIDSDK_API void setRemoteFile(const char *url);
 	/**
 	 * Add a file to a batch mode signature.
 	 *
@@ -1001,6 +1014,24 @@ public:
 	 * @deprecated - method related to visible signature using sectors
 	 **/
 	PTEIDSDK_API char *getOccupiedSectors(int page);
+	/**
+	 * Check if a visible signature placed at the given rectangle would overlap the existing annotations or
+	 * signatures of a page.
+	 *
+	 * The annotations of all the pages of a file are collected once and cached until the file changes, so checking
+	 * many positions or pages is cheap. The files added with addToBatchSigning() are analyzed in the background.
+	 *
+	 * @param page - page number, starting at 1
+	 * @param x1, y1, x2, y2 - corners of the rectangle in PDF points, in the default user space of the page
+	 * @param input_path - file of the batch to check, or NULL for the file set with setFileSigning()
+	 * @return true if the rectangle doesn't overlap any visible annotation
+	 **/
+	PTEIDSDK_API bool isAreaFree(int page, double x1, double y1, double x2, double y2, const char *input_path = NULL);
+	/**
+	 * Analyze again, in background threads, the annotations of the files added with addToBatchSigning().
+	 * Each file is already analyzed when it's added, this is only needed if the files were changed since.
+	 **/
+	PTEIDSDK_API void prefetchBatchOccupancy();
 	PTEIDSDK_API void setCustomImage(unsigned char *image_data, unsigned long image_length);
 	/**
 	 * Change the size of the visible signature (Minimum size: 120x35 px)
@@ -1776,6 +1807,13 @@ PTEIDSDK_API void PTEID_GetProxyFromPac(const char *pacFile, const char *url, st
 										std::string *proxy_port);
 #endif
 
+/**
+ * Return the SDK internal metrics (card APDUs, caches, PKI requests, PDF signature stages, PKCS#11 calls)
+ * in the Prometheus text format. The returned string is valid until the next call in the same thread.
+ * They can also be written periodically to the file set in the "metrics_file" configuration value.
+ */
+PTEIDSDK_API const char *PTEID_GetMetrics();
+
 PTEIDSDK_API void setCompatReaderContext(eIDMW::PTEID_ReaderContext *ctx);
 
 PTEIDSDK_API eIDMW::PTEID_ByteArray PTEID_CVC_Init(eIDMW::PTEID_ByteArray cvc_cert);
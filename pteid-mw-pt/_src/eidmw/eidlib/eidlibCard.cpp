@@ -323,6 +323,14 @@ void PTEID_PDFSignature::addToBatchSigning(char *input_path) { mp_signature->bat
 
 void PTEID_PDFSignature::setFileSigning(char *input_path) { mp_signature->setFile(input_path); }
 
+void PTEID_PDFSignature::setRemoteFile(const char *url) {
+	try {
+		mp_signature->setRemoteFile(url);
+	} catch (CMWException &e) {
+		throw PTEID_Exception::THROWException(e);
+	}
+}
+
 void PTEID_PDFSignature::addToBatchSigning(char *input_path, bool last_page) {
 	mp_signature->batchAddFile(input_path, last_page);
 }
@@ -356,6 +364,16 @@ char *PTEID_PDFSignature::getOccupiedSectors(int page) {
 	return mp_signature->getOccupiedSectors(page);
 }
 
+bool PTEID_PDFSignature::isAreaFree(int page, double x1, double y1, double x2, double y2, const char *input_path) {
+	try {
+		return mp_signature->isAreaFree(input_path, page, x1, y1, x2, y2);
+	} catch (CMWException &e) {
+		throw PTEID_Exception::THROWException(e);
+	}
+}
+
+void PTEID_PDFSignature::prefetchBatchOccupancy() { mp_signature->prefetchBatchOccupancy(); }
+
 PDFSignature *PTEID_PDFSignature::getPdfSignature() { return mp_signature; }
 
 int PTEID_PDFSignature::getPageCount() { return mp_signature->getPageCount(); }
@@ -252,6 +252,28 @@ PTEID_ByteArray &PTEID_Photo::getphoto() {
 	return *out;
 }
 
+PTEID_ByteArray &PTEID_Photo::getphotoThumbnail(unsigned int reduceFactor) {
+	PTEID_ByteArray *out = NULL;
+
+	BEGIN_TRY_CATCH
+
+	PhotoPteid *pimpl = static_cast<PhotoPteid *>(m_impl);
+	CByteArray *ca = pimpl->getPhotoPNG(reduceFactor);
+
+	out = dynamic_cast<PTEID_ByteArray *>(getObject(ca));
+	if (!out) {
+		out = new PTEID_ByteArray(m_context, *ca);
+		if (out)
+			addObject(out);
+		else
+			throw PTEID_ExParamRange();
+	}
+
+	END_TRY_CATCH
+
+	return *out;
+}
+
 PTEID_ByteArray &PTEID_Photo::getphotoCbeff() {
 	PTEID_ByteArray *out = NULL;
 
@@ -35,8 +35,10 @@
 
 #include "APLReader.h"
 #include "APLConfig.h"
+#include "CMDSignature.h"
 
 #include "Log.h"
+#include "Metrics.h"
 #include "Mutex.h"
 
 // UNIQUE INDEX FOR RETRIEVING OBJECT
@@ -281,6 +283,7 @@ PTEID_ReaderSet &PTEID_ReaderSet::instance() {
 void PTEID_ReaderSet::initSDK(bool bManageTestCard) {
 	try {
 		CAppLayer::init(bManageTestCard);
+		CMetrics::GetInstance()->StartFileWriter();
 	} catch (CMWException &e) {
 		throw PTEID_Exception::THROWException(e);
 	}
@@ -297,6 +300,9 @@ void PTEID_ReaderSet::releaseSDK() {
 		PTEID_ReaderSet_instance = NULL;
 
 		CAppLayer::release();
+		CMDSignature::releaseIdleConnections();
+		// The metrics file writer must not outlive the SDK library
+		CMetrics::GetInstance()->StopFileWriter();
 	} catch (CMWException &e) {
 		throw PTEID_Exception::THROWException(e);
 	}
@@ -1024,4 +1030,10 @@ void PTEID_LOG(PTEID_LogLevel level, const char *module_name, const char *format
 		throw PTEID_Exception::THROWException(e);
 	}
 }
+
+const char *PTEID_GetMetrics() {
+	static thread_local std::string metrics;
+	metrics = CMetrics::GetInstance()->Export();
+	return metrics.c_str();
+}
 } // namespace eIDMW
@@ -0,0 +1,229 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	ASiC containers written by ASiCWriter read back with libzip: entries, compression, contents and the
+	digests of the input files. The large test input is over 4 GiB, so its entry needs the Zip64 fields.
+*/
+#include "UnitTest.h"
+#include "TestPDF.h"
+
+#include "SigContainer.h"
+#include "ByteArray.h"
+#include "MWException.h"
+
+#include <openssl/sha.h>
+#include <sys/stat.h>
+#include <zip.h>
+
+#include <cstdio>
+#include <cstring>
+
+using namespace eIDMW;
+
+// Over 4 GiB, the input file is sparse and compresses to a few MB
+#define ASIC_TEST_LARGE_SIZE (4ULL * 1024 * 1024 * 1024 + 1024 * 1024)
+
+static const char *SIGNATURE_XML = "<XAdESSignatures>test</XAdESSignatures>";
+
+struct ZipEntry {
+	std::string name;
+	zip_uint16_t method;
+	zip_uint64_t size;
+	std::string data; // empty if readData is false
+	bool readOk;	  // the data was read and its CRC matched
+};
+
+// Entries of the container in the order of its central directory, empty if libzip can't open it
+static std::vector<ZipEntry> readZip(const std::string &path, bool readData) {
+	std::vector<ZipEntry> entries;
+	int error = 0;
+	// ZIP_CHECKCONS compares the local headers, rewritten once the data was written, with the central directory
+	zip_t *zip = zip_open(path.c_str(), ZIP_RDONLY | ZIP_CHECKCONS, &error);
+	if (zip == NULL)
+		return entries;
+
+	for (zip_int64_t i = 0; i < zip_get_num_entries(zip, 0); i++) {
+		zip_stat_t st;
+		zip_stat_init(&st);
+		ZipEntry entry;
+		entry.readOk = zip_stat_index(zip, (zip_uint64_t)i, 0, &st) == 0;
+		entry.name = st.name ? st.name : "";
+		entry.method = st.comp_method;
+		entry.size = st.size;
+
+		zip_file_t *file = zip_fopen_index(zip, (zip_uint64_t)i, 0);
+		entry.readOk = entry.readOk && file != NULL;
+		zip_uint64_t total = 0;
+		char buf[256 * 1024];
+		zip_int64_t n = 0;
+		while (file != NULL && (n = zip_fread(file, buf, sizeof(buf))) > 0) {
+			if (readData)
+				entry.data.append(buf, (size_t)n);
+			total += n;
+		}
+		// libzip checks the CRC at the end of the data, a mismatch is a read error
+		entry.readOk = entry.readOk && n == 0 && total == st.size;
+		if (file != NULL)
+			zip_fclose(file);
+		entries.push_back(entry);
+	}
+	zip_discard(zip);
+	return entries;
+}
+
+static std::string sha256(const std::string &data) {
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	SHA256((const unsigned char *)data.data(), data.size(), digest);
+	return std::string((const char *)digest, sizeof(digest));
+}
+
+static std::string digestOf(const CByteArray &digest) {
+	return std::string((const char *)digest.GetBytes(), digest.Size());
+}
+
+static bool fileExists(const std::string &path) {
+	FILE *f = fopen(path.c_str(), "rb");
+	if (f != NULL)
+		fclose(f);
+	return f != NULL;
+}
+
+static CByteArray signatureXml() {
+	// The signature of XadesSignature is a NUL-terminated string
+	return CByteArray((const unsigned char *)SIGNATURE_XML, (unsigned long)strlen(SIGNATURE_XML) + 1);
+}
+
+UNIT_TEST(asic_writer_round_trip) {
+	std::string dir = testTempDir();
+	std::string contents[] = {std::string(100000, 'a') + "end", "second file", ""};
+	std::string paths[] = {dir + "/document.txt", dir + "/other/document.txt", dir + "/empty.bin"};
+	writeFile(paths[0], contents[0]);
+	mkdir((dir + "/other").c_str(), 0700);
+	writeFile(paths[1], contents[1]);
+	writeFile(paths[2], contents[2]);
+	const char *inputs[] = {paths[0].c_str(), paths[1].c_str(), paths[2].c_str()};
+
+	// ASiC-E: three inputs, two of them with the same name
+	std::string output = dir + "/container.asice";
+	std::vector<std::string> digests;
+	{
+		ASiCWriter writer(inputs, 3, output.c_str());
+		for (unsigned int i = 0; i < 3; i++)
+			digests.push_back(digestOf(writer.addInputFile(i, NULL)));
+		check(!fileExists(output), "the container isn't at its path before close()");
+		writer.close(signatureXml());
+	}
+	check(digests[0] == sha256(contents[0]) && digests[1] == sha256(contents[1]) && digests[2] == sha256(contents[2]),
+		  "addInputFile() returns the SHA-256 digest of each input file");
+
+	std::vector<ZipEntry> entries = readZip(output, true);
+	const char *names[] = {"mimetype",		   "META-INF/README.txt", "META-INF/manifest.xml",
+						   "document.txt",	   "document_1.txt",	  "empty.bin",
+						   "META-INF/signatures001.xml"};
+	bool sameNames = entries.size() == 7;
+	bool allRead = true;
+	for (size_t i = 0; sameNames && i < entries.size(); i++) {
+		sameNames = entries[i].name == names[i];
+		allRead = allRead && entries[i].readOk;
+	}
+	check(sameNames, "ASiC-E: libzip opens the container and lists its entries in order");
+	check(allRead, "ASiC-E: every entry is read back with a matching CRC");
+	check(sameNames && entries[0].method == ZIP_CM_STORE && entries[0].data == "application/vnd.etsi.asic-e+zip",
+		  "ASiC-E: the mimetype is the first entry and is stored");
+	check(sameNames && entries[3].method == ZIP_CM_DEFLATE && entries[3].data == contents[0] &&
+			  entries[4].data == contents[1] && entries[5].data == contents[2] && entries[5].size == 0,
+		  "ASiC-E: the input files are compressed and read back unchanged");
+	check(sameNames && entries[2].data.find("document_1.txt") != std::string::npos &&
+			  entries[6].data == SIGNATURE_XML,
+		  "ASiC-E: the manifest lists the inputs and the signature is the XML without its NUL");
+
+	SigContainer container(output.c_str());
+	std::vector<std::string> listed = container.listInputFiles();
+	check(SigContainer::isValidASiC(output.c_str()) && listed.size() == 3,
+		  "ASiC-E: SigContainer reads the container written by ASiCWriter");
+
+	// ASiC-S: one input and no manifest
+	std::string single = dir + "/single.asics";
+	{
+		ASiCWriter writer(inputs, 1, single.c_str());
+		writer.addInputFile(0, NULL);
+		writer.close(signatureXml());
+	}
+	entries = readZip(single, true);
+	check(entries.size() == 4 && entries[0].data == "application/vnd.etsi.asic-s+zip" &&
+			  entries[2].name == "document.txt" && entries[2].data == contents[0] &&
+			  entries[3].name == "META-INF/signatures001.xml",
+		  "ASiC-S: the container has no manifest");
+
+	// A writer destroyed before close() leaves nothing behind
+	std::string unfinished = dir + "/unfinished.asice";
+	{
+		ASiCWriter writer(inputs, 3, unfinished.c_str());
+		writer.addInputFile(0, NULL);
+	}
+	check(!fileExists(unfinished) && !fileExists(unfinished + ".tmp"),
+		  "an unfinished container and its temporary file are removed");
+}
+
+UNIT_TEST(asic_writer_zip64) {
+	std::string dir = testTempDir();
+	std::string large = dir + "/large.bin";
+	// Sparse file: the last byte is written after a seek past 4 GiB
+	FILE *f = fopen(large.c_str(), "wb");
+	bool created = f != NULL && fseeko(f, (off_t)ASIC_TEST_LARGE_SIZE - 1, SEEK_SET) == 0 && fputc('z', f) == 'z';
+	if (f != NULL)
+		created = fclose(f) == 0 && created;
+	if (!created) {
+		check(false, "create the large input file");
+		return;
+	}
+
+	std::string small = dir + "/small.txt";
+	writeFile(small, "after the large file");
+	const char *inputs[] = {large.c_str(), small.c_str()};
+	std::string output = dir + "/large.asice";
+
+	TestClock::time_point start = TestClock::now();
+	CByteArray largeDigest;
+	{
+		ASiCWriter writer(inputs, 2, output.c_str());
+		largeDigest = writer.addInputFile(0, NULL);
+		writer.addInputFile(1, NULL);
+		writer.close(signatureXml());
+	}
+	double writeMillis = elapsedMillis(start);
+
+	// SHA-256 of the zeros and the last byte
+	SHA256_CTX ctx;
+	SHA256_Init(&ctx);
+	std::string zeros(1024 * 1024, '\0');
+	for (unsigned long long left = ASIC_TEST_LARGE_SIZE - 1; left > 0;) {
+		size_t chunk = left < zeros.size() ? (size_t)left : zeros.size();
+		SHA256_Update(&ctx, zeros.data(), chunk);
+		left -= chunk;
+	}
+	SHA256_Update(&ctx, "z", 1);
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	SHA256_Final(digest, &ctx);
+	check(digestOf(largeDigest) == std::string((const char *)digest, sizeof(digest)),
+		  "the digest of the large input is the SHA-256 of the file");
+
+	start = TestClock::now();
+	std::vector<ZipEntry> entries = readZip(output, false);
+	double readMillis = elapsedMillis(start);
+	printf("%.1f GiB input: %.0f ms to write the container, %.0f ms to read it back with libzip\n",
+		   ASIC_TEST_LARGE_SIZE / (1024.0 * 1024 * 1024), writeMillis, readMillis);
+
+	check(entries.size() == 6, "libzip opens the container with a Zip64 entry");
+	check(entries.size() == 6 && entries[3].name == "large.bin" && entries[3].size == ASIC_TEST_LARGE_SIZE &&
+			  entries[3].readOk,
+		  "the size of the large entry is read from its Zip64 fields and its CRC matches");
+	check(entries.size() == 6 && entries[4].name == "small.txt" && entries[4].readOk &&
+			  entries[5].name == "META-INF/signatures001.xml" && entries[5].readOk,
+		  "the entries after the large one are read back");
+}
@@ -0,0 +1,169 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	APDU traces of the card layer (see ApduTrace.h), only in test builds (qmake CONFIG+=virtual_card).
+	A session with the virtual card is recorded, read back and replayed by a virtual card loaded with the
+	trace. The APDUs and card time per instruction of the recorded and of the replayed session are printed
+	and compared.
+*/
+#ifdef PTEID_VIRTUAL_CARD
+
+#include "UnitTest.h"
+#include "TestPDF.h"
+
+#include "ApduTrace.h"
+#include "VirtualCard.h"
+
+#include <cstdio>
+#include <map>
+#include <vector>
+
+using namespace eIDMW;
+
+// Latency of each APDU of the recorded card, in mili-seconds
+#define RECORDED_CARD_LATENCY 3
+
+struct TraceSummary {
+	unsigned long apdus = 0;
+	unsigned long bytesSent = 0;
+	unsigned long bytesReceived = 0;
+	unsigned long long cardTime = 0; // microseconds
+	std::map<unsigned char, unsigned long> apdusByINS;
+	std::map<unsigned char, unsigned long long> cardTimeByINS;
+};
+
+static TraceSummary summarize(const std::vector<tApduTraceRecord> &records) {
+	TraceSummary summary;
+	for (size_t i = 0; i < records.size(); i++) {
+		const tApduTraceRecord &record = records[i];
+		if (record.ucType != APDU_TRACE_EXCHANGE || record.oCommand.Size() < 4)
+			continue;
+
+		unsigned char ins = record.oCommand.GetByte(1);
+		summary.apdus++;
+		summary.bytesSent += record.oCommand.Size();
+		summary.bytesReceived += record.oResponse.Size();
+		summary.cardTime += record.ulDuration;
+		summary.apdusByINS[ins]++;
+		summary.cardTimeByINS[ins] += record.ulDuration;
+	}
+	return summary;
+}
+
+static void printSummary(const char *name, const TraceSummary &summary) {
+	printf("%s:", name);
+	for (std::map<unsigned char, unsigned long>::const_iterator it = summary.apdusByINS.begin();
+		 it != summary.apdusByINS.end(); ++it)
+		printf(" %02X: %lu APDUs %.1f ms,", it->first, it->second, summary.cardTimeByINS.at(it->first) / 1000.0);
+	printf(" total: %lu APDUs %.1f ms, %lu bytes sent, %lu bytes received\n", summary.apdus,
+		   summary.cardTime / 1000.0, summary.bytesSent, summary.bytesReceived);
+}
+
+static CByteArray hexAPDU(const char *hex) {
+	CByteArray command;
+	unsigned int byte;
+	for (const char *p = hex; sscanf(p, "%2x", &byte) == 1; p += 2)
+		command.Append((unsigned char)byte);
+	return command;
+}
+
+// Sends a command to the card and records it in the trace like CPCSC does
+static CByteArray transmit(CVirtualCard &card, CApduTraceWriter *writer, const CByteArray &command) {
+	unsigned long latency = card.GetStats().ulModelledLatency;
+	CByteArray response = card.Transmit(command);
+	if (writer != NULL)
+		writer->WriteExchange(command, response, card.GetStats().ulModelledLatency - latency);
+	return response;
+}
+
+UNIT_TEST(apdu_trace_replay) {
+	std::string dir = testTempDir();
+	std::string efId(600, '\0');
+	for (size_t i = 0; i < efId.size(); i++)
+		efId[i] = (char)(i * 13);
+	if (!writeFile(dir + "/3F005F00EF02.bin", efId) || !writeFile(dir + "/pin_81.txt", "4321\n")) {
+		check(false, "write the card files");
+		return;
+	}
+
+	// SELECT EF.ID, 3 READ BINARY, VERIFY with a wrong PIN and with the PIN
+	std::vector<CByteArray> session;
+	session.push_back(hexAPDU("00A40800045F00EF02"));
+	session.push_back(hexAPDU("00B0000000"));
+	session.push_back(hexAPDU("00B0010000"));
+	session.push_back(hexAPDU("00B0020000"));
+	session.push_back(hexAPDU("0020008108" "31323334FFFFFFFF"));
+	session.push_back(hexAPDU("0020008108" "34333231FFFFFFFF"));
+
+	std::string trace = dir + "/trace.bin";
+	CVirtualCard recorded(dir, RECORDED_CARD_LATENCY);
+	std::vector<CByteArray> responses;
+	{
+		CApduTraceWriter writer(trace);
+		writer.WriteATR(recorded.GetATR());
+		for (size_t i = 0; i < session.size(); i++)
+			responses.push_back(transmit(recorded, &writer, session[i]));
+	}
+
+	std::vector<tApduTraceRecord> records;
+	check(ReadApduTrace(trace, records) && records.size() == session.size() + 1 &&
+			  records[0].ucType == APDU_TRACE_ATR && records[0].oCommand.Equals(recorded.GetATR()),
+		  "the trace has the ATR and every exchange");
+	if (records.size() != session.size() + 1)
+		return;
+
+	bool masked = true;
+	for (size_t i = 1; i < records.size(); i++) {
+		const CByteArray &command = records[i].oCommand;
+		if (!IsApduTracePinCommand(session[i - 1]))
+			continue;
+		masked = masked && command.Size() == session[i - 1].Size();
+		for (unsigned long j = 5; masked && j < command.Size(); j++)
+			masked = command.GetByte(j) == 0xFF;
+	}
+	check(masked, "the PIN values are masked");
+	check(records[6].oResponse.Size() == 2 && records[6].oResponse.GetByte(0) == 0x90,
+		  "the trace has the responses of the card");
+
+	// The replayed card answers PIN commands from the trace whatever their value
+	CVirtualCard replayed("", 0);
+	check(replayed.LoadReplay(trace), "load the trace in the virtual card");
+	check(replayed.GetATR().Equals(recorded.GetATR()), "the replayed card has the recorded ATR");
+
+	std::string replayTrace = dir + "/replay.bin";
+	bool sameResponses = true;
+	{
+		CApduTraceWriter writer(replayTrace);
+		for (size_t i = 0; i < session.size(); i++) {
+			CByteArray command = session[i];
+			if (IsApduTracePinCommand(command))
+				command.SetByte(0x30, 5);
+			sameResponses = sameResponses && transmit(replayed, &writer, command).Equals(responses[i]);
+		}
+	}
+	tVirtualCardStats stats = replayed.GetStats();
+	check(sameResponses && stats.ulReplayMisses == 0, "the replayed card returns the recorded responses");
+	check(stats.ulModelledLatency == session.size() * RECORDED_CARD_LATENCY * 1000,
+		  "the recorded card time is the modelled latency of the replay");
+
+	CByteArray unknown = replayed.Transmit(hexAPDU("0084000008"));
+	check(unknown.Size() == 2 && unknown.GetByte(0) == 0x6D && replayed.GetStats().ulReplayMisses == 1,
+		  "a command that is not in the trace is counted as a miss");
+
+	std::vector<tApduTraceRecord> replayRecords;
+	ReadApduTrace(replayTrace, replayRecords);
+	TraceSummary first = summarize(records);
+	TraceSummary second = summarize(replayRecords);
+	printSummary("recorded", first);
+	printSummary("replayed", second);
+	check(first.apdusByINS == second.apdusByINS && first.cardTimeByINS == second.cardTimeByINS &&
+			  first.bytesSent == second.bytesSent && first.bytesReceived == second.bytesReceived,
+		  "the recorded and replayed sessions have the same APDUs and card time per instruction");
+}
+
+#endif // PTEID_VIRTUAL_CARD
@@ -0,0 +1,438 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	CMD client of CMD/services against a local TLS mock of the CCMovelSignature SOAP service.
+	The mock signs the hashes it receives with a test key and returns a self-signed test certificate,
+	so the documents of a batch signature are signed end to end without the production service.
+*/
+#include "UnitTest.h"
+#include "LoopbackServer.h"
+#include "TestPDF.h"
+#include "TestPKI.h"
+
+#include "cmdServices.h"
+#include "cmdErrors.h"
+#include "CMDSignature.h"
+#include "PDFSignature.h"
+
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+
+#include <filesystem>
+#include <map>
+
+using namespace eIDMW;
+
+#define MOCK_PROCESS_ID "mock-process-1"
+#define MOCK_USER_ID "+351 900000000"
+#define CMD_STRUCTURES_NS "http://schemas.datacontract.org/2004/07/Ama.Structures.CCMovelSignature"
+
+static std::string toBase64(const std::vector<unsigned char> &data) {
+	std::string encoded(4 * ((data.size() + 2) / 3), '\0');
+	int len = EVP_EncodeBlock((unsigned char *)&encoded[0], data.data(), (int)data.size());
+	encoded.resize(len);
+	return encoded;
+}
+
+static std::vector<unsigned char> fromBase64(const std::string &encoded) {
+	std::vector<unsigned char> data(encoded.size() / 4 * 3);
+	int len = EVP_DecodeBlock(data.data(), (const unsigned char *)encoded.data(), (int)encoded.size());
+	if (len < 0)
+		return std::vector<unsigned char>();
+	// EVP_DecodeBlock counts the bytes of the padding
+	size_t padding = encoded.size() - encoded.find_last_not_of('=') - 1;
+	data.resize(len - padding);
+	return data;
+}
+
+// Texts of the elements with this local name, whatever their namespace prefix
+static std::vector<std::string> elementTexts(const std::string &xml, const std::string &name) {
+	std::vector<std::string> texts;
+	size_t pos = 0;
+	while ((pos = xml.find(name, pos)) != std::string::npos) {
+		size_t tagStart = xml.rfind('<', pos);
+		size_t start = pos + name.size();
+		pos = start;
+		// Only the start tags, <name> or <prefix:name>
+		if (tagStart == std::string::npos || xml[tagStart + 1] == '/' ||
+			xml.find_first_of(" >", tagStart) < start - name.size() ||
+			(start - name.size() != tagStart + 1 && xml[start - name.size() - 1] != ':') ||
+			(xml[start] != '>' && xml[start] != ' ' && xml[start] != '/'))
+			continue;
+		start = xml.find('>', start) + 1;
+		if (xml[start - 2] == '/') {
+			texts.push_back(std::string());
+			continue;
+		}
+		texts.push_back(xml.substr(start, xml.find('<', start) - start));
+	}
+	return texts;
+}
+
+static std::string elementText(const std::string &xml, const std::string &name) {
+	std::vector<std::string> texts = elementTexts(xml, name);
+	return texts.empty() ? std::string() : texts[0];
+}
+
+class MockCMDService : public LoopbackServer {
+public:
+	explicit MockCMDService(const TestIdentity &signer) : m_signer(signer), m_closeAfterEachResponse(false) {}
+
+	// Answers with "Connection: close" so that the client needs a new connection for each request
+	void closeAfterEachResponse() { m_closeAfterEachResponse = true; }
+
+	// Number of requests received for each SOAP action, e.g. "ForceSMS"
+	int requests(const std::string &action) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_requests[action];
+	}
+
+	// processId sent with each ForceSMS request
+	std::vector<std::string> forceSmsProcessIds() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_forceSmsProcessIds;
+	}
+
+	size_t lastBatchSize() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_digestInfos.size();
+	}
+
+protected:
+	bool answer(const HttpRequest &request, std::string &response) {
+		std::string action = request.header("SOAPAction");
+		action = action.substr(action.find_last_of('/') + 1);
+		if (!action.empty() && action[action.size() - 1] == '"')
+			action.erase(action.size() - 1);
+
+		std::string result;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_requests[action]++;
+		}
+
+		if (action == "GetCertificateWithPin") {
+			result = "<ns2:GetCertificateWithPinResponse xmlns:ns2=\"http://Ama.Authentication.Service/\">" +
+					 signStatus("GetCertificateWithPinResult", MOCK_PROCESS_ID) + "</ns2:GetCertificateWithPinResponse>";
+		} else if (action == "ForceSMS") {
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_forceSmsProcessIds.push_back(elementText(request.body, "processId"));
+			}
+			result = "<ns2:ForceSMSResponse xmlns:ns2=\"http://Ama.Authentication.Service/\">" +
+					 signStatus("ForceSMSResult", "") + "</ns2:ForceSMSResponse>";
+		} else if (action == "GetCertificate") {
+			result = "<ns2:GetCertificateResponse xmlns:ns2=\"http://Ama.Authentication.Service/\">"
+					 "<ns2:GetCertificateResult>" +
+					 m_signer.certificatePEM() + "</ns2:GetCertificateResult></ns2:GetCertificateResponse>";
+		} else if (action == "CCMovelMultipleSign") {
+			// Hashes are DigestInfo structures, kept in the order of their ids for the ValidateOtp response
+			std::vector<std::string> hashes = elementTexts(request.body, "Hash");
+			std::vector<std::string> ids = elementTexts(request.body, "id");
+			if (hashes.empty() || hashes.size() != ids.size())
+				return false;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_digestInfos.clear();
+				m_ids = ids;
+				for (size_t i = 0; i < hashes.size(); i++)
+					m_digestInfos.push_back(fromBase64(hashes[i]));
+			}
+			result = "<ns2:CCMovelMultipleSignResponse xmlns:ns2=\"http://Ama.Authentication.Service/\">" +
+					 signStatus("CCMovelMultipleSignResult", MOCK_PROCESS_ID) + "</ns2:CCMovelMultipleSignResponse>";
+		} else if (action == "ValidateOtp") {
+			std::string hashStructures;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				for (size_t i = 0; i < m_digestInfos.size(); i++) {
+					std::vector<unsigned char> signature =
+						m_signer.signDigestInfo(m_digestInfos[i].data(), m_digestInfos[i].size());
+					hashStructures += "<ns3:HashStructure><ns3:Hash>" + toBase64(signature) +
+									  "</ns3:Hash><ns3:Name>doc</ns3:Name><ns3:id>" + m_ids[i] +
+									  "</ns3:id></ns3:HashStructure>";
+				}
+			}
+			result = "<ns2:ValidateOtpResponse xmlns:ns2=\"http://Ama.Authentication.Service/\">"
+					 "<ns2:ValidateOtpResult xmlns:ns3=\"" CMD_STRUCTURES_NS "\"><ns3:ArrayOfHashStructure>" +
+					 hashStructures +
+					 "</ns3:ArrayOfHashStructure><ns3:Status><ns3:Code>200</ns3:Code><ns3:Message>OK</ns3:Message>"
+					 "</ns3:Status></ns2:ValidateOtpResult></ns2:ValidateOtpResponse>";
+		} else {
+			fprintf(stderr, "Mock CMD service: unexpected SOAPAction %s\n", action.c_str());
+			return false;
+		}
+
+		std::string body = "<?xml version=\"1.0\" encoding=\"UTF-8\"?><s:Envelope "
+						   "xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\"><s:Body>" +
+						   result + "</s:Body></s:Envelope>";
+		response = httpResponse("200 OK", "text/xml; charset=utf-8", body,
+								m_closeAfterEachResponse ? "Connection: close\r\n" : "Connection: keep-alive\r\n");
+		return true;
+	}
+
+private:
+	static std::string signStatus(const char *element, const char *processId) {
+		return std::string("<ns2:") + element + " xmlns:ns3=\"" CMD_STRUCTURES_NS "\"><ns3:Code>200</ns3:Code>" +
+			   "<ns3:Field></ns3:Field><ns3:FieldValue></ns3:FieldValue><ns3:Message>OK</ns3:Message>" +
+			   "<ns3:ProcessId>" + processId + "</ns3:ProcessId></ns2:" + element + ">";
+	}
+
+	const TestIdentity &m_signer;
+	bool m_closeAfterEachResponse;
+
+	std::mutex m_mutex; // protects everything below
+	std::map<std::string, int> m_requests;
+	std::vector<std::string> m_forceSmsProcessIds;
+	std::vector<std::vector<unsigned char>> m_digestInfos;
+	std::vector<std::string> m_ids;
+};
+
+// Starts the mock over TLS and points the CMD client at it
+static bool startMockService(MockCMDService &service, const TestIdentity &serverIdentity) {
+	std::string caFile = testTempDir() + "/mock_cmd_ca.pem";
+	if (!serverIdentity.writeCertificatePEM(caFile) ||
+		!service.useTLS(serverIdentity.certificate(), serverIdentity.key()) || !service.start())
+		return false;
+	CMDServices::setTestEndpoint(service.url() + "/Ama.Authentication.Frontend/CCMovelDigitalSignature.svc", caFile);
+	return true;
+}
+
+static void stopMockService(MockCMDService &service) {
+	// The idle clients keep their connection to the mock open
+	CMDServices::releaseIdleClients();
+	CMDServices::setTestEndpoint(std::string(), std::string());
+	service.stop();
+}
+
+UNIT_TEST(cmd_client_reuse) {
+	TestIdentity serverIdentity("127.0.0.1");
+	MockCMDService service(serverIdentity);
+	if (!startMockService(service, serverIdentity)) {
+		check(false, "start the TLS mock CMD service");
+		return;
+	}
+
+	CMDProxyInfo noProxy;
+	noProxy.port = 0;
+
+	CMDServices *client = CMDServices::acquire("mock-user", "mock-password", "mock-application");
+	check(client->askForCertificate(noProxy, MOCK_USER_ID, "1234") == ERR_NONE, "GetCertificateWithPin over TLS");
+	CMDServices::release(client);
+
+	CMDServices *reused = CMDServices::acquire("mock-user", "mock-password", "mock-application");
+	check(reused == client, "client reused with the same credentials");
+	check(reused->forceSMS(noProxy, MOCK_USER_ID) == ERR_NONE, "ForceSMS");
+	std::vector<std::string> processIds = service.forceSmsProcessIds();
+	check(processIds.size() == 1 && processIds[0].empty(), "processId of the previous operation not sent");
+	check(service.connections() == 1, "connection kept alive across operations");
+
+	CMDServices *other = CMDServices::acquire("mock-user", "mock-password", "other-application");
+	check(other != reused, "new client for other credentials");
+	check(other->forceSMS(noProxy, MOCK_USER_ID) == ERR_NONE, "ForceSMS with the new client");
+	check(service.connections() == 2, "new client uses its own connection");
+
+	CMDServices::release(reused);
+	CMDServices::release(other);
+	stopMockService(service);
+}
+
+UNIT_TEST(cmd_tls_session_resumption) {
+	TestIdentity serverIdentity("127.0.0.1");
+	MockCMDService service(serverIdentity);
+	service.closeAfterEachResponse();
+	if (!startMockService(service, serverIdentity)) {
+		check(false, "start the TLS mock CMD service");
+		return;
+	}
+
+	CMDProxyInfo noProxy;
+	noProxy.port = 0;
+
+	CMDServices *client = CMDServices::acquire("mock-user", "mock-password", "mock-application");
+	check(client->askForCertificate(noProxy, MOCK_USER_ID, "1234") == ERR_NONE, "GetCertificateWithPin");
+	CMDServices::release(client);
+
+	client = CMDServices::acquire("mock-user", "mock-password", "mock-application");
+	check(client->forceSMS(noProxy, MOCK_USER_ID) == ERR_NONE, "ForceSMS after the server closed the connection");
+	check(service.connections() == 2, "client reconnected");
+	check(service.resumedSessions() == 1, "TLS session resumed on the new connection");
+
+	CMDServices::release(client);
+	stopMockService(service);
+}
+
+UNIT_TEST(cmd_tls_untrusted_server) {
+	TestIdentity serverIdentity("127.0.0.1");
+	TestIdentity otherIdentity("127.0.0.1");
+	MockCMDService service(serverIdentity);
+	std::string caFile = testTempDir() + "/other_ca.pem";
+	if (!otherIdentity.writeCertificatePEM(caFile) ||
+		!service.useTLS(serverIdentity.certificate(), serverIdentity.key()) || !service.start()) {
+		check(false, "start the TLS mock CMD service");
+		return;
+	}
+	CMDServices::setTestEndpoint(service.url() + "/Ama.Authentication.Frontend/CCMovelDigitalSignature.svc", caFile);
+
+	CMDProxyInfo noProxy;
+	noProxy.port = 0;
+
+	CMDServices *client = CMDServices::acquire("mock-user", "mock-password", "mock-application");
+	check(client->forceSMS(noProxy, MOCK_USER_ID) != ERR_NONE, "server certificate not issued by the CA rejected");
+	check(service.requests("ForceSMS") == 0, "no request sent to the untrusted server");
+
+	CMDServices::release(client);
+	stopMockService(service);
+}
+
+// CCMovelMultipleSign and ValidateOtp of the CMD client with the hashes of 100 documents
+UNIT_TEST(cmd_multiple_sign) {
+	const int hashCount = 100;
+	const unsigned char sha256Prefix[] = {0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01,
+										  0x65, 0x03, 0x04, 0x02, 0x01, 0x05, 0x00, 0x04, 0x20};
+
+	TestIdentity serverIdentity("127.0.0.1");
+	TestIdentity signer("Test Citizen");
+	MockCMDService service(signer);
+	if (!startMockService(service, serverIdentity) || !signer.isOk()) {
+		check(false, "start the TLS mock CMD service");
+		return;
+	}
+
+	std::vector<std::vector<unsigned char>> digestInfos;
+	std::vector<unsigned char *> hashes;
+	std::vector<std::string> docNames;
+	for (int i = 0; i < hashCount; i++) {
+		std::vector<unsigned char> digestInfo(sha256Prefix, sha256Prefix + sizeof(sha256Prefix));
+		std::string document = "document " + std::to_string(i);
+		unsigned char digest[32];
+		EVP_Digest(document.data(), document.size(), digest, NULL, EVP_sha256(), NULL);
+		digestInfo.insert(digestInfo.end(), digest, digest + sizeof(digest));
+		digestInfos.push_back(digestInfo);
+		docNames.push_back(document);
+	}
+	for (int i = 0; i < hashCount; i++)
+		hashes.push_back(digestInfos[i].data());
+
+	CMDProxyInfo noProxy;
+	noProxy.port = 0;
+
+	CMDServices *client = CMDServices::acquire("mock-user", "mock-password", "mock-application");
+	std::vector<CByteArray> certificates;
+	check(client->getCertificate(noProxy, MOCK_USER_ID, certificates) == ERR_NONE, "GetCertificate");
+	check(client->ccMovelMultipleSign(noProxy, hashes, docNames, "1234") == ERR_NONE, "CCMovelMultipleSign");
+	check(service.lastBatchSize() == (size_t)hashCount, "every hash sent in one request");
+
+	std::vector<CByteArray *> signatures;
+	for (int i = 0; i < hashCount; i++)
+		signatures.push_back(new CByteArray());
+	check(client->getSignatures(noProxy, "123456", signatures) == ERR_NONE, "ValidateOtp");
+
+	int validSignatures = 0;
+	EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new(signer.key(), NULL);
+	EVP_PKEY_verify_init(ctx);
+	EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING);
+	for (int i = 0; i < hashCount; i++) {
+		if (EVP_PKEY_verify(ctx, signatures[i]->GetBytes(), signatures[i]->Size(), digestInfos[i].data(),
+							digestInfos[i].size()) == 1)
+			validSignatures++;
+		delete signatures[i];
+	}
+	EVP_PKEY_CTX_free(ctx);
+	check(validSignatures == hashCount, "signatures returned in the order of the hashes");
+	check(service.connections() == 1, "one connection for the whole operation");
+
+	CMDServices::release(client);
+	stopMockService(service);
+}
+
+UNIT_TEST(cmd_client_release_idle) {
+	TestIdentity serverIdentity("127.0.0.1");
+	MockCMDService service(serverIdentity);
+	if (!startMockService(service, serverIdentity)) {
+		check(false, "start the TLS mock CMD service");
+		return;
+	}
+
+	CMDProxyInfo noProxy;
+	noProxy.port = 0;
+
+	CMDServices *client = CMDServices::acquire("mock-user", "mock-password", "mock-application");
+	check(client->forceSMS(noProxy, MOCK_USER_ID) == ERR_NONE, "ForceSMS");
+	CMDServices::release(client);
+
+	CMDSignature::releaseIdleConnections();
+	client = CMDServices::acquire("mock-user", "mock-password", "mock-application");
+	check(client->forceSMS(noProxy, MOCK_USER_ID) == ERR_NONE, "ForceSMS with a new client");
+	check(service.connections() == 2, "idle client closed by releaseIdleConnections()");
+
+	CMDServices::release(client);
+	stopMockService(service);
+}
+
+/*
+	Batch signature of 100 PDFs: the documents are prepared by the PrepareDocumentThread workers, their hashes
+	are sent in one CCMovelMultipleSign request and the signatures of ValidateOtp are added to each document.
+*/
+UNIT_TEST(cmd_batch_signature) {
+	const int documentCount = 100;
+
+	TestIdentity serverIdentity("127.0.0.1");
+	TestIdentity signer("Test Citizen");
+	MockCMDService service(signer);
+	if (!startMockService(service, serverIdentity) || !signer.isOk()) {
+		check(false, "start the TLS mock CMD service");
+		return;
+	}
+
+	std::string dir = testTempDir();
+	std::string outputDir = dir + "/signed";
+	std::filesystem::create_directories(outputDir);
+	std::vector<PDFSignature *> documents;
+	CMDSignature cmdSignature("mock-user", "mock-password", "mock-application");
+	for (int i = 0; i < documentCount; i++) {
+		std::string path = dir + "/document" + std::to_string(i) + ".pdf";
+		writeSimpleTestPDF(path, 1 + i % 5);
+		documents.push_back(new PDFSignature(path.c_str()));
+		cmdSignature.add_pdf_handler(documents.back());
+	}
+	cmdSignature.enableBatchMode();
+
+	CMDProxyInfo noProxy;
+	noProxy.port = 0;
+
+	TestClock::time_point start = TestClock::now();
+	int ret = cmdSignature.signOpen(noProxy, MOCK_USER_ID, "1234", "Lisboa", "Test", outputDir.c_str());
+	double prepareMillis = elapsedMillis(start);
+	check(ret == ERR_NONE, "signOpen of the batch");
+
+	start = TestClock::now();
+	ret = cmdSignature.signClose("123456");
+	double closeMillis = elapsedMillis(start);
+	check(ret == ERR_NONE, "signClose of the batch");
+	printf("%d PDFs: signOpen %.1f ms, signClose %.1f ms\n", documentCount, prepareMillis, closeMillis);
+
+	check(service.requests("GetCertificate") == 1 && service.requests("CCMovelMultipleSign") == 1 &&
+			  service.requests("ValidateOtp") == 1,
+		  "one GetCertificate, CCMovelMultipleSign and ValidateOtp request for the batch");
+	check(service.lastBatchSize() == (size_t)documentCount, "one hash per document in CCMovelMultipleSign");
+
+	int validDocuments = 0;
+	for (std::filesystem::directory_iterator it(outputDir), end; it != end; ++it) {
+		std::string pdf;
+		std::vector<PDFSignatureCheck> signatures;
+		if (readFile(it->path().string(), pdf))
+			signatures = verifyPDFSignatures(pdf, signer.certificate());
+		if (signatures.size() == 1 && signatures[0].valid && signatures[0].byteRangeEnd == pdf.size())
+			validDocuments++;
+	}
+	check(validDocuments == documentCount, "every signed document has a valid signature of the CMD certificate");
+
+	for (size_t i = 0; i < documents.size(); i++)
+		delete documents[i];
+	stopMockService(service);
+}
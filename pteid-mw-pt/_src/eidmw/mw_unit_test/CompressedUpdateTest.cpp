@@ -0,0 +1,162 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	Signatures written in incremental updates with a cross-reference stream and an object stream
+	(PDFDoc::setCompressedUpdates). The digest of the bytes in the /ByteRange of the saved file must be the message
+	digest in the signed attributes of the CMS, like with the classic cross-reference table.
+*/
+#include "UnitTest.h"
+#include "TestPDF.h"
+#include "TestPKI.h"
+
+#include "PDFSignature.h"
+#include "MWException.h"
+#include "eidErrors.h"
+
+#include "poppler/PDFDoc.h"
+#include "goo/GooString.h"
+
+#include <openssl/cms.h>
+#include <openssl/sha.h>
+
+#include <cstring>
+#include <memory>
+
+using namespace eIDMW;
+
+static const unsigned char SHA256_DIGEST_INFO_PREFIX[] = {0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60,
+														  0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02,
+														  0x01, 0x05, 0x00, 0x04, 0x20};
+
+// SHA-256 of the bytes covered by the last /ByteRange of the file, empty if there is none
+static std::string byteRangeDigest(const std::string &pdf) {
+	size_t pos = pdf.rfind("/ByteRange [");
+	unsigned long start1, length1, start2, length2;
+	if (pos == std::string::npos ||
+		sscanf(pdf.c_str() + pos, "/ByteRange [%lu %lu %lu %lu", &start1, &length1, &start2, &length2) != 4 ||
+		start1 + length1 > pdf.size() || start2 + length2 > pdf.size())
+		return std::string();
+
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	SHA256_CTX ctx;
+	SHA256_Init(&ctx);
+	SHA256_Update(&ctx, pdf.data() + start1, length1);
+	SHA256_Update(&ctx, pdf.data() + start2, length2);
+	SHA256_Final(digest, &ctx);
+	return std::string((const char *)digest, sizeof(digest));
+}
+
+// Message digest signed in the last /Contents of the file, empty if there is none
+static std::string signedDigest(const std::string &pdf) {
+	size_t start = pdf.rfind("/Contents <");
+	size_t end = start == std::string::npos ? std::string::npos : pdf.find('>', start);
+	if (end == std::string::npos)
+		return std::string();
+
+	std::string der;
+	for (size_t i = start + strlen("/Contents <"); i + 1 < end; i += 2)
+		der += (char)strtol(pdf.substr(i, 2).c_str(), NULL, 16);
+	const unsigned char *p = (const unsigned char *)der.data();
+	CMS_ContentInfo *cms = d2i_CMS_ContentInfo(NULL, &p, (long)der.size());
+	if (cms == NULL)
+		return std::string();
+
+	std::string digest;
+	STACK_OF(CMS_SignerInfo) *signers = CMS_get0_SignerInfos(cms);
+	if (signers != NULL && sk_CMS_SignerInfo_num(signers) == 1) {
+		ASN1_OCTET_STRING *value = (ASN1_OCTET_STRING *)CMS_signed_get0_data_by_OBJ(
+			sk_CMS_SignerInfo_value(signers, 0), OBJ_nid2obj(NID_pkcs9_messageDigest), -3, V_ASN1_OCTET_STRING);
+		if (value != NULL)
+			digest.assign((const char *)ASN1_STRING_get0_data(value), ASN1_STRING_length(value));
+	}
+	CMS_ContentInfo_free(cms);
+	return digest;
+}
+
+struct SignedUpdate {
+	long error;
+	std::string pdf;
+};
+
+static SignedUpdate sign(const std::string &input, const std::string &output, const TestIdentity &signer) {
+	SignedUpdate result;
+	result.error = EIDMW_OK;
+	try {
+		PDFSignature signature(input.c_str());
+		std::vector<unsigned char> certificate = signer.certificateDER();
+		signature.setExternCertificate(CByteArray(certificate.data(), (unsigned long)certificate.size()));
+		std::vector<CByteArray> caCertificates;
+		signature.setExternCertificateCA(caCertificates);
+		signature.setIsCC(false);
+		signature.signFiles("Lisboa", "Test", output.c_str(), false);
+
+		CByteArray digestInfo(SHA256_DIGEST_INFO_PREFIX, sizeof(SHA256_DIGEST_INFO_PREFIX));
+		digestInfo.Append(signature.getHash());
+		std::vector<unsigned char> value = signer.signDigestInfo(digestInfo.GetBytes(), digestInfo.Size());
+		signature.signClose(CByteArray(value.data(), (unsigned long)value.size()));
+	} catch (CMWException &e) {
+		result.error = e.GetError();
+	}
+	readFile(output, result.pdf);
+	return result;
+}
+
+UNIT_TEST(pdf_compressed_update_signature) {
+	TestIdentity signer("Test Citizen");
+	std::string dir = testTempDir();
+	std::string input = dir + "/document.pdf";
+	std::string original;
+	if (!signer.isOk() || !writeSimpleTestPDF(input, 20) || !readFile(input, original)) {
+		check(false, "create the test document and certificate");
+		return;
+	}
+
+	// The option of the configuration is applied once, before the test chooses the format of the updates
+	configurePDFDocs();
+	PDFDoc::setCompressedUpdates(gFalse);
+	SignedUpdate plain = sign(input, dir + "/plain.pdf", signer);
+	PDFDoc::setCompressedUpdates(gTrue);
+	SignedUpdate compressed = sign(input, dir + "/compressed.pdf", signer);
+	PDFDoc::setCompressedUpdates(gFalse);
+
+	check(plain.error == EIDMW_OK && compressed.error == EIDMW_OK, "both documents are signed");
+	std::string plainUpdate = plain.pdf.size() > original.size() ? plain.pdf.substr(original.size()) : "";
+	std::string update = compressed.pdf.size() > original.size() ? compressed.pdf.substr(original.size()) : "";
+	printf("signature update of a 20-page document: %lu bytes with an xref table, %lu bytes with an xref stream\n",
+		   (unsigned long)plainUpdate.size(), (unsigned long)update.size());
+
+	check(compressed.pdf.compare(0, original.size(), original) == 0, "the signed file starts with the original file");
+	check(update.find("/Type /XRef") != std::string::npos && update.find("/Type /ObjStm") != std::string::npos &&
+			  update.find("\nxref\n") == std::string::npos,
+		  "the update has a cross-reference stream and an object stream");
+	check(!update.empty() && update.size() < plainUpdate.size(), "the compressed update is smaller");
+
+	std::string digest = signedDigest(compressed.pdf);
+	check(!signedDigest(plain.pdf).empty() && byteRangeDigest(plain.pdf) == signedDigest(plain.pdf),
+		  "xref table: the /ByteRange digest is the signed digest");
+	check(!digest.empty() && byteRangeDigest(compressed.pdf) == digest,
+		  "xref stream: the /ByteRange digest is the signed digest");
+
+	std::vector<PDFSignatureCheck> signatures = verifyPDFSignatures(compressed.pdf, signer.certificate());
+	check(signatures.size() == 1 && signatures[0].valid && signatures[0].byteRangeEnd == compressed.pdf.size(),
+		  "the signature of the compressed update is valid over the whole file");
+
+	std::unique_ptr<PDFDoc> doc(new PDFDoc(new GooString((dir + "/compressed.pdf").c_str())));
+	check(doc->isOk() && doc->getNumPages() == 20 && doc->isSigned(),
+		  "the document with the compressed update is read back signed");
+
+	// A second signature over the compressed update, the first one must stay valid
+	PDFDoc::setCompressedUpdates(gTrue);
+	SignedUpdate second = sign(dir + "/compressed.pdf", dir + "/compressed_twice.pdf", signer);
+	PDFDoc::setCompressedUpdates(gFalse);
+	signatures = verifyPDFSignatures(second.pdf, signer.certificate());
+	check(second.error == EIDMW_OK && byteRangeDigest(second.pdf) == signedDigest(second.pdf) &&
+			  signatures.size() == 2 && signatures[0].valid && signatures[1].valid &&
+			  signatures[0].byteRangeEnd == compressed.pdf.size() && signatures[1].byteRangeEnd == second.pdf.size(),
+		  "a second compressed update keeps the first signature valid");
+}
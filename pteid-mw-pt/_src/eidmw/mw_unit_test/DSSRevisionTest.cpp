@@ -0,0 +1,226 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	Validation data added by PDFDoc::addDSS() to a signed document in 3 revisions, like 3 LTV updates for the
+	same signer: the certificates and the CRL are the same in every revision, only the OCSP response is new.
+	The streams already in the document must be reused and the signature must stay valid.
+*/
+#include "UnitTest.h"
+#include "TestPDF.h"
+#include "TestPKI.h"
+
+#include "PDFSignature.h"
+#include "MWException.h"
+#include "eidErrors.h"
+
+#include "poppler/PDFDoc.h"
+#include "poppler/Catalog.h"
+#include "goo/GooString.h"
+
+#include <memory>
+
+using namespace eIDMW;
+
+#define DSS_TEST_REVISIONS 3
+#define DSS_TEST_CRL_SIZE 40000
+
+static const unsigned char SHA256_DIGEST_INFO_PREFIX[] = {0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60,
+														  0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02,
+														  0x01, 0x05, 0x00, 0x04, 0x20};
+
+static bool sign(const std::string &input, const std::string &output, const TestIdentity &signer) {
+	try {
+		PDFSignature signature(input.c_str());
+		std::vector<unsigned char> certificate = signer.certificateDER();
+		signature.setExternCertificate(CByteArray(certificate.data(), (unsigned long)certificate.size()));
+		std::vector<CByteArray> caCertificates;
+		signature.setExternCertificateCA(caCertificates);
+		signature.setIsCC(false);
+		signature.signFiles("Lisboa", "Test", output.c_str(), false);
+
+		CByteArray digestInfo(SHA256_DIGEST_INFO_PREFIX, sizeof(SHA256_DIGEST_INFO_PREFIX));
+		digestInfo.Append(signature.getHash());
+		std::vector<unsigned char> value = signer.signDigestInfo(digestInfo.GetBytes(), digestInfo.Size());
+		return signature.signClose(CByteArray(value.data(), (unsigned long)value.size())) == 0;
+	} catch (CMWException &) {
+		return false;
+	}
+}
+
+// Validation data of a test: pseudo-random bytes that don't compress, like DER, different for each seed
+static std::string validationData(char seed, size_t size) {
+	std::string data(size, '\0');
+	unsigned int state = (unsigned char)seed;
+	for (size_t i = 0; i < size; i++) {
+		state = state * 1103515245 + 12345;
+		data[i] = (char)(state >> 16);
+	}
+	return data;
+}
+
+static ValidationDataElement *element(const std::string &data, ValidationDataElement::ValidationDataType type,
+									  const std::string &vriKey) {
+	std::unordered_set<std::string> keys;
+	keys.insert(vriKey);
+	return new ValidationDataElement((unsigned char *)data.data(), data.size(), type, keys);
+}
+
+static std::string streamData(Object &stream) {
+	std::string data;
+	if (!stream.isStream())
+		return data;
+	stream.streamReset();
+	int c;
+	while ((c = stream.streamGetChar()) != EOF)
+		data += (char)c;
+	stream.streamClose();
+	return data;
+}
+
+static int arrayLength(Object &dict, const char *key) {
+	Object array;
+	int length = dict.isDict() && dict.dictLookup(key, &array)->isArray() ? array.arrayGetLength() : -1;
+	array.free();
+	return length;
+}
+
+// Contents of the DSS of a saved revision
+struct DSSSummary {
+	bool ok;
+	int certs, ocsps, crls;
+	std::vector<std::string> streams; // all the streams of /Certs, /OCSPs and /CRLs
+	int vriEntries;
+	bool vriComplete; // every VRI entry has the 2 certificates, 1 OCSP response and the CRL
+};
+
+static DSSSummary readDSS(const std::string &path) {
+	DSSSummary summary = {false, -1, -1, -1, std::vector<std::string>(), -1, true};
+	std::unique_ptr<PDFDoc> doc(new PDFDoc(new GooString(path.c_str())));
+	Object *dss = doc->isOk() ? doc->getCatalog()->getDSS() : NULL;
+	if (dss == NULL || !dss->isDict())
+		return summary;
+
+	summary.ok = true;
+	summary.certs = arrayLength(*dss, "Certs");
+	summary.ocsps = arrayLength(*dss, "OCSPs");
+	summary.crls = arrayLength(*dss, "CRLs");
+	const char *keys[] = {"Certs", "OCSPs", "CRLs"};
+	for (int k = 0; k < 3; k++) {
+		Object array, stream;
+		dss->dictLookup(keys[k], &array);
+		for (int i = 0; array.isArray() && i < array.arrayGetLength(); i++) {
+			summary.streams.push_back(streamData(*array.arrayGet(i, &stream)));
+			stream.free();
+		}
+		array.free();
+	}
+
+	Object vri;
+	if (dss->dictLookup("VRI", &vri)->isDict()) {
+		summary.vriEntries = vri.dictGetLength();
+		for (int i = 0; i < vri.dictGetLength(); i++) {
+			Object entry;
+			vri.dictGetVal(i, &entry);
+			if (arrayLength(entry, "Cert") != 2 || arrayLength(entry, "OCSP") != 1 || arrayLength(entry, "CRL") != 1)
+				summary.vriComplete = false;
+			entry.free();
+		}
+	}
+	vri.free();
+	return summary;
+}
+
+static void addRevisions(const std::string &signedPath, const std::string &name, GBool compressed,
+						 const TestIdentity &signer) {
+	std::string dir = testTempDir();
+	std::string mode = compressed ? "compressed updates: " : "xref tables: ";
+	std::string certA = validationData('A', 1200);
+	std::string certB = validationData('B', 1300);
+	std::string crl = validationData('C', DSS_TEST_CRL_SIZE);
+
+	PDFDoc::setCompressedUpdates(compressed);
+	std::string input = signedPath;
+	std::vector<size_t> sizes;
+	std::vector<DSSUpdateStats> stats;
+	for (int r = 0; r < DSS_TEST_REVISIONS; r++) {
+		std::string vriKey(40, (char)('0' + r));
+		std::vector<ValidationDataElement *> data;
+		data.push_back(element(certA, ValidationDataElement::CERT, vriKey));
+		data.push_back(element(certB, ValidationDataElement::CERT, vriKey));
+		// The same certificate twice in one update, like the signer certificate and an issuer of the OCSP signer
+		data.push_back(element(certA, ValidationDataElement::CERT, vriKey));
+		data.push_back(element(validationData((char)('a' + r), 500), ValidationDataElement::OCSP, vriKey));
+		data.push_back(element(crl, ValidationDataElement::CRL, vriKey));
+
+		std::string output = dir + "/" + name + "_" + std::to_string(r + 1) + ".pdf";
+		PDFDoc *doc = new PDFDoc(new GooString(input.c_str()));
+		stats.push_back(doc->addDSS(data));
+		doc->saveAs(new GooString(output.c_str()), writeForceIncremental);
+		delete doc;
+		for (size_t i = 0; i < data.size(); i++)
+			delete data[i];
+
+		std::string pdf;
+		readFile(output, pdf);
+		sizes.push_back(pdf.size());
+		input = output;
+	}
+	PDFDoc::setCompressedUpdates(gFalse);
+
+	std::string original, last;
+	readFile(signedPath, original);
+	readFile(input, last);
+	printf("%sDSS revisions of %lu, %lu and %lu bytes\n", mode.c_str(), (unsigned long)(sizes[0] - original.size()),
+		   (unsigned long)(sizes[1] - sizes[0]), (unsigned long)(sizes[2] - sizes[1]));
+
+	check(stats[0].addedStreams == 4 && stats[0].reusedStreams == 1 && stats[0].reusedBytes == certA.size(),
+		  mode + "the first revision embeds a certificate repeated in the update once");
+	bool reused = true;
+	for (int r = 1; r < DSS_TEST_REVISIONS; r++) {
+		reused = reused && stats[r].addedStreams == 1 && stats[r].reusedStreams == 4 &&
+				 stats[r].reusedBytes == 2 * certA.size() + certB.size() + crl.size();
+	}
+	check(reused, mode + "the next revisions only embed the new OCSP response");
+	check(sizes[1] - sizes[0] < 4096 && sizes[2] - sizes[1] < 4096 && sizes[0] - original.size() > crl.size() / 2,
+		  mode + "the next revisions don't grow the file by the size of the reused data");
+
+	DSSSummary dss = readDSS(input);
+	check(dss.ok && dss.certs == 2 && dss.ocsps == DSS_TEST_REVISIONS && dss.crls == 1,
+		  mode + "the DSS has no duplicate streams");
+	check(dss.streams.size() == 6 && dss.streams[0] == certA && dss.streams[1] == certB && dss.streams[5] == crl &&
+			  dss.streams[2] == validationData('a', 500) && dss.streams[4] == validationData('c', 500),
+		  mode + "the streams of the DSS are the validation data");
+	check(dss.vriEntries == DSS_TEST_REVISIONS && dss.vriComplete,
+		  mode + "the VRI entry of every revision has all its validation data");
+
+	std::vector<PDFSignatureCheck> signatures = verifyPDFSignatures(last, signer.certificate());
+	check(signatures.size() == 1 && signatures[0].valid && signatures[0].byteRangeEnd == original.size(),
+		  mode + "the signature stays valid");
+}
+
+UNIT_TEST(pdf_dss_revisions) {
+	TestIdentity signer("Test Citizen");
+	std::string dir = testTempDir();
+	std::string input = dir + "/document.pdf";
+	std::string signedPath = dir + "/signed.pdf";
+	if (!signer.isOk() || !writeSimpleTestPDF(input, 3)) {
+		check(false, "create the test document and certificate");
+		return;
+	}
+
+	// The option of the configuration is applied once, before the test chooses the format of the updates
+	configurePDFDocs();
+	PDFDoc::setCompressedUpdates(gFalse);
+	if (!sign(input, signedPath, signer)) {
+		check(false, "sign the test document");
+		return;
+	}
+
+	addRevisions(signedPath, "dss", gFalse, signer);
+	addRevisions(signedPath, "dss_compressed", gTrue, signer);
+}
@@ -0,0 +1,89 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	Copy of the original file by the saves of pteid-poppler (BaseStream::copyTo), timed against the copy one
+	character at a time that saveIncrementalUpdate() used to do. The copy must be the original file, also when
+	the file is truncated by another process while the document is open.
+*/
+#include "UnitTest.h"
+#include "TestPDF.h"
+
+#include "poppler/PDFDoc.h"
+#include "poppler/Stream.h"
+#include "poppler/ErrorCodes.h"
+#include "goo/GooString.h"
+
+#include <memory>
+
+// Padding of the large document, over loadedFileMaxSize so that it is read through a FileStream
+#define SAVE_TEST_PADDING (64 * 1024 * 1024)
+
+static std::string memoryCopy(MemOutStream &out) { return std::string((const char *)out.getData(), out.size()); }
+
+UNIT_TEST(pdf_incremental_save_copy) {
+	std::string dir = testTempDir();
+	std::string path = dir + "/large.pdf";
+	std::string original = simpleTestPDF(3, 595, 842, SAVE_TEST_PADDING);
+	if (!writeFile(path, original)) {
+		check(false, "write the test document");
+		return;
+	}
+	std::unique_ptr<PDFDoc> doc(new PDFDoc(new GooString(path.c_str())));
+	check(doc->isOk(), "the large document is opened");
+
+	// The copy of saveIncrementalUpdate() before BaseStream::copyTo
+	TestClock::time_point start = TestClock::now();
+	MemOutStream perChar(1024);
+	Stream *str = doc->getBaseStream();
+	str->reset();
+	int c;
+	while ((c = str->getChar()) != EOF)
+		perChar.put((char)c);
+	str->close();
+	double perCharMillis = elapsedMillis(start);
+
+	start = TestClock::now();
+	MemOutStream memory(1024);
+	doc->saveWithoutChangesAs(&memory);
+	double memoryMillis = elapsedMillis(start);
+
+	start = TestClock::now();
+	GooString copyPath((dir + "/large_copy.pdf").c_str());
+	doc->saveWithoutChangesAs(&copyPath);
+	double fileMillis = elapsedMillis(start);
+
+	printf("copy of a %.0f MB document: %.0f ms one character at a time, %.0f ms to memory, %.0f ms to a file\n",
+		   original.size() / (1024.0 * 1024), perCharMillis, memoryMillis, fileMillis);
+	std::string copy;
+	check(memoryCopy(perChar) == original && memoryCopy(memory) == original, "the copy in memory is the file");
+	check(readFile(dir + "/large_copy.pdf", copy) && copy == original, "the copy to a file is the file");
+	check(memoryMillis < perCharMillis && fileMillis < perCharMillis,
+		  "the copy is faster than one character at a time");
+
+	// The incremental update starts with the whole original file
+	GooString updatePath((dir + "/large_update.pdf").c_str());
+	check(doc->saveAs(&updatePath, writeForceIncremental) == errNone && readFile(dir + "/large_update.pdf", copy) &&
+			  copy.size() > original.size() && copy.compare(0, original.size(), original) == 0,
+		  "the incremental update follows the original file");
+
+	// A small document read into memory is copied from its buffer
+	std::string smallPath = dir + "/small.pdf";
+	std::string small = simpleTestPDF(3);
+	writeFile(smallPath, small);
+	std::unique_ptr<PDFDoc> smallDoc(new PDFDoc(new GooString(smallPath.c_str())));
+	MemOutStream smallCopy(1024);
+	smallDoc->saveWithoutChangesAs(&smallCopy);
+	check(memoryCopy(smallCopy) == small, "the copy of a small document is the file");
+
+	// The copy reads the file and stops at its new end, a mapping of the file would fault
+	writeFile(path, original.substr(0, original.size() / 2));
+	MemOutStream truncated(1024);
+	doc->saveWithoutChangesAs(&truncated);
+	check(memoryCopy(truncated) == original.substr(0, original.size() / 2),
+		  "the copy of a file truncated while it is open stops at its end");
+}
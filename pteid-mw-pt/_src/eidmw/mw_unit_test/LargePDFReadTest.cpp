@@ -0,0 +1,116 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	Streams of a document larger than loadedFileMaxSize, which pteid-poppler reads from the file with a
+	FileStream, read one after the other and from several threads at the same time.
+*/
+#include "UnitTest.h"
+#include "TestPDF.h"
+
+#include "poppler/PDFDoc.h"
+#include "poppler/XRef.h"
+#include "poppler/Stream.h"
+#include "goo/GooString.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#define LARGE_TEST_PAGES 400
+#define LARGE_TEST_STREAM_SIZE (64 * 1024)
+#define LARGE_TEST_THREADS 8
+
+// Content of the stream of a page, different for each page
+static std::string streamContent(int page) {
+	std::string data(LARGE_TEST_STREAM_SIZE, ' ');
+	unsigned int state = (unsigned int)page;
+	for (size_t i = 0; i < data.size(); i++) {
+		state = state * 1103515245 + 12345;
+		data[i] = (char)('a' + (state >> 16) % 26);
+	}
+	return data;
+}
+
+static std::string largeDocument(std::vector<int> &streams) {
+	TestPDFWriter writer;
+	int catalog = writer.reserveObject();
+	int root = writer.reserveObject();
+	std::string kids;
+	for (int page = 0; page < LARGE_TEST_PAGES; page++) {
+		int contents = writer.addStream("", streamContent(page));
+		streams.push_back(contents);
+		kids += objectRef(writer.addObject("<< /Type /Page /Parent " + objectRef(root) + " /Contents " +
+										   objectRef(contents) + " >>")) +
+				" ";
+	}
+	writer.setObject(root, "<< /Type /Pages /Kids [" + kids + "] /Count " + std::to_string(LARGE_TEST_PAGES) +
+							   " /MediaBox [0 0 595 842] >>");
+	writer.setObject(catalog, "<< /Type /Catalog /Pages " + objectRef(root) + " >>");
+	return writer.finish(catalog);
+}
+
+static std::string readStream(XRef *xref, int num) {
+	Object obj;
+	std::string data;
+	if (xref->fetch(num, 0, &obj)->isStream()) {
+		Guchar buf[1024];
+		int n;
+		obj.streamReset();
+		while ((n = obj.getStream()->doGetChars(sizeof(buf), buf)) > 0)
+			data.append((const char *)buf, n);
+		obj.streamClose();
+	}
+	obj.free();
+	return data;
+}
+
+UNIT_TEST(pdf_large_file_streams) {
+	std::string path = testTempDir() + "/large_streams.pdf";
+	std::vector<int> streams;
+	std::string pdf = largeDocument(streams);
+	if (pdf.size() <= loadedFileMaxSize || !writeFile(path, pdf)) {
+		check(false, "write a test document larger than loadedFileMaxSize");
+		return;
+	}
+	std::unique_ptr<PDFDoc> doc(new PDFDoc(new GooString(path.c_str())));
+	check(doc->isOk() && doc->getNumPages() == LARGE_TEST_PAGES, "the large document is opened");
+	XRef *xref = doc->getXRef();
+	std::vector<std::string> contents;
+	for (int page = 0; page < LARGE_TEST_PAGES; page++)
+		contents.push_back(streamContent(page));
+
+	TestClock::time_point start = TestClock::now();
+	int mismatches = 0;
+	for (int page = 0; page < LARGE_TEST_PAGES; page++) {
+		if (readStream(xref, streams[page]) != contents[page])
+			mismatches++;
+	}
+	double readMillis = elapsedMillis(start);
+	check(mismatches == 0, "the streams of the large document are read");
+
+	// Each thread reads the streams in a different order, interleaving its reads with the others
+	std::atomic<int> threadMismatches(0);
+	std::vector<std::thread> threads;
+	start = TestClock::now();
+	for (int t = 0; t < LARGE_TEST_THREADS; t++) {
+		threads.push_back(std::thread([&, t]() {
+			for (int i = 0; i < LARGE_TEST_PAGES; i++) {
+				int page = (i * 7 + t * 13) % LARGE_TEST_PAGES;
+				if (readStream(xref, streams[page]) != contents[page])
+					threadMismatches++;
+			}
+		}));
+	}
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+	double threadsMillis = elapsedMillis(start);
+
+	printf("%.0f MB document: %.0f ms to read its streams, %.0f ms for %d threads reading them all\n",
+		   pdf.size() / (1024.0 * 1024), readMillis, threadsMillis, LARGE_TEST_THREADS);
+	check(threadMismatches == 0, "the streams read from several threads at the same time are the streams");
+}
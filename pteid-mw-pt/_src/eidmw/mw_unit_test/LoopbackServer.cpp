@@ -0,0 +1,267 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+#include "LoopbackServer.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef WIN32
+typedef int socklen_t;
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define INVALID_SOCKET -1
+#define SD_BOTH SHUT_RDWR
+#define closesocket close
+#endif
+
+struct LoopbackServer::Connection {
+	SOCKET socket;
+	SSL *ssl;
+};
+
+static bool sameHeaderName(const std::string &headers, size_t pos, const std::string &name) {
+	for (size_t i = 0; i < name.size(); i++) {
+		if (tolower((unsigned char)headers[pos + i]) != tolower((unsigned char)name[i]))
+			return false;
+	}
+	return headers[pos + name.size()] == ':';
+}
+
+std::string HttpRequest::header(const std::string &name) const {
+	size_t pos = 0;
+	while ((pos = headers.find("\r\n", pos)) != std::string::npos) {
+		pos += 2;
+		if (pos + name.size() < headers.size() && sameHeaderName(headers, pos, name)) {
+			size_t start = headers.find_first_not_of(' ', pos + name.size() + 1);
+			return headers.substr(start, headers.find("\r\n", start) - start);
+		}
+	}
+	return std::string();
+}
+
+LoopbackServer::LoopbackServer()
+	: m_listener(INVALID_SOCKET), m_port(0), m_sslContext(NULL), m_stopped(false), m_connections(0),
+	  m_resumedSessions(0) {}
+
+LoopbackServer::~LoopbackServer() {
+	stop();
+	SSL_CTX_free(m_sslContext);
+}
+
+bool LoopbackServer::useTLS(X509 *certificate, EVP_PKEY *key) {
+	m_sslContext = SSL_CTX_new(TLS_server_method());
+	if (m_sslContext == NULL)
+		return false;
+	// Sessions are kept so that the clients can resume them on a new connection
+	const unsigned char sessionContext[] = "mw_unit_test";
+	SSL_CTX_set_session_id_context(m_sslContext, sessionContext, sizeof(sessionContext) - 1);
+	return SSL_CTX_use_certificate(m_sslContext, certificate) == 1 && SSL_CTX_use_PrivateKey(m_sslContext, key) == 1;
+}
+
+bool LoopbackServer::start() {
+	m_listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (m_listener == INVALID_SOCKET)
+		return false;
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	socklen_t len = sizeof(addr);
+	if (bind(m_listener, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(m_listener, 16) != 0 ||
+		getsockname(m_listener, (sockaddr *)&addr, &len) != 0) {
+		closesocket(m_listener);
+		m_listener = INVALID_SOCKET;
+		return false;
+	}
+
+	m_port = ntohs(addr.sin_port);
+	m_thread = std::thread(&LoopbackServer::serve, this);
+	return true;
+}
+
+void LoopbackServer::stop() {
+	if (m_listener == INVALID_SOCKET)
+		return;
+
+	// Unblocks accept() and then the recv() of the connections kept alive by the clients
+	shutdown(m_listener, SD_BOTH);
+	closesocket(m_listener);
+	m_thread.join();
+	m_listener = INVALID_SOCKET;
+
+	std::vector<std::thread> connectionThreads;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopped = true;
+		for (size_t i = 0; i < m_sockets.size(); i++)
+			shutdown(m_sockets[i], SD_BOTH);
+		connectionThreads.swap(m_connectionThreads);
+	}
+	for (size_t i = 0; i < connectionThreads.size(); i++)
+		connectionThreads[i].join();
+}
+
+std::string LoopbackServer::url() const {
+	return std::string(m_sslContext != NULL ? "https" : "http") + "://127.0.0.1:" + std::to_string(m_port);
+}
+
+int LoopbackServer::connections() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_connections;
+}
+
+int LoopbackServer::resumedSessions() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_resumedSessions;
+}
+
+std::string LoopbackServer::httpResponse(const std::string &status, const std::string &contentType,
+										 const std::string &body, const std::string &extraHeaders) {
+	return "HTTP/1.1 " + status + "\r\nContent-Type: " + contentType +
+		   "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n" + extraHeaders + "\r\n" + body;
+}
+
+void LoopbackServer::serve() {
+	while (true) {
+		SOCKET s = accept(m_listener, NULL, NULL);
+		if (s == INVALID_SOCKET)
+			return;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_stopped) {
+			closesocket(s);
+			return;
+		}
+		m_connections++;
+		m_sockets.push_back(s);
+		Connection *connection = new Connection;
+		connection->socket = s;
+		connection->ssl = NULL;
+		m_connectionThreads.push_back(std::thread(&LoopbackServer::serveConnection, this, connection));
+	}
+}
+
+void LoopbackServer::serveConnection(Connection *connection) {
+	bool ok = true;
+	if (m_sslContext != NULL) {
+		connection->ssl = SSL_new(m_sslContext);
+		SSL_set_fd(connection->ssl, (int)connection->socket);
+		ok = SSL_accept(connection->ssl) == 1;
+		if (ok && SSL_session_reused(connection->ssl)) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_resumedSessions++;
+		}
+	}
+
+	std::string buffer;
+	HttpRequest request;
+	while (ok && readRequest(connection, buffer, request)) {
+		std::string response;
+		if (!answer(request, response) || !sendAll(connection, response))
+			break;
+		size_t headersEnd = response.find("\r\n\r\n");
+		if (response.substr(0, headersEnd).find("\r\nConnection: close") != std::string::npos)
+			break;
+	}
+
+	if (connection->ssl != NULL) {
+		SSL_shutdown(connection->ssl);
+		SSL_free(connection->ssl);
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (size_t i = 0; i < m_sockets.size(); i++) {
+			if (m_sockets[i] == connection->socket) {
+				m_sockets.erase(m_sockets.begin() + i);
+				break;
+			}
+		}
+	}
+	closesocket(connection->socket);
+	delete connection;
+}
+
+bool LoopbackServer::readRequest(Connection *connection, std::string &buffer, HttpRequest &request) {
+	size_t headersEnd;
+	while ((headersEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+		if (!receive(connection, buffer))
+			return false;
+	}
+
+	std::string requestLine = buffer.substr(0, buffer.find("\r\n"));
+	size_t targetStart = requestLine.find(' ') + 1;
+	request.method = requestLine.substr(0, targetStart - 1);
+	request.target = requestLine.substr(targetStart, requestLine.find(' ', targetStart) - targetStart);
+	// The header block keeps the CRLF of the request line so that every header follows a CRLF
+	request.headers = buffer.substr(requestLine.size(), headersEnd + 4 - requestLine.size());
+	buffer.erase(0, headersEnd + 4);
+	request.body.clear();
+
+	if (request.header("Transfer-Encoding").find("chunked") != std::string::npos) {
+		while (true) {
+			size_t lineEnd;
+			while ((lineEnd = buffer.find("\r\n")) == std::string::npos) {
+				if (!receive(connection, buffer))
+					return false;
+			}
+			size_t chunkLen = strtoul(buffer.c_str(), NULL, 16);
+			while (buffer.size() < lineEnd + 2 + chunkLen + 2) {
+				if (!receive(connection, buffer))
+					return false;
+			}
+			request.body.append(buffer, lineEnd + 2, chunkLen);
+			buffer.erase(0, lineEnd + 2 + chunkLen + 2);
+			if (chunkLen == 0)
+				return true;
+		}
+	}
+
+	size_t contentLen = strtoul(request.header("Content-Length").c_str(), NULL, 10);
+	while (buffer.size() < contentLen) {
+		if (!receive(connection, buffer))
+			return false;
+	}
+	request.body = buffer.substr(0, contentLen);
+	buffer.erase(0, contentLen);
+	return true;
+}
+
+bool LoopbackServer::receive(Connection *connection, std::string &buffer) {
+	char data[16384];
+	int len;
+	if (connection->ssl != NULL)
+		len = SSL_read(connection->ssl, data, sizeof(data));
+	else
+		len = recv(connection->socket, data, sizeof(data), 0);
+	if (len <= 0)
+		return false;
+	buffer.append(data, len);
+	return true;
+}
+
+bool LoopbackServer::sendAll(Connection *connection, const std::string &data) {
+	size_t sent = 0;
+	while (sent < data.size()) {
+		int len;
+		int chunk = (int)std::min<size_t>(data.size() - sent, 1 << 20);
+		if (connection->ssl != NULL)
+			len = SSL_write(connection->ssl, data.data() + sent, chunk);
+		else
+			len = send(connection->socket, data.data() + sent, chunk, 0);
+		if (len <= 0)
+			return false;
+		sent += len;
+	}
+	return true;
+}
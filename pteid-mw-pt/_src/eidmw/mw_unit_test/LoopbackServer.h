@@ -0,0 +1,85 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	HTTP/1.1 server on 127.0.0.1 used by the tests in place of the CMD, SCAP and file servers.
+	Each connection is served by its own thread and kept alive until the client closes it or
+	a response has a "Connection: close" header, so the tests can count the connections the
+	clients open. With useTLS() the server speaks TLS and counts the resumed TLS sessions.
+*/
+#pragma once
+
+#include <openssl/ssl.h>
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef WIN32
+#include <winsock2.h>
+#else
+typedef int SOCKET;
+#endif
+
+struct HttpRequest {
+	std::string method;
+	std::string target;
+	std::string headers;
+	std::string body;
+
+	// Value of a header, the name is not case sensitive
+	std::string header(const std::string &name) const;
+};
+
+class LoopbackServer {
+public:
+	LoopbackServer();
+	virtual ~LoopbackServer();
+
+	// Serve over TLS with this certificate and key, which must be set before start()
+	bool useTLS(X509 *certificate, EVP_PKEY *key);
+
+	bool start();
+	void stop();
+
+	unsigned short port() const { return m_port; }
+	// e.g. https://127.0.0.1:40123
+	std::string url() const;
+
+	int connections();
+	int resumedSessions();
+
+protected:
+	// Builds the response to a request, returns false to close the connection without answering.
+	// Called from the connection threads, concurrently for different connections.
+	virtual bool answer(const HttpRequest &request, std::string &response) = 0;
+
+	static std::string httpResponse(const std::string &status, const std::string &contentType,
+									const std::string &body, const std::string &extraHeaders = std::string());
+
+private:
+	struct Connection;
+
+	void serve();
+	void serveConnection(Connection *connection);
+	bool readRequest(Connection *connection, std::string &buffer, HttpRequest &request);
+	bool receive(Connection *connection, std::string &buffer);
+	bool sendAll(Connection *connection, const std::string &data);
+
+	SOCKET m_listener;
+	unsigned short m_port;
+	SSL_CTX *m_sslContext;
+	std::thread m_thread;
+
+	std::mutex m_mutex; // protects everything below
+	bool m_stopped;
+	int m_connections;
+	int m_resumedSessions;
+	std::vector<SOCKET> m_sockets;
+	std::vector<std::thread> m_connectionThreads;
+};
@@ -0,0 +1,141 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	Documents prepared for a signature with an external certificate and closed to fit the PDF memory budget
+	before signClose(). The signed file must be the same as the one of a document that stayed open.
+*/
+#include "UnitTest.h"
+#include "TestPDF.h"
+#include "TestPKI.h"
+
+#include "PDFSignature.h"
+#include "MWException.h"
+#include "eidErrors.h"
+
+#include <ctime>
+
+using namespace eIDMW;
+
+// DigestInfo of a SHA-256 hash without the hash, the hashes of PDFSignature are signed like CMD does
+static const unsigned char SHA256_DIGEST_INFO_PREFIX[] = {0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60,
+														  0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02,
+														  0x01, 0x05, 0x00, 0x04, 0x20};
+
+static PDFSignature *prepare(const std::string &input, const std::string &output, const TestIdentity &signer) {
+	PDFSignature *signature = new PDFSignature(input.c_str());
+	std::vector<unsigned char> certificate = signer.certificateDER();
+	signature->setExternCertificate(CByteArray(certificate.data(), (unsigned long)certificate.size()));
+	std::vector<CByteArray> caCertificates;
+	signature->setExternCertificateCA(caCertificates);
+	signature->setIsCC(false);
+	signature->signFiles("Lisboa", "Test", output.c_str(), false);
+	return signature;
+}
+
+static int signClose(PDFSignature *signature, const TestIdentity &signer) {
+	CByteArray digestInfo(SHA256_DIGEST_INFO_PREFIX, sizeof(SHA256_DIGEST_INFO_PREFIX));
+	digestInfo.Append(signature->getHash());
+	std::vector<unsigned char> value = signer.signDigestInfo(digestInfo.GetBytes(), digestInfo.Size());
+	return signature->signClose(CByteArray(value.data(), (unsigned long)value.size()));
+}
+
+/*
+	The name of the signature field is random, so are the bytes that depend on it: the signature, the offsets of
+	the objects written after the field name and the byte ranges. They are removed so that two signatures of the
+	same file in the same second can be compared byte for byte.
+*/
+static void removeAfter(std::string &pdf, const std::string &marker, char end) {
+	size_t pos = 0;
+	while ((pos = pdf.find(marker, pos)) != std::string::npos) {
+		pos += marker.size();
+		pdf.erase(pos, pdf.find(end, pos) - pos);
+	}
+}
+
+static std::string withoutRandomBytes(const std::string &pdf) {
+	std::string result = pdf;
+	removeAfter(result, "/T (Signature", ')');
+	removeAfter(result, "/Contents <", '>');
+	removeAfter(result, "/ByteRange [", ']');
+	removeAfter(result, "startxref", '%');
+	// The offsets of the xref table entries, "0000001111 00000 n"
+	size_t pos = 0;
+	while ((pos = result.find(" 00000 n", pos)) != std::string::npos) {
+		result.erase(pos - 10, 10);
+		pos -= 10 - 1;
+	}
+	return result;
+}
+
+static bool isSigned(const std::string &path, const TestIdentity &signer) {
+	std::string pdf;
+	if (!readFile(path, pdf))
+		return false;
+	std::vector<PDFSignatureCheck> signatures = verifyPDFSignatures(pdf, signer.certificate());
+	return signatures.size() == 1 && signatures[0].valid && signatures[0].byteRangeEnd == pdf.size();
+}
+
+UNIT_TEST(pdf_closed_prepared_document) {
+	TestIdentity signer("Test Citizen");
+	std::string dir = testTempDir();
+	std::string input = dir + "/document.pdf";
+	if (!signer.isOk() || !writeSimpleTestPDF(input, 3)) {
+		check(false, "create the test document and certificate");
+		return;
+	}
+
+	// The signing time is in the signed bytes, both documents must be prepared in the same second
+	PDFSignature *open = NULL;
+	PDFSignature *closed = NULL;
+	time_t start = 0;
+	for (int attempt = 0; attempt < 3 && (open == NULL || time(NULL) != start); attempt++) {
+		delete open;
+		delete closed;
+		start = time(NULL);
+		open = prepare(input, dir + "/open.pdf", signer);
+		closed = prepare(input, dir + "/closed.pdf", signer);
+	}
+
+	check(closed->closePreparedDocument(), "the prepared document is closed");
+	check(closed->getPageCount() == 3, "the page count of the closed document is the one of the file");
+
+	check(signClose(open, signer) == 0, "signClose of the open document");
+	check(signClose(closed, signer) == 0, "signClose of the closed document");
+
+	std::string openPdf, closedPdf;
+	check(readFile(dir + "/open.pdf", openPdf) && readFile(dir + "/closed.pdf", closedPdf) && !closedPdf.empty() &&
+			  withoutRandomBytes(openPdf) == withoutRandomBytes(closedPdf),
+		  "the closed document is signed byte for byte like the open one");
+	std::string original;
+	readFile(input, original);
+	check(closedPdf.compare(0, original.size(), original) == 0, "the signed file starts with the original file");
+	check(isSigned(dir + "/closed.pdf", signer), "the signature of the closed document is valid");
+	delete open;
+	delete closed;
+
+	// A new signature prepared after the document was closed replaces the closed one
+	PDFSignature *prepared = prepare(input, dir + "/prepared_again.pdf", signer);
+	check(prepared->closePreparedDocument(), "the document prepared again is closed");
+	prepared->signFiles("Lisboa", "Test", (dir + "/prepared_again.pdf").c_str(), false);
+	check(signClose(prepared, signer) == 0 && isSigned(dir + "/prepared_again.pdf", signer),
+		  "a document prepared again after it was closed is signed");
+	delete prepared;
+
+	// The hash covers the original file, a closed document isn't signed if the file changed
+	PDFSignature *changed = prepare(input, dir + "/changed.pdf", signer);
+	check(changed->closePreparedDocument(), "the document to change is closed");
+	writeFile(input, original + "\n");
+	long error = 0;
+	try {
+		signClose(changed, signer);
+	} catch (CMWException &e) {
+		error = e.GetError();
+	}
+	check(error == EIDMW_PDF_INVALID_ERROR, "signClose fails if the file changed after it was closed");
+	delete changed;
+}
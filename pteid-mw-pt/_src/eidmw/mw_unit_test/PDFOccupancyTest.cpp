@@ -0,0 +1,157 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	Occupied sectors of every page of a 2000-page document found by PDFOccupancy in one pass, compared with
+	PDFDoc::getOccupiedSectors() called for each page.
+*/
+#include "UnitTest.h"
+#include "TestPDF.h"
+
+#include "PDFOccupancy.h"
+
+#include "poppler/PDFDoc.h"
+#include "goo/GooString.h"
+
+#include <memory>
+
+using namespace eIDMW;
+
+#define OCCUPANCY_TEST_PAGES 2000
+#define OCCUPANCY_TEST_PAGES_PER_NODE 50
+
+static std::string rect(int x) {
+	return " /Rect [" + std::to_string(x) + " 100 " + std::to_string(x + 150) + " 150]";
+}
+
+/*
+	Annotations of a page: signatures placed by sector (one of them hidden), a text field, a note and a square
+	annotation with signature field entries, which isn't a widget
+*/
+static std::string annotations(TestPDFWriter &writer, int page) {
+	std::vector<int> annots;
+	if (page % 3 == 0)
+		annots.push_back(writer.addObject("<< /Type /Annot /Subtype /Widget /FT /Sig /T (Sector" +
+										  std::to_string(page) + ") /SigSector " + std::to_string(page % 12 + 1) +
+										  rect(50) + " >>"));
+	if (page % 5 == 0)
+		annots.push_back(writer.addObject("<< /Type /Annot /Subtype /Widget /FT /Sig /T (Hidden" +
+										  std::to_string(page) + ") /F 2 /SigSector 18" + rect(250) + " >>"));
+	if (page % 7 == 0)
+		annots.push_back(writer.addObject("<< /Type /Annot /Subtype /Widget /FT /Tx /T (Text" +
+										  std::to_string(page) + ")" + rect(400) + " >>"));
+	if (page % 11 == 0)
+		annots.push_back(writer.addObject("<< /Type /Annot /Subtype /Text /Contents (Note)" + rect(50) + " >>"));
+	if (page % 13 == 0)
+		annots.push_back(
+			writer.addObject("<< /Type /Annot /Subtype /Square /FT /Sig /SigSector 9" + rect(300) + " >>"));
+
+	std::string refs;
+	for (size_t i = 0; i < annots.size(); i++)
+		refs += objectRef(annots[i]) + " ";
+	return annots.empty() ? std::string() : " /Annots [" + refs + "]";
+}
+
+// Pages under nodes of 50 pages each, the MediaBox is inherited from the root
+static std::string occupiedDocument() {
+	TestPDFWriter writer;
+	int catalog = writer.reserveObject();
+	int root = writer.reserveObject();
+	std::string rootKids;
+	for (int first = 0; first < OCCUPANCY_TEST_PAGES; first += OCCUPANCY_TEST_PAGES_PER_NODE) {
+		int node = writer.reserveObject();
+		std::string kids;
+		for (int page = first + 1; page <= first + OCCUPANCY_TEST_PAGES_PER_NODE; page++)
+			kids += objectRef(writer.addObject("<< /Type /Page /Parent " + objectRef(node) +
+											   annotations(writer, page) + " >>")) +
+					" ";
+		writer.setObject(node, "<< /Type /Pages /Parent " + objectRef(root) + " /Kids [" + kids + "] /Count " +
+								   std::to_string(OCCUPANCY_TEST_PAGES_PER_NODE) + " >>");
+		rootKids += objectRef(node) + " ";
+	}
+	writer.setObject(root, "<< /Type /Pages /Kids [" + rootKids + "] /Count " + std::to_string(OCCUPANCY_TEST_PAGES) +
+							   " /MediaBox [0 0 595 842] >>");
+	writer.setObject(catalog, "<< /Type /Catalog /Pages " + objectRef(root) + " >>");
+	return writer.finish(catalog);
+}
+
+/*
+	Widget of a signature field whose /FT is in the parent field. PDFDoc::getOccupiedSectors() only looks at the
+	widget dictionary and misses it.
+*/
+static std::string inheritedFieldDocument() {
+	TestPDFWriter writer;
+	int catalog = writer.reserveObject();
+	int root = writer.reserveObject();
+	int page = writer.reserveObject();
+	int field = writer.reserveObject();
+	int widget = writer.addObject("<< /Type /Annot /Subtype /Widget /Parent " + objectRef(field) + " /P " +
+								  objectRef(page) + " /SigSector 5" + rect(50) + " >>");
+	writer.setObject(field, "<< /FT /Sig /T (Signature1) /Kids [" + objectRef(widget) + "] >>");
+	writer.setObject(page, "<< /Type /Page /Parent " + objectRef(root) + " /Annots [" + objectRef(widget) + "] >>");
+	writer.setObject(root, "<< /Type /Pages /Kids [" + objectRef(page) + "] /Count 1 /MediaBox [0 0 595 842] >>");
+	writer.setObject(catalog, "<< /Type /Catalog /Pages " + objectRef(root) + " /AcroForm << /Fields [" +
+								  objectRef(field) + "] >> >>");
+	return writer.finish(catalog);
+}
+
+UNIT_TEST(pdf_occupancy_all_pages) {
+	std::string dir = testTempDir();
+	std::string path = dir + "/occupied.pdf";
+	if (!writeFile(path, occupiedDocument())) {
+		check(false, "write the test document");
+		return;
+	}
+
+	PDFOccupancy::clearCache();
+	TestClock::time_point start = TestClock::now();
+	std::shared_ptr<const PDFOccupancyMap> map = PDFOccupancy::analyze(path.c_str());
+	double analyzeMillis = elapsedMillis(start);
+
+	start = TestClock::now();
+	std::unique_ptr<PDFDoc> doc(new PDFDoc(new GooString(path.c_str())));
+	int mismatches = 0;
+	int occupiedPages = 0;
+	for (int page = 1; page <= OCCUPANCY_TEST_PAGES; page++) {
+		// The string belongs to a GooString that PDFDoc doesn't free
+		const char *sectors = doc->getOccupiedSectors(page);
+		std::string expected = sectors ? sectors : "";
+		if (map->getOccupiedSectors(page) != expected) {
+			printf("page %d: \"%s\" instead of \"%s\"\n", page, map->getOccupiedSectors(page).c_str(),
+				   expected.c_str());
+			mismatches++;
+		}
+		if (!expected.empty())
+			occupiedPages++;
+	}
+	double pagesMillis = elapsedMillis(start);
+	printf("%d pages, %d with signatures placed by sector: %.1f ms for all the pages, %.1f ms with PDFDoc page by "
+		   "page\n",
+		   OCCUPANCY_TEST_PAGES, occupiedPages, analyzeMillis, pagesMillis);
+	check(map->isOk() && map->pages.size() == OCCUPANCY_TEST_PAGES, "all the pages are analyzed");
+	check(mismatches == 0 && occupiedPages > 0, "the occupied sectors of every page are the ones of PDFDoc");
+	check(map->getOccupiedSectors(15) == "4,18", "hidden signatures placed by sector are reported");
+	check(map->getOccupiedSectors(13).empty(), "only widgets are signatures");
+
+	// Areas: the signature and the text field of page 21, the note of page 11 which has no signature
+	check(!map->pages[20].isFree(100, 120, 120, 130) && !map->pages[20].isFree(450, 120, 460, 130) &&
+			  map->pages[20].isFree(50, 300, 200, 400),
+		  "the areas of the signature and the text field are occupied");
+	check(!map->pages[10].isFree(100, 120, 120, 130) && map->getOccupiedSectors(11).empty(),
+		  "the area of a note is occupied but isn't a sector");
+
+	check(PDFOccupancy::analyze(path.c_str()) == map, "the analysis of an unchanged file is cached");
+	std::string pdf;
+	readFile(path, pdf);
+	writeFile(path, pdf + "\n");
+	check(PDFOccupancy::analyze(path.c_str()) != map, "a file that changed is analyzed again");
+
+	std::string inherited = dir + "/inherited_field.pdf";
+	writeFile(inherited, inheritedFieldDocument());
+	check(PDFOccupancy::analyze(inherited.c_str())->getOccupiedSectors(1) == "5",
+		  "a widget whose signature field type is in the parent field is a signature");
+}
@@ -0,0 +1,338 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	PDFProbe compared with the pages of pteid-poppler for 1000 files with inherited, rotated, reversed and
+	broken page trees, and the pre-flight of a batch signature of these files.
+*/
+#include "UnitTest.h"
+#include "TestPDF.h"
+
+#include "PDFProbe.h"
+#include "PDFSignature.h"
+#include "MWException.h"
+#include "eidErrors.h"
+
+#include "poppler/PDFDoc.h"
+#include "poppler/Page.h"
+#include "goo/GooString.h"
+
+#include <openssl/evp.h>
+
+#include <cstring>
+#include <memory>
+#include <utility>
+
+using namespace eIDMW;
+
+#define PROBE_TEST_FILES 1000
+
+static std::string pageDict(int parent, const std::string &extra = std::string()) {
+	return "<< /Type /Page /Parent " + objectRef(parent) + extra + " >>";
+}
+
+static std::string pagesDict(const std::vector<int> &kids, int count, int parent = 0,
+							 const std::string &extra = std::string()) {
+	std::string refs;
+	for (size_t i = 0; i < kids.size(); i++)
+		refs += objectRef(kids[i]) + " ";
+	return "<< /Type /Pages" + (parent ? " /Parent " + objectRef(parent) : std::string()) + " /Kids [" + refs +
+		   "] /Count " + std::to_string(count) + extra + " >>";
+}
+
+/*
+	MediaBox and Rotate inherited from the nodes and overridden by the pages: a reversed box, an all-zero box
+	(ignored), negative and out of range rotations, a real /Rotate (ignored) and a page without /Type.
+*/
+static std::string inheritedTree(TestPDFWriter &writer) {
+	int catalog = writer.reserveObject();
+	int root = writer.reserveObject();
+	int node = writer.reserveObject();
+	std::vector<int> nodeKids;
+	nodeKids.push_back(writer.addObject(pageDict(node)));
+	nodeKids.push_back(writer.addObject(pageDict(node, " /MediaBox [842 595 0 0]")));
+	nodeKids.push_back(writer.addObject(pageDict(node, " /MediaBox [0 0 0 0]")));
+	nodeKids.push_back(writer.addObject(pageDict(node, " /Rotate -90")));
+	int realRotate = writer.addObject(pageDict(root, " /Rotate 90.0 /MediaBox [0 0 842 595]"));
+	int noType = writer.addObject("<< /Parent " + objectRef(root) + " /Rotate 450 >>");
+
+	writer.setObject(node, pagesDict(nodeKids, 4, root, " /Rotate 90"));
+	writer.setObject(root, pagesDict({node, realRotate, noType}, 6, 0, " /MediaBox [0 0 595 842]"));
+	writer.setObject(catalog, "<< /Type /Catalog /Pages " + objectRef(root) + " >>");
+	return writer.finish(catalog);
+}
+
+/*
+	A box that doesn't start at the origin, landscape by its upper right corner, and a form with an XFA entry,
+	two signed signature fields (one inheriting /FT) and a text field.
+*/
+static std::string signedTree(TestPDFWriter &writer) {
+	int catalog = writer.reserveObject();
+	int root = writer.reserveObject();
+	int first = writer.addObject(pageDict(root));
+	int second = writer.addObject(pageDict(root, " /Rotate 270"));
+	int signature = writer.addObject("<< /Type /Sig /Filter /Adobe.PPKLite /Contents <00> >>");
+	int signed1 = writer.addObject("<< /FT /Sig /T (Signature1) /V " + objectRef(signature) + " >>");
+	int parent = writer.reserveObject();
+	int signed2 = writer.addObject("<< /Parent " + objectRef(parent) + " /T (Child) /V " + objectRef(signature) +
+								   " >>");
+	writer.setObject(parent, "<< /FT /Sig /T (Signature2) /Kids [" + objectRef(signed2) + "] >>");
+	int text = writer.addObject("<< /FT /Tx /T (Text) /V (value) >>");
+	int unsignedField = writer.addObject("<< /FT /Sig /T (Signature3) >>");
+
+	writer.setObject(root, pagesDict({first, second}, 2, 0, " /MediaBox [500 0 700 600]"));
+	writer.setObject(catalog, "<< /Type /Catalog /Pages " + objectRef(root) + " /AcroForm << /Fields [" +
+								  objectRef(signed1) + " " + objectRef(parent) + " " + objectRef(text) + " " +
+								  objectRef(unsignedField) + "] /XFA [(template) " + objectRef(text) + "] >> >>");
+	return writer.finish(catalog);
+}
+
+// A /Pages node that is its own kid: the second page isn't found
+static std::string loopTree(TestPDFWriter &writer) {
+	int catalog = writer.reserveObject();
+	int root = writer.reserveObject();
+	int node = writer.reserveObject();
+	int first = writer.addObject(pageDict(root));
+
+	writer.setObject(node, pagesDict({node}, 1, root));
+	writer.setObject(root, pagesDict({first, node}, 2, 0, " /MediaBox [0 0 842 595]"));
+	writer.setObject(catalog, "<< /Type /Catalog /Pages " + objectRef(root) + " >>");
+	return writer.finish(catalog);
+}
+
+// More pages than /Count, the last one is ignored
+static std::string overflowTree(TestPDFWriter &writer) {
+	int catalog = writer.reserveObject();
+	int root = writer.reserveObject();
+	std::vector<int> kids;
+	for (int i = 0; i < 3; i++)
+		kids.push_back(writer.addObject(pageDict(root, i == 2 ? " /MediaBox [0 0 842 595]" : "")));
+
+	writer.setObject(root, pagesDict(kids, 2));
+	writer.setObject(catalog, "<< /Type /Catalog /Pages " + objectRef(root) + " >>");
+	return writer.finish(catalog);
+}
+
+static std::string testFile(int i) {
+	if (i == PROBE_TEST_FILES - 1)
+		return "%PDF-1.7\nnot a PDF document\n";
+
+	TestPDFWriter writer;
+	switch (i % 5) {
+	case 0:
+		return simpleTestPDF(1 + i % 7);
+	case 1:
+		return simpleTestPDF(1 + i % 5, 842, 595);
+	case 2:
+		return inheritedTree(writer);
+	case 3:
+		return signedTree(writer);
+	default:
+		return (i / 5) % 2 ? loopTree(writer) : overflowTree(writer);
+	}
+}
+
+static void rc4(const unsigned char *key, size_t keyLen, unsigned char *data, size_t len) {
+	unsigned char s[256];
+	for (int i = 0; i < 256; i++)
+		s[i] = (unsigned char)i;
+	for (int i = 0, j = 0; i < 256; i++) {
+		j = (j + s[i] + key[i % keyLen]) & 0xff;
+		std::swap(s[i], s[j]);
+	}
+	for (size_t n = 0, i = 0, j = 0; n < len; n++) {
+		i = (i + 1) & 0xff;
+		j = (j + s[i]) & 0xff;
+		std::swap(s[i], s[j]);
+		data[n] ^= s[(s[i] + s[j]) & 0xff];
+	}
+}
+
+static std::string hex(const unsigned char *data, size_t len) {
+	static const char digits[] = "0123456789abcdef";
+	std::string result;
+	for (size_t i = 0; i < len; i++) {
+		result += digits[data[i] >> 4];
+		result += digits[data[i] & 0xf];
+	}
+	return result;
+}
+
+/*
+	Document encrypted with the standard security handler, revision 2 (RC4 40 bits), and empty passwords:
+	pteid-poppler opens it without a password. The streams aren't encrypted, only the page tree is read.
+*/
+static std::string encryptedPDF(int permissions) {
+	static const unsigned char PASSWORD_PADDING[32] = {
+		0x28, 0xbf, 0x4e, 0x5e, 0x4e, 0x75, 0x8a, 0x41, 0x64, 0x00, 0x4e, 0x56, 0xff, 0xfa, 0x01, 0x08,
+		0x2e, 0x2e, 0x00, 0xb6, 0xd0, 0x68, 0x3e, 0x80, 0x2f, 0x0c, 0xa9, 0xfe, 0x64, 0x53, 0x69, 0x7a};
+	const unsigned char id[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int digestLen = 0;
+
+	// Owner key from the padded owner password, /O is the padded user password encrypted with it
+	unsigned char o[32];
+	memcpy(o, PASSWORD_PADDING, sizeof(o));
+	EVP_Digest(PASSWORD_PADDING, sizeof(PASSWORD_PADDING), digest, &digestLen, EVP_md5(), NULL);
+	rc4(digest, 5, o, sizeof(o));
+
+	// File key from the padded user password, /O, /P and the first file identifier
+	std::string keyInput((const char *)PASSWORD_PADDING, sizeof(PASSWORD_PADDING));
+	keyInput.append((const char *)o, sizeof(o));
+	for (int i = 0; i < 4; i++)
+		keyInput += (char)(((unsigned int)permissions >> (8 * i)) & 0xff);
+	keyInput.append((const char *)id, sizeof(id));
+	EVP_Digest(keyInput.data(), keyInput.size(), digest, &digestLen, EVP_md5(), NULL);
+	unsigned char u[32];
+	memcpy(u, PASSWORD_PADDING, sizeof(u));
+	rc4(digest, 5, u, sizeof(u));
+
+	TestPDFWriter writer;
+	int catalog = writer.reserveObject();
+	int root = writer.reserveObject();
+	int page = writer.addObject(pageDict(root, " /MediaBox [0 0 842 595]"));
+	int encrypt = writer.addObject("<< /Filter /Standard /V 1 /R 2 /O <" + hex(o, sizeof(o)) + "> /U <" +
+								   hex(u, sizeof(u)) + "> /P " + std::to_string(permissions) + " >>");
+	writer.setObject(root, pagesDict({page}, 1));
+	writer.setObject(catalog, "<< /Type /Catalog /Pages " + objectRef(root) + " >>");
+
+	std::string pdf = writer.finish(catalog);
+	std::string fileId = "<" + hex(id, sizeof(id)) + ">";
+	pdf.replace(pdf.find(" /Root "), 1, " /Encrypt " + objectRef(encrypt) + " /ID [" + fileId + fileId + "] ");
+	return pdf;
+}
+
+// Orientation of the pages that pteid-poppler finds, from the first one to the first missing one
+static std::vector<bool> landscapePages(const std::string &path, int *pageCount) {
+	std::vector<bool> pages;
+	PDFSignature signature(path.c_str());
+	std::unique_ptr<PDFDoc> doc(new PDFDoc(new GooString(path.c_str())));
+	*pageCount = doc->isOk() ? doc->getNumPages() : 0;
+	for (int i = 1; i <= *pageCount && doc->getPage(i) != NULL; i++) {
+		signature.setVisible(i, 1);
+		pages.push_back(signature.isLandscapeFormat());
+	}
+	return pages;
+}
+
+UNIT_TEST(pdf_probe_preflight) {
+	std::string dir = testTempDir();
+	std::vector<std::string> paths;
+	for (int i = 0; i < PROBE_TEST_FILES; i++) {
+		paths.push_back(dir + "/probe_" + std::to_string(i) + ".pdf");
+		if (!writeFile(paths.back(), testFile(i))) {
+			check(false, "write the test documents");
+			return;
+		}
+	}
+
+	PDFProbe::clearCache();
+	TestClock::time_point start = TestClock::now();
+	std::vector<std::shared_ptr<const PDFProbeInfo>> probes;
+	for (int i = 0; i < PROBE_TEST_FILES; i++)
+		probes.push_back(PDFProbe::probe(paths[i].c_str()));
+	double probeMillis = elapsedMillis(start);
+
+	start = TestClock::now();
+	int mismatches = 0;
+	for (int i = 0; i < PROBE_TEST_FILES - 1; i++) {
+		int pageCount = 0;
+		std::vector<bool> landscape = landscapePages(paths[i], &pageCount);
+		bool same = probes[i]->isOk() && !probes[i]->encrypted && probes[i]->pageCount == pageCount &&
+					probes[i]->pages.size() == landscape.size();
+		for (size_t page = 0; same && page < landscape.size(); page++)
+			same = probes[i]->isLandscape((int)page + 1) == landscape[page];
+		if (!same) {
+			printf("probe_%d.pdf: %d page(s) and %d found by the probe, %d and %d by PDFDoc\n", i,
+				   probes[i]->pageCount, (int)probes[i]->pages.size(), pageCount, (int)landscape.size());
+			mismatches++;
+		}
+	}
+	double pagesMillis = elapsedMillis(start);
+	printf("%d files: %.0f ms to probe, %.0f ms to read the pages with PDFDoc\n", PROBE_TEST_FILES, probeMillis,
+		   pagesMillis);
+	check(mismatches == 0, "the page count and the orientation of the pages are the ones of PDFDoc");
+	check(!probes[PROBE_TEST_FILES - 1]->isOk(), "the broken file is reported");
+
+	// Pages of probe_2.pdf: inherited Rotate 90 and portrait box, reversed landscape box, all-zero box,
+	// Rotate -90, real Rotate and Rotate 450
+	const std::vector<PDFProbePage> &inherited = probes[2]->pages;
+	check(inherited.size() == 6 && inherited[0].rotate == 90 && inherited[1].x2 == 842 && inherited[1].x1 == 0 &&
+			  inherited[2].y2 == 842 && inherited[3].rotate == 270 && inherited[4].rotate == 0 &&
+			  inherited[5].rotate == 90,
+		  "MediaBox and Rotate are read and inherited like in PageAttrs");
+	check(probes[3]->signatureCount == 2 && probes[3]->xfaForm && !probes[0]->xfaForm &&
+			  probes[0]->signatureCount == 0,
+		  "signature fields with a value and XFA forms are found");
+	check(probes[4]->pages.size() == 2 && probes[9]->pages.size() == 1, "loops and extra pages end the page list");
+
+	int permissions = -3904;
+	std::string encrypted = dir + "/encrypted.pdf";
+	writeFile(encrypted, encryptedPDF(permissions));
+	std::shared_ptr<const PDFProbeInfo> encryptedInfo = PDFProbe::probe(encrypted.c_str());
+	check(encryptedInfo->isOk() && encryptedInfo->encrypted && encryptedInfo->permissions == permissions &&
+			  encryptedInfo->isLandscape(1),
+		  "encryption and permissions are read");
+
+	// Probed again: the cached results, except for a file that changed
+	bool cached = true;
+	for (int i = 0; i < PROBE_TEST_FILES; i++)
+		cached = cached && PDFProbe::probe(paths[i].c_str()) == probes[i];
+	check(cached, "the probes of unchanged files are cached");
+	std::string changed;
+	readFile(paths[0], changed);
+	writeFile(paths[0], changed + "\n");
+	check(PDFProbe::probe(paths[0].c_str()) != probes[0], "a file that changed is probed again");
+
+	// The batch copies read the orientation of the last page from the probe
+	PDFSignature batch;
+	for (int i = 0; i < PROBE_TEST_FILES; i++)
+		batch.batchAddFile((char *)paths[i].c_str(), true);
+	batch.setVisibleCoordinates(1, 0.1, 0.1);
+	bool sameOrientation = true;
+	for (int i = 0; i < 50; i++) {
+		int pageCount = 0;
+		std::vector<bool> landscape = landscapePages(paths[i], &pageCount);
+		std::unique_ptr<PDFSignature> copy(batch.getSpecialCopy(i));
+		bool expected = (int)landscape.size() == pageCount && landscape.back();
+		sameOrientation = sameOrientation && copy->isLandscapeFormat() == expected;
+	}
+	check(sameOrientation, "the batch copies have the orientation of the last page of their file");
+
+	// The broken file is the last one, the pre-flight reports it before any file is signed
+	PDFProbe::clearCache();
+	std::string output = dir;
+	long error = 0;
+	unsigned int failedIndex = 0;
+	start = TestClock::now();
+	try {
+		batch.signFiles("Lisboa", "Test", output.c_str(), true);
+	} catch (CBatchSignFailedException &e) {
+		error = e.GetError();
+		failedIndex = e.GetFailedSignatureIndex();
+	}
+	double preflightMillis = elapsedMillis(start);
+	printf("pre-flight of a batch of %d files: %.0f ms\n", PROBE_TEST_FILES, preflightMillis);
+	check(error == EIDMW_PDF_INVALID_ERROR && failedIndex == PROBE_TEST_FILES - 1,
+		  "the pre-flight fails on the broken file");
+	std::string signedFile;
+	check(!readFile(output + "/probe_0_signed.pdf", signedFile), "no file is signed before the pre-flight fails");
+	check(preflightMillis < 10000, "the pre-flight of the batch takes seconds");
+
+	// An encrypted file in a batch
+	PDFSignature encryptedBatch;
+	encryptedBatch.batchAddFile((char *)paths[1].c_str(), false);
+	encryptedBatch.batchAddFile((char *)encrypted.c_str(), false);
+	error = 0;
+	try {
+		encryptedBatch.signFiles("Lisboa", "Test", output.c_str(), true);
+	} catch (CBatchSignFailedException &e) {
+		error = e.GetError();
+		failedIndex = e.GetFailedSignatureIndex();
+	}
+	check(error == EIDMW_PDF_UNSUPPORTED_ERROR && failedIndex == 1, "the pre-flight fails on the encrypted file");
+}
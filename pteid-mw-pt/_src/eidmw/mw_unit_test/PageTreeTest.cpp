@@ -0,0 +1,194 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	Pages of pteid-poppler looked up directly in the page tree (Catalog::findPageInTree) compared with the
+	pages found by walking the tree in order, for trees with empty, mixed and inconsistent nodes.
+*/
+#include "UnitTest.h"
+#include "TestPDF.h"
+
+#include "poppler/PDFDoc.h"
+#include "poppler/Catalog.h"
+#include "poppler/Page.h"
+#include "goo/GooString.h"
+
+#include <memory>
+
+// Dictionary of a leaf page, its number is written in /Label so that the tests can tell which page they got
+static std::string pageDict(int parent, const std::string &label, const std::string &extra = std::string()) {
+	return "<< /Type /Page /Parent " + objectRef(parent) + " /Label (" + label + ")" + extra + " >>";
+}
+
+static std::string pagesDict(const std::vector<int> &kids, int count, int parent = 0,
+							 const std::string &extra = std::string()) {
+	std::string refs;
+	for (size_t i = 0; i < kids.size(); i++)
+		refs += objectRef(kids[i]) + " ";
+	return "<< /Type /Pages" + (parent ? " /Parent " + objectRef(parent) : std::string()) + " /Kids [" + refs +
+		   "] /Count " + std::to_string(count) + extra + " >>";
+}
+
+struct PageSummary {
+	int ref;
+	int rotate;
+	double width;
+};
+
+static bool samePages(const std::vector<PageSummary> &a, const std::vector<PageSummary> &b) {
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); i++) {
+		if (a[i].ref != b[i].ref || a[i].rotate != b[i].rotate || a[i].width != b[i].width)
+			return false;
+	}
+	return true;
+}
+
+// Pages of the file, read from the last one to the first (directly) or from the first one to the last (in order)
+static std::vector<PageSummary> readPages(const std::string &path, bool reverse) {
+	std::unique_ptr<PDFDoc> doc(new PDFDoc(new GooString(path.c_str())));
+	std::vector<PageSummary> pages;
+	if (!doc->isOk())
+		return pages;
+
+	int count = doc->getNumPages();
+	pages.resize(count);
+	for (int n = 0; n < count; n++) {
+		int i = reverse ? count - n : n + 1;
+		Page *page = doc->getPage(i);
+		Ref *ref = doc->getCatalog()->getPageRef(i);
+		if (page == NULL || ref == NULL)
+			return std::vector<PageSummary>();
+		pages[i - 1].ref = ref->num;
+		pages[i - 1].rotate = page->getRotate();
+		pages[i - 1].width = page->getMediaWidth();
+	}
+	return pages;
+}
+
+/*
+	Root with an empty /Pages node, a page and a /Pages node of 2 pages: /Count 3 is the number of kids of
+	the root but its second kid isn't the second page. The rotation and media box are inherited.
+*/
+static std::string mixedTree(TestPDFWriter &writer) {
+	int catalog = writer.reserveObject();
+	int root = writer.reserveObject();
+	int empty = writer.reserveObject();
+	int first = writer.addObject(pageDict(root, "1"));
+	int node = writer.reserveObject();
+	int second = writer.addObject(pageDict(node, "2"));
+	int third = writer.addObject(pageDict(node, "3", " /MediaBox [0 0 300 400]"));
+
+	writer.setObject(empty, pagesDict(std::vector<int>(), 0, root));
+	writer.setObject(node, pagesDict({second, third}, 2, root, " /Rotate 90"));
+	writer.setObject(root, pagesDict({empty, first, node}, 3, 0, " /MediaBox [0 0 595 842]"));
+	writer.setObject(catalog, "<< /Type /Catalog /Pages " + objectRef(root) + " >>");
+	return writer.finish(catalog);
+}
+
+// Three levels of /Pages nodes with empty nodes between them, 4 * 5 * 5 pages
+static std::string nestedTree(TestPDFWriter &writer) {
+	int catalog = writer.reserveObject();
+	int root = writer.reserveObject();
+	std::vector<int> rootKids;
+	int label = 1;
+	for (int i = 0; i < 4; i++) {
+		int middle = writer.reserveObject();
+		std::vector<int> middleKids;
+		for (int j = 0; j < 5; j++) {
+			int leaves = writer.reserveObject();
+			std::vector<int> pages;
+			for (int k = 0; k < 5; k++)
+				pages.push_back(writer.addObject(pageDict(leaves, std::to_string(label++))));
+			writer.setObject(leaves, pagesDict(pages, 5, middle, j == 2 ? " /Rotate 180" : ""));
+			middleKids.push_back(leaves);
+			middleKids.push_back(writer.addObject(pagesDict(std::vector<int>(), 0, middle)));
+		}
+		writer.setObject(middle, pagesDict(middleKids, 25, root));
+		rootKids.push_back(middle);
+	}
+	writer.setObject(root, pagesDict(rootKids, 100, 0, " /MediaBox [0 0 595 842]"));
+	writer.setObject(catalog, "<< /Type /Catalog /Pages " + objectRef(root) + " >>");
+	return writer.finish(catalog);
+}
+
+/*
+	The first /Pages node has 2 pages but /Count 1: the counts of the kids of the root don't add up to its
+	/Count, the pages must be the ones found in order.
+*/
+static std::string inconsistentTree(TestPDFWriter &writer) {
+	int catalog = writer.reserveObject();
+	int root = writer.reserveObject();
+	int node = writer.reserveObject();
+	int first = writer.addObject(pageDict(node, "1"));
+	int second = writer.addObject(pageDict(node, "2"));
+	int third = writer.addObject(pageDict(root, "3"));
+
+	writer.setObject(node, pagesDict({first, second}, 1, root));
+	writer.setObject(root, pagesDict({node, third}, 3, 0, " /MediaBox [0 0 595 842]"));
+	writer.setObject(catalog, "<< /Type /Catalog /Pages " + objectRef(root) + " >>");
+	return writer.finish(catalog);
+}
+
+// A /Pages node that is its own kid, with counts that add up
+static std::string loopTree(TestPDFWriter &writer) {
+	int catalog = writer.reserveObject();
+	int root = writer.reserveObject();
+	int node = writer.reserveObject();
+	int first = writer.addObject(pageDict(root, "1"));
+
+	writer.setObject(node, pagesDict({node}, 1, root));
+	writer.setObject(root, pagesDict({first, node}, 2, 0, " /MediaBox [0 0 595 842]"));
+	writer.setObject(catalog, "<< /Type /Catalog /Pages " + objectRef(root) + " >>");
+	return writer.finish(catalog);
+}
+
+UNIT_TEST(pdf_page_tree_lookup) {
+	std::string dir = testTempDir();
+	struct {
+		const char *name;
+		std::string (*build)(TestPDFWriter &writer);
+		int pages;
+	} trees[] = {{"mixed", mixedTree, 3}, {"nested", nestedTree, 100}, {"inconsistent", inconsistentTree, 3}};
+
+	for (size_t t = 0; t < sizeof(trees) / sizeof(trees[0]); t++) {
+		TestPDFWriter writer;
+		std::string path = dir + "/" + trees[t].name + ".pdf";
+		writeFile(path, trees[t].build(writer));
+		std::vector<PageSummary> inOrder = readPages(path, false);
+		std::vector<PageSummary> direct = readPages(path, true);
+		check(inOrder.size() == (size_t)trees[t].pages && samePages(direct, inOrder),
+			  std::string(trees[t].name) + " tree: the pages looked up directly are the pages in order");
+	}
+
+	// The second page of the mixed tree (object 6) is the first page of its last kid, which inherits /Rotate 90
+	std::vector<PageSummary> pages = readPages(dir + "/mixed.pdf", true);
+	check(pages.size() == 3 && pages[0].ref == 4 && pages[1].ref == 6 && pages[1].rotate == 90 &&
+			  pages[2].width == 300,
+		  "mixed tree: an empty node before a page isn't counted");
+
+	// The loop is reported and the lookup doesn't hang
+	TestPDFWriter loopWriter;
+	writeFile(dir + "/loop.pdf", loopTree(loopWriter));
+	std::unique_ptr<PDFDoc> loop(new PDFDoc(new GooString((dir + "/loop.pdf").c_str())));
+	check(loop->isOk() && loop->getPage(2) == NULL && loop->getPage(1) != NULL,
+		  "loop tree: the page in the loop isn't found");
+
+	// Direct lookups of a flat tree count the kids of the root once
+	writeSimpleTestPDF(dir + "/flat.pdf", 2000);
+	TestClock::time_point start = TestClock::now();
+	std::vector<PageSummary> flat = readPages(dir + "/flat.pdf", true);
+	double reverseMillis = elapsedMillis(start);
+	start = TestClock::now();
+	std::vector<PageSummary> flatInOrder = readPages(dir + "/flat.pdf", false);
+	double inOrderMillis = elapsedMillis(start);
+	printf("2000 pages of a flat tree: %.1f ms from the last one, %.1f ms in order\n", reverseMillis, inOrderMillis);
+	check(flat.size() == 2000 && samePages(flat, flatInOrder),
+		  "flat tree: the pages looked up directly are the pages in order");
+	check(reverseMillis < 4 * inOrderMillis + 100, "flat tree: reading the pages from the last one isn't quadratic");
+}
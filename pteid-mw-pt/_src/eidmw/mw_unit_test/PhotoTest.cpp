@@ -0,0 +1,106 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	Conversion of the card photo to PNG. data/photo.jp2 is a synthetic 360x448 photo encoded like the
+	photo of the card: JP2 with 6 resolution levels and about 12 KB of lossy codestream.
+	Every reduce factor used for thumbnails is decoded and the time of the conversion and of
+	PhotoPteid::getPhotoPNG(), served by the photo conversion cache, is reported.
+*/
+#include "UnitTest.h"
+#include "TestPDF.h"
+
+#include "PhotoPteid.h"
+#include "J2KHelper.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace eIDMW;
+
+#define PHOTO_WIDTH 360
+#define PHOTO_HEIGHT 448
+#define MAX_REDUCE_FACTOR 3
+#define PHOTO_ITERATIONS 20
+
+// Width and height from the IHDR chunk that follows the signature of every PNG
+static bool pngSize(const unsigned char *png, unsigned long size, unsigned long &width, unsigned long &height) {
+	static const unsigned char signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	if (size < 24 || memcmp(png, signature, sizeof(signature)) != 0 || memcmp(png + 12, "IHDR", 4) != 0)
+		return false;
+	width = (unsigned long)png[16] << 24 | png[17] << 16 | png[18] << 8 | png[19];
+	height = (unsigned long)png[20] << 24 | png[21] << 16 | png[22] << 8 | png[23];
+	return true;
+}
+
+UNIT_TEST(photo_decode) {
+	std::string jp2;
+	if (!readFile(testDataPath("photo.jp2"), jp2)) {
+		check(false, "read data/photo.jp2");
+		return;
+	}
+	CByteArray photo((const unsigned char *)jp2.data(), (unsigned long)jp2.size());
+
+	for (unsigned int reduce = 0; reduce <= MAX_REDUCE_FACTOR; reduce++) {
+		std::string label = "reduce " + std::to_string(reduce);
+		unsigned long width = 0, height = 0, pngBytes = 0;
+		bool converted = true;
+
+		TestClock::time_point start = TestClock::now();
+		for (int i = 0; i < PHOTO_ITERATIONS; i++) {
+			unsigned char *png = NULL;
+			unsigned long png_size = 0;
+			convert_to_png((unsigned char *)jp2.data(), (unsigned long)jp2.size(), &png, &png_size, reduce);
+			converted = converted && png != NULL && pngSize(png, png_size, width, height);
+			pngBytes = png_size;
+			free(png);
+		}
+		double convertMs = elapsedMillis(start) / PHOTO_ITERATIONS;
+
+		// Each resolution level halves the size, rounding up
+		unsigned long expectedWidth = (PHOTO_WIDTH + (1 << reduce) - 1) >> reduce;
+		unsigned long expectedHeight = (PHOTO_HEIGHT + (1 << reduce) - 1) >> reduce;
+		check(converted, label + ": PNG written");
+		check(width == expectedWidth && height == expectedHeight, label + ": PNG size");
+
+		// The first call fills the process-wide conversion cache, the others are served by it
+		{
+			PhotoPteid warmup(photo);
+			warmup.getPhotoPNG(reduce);
+		}
+		bool cachedSame = true;
+		start = TestClock::now();
+		for (int i = 0; i < PHOTO_ITERATIONS; i++) {
+			PhotoPteid cached(photo);
+			CByteArray *png = cached.getPhotoPNG(reduce);
+			cachedSame = cachedSame && png != NULL && png->Size() == pngBytes;
+		}
+		double cachedMs = elapsedMillis(start) / PHOTO_ITERATIONS;
+		check(cachedSame, label + ": getPhotoPNG() returns the converted PNG");
+
+		printf("%s: %lux%lu, %lu PNG bytes, convert %.3f ms, cached %.3f ms\n", label.c_str(), width, height,
+			   pngBytes, convertMs, cachedMs);
+	}
+
+	// The reduce factor is limited to the 6 resolution levels of the photo
+	unsigned char *smallest = NULL;
+	unsigned long smallest_size = 0, width = 0, height = 0;
+	convert_to_png((unsigned char *)jp2.data(), (unsigned long)jp2.size(), &smallest, &smallest_size, 8);
+	check(smallest != NULL && pngSize(smallest, smallest_size, width, height) && width == (PHOTO_WIDTH + 31) / 32 &&
+			  height == (PHOTO_HEIGHT + 31) / 32,
+		  "reduce 8 is limited to the lowest resolution level");
+	free(smallest);
+
+	// Not a JPEG-2000 file
+	unsigned char *png = NULL;
+	unsigned long png_size = 0;
+	std::string garbage(jp2.size(), 'x');
+	convert_to_png((unsigned char *)garbage.data(), (unsigned long)garbage.size(), &png, &png_size, 0);
+	check(png == NULL, "a file that is not JPEG-2000 is rejected");
+	free(png);
+}
@@ -0,0 +1,204 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	PDF signed by PDFSignature::setRemoteFile() from a local HTTP server that answers range requests, like
+	the document-management servers do. The server appends the incremental update of the output file to its
+	copy, which must then have a valid signature over the whole file.
+*/
+#include "UnitTest.h"
+#include "LoopbackServer.h"
+#include "TestPDF.h"
+#include "TestPKI.h"
+
+#include "PDFSignature.h"
+#include "MWException.h"
+#include "eidErrors.h"
+
+using namespace eIDMW;
+
+// Size of the padding stream of the served document, only the parts the parser needs should be fetched
+#define REMOTE_TEST_PADDING (32 * 1024 * 1024)
+
+static const unsigned char SHA256_DIGEST_INFO_PREFIX[] = {0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60,
+														  0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02,
+														  0x01, 0x05, 0x00, 0x04, 0x20};
+
+class RangeServer : public LoopbackServer {
+public:
+	RangeServer() : m_ignoreRanges(false), m_partialBytes(0), m_fullReads(0) {}
+
+	// An empty etag or lastModified isn't sent
+	void setFile(const std::string &data, const std::string &etag, const std::string &lastModified) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_data = data;
+		m_etag = etag;
+		m_lastModified = lastModified;
+	}
+
+	// Answer range requests with the whole file, like servers without range support
+	void ignoreRanges() { m_ignoreRanges = true; }
+
+	// Bytes sent for ranges other than the whole file
+	size_t partialBytes() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_partialBytes;
+	}
+
+	// Requests that got the whole file
+	int fullReads() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_fullReads;
+	}
+
+protected:
+	bool answer(const HttpRequest &request, std::string &response) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::string ifMatch = request.header("If-Match");
+		std::string ifUnmodifiedSince = request.header("If-Unmodified-Since");
+		if ((!ifMatch.empty() && ifMatch != m_etag) ||
+			(!ifUnmodifiedSince.empty() && ifUnmodifiedSince != m_lastModified)) {
+			response = httpResponse("412 Precondition Failed", "text/plain", "changed");
+			return true;
+		}
+
+		std::string validators;
+		if (!m_etag.empty())
+			validators += "ETag: " + m_etag + "\r\n";
+		if (!m_lastModified.empty())
+			validators += "Last-Modified: " + m_lastModified + "\r\n";
+
+		if (request.method == "HEAD") {
+			response = "HTTP/1.1 200 OK\r\nContent-Type: application/pdf\r\nContent-Length: " +
+					   std::to_string(m_data.size()) + "\r\nAccept-Ranges: bytes\r\n" + validators + "\r\n";
+			return true;
+		}
+
+		unsigned long first = 0, last = 0;
+		std::string range = request.header("Range");
+		if (m_ignoreRanges || sscanf(range.c_str(), "bytes=%lu-%lu", &first, &last) != 2 || last < first ||
+			first >= m_data.size()) {
+			m_fullReads++;
+			response = httpResponse("200 OK", "application/pdf", m_data, validators);
+			return true;
+		}
+		// The chunks of the parser may end after the end of the file
+		if (last >= m_data.size())
+			last = (unsigned long)m_data.size() - 1;
+
+		if (first == 0 && last == m_data.size() - 1)
+			m_fullReads++;
+		else
+			m_partialBytes += last - first + 1;
+		response = httpResponse("206 Partial Content", "application/pdf", m_data.substr(first, last - first + 1),
+								validators + "Content-Range: bytes " + std::to_string(first) + "-" +
+									std::to_string(last) + "/" + std::to_string(m_data.size()) + "\r\n");
+		return true;
+	}
+
+private:
+	std::mutex m_mutex; // protects everything below
+	bool m_ignoreRanges;
+	std::string m_data;
+	std::string m_etag;
+	std::string m_lastModified;
+	size_t m_partialBytes;
+	int m_fullReads;
+};
+
+// Error of the signature of the remote file, EIDMW_OK if the update was written to output
+static long signRemote(const std::string &url, const std::string &output, const TestIdentity &signer) {
+	try {
+		PDFSignature signature;
+		signature.setRemoteFile(url.c_str());
+		std::vector<unsigned char> certificate = signer.certificateDER();
+		signature.setExternCertificate(CByteArray(certificate.data(), (unsigned long)certificate.size()));
+		std::vector<CByteArray> caCertificates;
+		signature.setExternCertificateCA(caCertificates);
+		signature.setIsCC(false);
+		signature.signFiles("Lisboa", "Test", output.c_str(), false);
+
+		CByteArray digestInfo(SHA256_DIGEST_INFO_PREFIX, sizeof(SHA256_DIGEST_INFO_PREFIX));
+		digestInfo.Append(signature.getHash());
+		std::vector<unsigned char> value = signer.signDigestInfo(digestInfo.GetBytes(), digestInfo.Size());
+		signature.signClose(CByteArray(value.data(), (unsigned long)value.size()));
+	} catch (CMWException &e) {
+		return e.GetError();
+	}
+	return EIDMW_OK;
+}
+
+static bool isSigned(const std::string &pdf, const TestIdentity &signer) {
+	std::vector<PDFSignatureCheck> signatures = verifyPDFSignatures(pdf, signer.certificate());
+	return signatures.size() == 1 && signatures[0].valid && signatures[0].byteRangeEnd == pdf.size();
+}
+
+UNIT_TEST(pdf_remote_signature) {
+	TestIdentity signer("Test Citizen");
+	RangeServer server;
+	std::string dir = testTempDir();
+	std::string document = simpleTestPDF(3, 595, 842, REMOTE_TEST_PADDING);
+	server.setFile(document, "\"v1\"", "Mon, 19 Oct 2026 10:00:00 GMT");
+	if (!signer.isOk() || !server.start()) {
+		check(false, "start the file server and create the test certificate");
+		return;
+	}
+	std::string url = server.url() + "/documents/large.pdf";
+
+	TestClock::time_point start = TestClock::now();
+	long error = signRemote(url, dir + "/update.pdf", signer);
+	double signMillis = elapsedMillis(start);
+	std::string update;
+	check(error == EIDMW_OK && readFile(dir + "/update.pdf", update) && !update.empty(),
+		  "the remote document is signed");
+	printf("%.0f MB document: %.0f ms, %lu bytes read by range requests, %d whole file read(s), %d connection(s)\n",
+		   document.size() / (1024.0 * 1024), signMillis, (unsigned long)server.partialBytes(), server.fullReads(),
+		   server.connections());
+	check(update.size() < document.size() && isSigned(document + update, signer),
+		  "the file with the update appended has a valid signature over the whole file");
+	check(server.partialBytes() < 1024 * 1024, "the parser reads only a small part of the file");
+	check(server.fullReads() == 1, "the file is read once for the digest");
+	check(server.connections() == 1, "the requests for the file share one connection");
+
+	// Without ETag the requests are conditional on Last-Modified
+	server.setFile(document, "", "Mon, 19 Oct 2026 10:00:00 GMT");
+	error = signRemote(url, dir + "/update_last_modified.pdf", signer);
+	check(error == EIDMW_OK && readFile(dir + "/update_last_modified.pdf", update) &&
+			  isSigned(document + update, signer),
+		  "a document without ETag is signed with Last-Modified");
+
+	server.setFile(document, "W/\"weak\"", "");
+	check(signRemote(url, dir + "/update_weak.pdf", signer) == EIDMW_PDF_UNSUPPORTED_ERROR,
+		  "a document with neither a strong ETag nor Last-Modified isn't signed");
+
+	// The file changes on the server after it was opened: the digest request fails
+	server.setFile(document, "\"v1\"", "");
+	PDFSignature changed;
+	changed.setRemoteFile(url.c_str());
+	server.setFile(document + "\n", "\"v2\"", "");
+	std::vector<unsigned char> certificate = signer.certificateDER();
+	changed.setExternCertificate(CByteArray(certificate.data(), (unsigned long)certificate.size()));
+	std::vector<CByteArray> caCertificates;
+	changed.setExternCertificateCA(caCertificates);
+	changed.setIsCC(false);
+	error = EIDMW_OK;
+	try {
+		changed.signFiles("Lisboa", "Test", (dir + "/update_changed.pdf").c_str(), false);
+	} catch (CMWException &e) {
+		error = e.GetError();
+	}
+	check(error == EIDMW_PDF_INVALID_ERROR && !readFile(dir + "/update_changed.pdf", update),
+		  "a document changed on the server isn't signed");
+
+	// The whole file in answer to a range request isn't taken as the range
+	server.setFile(document, "\"v1\"", "");
+	server.ignoreRanges();
+	check(signRemote(url, dir + "/update_no_ranges.pdf", signer) != EIDMW_OK,
+		  "a server without range requests is reported");
+
+	server.stop();
+}
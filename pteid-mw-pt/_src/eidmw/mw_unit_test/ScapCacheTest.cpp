@@ -0,0 +1,118 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	Lookups in the in-memory index of the SCAP attribute cache (scapcache.h) compared with a filter of the
+	whole cache, for a cache of many citizen documents written in a temporary directory.
+*/
+#include "UnitTest.h"
+
+#include "scapsettings.h"
+#include "scapcache.h"
+
+using namespace eIDMW;
+
+#define CACHED_DOCUMENTS 300
+#define PROVIDERS 20
+
+static std::string providerUri(int provider) { return "http://interop.gov.pt/SCAP/P" + std::to_string(provider); }
+
+// Response of the SCAP service for one citizen document, in the format of the cache files
+static std::string scapResponse(int document, const std::vector<int> &providers) {
+	std::string json = "{\"citizenInfo\":{\"name\":\"Citizen " + std::to_string(document) + "\"},\"citizenAttributes\":[";
+	for (size_t p = 0; p < providers.size(); p++) {
+		std::string provider = std::to_string(providers[p]);
+		json += std::string(p ? "," : "") + "{\"attributeProviderInfo\":{\"uriId\":\"" + providerUri(providers[p]) +
+				"\",\"name\":\"Provider " + provider + "\",\"type\":\"ENTERPRISE\",\"nipc\":\"5000000" + provider +
+				"\",\"logo\":\"\"},\"attributes\":[";
+		for (int a = 0; a < 3; a++) {
+			json += std::string(a ? "," : "") + "{\"id\":\"attribute-" + std::to_string(a) +
+					"\",\"description\":\"Attribute " + std::to_string(a) +
+					"\",\"validity\":\"2099-12-31\",\"subAttributes\":[]}";
+		}
+		json += "]}";
+	}
+	return json + "]}";
+}
+
+static std::vector<std::string> uniqueIds(const std::vector<ScapAttribute> &attributes) {
+	std::vector<std::string> ids;
+	for (const ScapAttribute &attribute : attributes)
+		ids.push_back(attribute.unique_id);
+	return ids;
+}
+
+static std::vector<std::string> filterByProvider(const std::vector<ScapAttribute> &attributes,
+												 const std::string &uri) {
+	std::vector<std::string> ids;
+	for (const ScapAttribute &attribute : attributes) {
+		if (attribute.provider.uriId == uri)
+			ids.push_back(attribute.unique_id);
+	}
+	return ids;
+}
+
+UNIT_TEST(scap_cache_lookups) {
+	QString dir = QString::fromStdString(testTempDir());
+	set_scap_test_cache_dir(dir);
+
+	bool written = true;
+	for (int d = 0; d < CACHED_DOCUMENTS; d++) {
+		std::vector<int> providers;
+		for (int k = 0; k < 4; k++)
+			providers.push_back((d + k * 3) % PROVIDERS);
+		std::vector<ScapAttribute> attributes;
+		written = cache_response(scapResponse(d, providers), "document" + std::to_string(d), attributes) && written;
+	}
+	check(written, "write the cached documents");
+
+	ScapResult<std::vector<ScapAttribute>> all = load_cache();
+	check(!all.is_error() && all.data().size() == CACHED_DOCUMENTS * 4 * 3, "every cached attribute is loaded");
+	if (all.is_error())
+		return;
+
+	bool sameAsFilter = true;
+	for (int p = 0; p < PROVIDERS; p++) {
+		ScapResult<std::vector<ScapAttribute>> found = find_cached_attributes_by_provider(providerUri(p));
+		sameAsFilter = sameAsFilter && !found.is_error() && !found.data().empty() &&
+					   uniqueIds(found.data()) == filterByProvider(all.data(), providerUri(p));
+	}
+	check(sameAsFilter, "by provider: the attributes of each provider in cache order");
+	check(find_cached_attributes_by_provider(providerUri(PROVIDERS)).data().empty(),
+		  "by provider: no attributes for an unknown provider");
+
+	std::vector<std::string> ids = {all.data()[7].unique_id, all.data()[1].unique_id, all.data()[7].unique_id};
+	ScapResult<std::vector<ScapAttribute>> byId = find_cached_attributes(ids);
+	check(!byId.is_error() && byId.data().size() == 2 && byId.data()[0].unique_id == all.data()[1].unique_id &&
+			  byId.data()[1].unique_id == all.data()[7].unique_id,
+		  "by id: each attribute once, in cache order");
+
+	// A document written again with another provider replaces its entries in the index
+	std::vector<ScapAttribute> attributes;
+	cache_response(scapResponse(0, {PROVIDERS}), "document0", attributes);
+	ScapResult<std::vector<ScapAttribute>> replaced = find_cached_attributes_by_provider(providerUri(PROVIDERS));
+	check(!replaced.is_error() && replaced.data().size() == 3 && replaced.data()[0].citizen_name == "Citizen 0",
+		  "by provider: a provider added to a cached document is found");
+
+	// Reading the whole cache again, then the same lookup with the cache unchanged
+	set_scap_test_cache_dir(dir + "/other");
+	load_cache();
+	set_scap_test_cache_dir(dir);
+	TestClock::time_point start = TestClock::now();
+	ScapResult<std::vector<ScapAttribute>> parsed = find_cached_attributes_by_provider(providerUri(1));
+	double parseMillis = elapsedMillis(start);
+	start = TestClock::now();
+	ScapResult<std::vector<ScapAttribute>> indexed = find_cached_attributes_by_provider(providerUri(1));
+	double indexedMillis = elapsedMillis(start);
+	printf("provider lookup in %d cached documents: %.2f ms reading the cache, %.2f ms with the cache unchanged\n",
+		   CACHED_DOCUMENTS, parseMillis, indexedMillis);
+	check(!indexed.is_error() && uniqueIds(indexed.data()) == uniqueIds(parsed.data()) &&
+			  indexedMillis < parseMillis / 2,
+		  "by provider: an unchanged cache isn't parsed again");
+
+	set_scap_test_cache_dir(QString());
+}
@@ -0,0 +1,200 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	SCAP polling scheduler against a local stub of the SCAP "get result" endpoints.
+	Each simulated SCAP process is answered with status 102 until its provider latency has elapsed
+	and with status 200 afterwards. The stub also delays every answer to simulate the network.
+*/
+#include "UnitTest.h"
+#include "LoopbackServer.h"
+
+#include "scapclient.h"
+#include "scapservice.h"
+
+#include <atomic>
+#include <map>
+
+using namespace eIDMW;
+
+// Time taken by the stub to answer each request
+#define STUB_RESPONSE_DELAY_MS 50
+
+class ScapStub : public LoopbackServer {
+public:
+	/* Starts a SCAP process whose result is ready after latencyMs.
+	   A non-zero retryAfter is sent as Retry-After (in seconds) while the process is in progress. */
+	void addProcess(const std::string &processId, int latencyMs, int retryAfter = 0) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Process &process = m_processes[processId];
+		process.ready = TestClock::now() + std::chrono::milliseconds(latencyMs);
+		process.retryAfter = retryAfter;
+		process.polls = 0;
+	}
+
+	int polls(const std::string &processId) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_processes[processId].polls;
+	}
+
+protected:
+	bool answer(const HttpRequest &request, std::string &response) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(STUB_RESPONSE_DELAY_MS));
+
+		std::string code = "404";
+		std::string extraHeaders;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			std::map<std::string, Process>::iterator it = m_processes.find(processId(request.body));
+			if (it != m_processes.end()) {
+				Process &process = it->second;
+				process.polls++;
+				if (TestClock::now() >= process.ready) {
+					code = "200";
+				} else {
+					code = "102";
+					if (process.retryAfter > 0)
+						extraHeaders = "Retry-After: " + std::to_string(process.retryAfter) + "\r\n";
+				}
+			}
+		}
+
+		std::string json = "{\"status\":{\"code\":\"" + code + "\",\"codeDescription\":\"stub\"}}";
+		response = httpResponse("200 OK", "application/json", json, extraHeaders);
+		return true;
+	}
+
+private:
+	struct Process {
+		TestClock::time_point ready;
+		int retryAfter;
+		int polls;
+	};
+
+	// Value of the "processId" string in the JSON body of a polling request
+	static std::string processId(const std::string &body) {
+		size_t pos = body.find("\"processId\"");
+		if (pos == std::string::npos)
+			return std::string();
+		size_t start = body.find('"', body.find(':', pos)) + 1;
+		return body.substr(start, body.find('"', start) - start);
+	}
+
+	std::mutex m_mutex; // protects m_processes
+	std::map<std::string, Process> m_processes;
+};
+
+struct PollResult {
+	unsigned int status;
+	unsigned int scapStatus;
+	double elapsedMs;
+};
+
+static PollResult poll(const std::string &processId, const std::atomic<bool> *cancelled = NULL) {
+	ScapCredentials credentials = {"stub-user", "stub-password", "stub-application"};
+	ScapRequest request;
+	request.endpoint = "/SCAPAttributeService/getCitizenAttributesResponse";
+	request.body = create_fetch_attributes_body(processId);
+
+	TestClock::time_point start = TestClock::now();
+	ScapResponse response = perform_polling_request(credentials, request, cancelled);
+
+	PollResult result;
+	result.status = response.status;
+	result.scapStatus = response.status == SCAP_OK ? get_response_status(response.response) : 0;
+	result.elapsedMs = elapsedMillis(start);
+	return result;
+}
+
+static bool startStub(ScapStub &stub) {
+	if (!stub.start())
+		return false;
+	set_scap_test_server("http://127.0.0.1", std::to_string(stub.port()));
+	return true;
+}
+
+static void stopStub(ScapStub &stub) {
+	set_scap_test_server(std::string(), std::string());
+	stub.stop();
+}
+
+// Concurrent polls complete soon after the latency of their provider and share the scheduler connections
+UNIT_TEST(scap_polling_backoff) {
+	ScapStub stub;
+	if (!startStub(stub)) {
+		check(false, "start the SCAP stub");
+		return;
+	}
+
+	const int latencies[] = {200, 700, 1200, 2500, 4000, 6000};
+	const size_t count = sizeof(latencies) / sizeof(latencies[0]);
+	std::vector<PollResult> results(count);
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < count; i++) {
+		std::string processId = "latency-" + std::to_string(latencies[i]);
+		stub.addProcess(processId, latencies[i]);
+		threads.push_back(std::thread([&results, i, processId]() { results[i] = poll(processId); }));
+	}
+
+	int totalPolls = 0;
+	for (size_t i = 0; i < count; i++) {
+		threads[i].join();
+		std::string processId = "latency-" + std::to_string(latencies[i]);
+		int polls = stub.polls(processId);
+		totalPolls += polls;
+		printf("%s: %.0f ms, %d poll(s)\n", processId.c_str(), results[i].elapsedMs, polls);
+
+		check(results[i].status == SCAP_OK && results[i].scapStatus == SCAP_OK, processId + " completed");
+		// The result is seen at the first poll after the latency, at most one maximum backoff interval later
+		check(results[i].elapsedMs >= latencies[i] && results[i].elapsedMs < latencies[i] + 4000 + 500,
+			  processId + " completed within one backoff interval of its latency");
+	}
+	printf("%d poll(s) over %d connection(s)\n", totalPolls, stub.connections());
+	check(stub.connections() < totalPolls, "polls reuse the connections of the scheduler");
+
+	stopStub(stub);
+}
+
+UNIT_TEST(scap_polling_retry_after) {
+	ScapStub stub;
+	if (!startStub(stub)) {
+		check(false, "start the SCAP stub");
+		return;
+	}
+
+	// Retry-After of 2 s: without it the result would be seen at the second poll, 1.5 s after the start
+	stub.addProcess("retry-after", 1200, 2);
+	PollResult retried = poll("retry-after");
+	printf("retry-after: %.0f ms, %d poll(s)\n", retried.elapsedMs, stub.polls("retry-after"));
+	check(retried.scapStatus == SCAP_OK && retried.elapsedMs >= 2400 && stub.polls("retry-after") == 2,
+		  "Retry-After takes precedence over the backoff interval");
+
+	stopStub(stub);
+}
+
+UNIT_TEST(scap_polling_cancel) {
+	ScapStub stub;
+	if (!startStub(stub)) {
+		check(false, "start the SCAP stub");
+		return;
+	}
+
+	// A poll that would otherwise run until the polling time limit
+	stub.addProcess("cancelled", 30000);
+	std::atomic<bool> cancelled(false);
+	std::thread canceller([&cancelled]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(700));
+		cancelled = true;
+	});
+	PollResult cancelResult = poll("cancelled", &cancelled);
+	canceller.join();
+	printf("cancelled: %.0f ms\n", cancelResult.elapsedMs);
+	check(cancelResult.status == POLLING_CANCELED_ERROR && cancelResult.elapsedMs < 700 + 500,
+		  "cancelled poll returns promptly");
+
+	stopStub(stub);
+}
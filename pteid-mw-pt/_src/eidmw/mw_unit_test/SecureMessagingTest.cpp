@@ -0,0 +1,82 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	Known answers of the PACE secure messaging codec (SecureMessaging.h) with AES-128 session keys.
+	The expected APDUs were computed separately with the openssl command line tool (AES-ECB for the IV,
+	AES-CBC for the cryptograms and CMAC), starting each case from a send sequence counter of 0.
+*/
+#include "UnitTest.h"
+
+#include "SecureMessaging.h"
+
+#include <cstring>
+
+using namespace eIDMW;
+
+static const char *KS_ENC = "00112233445566778899aabbccddeeff";
+static const char *KS_MAC = "0f0e0d0c0b0a09080706050403020100";
+
+static bool initCodec(SecureMessagingCodec &codec) {
+	CByteArray kEnc(KS_ENC, true);
+	CByteArray kMac(KS_MAC, true);
+	return codec.init(kEnc.GetBytes(), kEnc.Size(), kMac.GetBytes(), kMac.Size());
+}
+
+static bool sameBytes(const CByteArray &bytes, unsigned long offset, const std::string &hex) {
+	CByteArray expected(hex, true);
+	return bytes.Size() >= offset + expected.Size() &&
+		   memcmp(bytes.GetBytes() + offset, expected.GetBytes(), expected.Size()) == 0;
+}
+
+static bool wrapsTo(const std::string &header, const std::string &data, const std::string &le, bool includeLe,
+					const std::string &expected) {
+	SecureMessagingCodec codec;
+	CByteArray h(header, true), d(data, true), l(le, true), protectedAPDU;
+	return initCodec(codec) &&
+		   codec.wrap(h.GetBytes(), d.GetBytes(), d.Size(), l.GetBytes(), l.Size(), includeLe, false, protectedAPDU) &&
+		   protectedAPDU.Size() == CByteArray(expected, true).Size() && sameBytes(protectedAPDU, 0, expected);
+}
+
+UNIT_TEST(secure_messaging_known_answers) {
+	check(wrapsTo("00a4020c", "011e", "", false,
+				  "0ca4020c1d8711014434d81ed9208e59969d363a5b43feb98e08686191e257b52c4a00"),
+		  "command with data: DO'87 and DO'8E");
+	check(wrapsTo("00b00000", "", "00", true, "0cb000000d9701008e08e1dcae2ab9dd31ab00"),
+		  "command with Le only: DO'97 and DO'8E");
+	// The MAC covers SSC || padded header, there is no padding block for the empty data objects
+	check(wrapsTo("80e00000", "", "", false, "8ce000000a8e0816918320ffa59e6300"),
+		  "command without data objects: DO'8E only");
+
+	// Extended command of 300 bytes: 3-byte Lc, DO'87 with a 2-byte length and a 2-byte Le
+	SecureMessagingCodec codec;
+	CByteArray header("002a9e9a", true), le("0000", true), extended;
+	CByteArray data;
+	for (int i = 0; i < 300; i++)
+		data.Append((unsigned char)i);
+	check(initCodec(codec) && codec.wrap(header.GetBytes(), data.GetBytes(), data.Size(), le.GetBytes(), le.Size(),
+										 true, true, extended),
+		  "wrap the extended command");
+	check(extended.Size() == 332 && sameBytes(extended, 0, "0c2a9e9a0001438782013101"),
+		  "extended command: header, 3-byte Lc and DO'87 length");
+	check(sameBytes(extended, 12 + 288, "fe3b028c16c09728eb41e58653eb1901") &&
+			  sameBytes(extended, 12 + 304, "970200008e0898a1a7a7320143c00000"),
+		  "extended command: last cryptogram block, DO'97, DO'8E and 2-byte Le");
+
+	// Response to the command above (SSC 2): DO'87, DO'99 and DO'8E
+	CByteArray plain;
+	std::string response = "8711011312c6d1d9c148d79778b0a4d7eef22c990290008e08c89e8ec90bf7ec379000";
+	check(codec.unwrap(CByteArray(response, true), plain) && plain.Size() == 14 &&
+			  sameBytes(plain, 0, "6f0a8408a0000000770108009000"),
+		  "response: data and status word");
+
+	// A response that doesn't match its MAC is rejected
+	std::string tampered = response;
+	tampered[10] = tampered[10] == '0' ? '1' : '0';
+	CByteArray rejected;
+	check(!codec.unwrap(CByteArray(tampered, true), rejected), "response with a wrong MAC is rejected");
+}
@@ -0,0 +1,154 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+#include "TestPDF.h"
+
+#include <openssl/cms.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int TestPDFWriter::reserveObject() {
+	m_objects.push_back(std::string());
+	return (int)m_objects.size();
+}
+
+int TestPDFWriter::addObject(const std::string &body) {
+	m_objects.push_back(body);
+	return (int)m_objects.size();
+}
+
+void TestPDFWriter::setObject(int number, const std::string &body) { m_objects[number - 1] = body; }
+
+int TestPDFWriter::addStream(const std::string &dictEntries, const std::string &data) {
+	return addObject("<< " + dictEntries + " /Length " + std::to_string(data.size()) + " >>\nstream\n" + data +
+					 "\nendstream");
+}
+
+std::string TestPDFWriter::finish(int catalog) const {
+	std::string pdf = "%PDF-1.7\n%\xe2\xe3\xcf\xd3\n";
+	std::vector<size_t> offsets;
+	for (size_t i = 0; i < m_objects.size(); i++) {
+		offsets.push_back(pdf.size());
+		pdf += std::to_string(i + 1) + " 0 obj\n" + m_objects[i] + "\nendobj\n";
+	}
+
+	size_t xref = pdf.size();
+	pdf += "xref\n0 " + std::to_string(m_objects.size() + 1) + "\n0000000000 65535 f \n";
+	char entry[32];
+	for (size_t i = 0; i < offsets.size(); i++) {
+		snprintf(entry, sizeof(entry), "%010lu 00000 n \n", (unsigned long)offsets[i]);
+		pdf += entry;
+	}
+	pdf += "trailer\n<< /Size " + std::to_string(m_objects.size() + 1) + " /Root " + objectRef(catalog) +
+		   " >>\nstartxref\n" + std::to_string(xref) + "\n%%EOF\n";
+	return pdf;
+}
+
+bool TestPDFWriter::write(const std::string &path, int catalog) const { return writeFile(path, finish(catalog)); }
+
+std::string objectRef(int number) { return std::to_string(number) + " 0 R"; }
+
+std::string simpleTestPDF(int pages, double width, double height, size_t padding) {
+	TestPDFWriter writer;
+	int catalog = writer.reserveObject();
+	int pagesNode = writer.reserveObject();
+	int font = writer.addObject("<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>");
+	if (padding > 0) {
+		std::string data(padding, '\0');
+		for (size_t i = 0; i < padding; i++)
+			data[i] = (char)((i * 131) & 0xff);
+		writer.addStream("", data);
+	}
+
+	char mediaBox[64];
+	snprintf(mediaBox, sizeof(mediaBox), "[0 0 %g %g]", width, height);
+	std::string kids;
+	for (int i = 0; i < pages; i++) {
+		int contents = writer.addStream("", "BT /F1 24 Tf 72 720 Td (Page " + std::to_string(i + 1) + ") Tj ET");
+		int page = writer.addObject("<< /Type /Page /Parent " + objectRef(pagesNode) + " /MediaBox " + mediaBox +
+									" /Resources << /Font << /F1 " + objectRef(font) + " >> >> /Contents " +
+									objectRef(contents) + " >>");
+		kids += objectRef(page) + " ";
+	}
+
+	writer.setObject(pagesNode, "<< /Type /Pages /Kids [" + kids + "] /Count " + std::to_string(pages) + " >>");
+	writer.setObject(catalog, "<< /Type /Catalog /Pages " + objectRef(pagesNode) + " >>");
+	return writer.finish(catalog);
+}
+
+bool writeSimpleTestPDF(const std::string &path, int pages, double width, double height, size_t padding) {
+	return writeFile(path, simpleTestPDF(pages, width, height, padding));
+}
+
+bool readFile(const std::string &path, std::string &data) {
+	FILE *f = fopen(path.c_str(), "rb");
+	if (f == NULL)
+		return false;
+	data.clear();
+	char buffer[65536];
+	size_t len;
+	while ((len = fread(buffer, 1, sizeof(buffer), f)) > 0)
+		data.append(buffer, len);
+	bool ok = ferror(f) == 0;
+	fclose(f);
+	return ok;
+}
+
+bool writeFile(const std::string &path, const std::string &data) {
+	FILE *f = fopen(path.c_str(), "wb");
+	if (f == NULL)
+		return false;
+	bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+	return fclose(f) == 0 && ok;
+}
+
+static bool verifyCMS(const std::string &signedData, const std::string &contentsHex, X509 *signer) {
+	std::string der;
+	for (size_t i = 0; i + 1 < contentsHex.size(); i += 2)
+		der += (char)strtol(contentsHex.substr(i, 2).c_str(), NULL, 16);
+
+	const unsigned char *p = (const unsigned char *)der.data();
+	CMS_ContentInfo *cms = d2i_CMS_ContentInfo(NULL, &p, (long)der.size());
+	if (cms == NULL)
+		return false;
+
+	BIO *content = BIO_new_mem_buf(signedData.data(), (int)signedData.size());
+	bool ok = CMS_verify(cms, NULL, NULL, content, NULL, CMS_DETACHED | CMS_BINARY | CMS_NO_SIGNER_CERT_VERIFY) == 1;
+	if (ok) {
+		STACK_OF(X509) *signers = CMS_get0_signers(cms);
+		ok = signers != NULL && sk_X509_num(signers) == 1 && X509_cmp(sk_X509_value(signers, 0), signer) == 0;
+		sk_X509_free(signers);
+	}
+	BIO_free(content);
+	CMS_ContentInfo_free(cms);
+	return ok;
+}
+
+std::vector<PDFSignatureCheck> verifyPDFSignatures(const std::string &pdf, X509 *signer) {
+	std::vector<PDFSignatureCheck> checks;
+	size_t pos = 0;
+	while ((pos = pdf.find("/ByteRange", pos)) != std::string::npos) {
+		pos += 10;
+		unsigned long range[4];
+		if (sscanf(pdf.c_str() + pos, " [ %lu %lu %lu %lu", &range[0], &range[1], &range[2], &range[3]) != 4)
+			continue;
+
+		PDFSignatureCheck check;
+		check.byteRangeEnd = range[2] + range[3];
+		check.valid = range[0] == 0 && range[1] + 2 <= range[2] && check.byteRangeEnd <= pdf.size();
+		if (check.valid) {
+			std::string signedData = pdf.substr(range[0], range[1]) + pdf.substr(range[2], range[3]);
+			// The gap between the two ranges is the hex string of /Contents, <...>
+			std::string contentsHex = pdf.substr(range[1] + 1, range[2] - range[1] - 2);
+			check.valid = verifyCMS(signedData, contentsHex, signer);
+		}
+		checks.push_back(check);
+	}
+	return checks;
+}
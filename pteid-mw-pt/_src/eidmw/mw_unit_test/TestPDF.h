@@ -0,0 +1,55 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	PDF files written by the tests and checks of the signatures in the PDF files the middleware writes.
+*/
+#pragma once
+
+#include <openssl/x509.h>
+
+#include <string>
+#include <vector>
+
+// Writes a PDF with a classic xref table from objects numbered in the order they are added
+class TestPDFWriter {
+public:
+	// Reserves the next object number, the object is given later with setObject()
+	int reserveObject();
+	int addObject(const std::string &body);
+	void setObject(int number, const std::string &body);
+	// Adds a stream object, /Length is added to the dictionary entries
+	int addStream(const std::string &dictEntries, const std::string &data);
+
+	std::string finish(int catalog) const;
+	bool write(const std::string &path, int catalog) const;
+
+private:
+	std::vector<std::string> m_objects;
+};
+
+std::string objectRef(int number);
+
+// PDF with pages of size width x height pt, each with a line of text, under one /Pages node.
+// With padding, a stream of that many bytes is added so that the file is large.
+std::string simpleTestPDF(int pages, double width = 595, double height = 842, size_t padding = 0);
+bool writeSimpleTestPDF(const std::string &path, int pages, double width = 595, double height = 842,
+						size_t padding = 0);
+
+bool readFile(const std::string &path, std::string &data);
+bool writeFile(const std::string &path, const std::string &data);
+
+struct PDFSignatureCheck {
+	size_t byteRangeEnd; // the signature covers the file up to here, it is the size of its revision
+	bool valid;
+};
+
+/*
+	Verifies the CMS signature of each /ByteRange of the file over the bytes it covers.
+	The signer certificate must be signer, its chain is not verified.
+*/
+std::vector<PDFSignatureCheck> verifyPDFSignatures(const std::string &pdf, X509 *signer);
@@ -0,0 +1,118 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+#include "TestPKI.h"
+
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/x509v3.h>
+
+#include <cstdio>
+
+static EVP_PKEY *generateRSAKey() {
+	EVP_PKEY *key = NULL;
+	EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+	if (ctx == NULL || EVP_PKEY_keygen_init(ctx) <= 0 || EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, 2048) <= 0 ||
+		EVP_PKEY_keygen(ctx, &key) <= 0) {
+		key = NULL;
+	}
+	EVP_PKEY_CTX_free(ctx);
+	return key;
+}
+
+static bool addExtension(X509 *certificate, int nid, const char *value) {
+	X509V3_CTX ctx;
+	X509V3_set_ctx_nodb(&ctx);
+	X509V3_set_ctx(&ctx, certificate, certificate, NULL, NULL, 0);
+	X509_EXTENSION *extension = X509V3_EXT_conf_nid(NULL, &ctx, nid, (char *)value);
+	if (extension == NULL)
+		return false;
+	bool ok = X509_add_ext(certificate, extension, -1) == 1;
+	X509_EXTENSION_free(extension);
+	return ok;
+}
+
+TestIdentity::TestIdentity(const std::string &commonName) : m_key(generateRSAKey()), m_certificate(NULL) {
+	if (m_key == NULL)
+		return;
+
+	X509 *certificate = X509_new();
+	X509_set_version(certificate, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+	X509_gmtime_adj(X509_getm_notBefore(certificate), -3600);
+	X509_gmtime_adj(X509_getm_notAfter(certificate), 24 * 3600);
+	X509_set_pubkey(certificate, m_key);
+
+	X509_NAME *name = X509_get_subject_name(certificate);
+	X509_NAME_add_entry_by_txt(name, "C", MBSTRING_ASC, (const unsigned char *)"PT", -1, -1, 0);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)commonName.c_str(), -1, -1, 0);
+	// The signatures of the middleware show the serialNumber of the subject as the document number
+	X509_NAME_add_entry_by_txt(name, "serialNumber", MBSTRING_ASC, (const unsigned char *)"BI000000000", -1, -1, 0);
+	X509_set_issuer_name(certificate, name);
+
+	if (addExtension(certificate, NID_basic_constraints, "critical,CA:FALSE") &&
+		addExtension(certificate, NID_key_usage, "critical,digitalSignature,nonRepudiation,keyEncipherment") &&
+		addExtension(certificate, NID_subject_alt_name, "IP:127.0.0.1,DNS:127.0.0.1,DNS:localhost") &&
+		X509_sign(certificate, m_key, EVP_sha256()) > 0) {
+		m_certificate = certificate;
+	} else {
+		X509_free(certificate);
+	}
+}
+
+TestIdentity::~TestIdentity() {
+	X509_free(m_certificate);
+	EVP_PKEY_free(m_key);
+}
+
+std::string TestIdentity::certificatePEM() const {
+	std::string pem;
+	BIO *bio = BIO_new(BIO_s_mem());
+	if (m_certificate != NULL && PEM_write_bio_X509(bio, m_certificate) == 1) {
+		char *data = NULL;
+		long len = BIO_get_mem_data(bio, &data);
+		pem.assign(data, len);
+	}
+	BIO_free(bio);
+	return pem;
+}
+
+std::vector<unsigned char> TestIdentity::certificateDER() const {
+	std::vector<unsigned char> der;
+	int len = m_certificate != NULL ? i2d_X509(m_certificate, NULL) : 0;
+	if (len > 0) {
+		der.resize(len);
+		unsigned char *p = der.data();
+		i2d_X509(m_certificate, &p);
+	}
+	return der;
+}
+
+bool TestIdentity::writeCertificatePEM(const std::string &path) const {
+	std::string pem = certificatePEM();
+	FILE *f = fopen(path.c_str(), "wb");
+	if (f == NULL)
+		return false;
+	bool ok = !pem.empty() && fwrite(pem.data(), 1, pem.size(), f) == pem.size();
+	return fclose(f) == 0 && ok;
+}
+
+std::vector<unsigned char> TestIdentity::signDigestInfo(const unsigned char *digestInfo, size_t len) const {
+	std::vector<unsigned char> signature;
+	EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new(m_key, NULL);
+	size_t signatureLen = 0;
+	if (ctx != NULL && EVP_PKEY_sign_init(ctx) > 0 && EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) > 0 &&
+		EVP_PKEY_sign(ctx, NULL, &signatureLen, digestInfo, len) > 0) {
+		signature.resize(signatureLen);
+		if (EVP_PKEY_sign(ctx, signature.data(), &signatureLen, digestInfo, len) > 0)
+			signature.resize(signatureLen);
+		else
+			signature.clear();
+	}
+	EVP_PKEY_CTX_free(ctx);
+	return signature;
+}
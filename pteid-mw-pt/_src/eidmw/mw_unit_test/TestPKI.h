@@ -0,0 +1,43 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	RSA key and self-signed certificate generated for a test, used by the TLS loopback servers
+	and by the mocks that return signatures (CMD) or certificates.
+*/
+#pragma once
+
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+#include <string>
+#include <vector>
+
+class TestIdentity {
+public:
+	// The certificate is valid for 127.0.0.1 (IP and DNS subject alternative names) so it can serve TLS
+	explicit TestIdentity(const std::string &commonName);
+	~TestIdentity();
+
+	bool isOk() const { return m_key != NULL && m_certificate != NULL; }
+	EVP_PKEY *key() const { return m_key; }
+	X509 *certificate() const { return m_certificate; }
+
+	std::string certificatePEM() const;
+	std::vector<unsigned char> certificateDER() const;
+	bool writeCertificatePEM(const std::string &path) const;
+
+	// PKCS#1 v1.5 signature of an encoded DigestInfo, which is what the CMD service returns
+	std::vector<unsigned char> signDigestInfo(const unsigned char *digestInfo, size_t len) const;
+
+private:
+	TestIdentity(const TestIdentity &);
+	TestIdentity &operator=(const TestIdentity &);
+
+	EVP_PKEY *m_key;
+	X509 *m_certificate;
+};
@@ -0,0 +1,41 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	Test registry of mw_unit_test. A test is a function defined with UNIT_TEST(name) in any source file
+	of the project. main.cpp runs every test, or the ones named on the command line, in name order and
+	prints the result of each check() like crl_unit_test does. The exit code is 1 if a check failed.
+*/
+#pragma once
+
+#include <chrono>
+#include <string>
+
+typedef void (*UnitTestFunction)();
+
+struct UnitTestRegistration {
+	UnitTestRegistration(const char *name, UnitTestFunction function);
+};
+
+#define UNIT_TEST(name)                                                                                            \
+	static void name();                                                                                            \
+	static UnitTestRegistration name##_registration(#name, name);                                                  \
+	static void name()
+
+// Records the result of one check of the running test
+void check(bool ok, const std::string &what);
+
+// Path of a file of the data directory of the project (mw_unit_test/data)
+std::string testDataPath(const std::string &name);
+
+// Empty directory for the files written by the running test, removed when the test ends
+std::string testTempDir();
+
+typedef std::chrono::steady_clock TestClock;
+
+// Milliseconds elapsed since a point in time, for the timings reported by the tests
+double elapsedMillis(TestClock::time_point since);
@@ -0,0 +1,276 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	Virtual card of the card layer (see VirtualCard.h), only in test builds (qmake CONFIG+=virtual_card).
+	virtual_card_apdus runs the commands of a card read and of a signature against a card written by the test.
+	card_flows measures the card flows of the middleware against the virtual card set in the configuration
+	("virtual_card_dir" or "apdu_replay_file", e.g. a copy of a real card): the mean time, APDUs, bytes and
+	modelled card time of one iteration of
+	- read-all: ID, SOD and certificates with the SDK;
+	- sign: signature PIN verification and SHA-256 signature with the SDK;
+	- pkcs11-sign: login and signature with the PKCS#11 module.
+	The PIN of the configured card is read from MW_UNIT_TEST_PIN, "1234" by default.
+*/
+#ifdef PTEID_VIRTUAL_CARD
+
+#include "UnitTest.h"
+#include "TestPDF.h"
+#include "TestPKI.h"
+
+#include "eidlib.h"
+#include "eidlibException.h"
+#include "eidErrors.h"
+#include "VirtualCard.h"
+#include "pteid_p11.h"
+
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/sha.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace eIDMW;
+
+#define CARD_FLOW_ITERATIONS 10
+// Latency of each APDU of the test card, in mili-seconds
+#define TEST_CARD_LATENCY 2
+
+static const unsigned char TEST_DATA[] = "mw_unit_test";
+
+static CByteArray apdu(const unsigned char *header, size_t headerLen, const unsigned char *data = NULL,
+					   size_t dataLen = 0) {
+	CByteArray command(header, (unsigned long)headerLen);
+	if (dataLen > 0) {
+		command.Append((unsigned char)dataLen);
+		command.Append(data, (unsigned long)dataLen);
+	}
+	return command;
+}
+
+static unsigned long sw(const CByteArray &response) {
+	unsigned long size = response.Size();
+	return size < 2 ? 0 : (unsigned long)response.GetByte(size - 2) << 8 | response.GetByte(size - 1);
+}
+
+UNIT_TEST(virtual_card_apdus) {
+	TestIdentity identity("Virtual Card Signature Key");
+	if (!identity.isOk()) {
+		check(false, "generate the signature key");
+		return;
+	}
+
+	// EF.ID in DF 5F00, the signature PIN (81) and the signature key (8C)
+	std::string dir = testTempDir();
+	std::string efId(1000, '\0');
+	for (size_t i = 0; i < efId.size(); i++)
+		efId[i] = (char)(i * 7);
+	FILE *keyFile = fopen((dir + "/key_8C.pem").c_str(), "w");
+	bool written = keyFile != NULL && PEM_write_PrivateKey(keyFile, identity.key(), NULL, NULL, 0, NULL, NULL) == 1;
+	if (keyFile != NULL)
+		written = fclose(keyFile) == 0 && written;
+	written = written && writeFile(dir + "/3F005F00EF02.bin", efId) && writeFile(dir + "/pin_81.txt", "4321\n");
+	if (!written) {
+		check(false, "write the card files");
+		return;
+	}
+
+	CVirtualCard card(dir, TEST_CARD_LATENCY);
+	TestClock::time_point start = TestClock::now();
+
+	// Select by path, the FCI has the file size in tag 81
+	const unsigned char selectEfId[] = {0x00, 0xA4, 0x08, 0x00};
+	const unsigned char efIdPath[] = {0x5F, 0x00, 0xEF, 0x02};
+	CByteArray fci = card.Transmit(apdu(selectEfId, sizeof(selectEfId), efIdPath, sizeof(efIdPath)));
+	check(sw(fci) == 0x9000 && fci.Size() > 6 && fci.GetByte(2) == 0x81 &&
+			  ((unsigned long)fci.GetByte(4) << 8 | fci.GetByte(5)) == efId.size(),
+		  "SELECT by path returns the file size");
+
+	std::string read;
+	unsigned long readBinaryResult = 0x9000;
+	while (read.size() < efId.size() && readBinaryResult == 0x9000) {
+		const unsigned char readBinary[] = {0x00, 0xB0, (unsigned char)(read.size() >> 8),
+											(unsigned char)(read.size() & 0xFF), 0x00};
+		CByteArray response = card.Transmit(apdu(readBinary, sizeof(readBinary)));
+		readBinaryResult = sw(response);
+		read.append((const char *)response.GetBytes(), response.Size() - 2);
+	}
+	check(readBinaryResult == 0x9000 && read == efId, "READ BINARY returns the file");
+
+	// A signature needs the PIN
+	const unsigned char mseSet[] = {0x00, 0x22, 0x41, 0xB6};
+	const unsigned char mseData[] = {0x80, 0x01, 0x42, 0x84, 0x01, 0x8C};
+	check(sw(card.Transmit(apdu(mseSet, sizeof(mseSet), mseData, sizeof(mseData)))) == 0x9000, "MSE:SET");
+
+	unsigned char hashData[2 + SHA256_DIGEST_LENGTH] = {0x90, SHA256_DIGEST_LENGTH};
+	SHA256(TEST_DATA, sizeof(TEST_DATA), hashData + 2);
+	const unsigned char psoHash[] = {0x00, 0x2A, 0x90, 0xA0};
+	const unsigned char psoCds[] = {0x00, 0x2A, 0x9E, 0x9A, 0x00};
+	card.Transmit(apdu(psoHash, sizeof(psoHash), hashData, sizeof(hashData)));
+	check(sw(card.Transmit(apdu(psoCds, sizeof(psoCds)))) == 0x6982, "PSO:CDS without the PIN is refused");
+
+	const unsigned char verify[] = {0x00, 0x20, 0x00, 0x81};
+	const unsigned char wrongPin[] = {'1', '2', '3', '4', 0xFF, 0xFF, 0xFF, 0xFF};
+	const unsigned char pin[] = {'4', '3', '2', '1', 0xFF, 0xFF, 0xFF, 0xFF};
+	check(sw(card.Transmit(apdu(verify, sizeof(verify), wrongPin, sizeof(wrongPin)))) == 0x63C2,
+		  "VERIFY with a wrong PIN returns the remaining tries");
+	check(sw(card.Transmit(apdu(verify, sizeof(verify), pin, sizeof(pin)))) == 0x9000, "VERIFY");
+
+	card.Transmit(apdu(psoHash, sizeof(psoHash), hashData, sizeof(hashData)));
+	CByteArray signature = card.Transmit(apdu(psoCds, sizeof(psoCds)));
+	bool verified = sw(signature) == 0x9000;
+	if (verified) {
+		EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new(identity.key(), NULL);
+		verified = ctx != NULL && EVP_PKEY_verify_init(ctx) > 0 &&
+				  EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) > 0 &&
+				  EVP_PKEY_CTX_set_signature_md(ctx, EVP_sha256()) > 0 &&
+				  EVP_PKEY_verify(ctx, signature.GetBytes(), signature.Size() - 2, hashData + 2,
+								  SHA256_DIGEST_LENGTH) == 1;
+		EVP_PKEY_CTX_free(ctx);
+	}
+	check(verified, "PSO:CDS signs the hash with the key of the security environment");
+
+	double ms = elapsedMillis(start);
+	tVirtualCardStats stats = card.GetStats();
+	printf("%lu APDUs, %lu bytes sent, %lu bytes received, %.1f ms, modelled card time %.1f ms\n",
+		   stats.ulApduCount, stats.ulBytesSent, stats.ulBytesReceived, ms, stats.ulModelledLatency / 1000.0);
+	check(stats.ulModelledLatency == stats.ulApduCount * TEST_CARD_LATENCY * 1000 &&
+			  ms >= stats.ulApduCount * TEST_CARD_LATENCY,
+		  "every APDU waits for the card latency");
+}
+
+static void report(const char *flow, double ms, const tVirtualCardStats &stats) {
+	printf("%s: %.3f ms, %.1f APDUs, %.1f bytes sent, %.1f bytes received, card %.3f ms\n", flow,
+		   ms / CARD_FLOW_ITERATIONS, (double)stats.ulApduCount / CARD_FLOW_ITERATIONS,
+		   (double)stats.ulBytesSent / CARD_FLOW_ITERATIONS, (double)stats.ulBytesReceived / CARD_FLOW_ITERATIONS,
+		   (double)stats.ulModelledLatency / CARD_FLOW_ITERATIONS / 1000);
+	check(stats.ulReplayMisses == 0, std::string(flow) + ": every command is answered");
+}
+
+static void readAll(PTEID_EIDCard &card) {
+	card.getID().getDocumentNumber();
+	card.getSod().getData();
+	PTEID_Certificates &certificates = card.getCertificates();
+	for (unsigned long i = 0; i < certificates.countFromCard(); i++)
+		certificates.getCertFromCard(i).getCertData();
+}
+
+static void sign(PTEID_EIDCard &card, const char *pin) {
+	unsigned long remaining = 0;
+	if (!card.getPins().getPinByPinRef(PTEID_Pin::SIGN_PIN).verifyPin(pin, remaining, false))
+		throw PTEID_Exception(EIDMW_ERR_PIN_BAD);
+
+	PTEID_ByteArray data(TEST_DATA, sizeof(TEST_DATA));
+	card.SignSHA256(data, true);
+}
+
+// Slot of the virtual card reader, the slot description is padded with spaces
+static bool findVirtualSlot(CK_SLOT_ID &slot) {
+	CK_ULONG count = 0;
+	if (C_GetSlotList(CK_TRUE, NULL, &count) != CKR_OK || count == 0)
+		return false;
+	std::vector<CK_SLOT_ID> slots(count);
+	if (C_GetSlotList(CK_TRUE, slots.data(), &count) != CKR_OK)
+		return false;
+
+	for (CK_ULONG i = 0; i < count; i++) {
+		CK_SLOT_INFO info;
+		if (C_GetSlotInfo(slots[i], &info) == CKR_OK &&
+			strncmp((const char *)info.slotDescription, VIRTUAL_READER_NAME, strlen(VIRTUAL_READER_NAME)) == 0) {
+			slot = slots[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+static CK_RV pkcs11Sign(CK_SLOT_ID slot, const char *pin) {
+	CK_SESSION_HANDLE session;
+	CK_RV rv = C_OpenSession(slot, CKF_SERIAL_SESSION, NULL, NULL, &session);
+	if (rv != CKR_OK)
+		return rv;
+
+	rv = C_Login(session, CKU_USER, (CK_UTF8CHAR_PTR)pin, (CK_ULONG)strlen(pin));
+
+	CK_OBJECT_CLASS keyClass = CKO_PRIVATE_KEY;
+	CK_ATTRIBUTE keyTemplate[] = {{CKA_CLASS, &keyClass, sizeof(keyClass)}};
+	CK_OBJECT_HANDLE key;
+	CK_ULONG found = 0;
+	if (rv == CKR_OK && (rv = C_FindObjectsInit(session, keyTemplate, 1)) == CKR_OK) {
+		rv = C_FindObjects(session, &key, 1, &found);
+		C_FindObjectsFinal(session);
+		if (rv == CKR_OK && found == 0)
+			rv = CKR_KEY_HANDLE_INVALID;
+	}
+
+	CK_KEY_TYPE keyType = CKK_RSA;
+	CK_ATTRIBUTE typeTemplate[] = {{CKA_KEY_TYPE, &keyType, sizeof(keyType)}};
+	if (rv == CKR_OK)
+		rv = C_GetAttributeValue(session, key, typeTemplate, 1);
+
+	CK_MECHANISM mechanism = {keyType == CKK_EC ? CKM_ECDSA_SHA256 : CKM_SHA256_RSA_PKCS, NULL, 0};
+	CK_BYTE signature[512];
+	CK_ULONG signatureLen = sizeof(signature);
+	if (rv == CKR_OK)
+		rv = C_SignInit(session, &mechanism, key);
+	if (rv == CKR_OK)
+		rv = C_Sign(session, (CK_BYTE_PTR)TEST_DATA, sizeof(TEST_DATA), signature, &signatureLen);
+
+	C_Logout(session);
+	C_CloseSession(session);
+	return rv;
+}
+
+UNIT_TEST(card_flows) {
+	CVirtualCard *virtualCard = CVirtualCard::GetInstance();
+	if (virtualCard == NULL) {
+		printf("card_flows: no virtual card in the configuration (virtual_card_dir or apdu_replay_file), skipped\n");
+		return;
+	}
+	const char *pin = getenv("MW_UNIT_TEST_PIN") != NULL ? getenv("MW_UNIT_TEST_PIN") : "1234";
+
+	// The SDK is released before the PKCS#11 flow so that each one starts with its own card connection
+	try {
+		PTEID_InitSDK();
+		PTEID_EIDCard &card = ReaderSet.getReaderByName(VIRTUAL_READER_NAME).getEIDCard();
+
+		virtualCard->ResetStats();
+		TestClock::time_point start = TestClock::now();
+		for (int i = 0; i < CARD_FLOW_ITERATIONS; i++)
+			readAll(card);
+		report("read-all", elapsedMillis(start), virtualCard->GetStats());
+
+		virtualCard->ResetStats();
+		start = TestClock::now();
+		for (int i = 0; i < CARD_FLOW_ITERATIONS; i++)
+			sign(card, pin);
+		report("sign", elapsedMillis(start), virtualCard->GetStats());
+	} catch (PTEID_Exception &e) {
+		check(false, "SDK flows, error " + std::to_string(e.GetError()));
+	}
+	PTEID_ReleaseSDK();
+
+	CK_RV rv = C_Initialize(NULL);
+	CK_SLOT_ID slot;
+	if (rv != CKR_OK || !findVirtualSlot(slot)) {
+		check(false, "the PKCS#11 module has a slot for " VIRTUAL_READER_NAME);
+	} else {
+		virtualCard->ResetStats();
+		TestClock::time_point start = TestClock::now();
+		for (int i = 0; i < CARD_FLOW_ITERATIONS && rv == CKR_OK; i++)
+			rv = pkcs11Sign(slot, pin);
+		check(rv == CKR_OK, "pkcs11-sign: login and signature");
+		if (rv == CKR_OK)
+			report("pkcs11-sign", elapsedMillis(start), virtualCard->GetStats());
+	}
+	C_Finalize(NULL);
+}
+
+#endif // PTEID_VIRTUAL_CARD
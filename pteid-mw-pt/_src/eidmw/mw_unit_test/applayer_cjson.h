@@ -0,0 +1,52 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	Included before every source of mw_unit_test. The applayer bundles an old cJSON, hidden inside its
+	library, while the SCAP library uses the cJSON of the system. Both are linked into this executable,
+	so the functions of the bundled copy are renamed here to keep the SCAP code on the system cJSON.
+*/
+#pragma once
+
+#define cJSON_AddItemReferenceToArray applayer_cJSON_AddItemReferenceToArray
+#define cJSON_AddItemReferenceToObject applayer_cJSON_AddItemReferenceToObject
+#define cJSON_AddItemToArray applayer_cJSON_AddItemToArray
+#define cJSON_AddItemToObject applayer_cJSON_AddItemToObject
+#define cJSON_CreateArray applayer_cJSON_CreateArray
+#define cJSON_CreateBool applayer_cJSON_CreateBool
+#define cJSON_CreateDoubleArray applayer_cJSON_CreateDoubleArray
+#define cJSON_CreateFalse applayer_cJSON_CreateFalse
+#define cJSON_CreateFloatArray applayer_cJSON_CreateFloatArray
+#define cJSON_CreateIntArray applayer_cJSON_CreateIntArray
+#define cJSON_CreateNull applayer_cJSON_CreateNull
+#define cJSON_CreateNumber applayer_cJSON_CreateNumber
+#define cJSON_CreateObject applayer_cJSON_CreateObject
+#define cJSON_CreateString applayer_cJSON_CreateString
+#define cJSON_CreateStringArray applayer_cJSON_CreateStringArray
+#define cJSON_CreateTrue applayer_cJSON_CreateTrue
+#define cJSON_Delete applayer_cJSON_Delete
+#define cJSON_DeleteItemFromArray applayer_cJSON_DeleteItemFromArray
+#define cJSON_DeleteItemFromObject applayer_cJSON_DeleteItemFromObject
+#define cJSON_DetachItemFromArray applayer_cJSON_DetachItemFromArray
+#define cJSON_DetachItemFromObject applayer_cJSON_DetachItemFromObject
+#define cJSON_Duplicate applayer_cJSON_Duplicate
+#define cJSON_GetArrayItem applayer_cJSON_GetArrayItem
+#define cJSON_GetArraySize applayer_cJSON_GetArraySize
+#define cJSON_GetErrorPtr applayer_cJSON_GetErrorPtr
+#define cJSON_GetObjectItem applayer_cJSON_GetObjectItem
+#define cJSON_InitHooks applayer_cJSON_InitHooks
+#define cJSON_IsArray applayer_cJSON_IsArray
+#define cJSON_IsNumber applayer_cJSON_IsNumber
+#define cJSON_IsObject applayer_cJSON_IsObject
+#define cJSON_IsString applayer_cJSON_IsString
+#define cJSON_Minify applayer_cJSON_Minify
+#define cJSON_Parse applayer_cJSON_Parse
+#define cJSON_ParseWithOpts applayer_cJSON_ParseWithOpts
+#define cJSON_Print applayer_cJSON_Print
+#define cJSON_PrintUnformatted applayer_cJSON_PrintUnformatted
+#define cJSON_ReplaceItemInArray applayer_cJSON_ReplaceItemInArray
+#define cJSON_ReplaceItemInObject applayer_cJSON_ReplaceItemInObject
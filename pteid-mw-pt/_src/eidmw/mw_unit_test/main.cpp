@@ -0,0 +1,102 @@
+/*-****************************************************************************
+
+ * Copyright (C) 2025 Caixa Magica Software.
+ *
+ * Licensed under the EUPL V.1.2
+
+****************************************************************************-*/
+/*
+	Unit tests of the middleware that don't need a card reader or the production services.
+	Usage: mw_unit_test.out [<test name>...]
+	Without arguments every test is run, "make check" runs them all after the build.
+*/
+#include "UnitTest.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <map>
+
+#ifdef WIN32
+#include <winsock2.h>
+#endif
+
+#ifndef MW_UNIT_TEST_DATA
+#define MW_UNIT_TEST_DATA "data"
+#endif
+
+namespace fs = std::filesystem;
+
+static std::map<std::string, UnitTestFunction> &registeredTests() {
+	static std::map<std::string, UnitTestFunction> tests;
+	return tests;
+}
+
+static std::string currentTest;
+static std::string currentTempDir;
+static int failures = 0;
+
+UnitTestRegistration::UnitTestRegistration(const char *name, UnitTestFunction function) {
+	registeredTests()[name] = function;
+}
+
+void check(bool ok, const std::string &what) {
+	printf("%s: %s: %s\n", currentTest.c_str(), what.c_str(), ok ? "Test passed!" : "Test failed!");
+	fflush(stdout);
+	if (!ok)
+		failures++;
+}
+
+std::string testDataPath(const std::string &name) { return (fs::path(MW_UNIT_TEST_DATA) / name).string(); }
+
+std::string testTempDir() {
+	if (currentTempDir.empty()) {
+		fs::path dir = fs::temp_directory_path() / ("mw_unit_test_" + currentTest);
+		std::error_code ec;
+		fs::remove_all(dir, ec);
+		fs::create_directories(dir);
+		currentTempDir = dir.string();
+	}
+	return currentTempDir;
+}
+
+double elapsedMillis(TestClock::time_point since) {
+	return std::chrono::duration<double, std::milli>(TestClock::now() - since).count();
+}
+
+int main(int argc, char **argv) {
+#ifdef WIN32
+	WSADATA wsaData;
+	WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+
+	std::map<std::string, UnitTestFunction> &tests = registeredTests();
+	for (int i = 1; i < argc; i++) {
+		if (tests.find(argv[i]) == tests.end()) {
+			fprintf(stderr, "Unknown test %s\n", argv[i]);
+			return 2;
+		}
+	}
+
+	int run = 0;
+	for (std::map<std::string, UnitTestFunction>::iterator it = tests.begin(); it != tests.end(); ++it) {
+		bool selected = argc == 1;
+		for (int i = 1; i < argc && !selected; i++)
+			selected = it->first == argv[i];
+		if (!selected)
+			continue;
+
+		currentTest = it->first;
+		currentTempDir.clear();
+		it->second();
+		run++;
+
+		if (!currentTempDir.empty()) {
+			std::error_code ec;
+			fs::remove_all(currentTempDir, ec);
+		}
+	}
+
+	printf("%d test(s) run, %d check(s) failed\n", run, failures);
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,160 @@
+######################################################################
+# Unit tests of the middleware that run without a card or the production services
+######################################################################
+
+include(../_Builds/eidcommon.mak)
+
+TEMPLATE = app
+TARGET = mw_unit_test.out
+
+message("Compile $$TARGET")
+
+###
+### Compiler setup
+###
+
+CONFIG -= warn_on
+CONFIG += console link_pkgconfig
+# The SCAP library is built with Qt
+QT -= gui
+QT += network
+# "make check" runs the tests
+CONFIG += testcase
+
+## destination directory for the compiler
+DESTDIR = .
+
+#external libs are openjp2="libopenjp2-7-dev", png="libpng-dev", z="zlib1g-dev"
+LIBS += -L../lib \
+	    -lpteidscap \
+	    -l$${EIDLIB} \
+	    -l$${COMMONLIB} \
+	    -l$${DLGLIB} \
+	    -lcjson \
+	    -lcrypto -lssl \
+	    -lxerces-c \
+	    -lxml-security-c \
+	    -lcurl \
+	    -lpng \
+	    -lz \
+	    -lzip
+
+macx:  LIBS += -lopenjp2
+!macx: PKGCONFIG += libopenjp2
+
+!macx: LIBS += -Wl,-R,'../lib'
+LIBS += ../lib/libpteid-poppler.a
+!macx: LIBS += -Wl,--exclude-libs,ALL
+
+macx: LIBS += -L $$DEPS_DIR/openssl-3/lib/ \
+	-L$$DEPS_DIR/xerces-c-3.2.4/lib/ \
+	-L$$DEPS_DIR/libzip/lib/ \
+	-L$$DEPS_DIR/libpng/lib \
+	-L$$DEPS_DIR/openjpeg/lib \
+	-L$$DEPS_DIR/xml-security-c/lib \
+	-L$$DEPS_DIR/libcurl/lib/ \
+	-L$$DEPS_DIR/cJSON-1.7.15/lib/
+macx: LIBS += -Wl,-framework -Wl,CoreFoundation
+macx: LIBS += -Wl,-framework -Wl,SystemConfiguration
+macx: LIBS += -Wl,-framework -Wl,CoreServices
+macx: LIBS += -liconv
+macx: INCLUDEPATH +=$$DEPS_DIR/openssl-3/include $$DEPS_DIR/libzip/include $$DEPS_DIR/openjpeg/include/openjpeg-2.4/ $$DEPS_DIR/xml-security-c/include/ $$DEPS_DIR/xerces-c-3.2.4/include $$DEPS_DIR/libpng/include $$DEPS_DIR/cJSON-1.7.15/include
+!macx: INCLUDEPATH += /usr/include/libpng16
+
+LIBS += -l$${CARDLAYERLIB}
+# The card flows of VirtualCardTest.cpp use the PKCS#11 module
+virtual_card: LIBS += -l$${PKCS11LIB}
+
+DEPENDPATH += .
+INCLUDEPATH += . ../common ../pteid-poppler ../cardlayer ../eidlib ../dialogs ../applayer ../CMD/services ../scap ../pkcs11
+macx: INCLUDEPATH += /usr/local/include
+INCLUDEPATH += $${PCSC_INCLUDE_DIR}
+
+DEFINES += APPLAYER_EXPORTS OPENSSL_SUPPRESS_DEPRECATED
+unix: DEFINES += __UNIX__ WITH_OPENSSL
+DEFINES += MW_UNIT_TEST_DATA=\\\"$$PWD/data\\\"
+# Keeps the cJSON bundled in the applayer apart from the one of the SCAP library
+QMAKE_CFLAGS += -include $$PWD/applayer_cjson.h
+QMAKE_CXXFLAGS += -include $$PWD/applayer_cjson.h
+
+# Input
+HEADERS += \
+	UnitTest.h \
+	LoopbackServer.h \
+	TestPKI.h \
+	TestPDF.h \
+	applayer_cjson.h
+
+# The applayer and the CMD client are built with hidden visibility so their sources are compiled here
+SOURCES += \
+	../applayer/APLCertif.cpp        \
+	../applayer/APLCrypto.cpp        \
+	../applayer/APLCardPteid.cpp     \
+	../applayer/APLConfig.cpp	\
+	../applayer/APLReader.cpp        \
+	../applayer/CardFile.cpp	        \
+	../applayer/CardPteid.cpp        \
+	../applayer/CertStatusCache.cpp  \
+	../applayer/cryptoFramework.cpp  \
+	../applayer/cryptoFwkPteid.cpp   \
+	../applayer/APLCard.cpp          \
+	../applayer/MiscUtil.cpp \
+	../applayer/XercesUtils.cpp \
+	../applayer/PhotoPteid.cpp \
+	../applayer/APLPublicKey.cpp \
+	../applayer/SigContainer.cpp \
+	../applayer/XadesSignature.cpp \
+	../applayer/RemoteAddress.cpp  \
+	../applayer/RemoteAddressRequest.cpp \
+	../applayer/SODParser.cpp \
+	../applayer/SSLConnection.cpp \
+	../applayer/TSAClient.cpp \
+	../applayer/SecurityContext.cpp \
+	../applayer/sign-pkcs7.cpp \
+	../applayer/cJSON.c \
+	../applayer/PKIFetcher.cpp \
+	../applayer/PDFSignature.cpp \
+	../applayer/PDFProbe.cpp \
+	../applayer/PDFOccupancy.cpp \
+	../applayer/PDFMemoryBudget.cpp \
+	../applayer/RemotePDF.cpp \
+	../applayer/PAdESExtender.cpp \
+	../applayer/MutualAuthentication.cpp \
+	../applayer/PNGConverter.cpp \
+	../applayer/J2KHelper.cpp \
+	../applayer/CurlUtil.cpp \
+	../applayer/proxyinfo.cpp \
+	../applayer/asn1_idfile.cpp \
+	../CMD/services/cmdServices.cpp \
+	../CMD/services/CMDSignature.cpp \
+	../CMD/services/cmdSignatureClient.cpp \
+	../CMD/services/cmdCertificates.cpp \
+	../CMD/services/soapC.cpp \
+	../CMD/services/soapBasicHttpBinding_USCORECCMovelSignatureProxy.cpp \
+	../CMD/services/stdsoap2.cpp \
+	../CMD/services/credentials.cpp \
+	main.cpp \
+	LoopbackServer.cpp \
+	TestPKI.cpp \
+	TestPDF.cpp \
+	CMDTest.cpp \
+	ScapPollingTest.cpp \
+	ScapCacheTest.cpp \
+	PhotoTest.cpp \
+	VirtualCardTest.cpp \
+	ApduTraceTest.cpp \
+	PDFMemoryBudgetTest.cpp \
+	PageTreeTest.cpp \
+	PDFProbeTest.cpp \
+	PDFOccupancyTest.cpp \
+	RemotePDFTest.cpp \
+	CompressedUpdateTest.cpp \
+	DSSRevisionTest.cpp \
+	IncrementalSaveTest.cpp \
+	LargePDFReadTest.cpp \
+	ASiCWriterTest.cpp \
+	SecureMessagingTest.cpp
+
+# Disable annoying and mostly useless gcc warning and add hidden visibility for non-exposed classes and functions
+QMAKE_CXXFLAGS += -Wno-write-strings -fvisibility=hidden
+QMAKE_CFLAGS += -fvisibility=hidden
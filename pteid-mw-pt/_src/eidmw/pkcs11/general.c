@@ -39,6 +39,8 @@ extern CK_FUNCTION_LIST pkcs11_function_list;
 static int g_final = 0;
 static int g_init = 0;
 
+int p11_is_initialized() { return g_init; }
+
 #ifndef WIN32
 #define _strdup strdup
 #define _snprintf snprintf
@@ -108,6 +110,7 @@ CK_RV C_Initialize(CK_VOID_PTR pReserved) {
 			p11_init_lock(p_args);
 		}
 		cal_init();
+		p11_metrics_init();
 		log_trace(WHERE, "S: Initialize this PKCS11 Module");
 		log_trace(WHERE, "S: =============================");
 	}
@@ -147,6 +150,7 @@ CK_RV C_Finalize(CK_VOID_PTR pReserved) {
 	g_final = 0;
 
 	ret = cal_close();
+	p11_metrics_finalize();
 
 	g_init = 0;
 
@@ -76,6 +76,7 @@ CK_RV C_GetAttributeValue(CK_SESSION_HANDLE hSession, /* the session's handle */
 						  CK_ATTRIBUTE_PTR pTemplate, /* specifies attributes, gets values */
 						  CK_ULONG ulCount)			  /* attributes in template */
 {
+	unsigned long long ullStart = p11_metrics_start();
 	/*
 	This function returns the values from the object.
 	Object is cached so objects are read only once and remain valid until new session is setup with token.
@@ -176,6 +177,7 @@ CK_RV C_GetAttributeValue(CK_SESSION_HANDLE hSession, /* the session's handle */
 
 cleanup:
 	p11_unlock();
+	p11_metrics_end(P11_METRIC_GET_ATTRIBUTE_VALUE, ullStart, ret);
 	return ((CK_RV)ret);
 }
 #undef WHERE
@@ -196,6 +198,7 @@ CK_RV C_FindObjectsInit(CK_SESSION_HANDLE hSession, /* the session's handle */
 						CK_ATTRIBUTE_PTR pTemplate, /* attribute values to match */
 						CK_ULONG ulCount)			/* attributes in search template */
 {
+	unsigned long long ullStart = p11_metrics_start();
 	P11_SESSION *pSession = NULL;
 	P11_FIND_DATA *pData = NULL;
 	int ret;
@@ -289,6 +292,7 @@ CK_RV C_FindObjectsInit(CK_SESSION_HANDLE hSession, /* the session's handle */
 
 cleanup:
 	p11_unlock();
+	p11_metrics_end(P11_METRIC_FIND_OBJECTS_INIT, ullStart, ret);
 	return ((CK_RV)ret);
 }
 #undef WHERE
@@ -299,6 +303,7 @@ CK_RV C_FindObjects(CK_SESSION_HANDLE hSession,	   /* the session's handle */
 					CK_ULONG ulMaxObjectCount,	   /* max handles to be returned */
 					CK_ULONG_PTR pulObjectCount)   /* actual number returned */
 {
+	unsigned long long ullStart = p11_metrics_start();
 	/*
 
 	this function finds handles to objects but does not actually reads them.
@@ -448,6 +453,7 @@ CK_RV C_FindObjects(CK_SESSION_HANDLE hSession,	   /* the session's handle */
 
 cleanup:
 	p11_unlock();
+	p11_metrics_end(P11_METRIC_FIND_OBJECTS, ullStart, ret);
 	return ((CK_RV)ret);
 }
 #undef WHERE
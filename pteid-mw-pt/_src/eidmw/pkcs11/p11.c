@@ -81,6 +81,30 @@ int p11_get_session(unsigned int h, P11_SESSION **ppSession) {
 	return (ret);
 }
 
+/* Session of a handle in use, unlike p11_get_session() the state of its card isn't checked */
+P11_SESSION *p11_find_session(unsigned int h) {
+	if ((h == 0) || (h > nSessions) || (gpSessions[h - 1].inuse == 0))
+		return (NULL);
+
+	return (&gpSessions[h - 1]);
+}
+
+/* A digest or sign operation that is being hashed without the global lock (see sign.c) can't be freed
+   when its session is closed: it's detached from the session and freed by the thread that hashes it */
+void p11_detach_busy_operations(P11_SESSION *pSession) {
+	P11_DIGEST_DATA *pDigestData = (P11_DIGEST_DATA *)pSession->Operation[P11_OPERATION_DIGEST].pData;
+	P11_SIGN_DATA *pSignData = (P11_SIGN_DATA *)pSession->Operation[P11_OPERATION_SIGN].pData;
+
+	if (pDigestData != NULL && pDigestData->busy) {
+		pSession->Operation[P11_OPERATION_DIGEST].pData = NULL;
+		pSession->Operation[P11_OPERATION_DIGEST].active = 0;
+	}
+	if (pSignData != NULL && pSignData->busy) {
+		pSession->Operation[P11_OPERATION_SIGN].pData = NULL;
+		pSession->Operation[P11_OPERATION_SIGN].active = 0;
+	}
+}
+
 P11_OBJECT *p11_get_slot_object(P11_SLOT *pSlot, unsigned int h) {
 	if ((h < 1) || (h > pSlot->nobjects))
 		return (NULL); // invalid handle
@@ -159,6 +183,7 @@ CK_RV p11_close_all_sessions(CK_SLOT_ID slotID) {
 			}
 
 			// clear data so it can be reused
+			p11_detach_busy_operations(pSession);
 			pSession->inuse = 0;
 			pSession->flags = 0;
 			pSession->hslot = 0;
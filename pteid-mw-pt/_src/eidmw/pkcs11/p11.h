@@ -153,12 +153,14 @@ typedef struct P11_FIND_DATA {
 
 typedef struct P11_DIGEST_DATA {
 	int update;
+	int busy; // data is being hashed without the global lock
 	void *phash;
 	unsigned int l_hash;
 } P11_DIGEST_DATA;
 
 typedef struct P11_SIGN_DATA {
 	int update;
+	int busy; // data is being hashed without the global lock
 	CK_MECHANISM_TYPE mechanism;
 	CK_OBJECT_HANDLE hKey;
 	CK_ULONG l_sign;
@@ -191,6 +193,9 @@ int p11_read_object(P11_SLOT *pSlot, P11_OBJECT *pObject);
 
 P11_SLOT *p11_get_slot(unsigned int h);
 int p11_get_session(unsigned int h, P11_SESSION **ppSession);
+P11_SESSION *p11_find_session(unsigned int h);
+void p11_detach_busy_operations(P11_SESSION *pSession);
+int p11_is_initialized();
 P11_OBJECT *p11_get_slot_object(P11_SLOT *pSlot, unsigned int h);
 int p11_get_nreaders();
 
@@ -43,6 +43,11 @@ int hash_init(CK_MECHANISM_PTR pMechanism, void **pphashinfo, unsigned int *size
 		*size = 20;
 		break;
 
+	case CKM_ECDSA_SHA224:
+		algo = ALGO_SHA224;
+		*size = 28;
+		break;
+
 	case CKM_SHA256:
 	case CKM_ECDSA_SHA256:
 	case CKM_SHA256_RSA_PKCS:
@@ -87,9 +92,13 @@ cleanup:
 int hash_update(void *phashinfo, char *p, unsigned long l) {
 	int ret = CKR_OK;
 	CHash *oHash = (CHash *)phashinfo;
-	CByteArray data((unsigned char *)p, l);
 
-	oHash->Update(data);
+	// Hash the caller's buffer directly: the parts passed to C_DigestUpdate/C_SignUpdate can be large
+	try {
+		oHash->Update((const unsigned char *)p, l);
+	} catch (...) {
+		ret = CKR_FUNCTION_FAILED;
+	}
 
 	return (ret);
 }
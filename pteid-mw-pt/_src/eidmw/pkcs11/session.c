@@ -50,6 +50,7 @@ CK_RV C_OpenSession(CK_SLOT_ID slotID,				 /* the slot's ID */
 					CK_NOTIFY Notify,				 /* notification callback function */
 					CK_SESSION_HANDLE_PTR phSession) /* receives new session handle */
 {
+	unsigned long long ullStart = p11_metrics_start();
 	int ret;
 	P11_SLOT *pSlot = NULL;
 	P11_SESSION *pSession = NULL;
@@ -123,6 +124,7 @@ CK_RV C_OpenSession(CK_SLOT_ID slotID,				 /* the slot's ID */
 cleanup:
 	p11_unlock();
 	log_trace(WHERE, "I: leave, ret = %i", ret);
+	p11_metrics_end(P11_METRIC_OPEN_SESSION, ullStart, ret);
 	return ((CK_RV)ret);
 }
 #undef WHERE
@@ -169,6 +171,7 @@ CK_RV C_CloseSession(CK_SESSION_HANDLE hSession) {
 	}
 
 	// clear data so it can be reused
+	p11_detach_busy_operations(pSession);
 	pSession->state = 0;
 	pSession->inuse = 0;
 	pSession->flags = 0;
@@ -322,6 +325,7 @@ CK_RV C_Login(CK_SESSION_HANDLE hSession, /* the session's handle */
 			  CK_CHAR_PTR pPin,			  /* the user's PIN */
 			  CK_ULONG ulPinLen)		  /* the length of the PIN */
 {
+	unsigned long long ullStart = p11_metrics_start();
 	int ret;
 	P11_SESSION *pSession = NULL;
 	P11_SLOT *pSlot = NULL;
@@ -372,6 +376,7 @@ cleanup:
 	p11_unlock();
 	log_trace(WHERE, "I: leave, ret = %i", ret);
 
+	p11_metrics_end(P11_METRIC_LOGIN, ullStart, ret);
 	return ((CK_RV)ret);
 }
 #undef WHERE
@@ -379,6 +384,7 @@ cleanup:
 #define WHERE "C_Logout()"
 CK_RV C_Logout(CK_SESSION_HANDLE hSession) /* the session's handle */
 {
+	unsigned long long ullStart = p11_metrics_start();
 	int ret = CKR_OK;
 	P11_SESSION *pSession = NULL;
 	P11_SLOT *pSlot = NULL;
@@ -419,6 +425,7 @@ CK_RV C_Logout(CK_SESSION_HANDLE hSession) /* the session's handle */
 cleanup:
 	p11_unlock();
 	log_trace(WHERE, "I: leave, ret = %i", ret);
+	p11_metrics_end(P11_METRIC_LOGOUT, ullStart, ret);
 	return ((CK_RV)ret);
 }
 #undef WHERE
@@ -30,10 +30,62 @@
 #include "cal.h"
 #include "phash.h"
 
+/* Frees the data of an operation detached from its session by p11_detach_busy_operations(),
+   hash_final() is the only way to free the hash */
+static void free_detached_operation(int operation, void *pData) {
+	unsigned char digest[64];
+	unsigned long len = sizeof(digest);
+
+	if (operation == P11_OPERATION_DIGEST) {
+		hash_final(((P11_DIGEST_DATA *)pData)->phash, digest, &len);
+	} else {
+		hash_final(((P11_SIGN_DATA *)pData)->phash, digest, &len);
+		free(((P11_SIGN_DATA *)pData)->pbuf);
+	}
+	free(pData);
+}
+
+/* Hash data for a session without holding the global lock: the module lock is also held while the
+   card computes a signature, so hashing a large document in one session would otherwise wait for
+   (or delay) the card operations of the other sessions. The operation is marked busy meanwhile so
+   that it can't be finalized from another thread, and closing the session detaches it instead of
+   freeing it. Must be called with the lock held.
+   Once the lock is taken again the session is looked up by its handle and *ppSession is updated, as
+   the session table may have been reallocated. Returns CKR_SESSION_HANDLE_INVALID if the session was
+   closed meanwhile (the operation data is then freed here), CKR_CRYPTOKI_NOT_INITIALIZED if the
+   module was finalized meanwhile and CKR_CANT_LOCK, without the lock held, if the lock can't be taken again. */
+static int hash_update_unlocked(CK_SESSION_HANDLE hSession, int operation, P11_SESSION **ppSession, int *pbusy,
+								void *phash, CK_BYTE_PTR pPart, CK_ULONG ulPartLen) {
+	void *pData = (*ppSession)->Operation[operation].pData;
+	int ret;
+
+	*pbusy = 1;
+	p11_unlock();
+	ret = hash_update(phash, (char *)pPart, ulPartLen);
+	if (p11_lock() != CKR_OK)
+		return CKR_CRYPTOKI_NOT_INITIALIZED;
+	*pbusy = 0;
+
+	if (!p11_is_initialized()) {
+		log_trace("hash_update_unlocked()", "E: the module was finalized while hashing");
+		return CKR_CRYPTOKI_NOT_INITIALIZED;
+	}
+
+	*ppSession = p11_find_session(hSession);
+	if (*ppSession == NULL || (*ppSession)->Operation[operation].pData != pData) {
+		log_trace("hash_update_unlocked()", "E: Session %d was closed while hashing", hSession);
+		free_detached_operation(operation, pData);
+		return CKR_SESSION_HANDLE_INVALID;
+	}
+
+	return ret ? CKR_FUNCTION_FAILED : CKR_OK;
+}
+
 #define WHERE "C_DigestInit()"
 CK_RV C_DigestInit(CK_SESSION_HANDLE hSession,	/* the session's handle */
 				   CK_MECHANISM_PTR pMechanism) /* the digesting mechanism */
 {
+	unsigned long long ullStart = p11_metrics_start();
 	int ret;
 	P11_SESSION *pSession = NULL;
 	P11_DIGEST_DATA *pDigestData = NULL;
@@ -79,6 +131,7 @@ CK_RV C_DigestInit(CK_SESSION_HANDLE hSession,	/* the session's handle */
 
 cleanup:
 	p11_unlock();
+	p11_metrics_end(P11_METRIC_DIGEST_INIT, ullStart, ret);
 	return ((CK_RV)ret);
 }
 #undef WHERE
@@ -90,6 +143,7 @@ CK_RV C_Digest(CK_SESSION_HANDLE hSession, /* the session's handle */
 			   CK_BYTE_PTR pDigest,		   /* receives the message digest */
 			   CK_ULONG_PTR pulDigestLen)  /* receives byte length of digest */
 {
+	unsigned long long ullStart = p11_metrics_start();
 	int ret;
 	P11_SESSION *pSession = NULL;
 	P11_DIGEST_DATA *pDigestData = NULL;
@@ -120,6 +174,12 @@ CK_RV C_Digest(CK_SESSION_HANDLE hSession, /* the session's handle */
 		goto cleanup;
 	}
 
+	if (pDigestData->busy) {
+		log_trace(WHERE, "E: Session %d: digest operation in progress in another thread", hSession);
+		ret = CKR_OPERATION_ACTIVE;
+		goto cleanup;
+	}
+
 	if (pDigestData->update) {
 		log_trace(WHERE, "E: C_Digest() cannot be used to finalize C_DigestUpdate()");
 		ret = CKR_FUNCTION_FAILED;
@@ -139,7 +199,12 @@ CK_RV C_Digest(CK_SESSION_HANDLE hSession, /* the session's handle */
 		goto cleanup;
 	}
 
-	ret = hash_update(pDigestData->phash, (char *)pData, ulDataLen);
+	ret = hash_update_unlocked(hSession, P11_OPERATION_DIGEST, &pSession, &pDigestData->busy, pDigestData->phash,
+							   pData, ulDataLen);
+	if (ret == CKR_CANT_LOCK)
+		goto unlocked;
+	if (ret == CKR_SESSION_HANDLE_INVALID || ret == CKR_CRYPTOKI_NOT_INITIALIZED)
+		goto cleanup;
 	if (ret == 0)
 		ret = hash_final(pDigestData->phash, pDigest, pulDigestLen);
 	if (ret) {
@@ -155,7 +220,8 @@ CK_RV C_Digest(CK_SESSION_HANDLE hSession, /* the session's handle */
 
 cleanup:
 	p11_unlock();
-
+unlocked:
+	p11_metrics_end(P11_METRIC_DIGEST, ullStart, ret);
 	return ((CK_RV)ret);
 }
 #undef WHERE
@@ -165,6 +231,7 @@ CK_RV C_DigestUpdate(CK_SESSION_HANDLE hSession, /* the session's handle */
 					 CK_BYTE_PTR pPart,			 /* data to be digested */
 					 CK_ULONG ulPartLen)		 /* bytes of data to be digested */
 {
+	unsigned long long ullStart = p11_metrics_start();
 	int ret;
 	P11_SESSION *pSession = NULL;
 	P11_DIGEST_DATA *pDigestData = NULL;
@@ -195,7 +262,19 @@ CK_RV C_DigestUpdate(CK_SESSION_HANDLE hSession, /* the session's handle */
 		goto cleanup;
 	}
 
-	ret = hash_update(pDigestData->phash, (char *)pPart, ulPartLen);
+	if (pDigestData->busy) {
+		log_trace(WHERE, "E: Session %d: digest operation in progress in another thread", hSession);
+		ret = CKR_OPERATION_ACTIVE;
+		goto cleanup;
+	}
+
+	pDigestData->update = 1;
+	ret = hash_update_unlocked(hSession, P11_OPERATION_DIGEST, &pSession, &pDigestData->busy, pDigestData->phash,
+							   pPart, ulPartLen);
+	if (ret == CKR_CANT_LOCK)
+		goto unlocked;
+	if (ret == CKR_SESSION_HANDLE_INVALID || ret == CKR_CRYPTOKI_NOT_INITIALIZED)
+		goto cleanup;
 	if (ret) {
 		log_trace(WHERE, "E: hash_update failed()");
 		ret = CKR_FUNCTION_FAILED;
@@ -204,7 +283,8 @@ CK_RV C_DigestUpdate(CK_SESSION_HANDLE hSession, /* the session's handle */
 
 cleanup:
 	p11_unlock();
-
+unlocked:
+	p11_metrics_end(P11_METRIC_DIGEST_UPDATE, ullStart, ret);
 	return ((CK_RV)ret);
 }
 #undef WHERE
@@ -223,6 +303,7 @@ CK_RV C_DigestFinal(CK_SESSION_HANDLE hSession, /* the session's handle */
 					CK_BYTE_PTR pDigest,		/* receives the message digest */
 					CK_ULONG_PTR pulDigestLen)	/* receives byte count of digest */
 {
+	unsigned long long ullStart = p11_metrics_start();
 	int ret;
 	P11_SESSION *pSession = NULL;
 	P11_DIGEST_DATA *pDigestData = NULL;
@@ -253,6 +334,12 @@ CK_RV C_DigestFinal(CK_SESSION_HANDLE hSession, /* the session's handle */
 		goto cleanup;
 	}
 
+	if (pDigestData->busy) {
+		log_trace(WHERE, "E: Session %d: digest operation in progress in another thread", hSession);
+		ret = CKR_OPERATION_ACTIVE;
+		goto cleanup;
+	}
+
 	if (pDigest == NULL) {
 		*pulDigestLen = pDigestData->l_hash;
 		/* return ok without terminating digest params */
@@ -281,6 +368,7 @@ CK_RV C_DigestFinal(CK_SESSION_HANDLE hSession, /* the session's handle */
 cleanup:
 	p11_unlock();
 
+	p11_metrics_end(P11_METRIC_DIGEST_FINAL, ullStart, ret);
 	return ((CK_RV)ret);
 }
 #undef WHERE
@@ -290,6 +378,7 @@ CK_RV C_SignInit(CK_SESSION_HANDLE hSession,  /* the session's handle */
 				 CK_MECHANISM_PTR pMechanism, /* the signature mechanism */
 				 CK_OBJECT_HANDLE hKey)		  /* handle of the signature key */
 {
+	unsigned long long ullStart = p11_metrics_start();
 	int ret;
 	P11_SESSION *pSession = NULL;
 	P11_SLOT *pSlot = NULL;
@@ -448,6 +537,7 @@ CK_RV C_SignInit(CK_SESSION_HANDLE hSession,  /* the session's handle */
 cleanup:
 	p11_unlock();
 
+	p11_metrics_end(P11_METRIC_SIGN_INIT, ullStart, ret);
 	return ((CK_RV)ret);
 }
 #undef WHERE
@@ -459,6 +549,7 @@ CK_RV C_Sign(CK_SESSION_HANDLE hSession,   /* the session's handle */
 			 CK_BYTE_PTR pSignature,	   /* receives the signature */
 			 CK_ULONG_PTR pulSignatureLen) /* receives byte count of signature */
 {
+	unsigned long long ullStart = p11_metrics_start();
 	int ret = CKR_OK;
 	P11_SESSION *pSession = NULL;
 	P11_SIGN_DATA *pSignData = NULL;
@@ -492,6 +583,12 @@ CK_RV C_Sign(CK_SESSION_HANDLE hSession,   /* the session's handle */
 		goto cleanup;
 	}
 
+	if (pSignData->busy) {
+		log_trace(WHERE, "E: Session %d: sign operation in progress in another thread", hSession);
+		ret = CKR_OPERATION_ACTIVE;
+		goto cleanup;
+	}
+
 	if (pSignData->update) {
 		log_trace(WHERE, "E: C_Sign() cannot be used to finalize a C_SignUpdate() function");
 		ret = CKR_FUNCTION_FAILED;
@@ -519,7 +616,12 @@ CK_RV C_Sign(CK_SESSION_HANDLE hSession,   /* the session's handle */
 			ret = CKR_HOST_MEMORY;
 			goto cleanup;
 		}
-		ret = hash_update(pSignData->phash, (char *)pData, ulDataLen);
+		ret = hash_update_unlocked(hSession, P11_OPERATION_SIGN, &pSession, &pSignData->busy, pSignData->phash,
+								   pData, ulDataLen);
+		if (ret == CKR_CANT_LOCK)
+			goto unlocked;
+		if (ret == CKR_SESSION_HANDLE_INVALID || ret == CKR_CRYPTOKI_NOT_INITIALIZED)
+			goto cleanup;
 		if (ret == 0)
 			ret = hash_final(pSignData->phash, pDigest, &ulDigestLen);
 		if (ret) {
@@ -545,14 +647,17 @@ CK_RV C_Sign(CK_SESSION_HANDLE hSession,   /* the session's handle */
 
 terminate:
 	// terminate sign operation
+	free(pSignData->pbuf);
 	free(pSignData);
 	pSession->Operation[P11_OPERATION_SIGN].pData = NULL;
 	pSession->Operation[P11_OPERATION_SIGN].active = 0;
 
 cleanup:
+	p11_unlock();
+unlocked:
 	if (pDigest)
 		free(pDigest);
-	p11_unlock();
+	p11_metrics_end(P11_METRIC_SIGN, ullStart, ret);
 	return ((CK_RV)ret);
 }
 #undef WHERE
@@ -562,6 +667,7 @@ CK_RV C_SignUpdate(CK_SESSION_HANDLE hSession, /* the session's handle */
 				   CK_BYTE_PTR pPart,		   /* the data (digest) to be signed */
 				   CK_ULONG ulPartLen)		   /* count of bytes to be signed */
 {
+	unsigned long long ullStart = p11_metrics_start();
 	int ret;
 	P11_SESSION *pSession = NULL;
 	P11_SIGN_DATA *pSignData = NULL;
@@ -592,6 +698,15 @@ CK_RV C_SignUpdate(CK_SESSION_HANDLE hSession, /* the session's handle */
 		goto cleanup;
 	}
 
+	if (pSignData->busy) {
+		log_trace(WHERE, "E: Session %d: sign operation in progress in another thread", hSession);
+		ret = CKR_OPERATION_ACTIVE;
+		goto cleanup;
+	}
+
+	pSignData->update = 1;
+
+	/* without a hash mechanism the input is a digest or DigestInfo, never larger than the signature */
 	if (pSignData->phash == NULL) {
 		if ((ulPartLen + pSignData->lbuf) > pSignData->l_sign) {
 			log_trace(WHERE, "E: size not possible for signing");
@@ -608,7 +723,12 @@ CK_RV C_SignUpdate(CK_SESSION_HANDLE hSession, /* the session's handle */
 		memcpy(pSignData->pbuf + pSignData->lbuf, pPart, ulPartLen);
 		pSignData->lbuf += ulPartLen;
 	} else {
-		ret = hash_update(pSignData->phash, (char *)pPart, ulPartLen);
+		ret = hash_update_unlocked(hSession, P11_OPERATION_SIGN, &pSession, &pSignData->busy, pSignData->phash,
+								   pPart, ulPartLen);
+		if (ret == CKR_CANT_LOCK)
+			goto unlocked;
+		if (ret == CKR_SESSION_HANDLE_INVALID || ret == CKR_CRYPTOKI_NOT_INITIALIZED)
+			goto cleanup;
 		if (ret) {
 			log_trace(WHERE, "E: hash_update failed");
 			ret = CKR_FUNCTION_FAILED;
@@ -619,6 +739,8 @@ CK_RV C_SignUpdate(CK_SESSION_HANDLE hSession, /* the session's handle */
 cleanup:
 
 	p11_unlock();
+unlocked:
+	p11_metrics_end(P11_METRIC_SIGN_UPDATE, ullStart, ret);
 	return ((CK_RV)ret);
 }
 #undef WHERE
@@ -628,6 +750,7 @@ CK_RV C_SignFinal(CK_SESSION_HANDLE hSession,	/* the session's handle */
 				  CK_BYTE_PTR pSignature,		/* receives the signature */
 				  CK_ULONG_PTR pulSignatureLen) /* receives byte count of signature */
 {
+	unsigned long long ullStart = p11_metrics_start();
 	int ret;
 	P11_SESSION *pSession = NULL;
 	P11_SIGN_DATA *pSignData = NULL;
@@ -660,6 +783,12 @@ CK_RV C_SignFinal(CK_SESSION_HANDLE hSession,	/* the session's handle */
 		goto cleanup;
 	}
 
+	if (pSignData->busy) {
+		log_trace(WHERE, "E: Session %d: sign operation in progress in another thread", hSession);
+		ret = CKR_OPERATION_ACTIVE;
+		goto cleanup;
+	}
+
 	/* Specific call to get the allocation size needed for the signature:
 	   described in section 5.2 of the PKCS#11 spec
 	*/
@@ -705,6 +834,7 @@ CK_RV C_SignFinal(CK_SESSION_HANDLE hSession,	/* the session's handle */
 		log_trace(WHERE, "E: cal_sign() returned %s", log_map_error(ret));
 
 	// terminate sign operation
+	free(pSignData->pbuf);
 	free(pSignData);
 	pSession->Operation[P11_OPERATION_SIGN].pData = NULL;
 	pSession->Operation[P11_OPERATION_SIGN].active = 0;
@@ -715,6 +845,7 @@ cleanup:
 
 	p11_unlock();
 
+	p11_metrics_end(P11_METRIC_SIGN_FINAL, ullStart, ret);
 	return ((CK_RV)ret);
 }
 #undef WHERE
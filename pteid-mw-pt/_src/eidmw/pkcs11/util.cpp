@@ -24,9 +24,13 @@
 // #include <stdlib.h>
 // #include <string.h>
 #include "pteid_p11.h"
+#include "Metrics.h"
 #include "Mutex.h"
 #include "util.h"
 
+#include <chrono>
+#include <string>
+
 using namespace eIDMW;
 
 // EID LOCKING
@@ -169,3 +173,76 @@ void util_unlock(void *lock) {
 		mutex->Unlock();
 	}
 }
+
+unsigned long long p11_metrics_start() {
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+static const char *const p11_metric_functions[P11_METRIC_COUNT] = {
+	"C_OpenSession",
+	"C_Login",
+	"C_Logout",
+	"C_GetAttributeValue",
+	"C_FindObjectsInit",
+	"C_FindObjects",
+	"C_DigestInit",
+	"C_Digest",
+	"C_DigestUpdate",
+	"C_DigestFinal",
+	"C_SignInit",
+	"C_Sign",
+	"C_SignUpdate",
+	"C_SignFinal",
+};
+
+struct P11CallMetrics {
+	CMetricHistogram *duration;
+	CMetricCounter *errors;
+};
+
+/* The metrics of every timed call are registered once, the calls then only update their atomics.
+   Returns NULL if the registration failed: metrics must never make a PKCS#11 call fail */
+static const P11CallMetrics *p11_call_metrics() {
+	static const P11CallMetrics *table = []() -> const P11CallMetrics * {
+		static P11CallMetrics metrics[P11_METRIC_COUNT];
+		try {
+			CMetrics *registry = CMetrics::GetInstance();
+			for (int i = 0; i < P11_METRIC_COUNT; i++) {
+				std::string labels = std::string("function=\"") + p11_metric_functions[i] + "\"";
+				metrics[i].duration = registry->GetHistogram("pteid_pkcs11_call_duration_seconds",
+															 "Duration of the PKCS#11 calls", labels);
+				metrics[i].errors = registry->GetCounter("pteid_pkcs11_call_errors_total",
+														 "PKCS#11 calls that returned an error", labels);
+			}
+		} catch (...) {
+			return NULL;
+		}
+		return metrics;
+	}();
+	return table;
+}
+
+void p11_metrics_end(P11_METRIC function, unsigned long long start, CK_RV ret) {
+	const P11CallMetrics *metrics = p11_call_metrics();
+	if (metrics == NULL)
+		return;
+
+	metrics[function].duration->ObserveMicroseconds(p11_metrics_start() - start);
+	if (ret != CKR_OK)
+		metrics[function].errors->Inc();
+}
+
+void p11_metrics_init() {
+	try {
+		CMetrics::GetInstance()->StartFileWriter();
+	} catch (...) {
+	}
+}
+
+void p11_metrics_finalize() {
+	try {
+		CMetrics::GetInstance()->StopFileWriter();
+	} catch (...) {
+	}
+}
@@ -40,6 +40,33 @@ void util_lock(void *lock);
 void util_unlock(void *lock);
 void strcpy_n(unsigned char *to, const char *from, size_t n, char padding);
 
+/* PKCS#11 calls timed for the module metrics */
+typedef enum {
+	P11_METRIC_OPEN_SESSION,
+	P11_METRIC_LOGIN,
+	P11_METRIC_LOGOUT,
+	P11_METRIC_GET_ATTRIBUTE_VALUE,
+	P11_METRIC_FIND_OBJECTS_INIT,
+	P11_METRIC_FIND_OBJECTS,
+	P11_METRIC_DIGEST_INIT,
+	P11_METRIC_DIGEST,
+	P11_METRIC_DIGEST_UPDATE,
+	P11_METRIC_DIGEST_FINAL,
+	P11_METRIC_SIGN_INIT,
+	P11_METRIC_SIGN,
+	P11_METRIC_SIGN_UPDATE,
+	P11_METRIC_SIGN_FINAL,
+	P11_METRIC_COUNT
+} P11_METRIC;
+
+/* Timing of the PKCS#11 calls for the module metrics */
+unsigned long long p11_metrics_start();
+void p11_metrics_end(P11_METRIC function, unsigned long long start, CK_RV ret);
+
+/* Start and stop the metrics file writer with C_Initialize and C_Finalize */
+void p11_metrics_init();
+void p11_metrics_finalize();
+
 #ifdef __cplusplus
 }
 #endif
@@ -28,6 +28,9 @@ applayer.depends = pteid-poppler
 SUBDIRS += scap
 SUBDIRS += eidguiV2
 
+## unit tests, "make check" runs them
+SUBDIRS += mw_unit_test
+
 macx:SUBDIRS += pteid-ctk
 
 ## the subdirs have to be built in the given order
@@ -44,6 +44,8 @@
 typedef CRITICAL_SECTION GooMutex;
 
 #define gInitMutex(m) InitializeCriticalSection(m)
+// critical sections can always be re-entered by their owner
+#define gInitRecursiveMutex(m) InitializeCriticalSection(m)
 #define gDestroyMutex(m) DeleteCriticalSection(m)
 #define gLockMutex(m) EnterCriticalSection(m)
 #define gUnlockMutex(m) LeaveCriticalSection(m)
@@ -55,10 +57,19 @@ typedef CRITICAL_SECTION GooMutex;
 typedef pthread_mutex_t GooMutex;
 
 #define gInitMutex(m) pthread_mutex_init(m, NULL)
+#define gInitRecursiveMutex(m) gInitRecursiveMutexImpl(m)
 #define gDestroyMutex(m) pthread_mutex_destroy(m)
 #define gLockMutex(m) pthread_mutex_lock(m)
 #define gUnlockMutex(m) pthread_mutex_unlock(m)
 
+static inline void gInitRecursiveMutexImpl(GooMutex *m) {
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(m, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
 #endif
 
 #endif
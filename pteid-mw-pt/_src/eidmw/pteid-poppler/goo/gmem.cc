@@ -28,8 +28,57 @@
 #include <stddef.h>
 #include <string.h>
 #include <limits.h>
+#include <atomic>
 #include "gmem.h"
 
+#if defined(_WIN32)
+#include <malloc.h>
+#define gMemBlockSize(p) _msize(p)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define gMemBlockSize(p) malloc_size(p)
+#else
+#include <malloc.h>
+#define gMemBlockSize(p) malloc_usable_size(p)
+#endif
+
+// Constant-initialized, so blocks allocated by static constructors are counted too
+static std::atomic<long long> gMemAllocated(0);
+static std::atomic<long long> gMemPeak(0);
+
+static inline void gMemAccountAlloc(void *p) {
+  if (!p) {
+    return;
+  }
+  long long size = (long long)gMemBlockSize(p);
+  long long allocated = gMemAllocated.fetch_add(size, std::memory_order_relaxed) + size;
+  long long peak = gMemPeak.load(std::memory_order_relaxed);
+  while (allocated > peak &&
+         !gMemPeak.compare_exchange_weak(peak, allocated, std::memory_order_relaxed)) {
+  }
+}
+
+static inline void gMemAccountFree(void *p) {
+  if (!p) {
+    return;
+  }
+  gMemAllocated.fetch_sub((long long)gMemBlockSize(p), std::memory_order_relaxed);
+}
+
+size_t gMemGetAllocated() {
+  long long allocated = gMemAllocated.load(std::memory_order_relaxed);
+  return allocated > 0 ? (size_t)allocated : 0;
+}
+
+size_t gMemGetPeak() {
+  long long peak = gMemPeak.load(std::memory_order_relaxed);
+  return peak > 0 ? (size_t)peak : 0;
+}
+
+void gMemResetPeak() {
+  gMemPeak = gMemAllocated.load(std::memory_order_relaxed);
+}
+
 #ifdef DEBUG_MEM
 
 typedef struct _GMemHdr {
@@ -122,6 +171,7 @@ inline static void *gmalloc(size_t size, bool checkoverflow) {
     if (checkoverflow) return NULL;
     else exit(1);
   }
+  gMemAccountAlloc(p);
   return p;
 #endif
 }
@@ -171,20 +221,25 @@ inline static void *grealloc(void *p, size_t size, bool checkoverflow) {
   }
   if (size == 0) {
     if (p) {
+      gMemAccountFree(p);
       free(p);
     }
     return NULL;
   }
+  // A failed realloc leaves the block allocated, it's counted again below
+  gMemAccountFree(p);
   if (p) {
     q = realloc(p, size);
   } else {
     q = malloc(size);
   }
   if (!q) {
+    gMemAccountAlloc(p);
     fprintf(stderr, "Out of memory\n");
     if (checkoverflow) return NULL;
     else exit(1);
   }
+  gMemAccountAlloc(q);
   return q;
 #endif
 }
@@ -307,6 +362,7 @@ void gfree(void *p) {
   }
 #else
   if (p) {
+    gMemAccountFree(p);
     free(p);
   }
 #endif
@@ -65,7 +65,17 @@ extern void *greallocn_checkoverflow(void *p, int nObjs, int objSize);
 /*
  * Same as free, but checks for and ignores NULL pointers.
  */
-extern void gfree(void *p);
+extern POPPLER_API void gfree(void *p);
+
+/*
+ * Accounting of the memory allocated through these functions, using the
+ * usable size of each block. It counts from the first allocation of the
+ * process, blocks must be released with gfree() for it to stay accurate.
+ */
+extern POPPLER_API size_t gMemGetAllocated();
+/* Highest value of gMemGetAllocated() since the last gMemResetPeak() */
+extern POPPLER_API size_t gMemGetPeak();
+extern POPPLER_API void gMemResetPeak();
 
 #ifdef DEBUG_MEM
 /*
@@ -31,6 +31,8 @@
 
 #include "Object.h"
 
+#include <atomic>
+
 class XRef;
 
 //------------------------------------------------------------------------
@@ -60,8 +62,8 @@ public:
   void remove(int i);
 
   // Accessors.
-  Object *get(int i, Object *obj);
-  Object *getNF(int i, Object *obj);
+  POPPLER_API Object *get(int i, Object *obj);
+  POPPLER_API Object *getNF(int i, Object *obj);
   GBool getString(int i, GooString *string);
 
 private:
@@ -70,7 +72,7 @@ private:
   Object *elems;		// array of elements
   int size;			// size of <elems> array
   int length;			// number of elements in array
-  int ref;			// reference count
+  std::atomic<int> ref;		// reference count, shared objects can be copied by several threads
 };
 
 #endif
@@ -11,6 +11,7 @@
 //========================================================================
 
 #include <config.h>
+#include "goo/gmem.h"
 #include "CachedFile.h"
 
 //------------------------------------------------------------------------
@@ -24,6 +25,7 @@ CachedFile::CachedFile(CachedFileLoader *cachedFileLoaderA, GooString *uriA)
 
   streamPos = 0;
   chunks = new std::vector<Chunk>();
+  readAheadChunks = 0;
   length = 0;
 
   length = loader->init(uri, this);
@@ -42,6 +44,9 @@ CachedFile::~CachedFile()
 {
   delete uri;
   delete loader;
+  for (size_t i = 0; i < chunks->size(); i++) {
+    gfree((*chunks)[i].data);
+  }
   delete chunks;
 }
 
@@ -111,6 +116,10 @@ int CachedFile::cache(const std::vector<ByteRange> &origRanges)
            chunkNeeded[chunk] = true;
       }
     }
+    for (int chunk = endChunk + 1; chunk <= endChunk + readAheadChunks && chunk < numChunks; chunk++) {
+      if ((*chunks)[chunk].state != chunkStateNew) break;
+      chunkNeeded[chunk] = true;
+    }
   }
 
   int chunk = 0;
@@ -162,6 +171,10 @@ size_t CachedFile::read(void *ptr, size_t unitsize, size_t count)
     if (len > toCopy)
       len = toCopy;
 
+    if (!(*chunks)[chunk].data) {
+      error(errInternal, -1, "Chunk {0:d} of '{1:t}' was not loaded.", chunk, uri);
+      return bytes - toCopy;
+    }
     memcpy(ptr, (*chunks)[chunk].data + offset, len);
     streamPos += len;
     toCopy -= len;
@@ -227,6 +240,10 @@ size_t CachedFileWriter::write(const char *ptr, size_t size)
        cachedFile->chunks->resize(chunk + 1);
     }
 
+    if (!(*cachedFile->chunks)[chunk].data) {
+       (*cachedFile->chunks)[chunk].data = (char *)gmalloc(CachedFileChunkSize);
+    }
+
     nfree = CachedFileChunkSize - offset;
     ncopy = (len >= nfree) ? nfree : len;
     memcpy(&((*cachedFile->chunks)[chunk].data[offset]), cp, ncopy);
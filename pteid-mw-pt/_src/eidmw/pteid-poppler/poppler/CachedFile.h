@@ -46,9 +46,12 @@ friend class CachedFileWriter;
 
 public:
 
-  CachedFile(CachedFileLoader *cacheLoader, GooString *uri);
+  POPPLER_API CachedFile(CachedFileLoader *cacheLoader, GooString *uri);
 
   Guint getLength() { return length; }
+  // Number of chunks loaded after the ones requested by a read, so that
+  // sequential reads need fewer loads. Defaults to 0.
+  void setReadAhead(int chunksA) { readAheadChunks = chunksA; }
   long int tell();
   int seek(long int offset, int origin);
   size_t read(void * ptr, size_t unitsize, size_t count);
@@ -68,9 +71,11 @@ private:
     chunkStateLoaded
   };
 
+  // data is allocated when the chunk is loaded, so that a large remote file
+  // only takes the memory of the parts that were read
   typedef struct {
     ChunkState state;
-    char data[CachedFileChunkSize];
+    char *data;
   } Chunk;
 
   int cache(size_t offset, size_t length);
@@ -82,6 +87,7 @@ private:
   size_t streamPos;
 
   std::vector<Chunk> *chunks;
+  int readAheadChunks;
 
   int refCnt;  // reference count
 
@@ -106,7 +112,7 @@ public:
   ~CachedFileWriter();
 
   // Writes size bytes from ptr to cachedFile, returns number of bytes written.
-  size_t write(const char *ptr, size_t size);
+  POPPLER_API size_t write(const char *ptr, size_t size);
 
 private:
 
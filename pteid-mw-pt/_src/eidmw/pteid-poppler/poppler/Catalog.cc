@@ -56,9 +56,11 @@
 #include <time.h>
 #include <iostream>
 //For unique_ptr
+#include <algorithm>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <math.h>
 
 #include "config.h"
@@ -87,6 +89,9 @@
 #include "FontEncodingTables.h"
 #include "VisibleSignatureBitmap.h"
 #include "Myriad-Font.h"
+#if MULTITHREADED
+#include "goo/GooMutex.h"
+#endif
 
 //Forward-declaration of the function defined in Iconv.cc
 //couldn't bother to write a header for it
@@ -123,6 +128,7 @@ Catalog::Catalog(PDFDoc *docA) {
   pagesRefList = NULL;
   attrsList = NULL;
   kidsIdxList = NULL;
+  pagesRoot = NULL;
   lastCachedPage = 0;
   m_sig_dict = NULL;
   useCCLogo = false;
@@ -187,6 +193,9 @@ Catalog::~Catalog() {
     }
     delete pagesList;
   }
+  if (pagesRoot && !pagesRoot->decRef()) {
+    delete pagesRoot;
+  }
   if (pages) {
     for (int i = 0; i < pagesSize; ++i) {
       if (pages[i]) {
@@ -961,9 +970,126 @@ std::string Catalog::get_commands_template(int rect_y, unsigned char *img_data){
   return commands_template;
 }
 
-void Catalog::addSignatureAppearance(Object *signature_field, SignatureSignerInfo *signer_info,
-	char * date_str, const char* location, const char* reason, int rect_x, int rect_y,
-	unsigned char *img_data, unsigned long img_length, int rotate_signature, bool isPTLanguage)
+/*
+ * Cache of the n2 layer content stream of visible signatures shared by all documents.
+ * Within a batch signature the seal text and geometry are the same for every document so the
+ * font size calculation and line wrapping only need to run once. The signing date is the only
+ * per-document value so the stream is stored split around it.
+ */
+#define SIGNATURE_APPEARANCE_CACHE_MAX 32
+
+class SignatureAppearanceCache {
+public:
+  SignatureAppearanceCache() : fontTablesReady(false) {
+#if MULTITHREADED
+    gInitMutex(&mutex);
+#endif
+  }
+
+  ~SignatureAppearanceCache() {
+#if MULTITHREADED
+    gDestroyMutex(&mutex);
+#endif
+  }
+
+  void initFontTables() {
+    lock();
+    if (!fontTablesReady) {
+      initBuiltinFontTables();
+      fontTablesReady = true;
+    }
+    unlock();
+  }
+
+  // Returns a new GooString owned by the caller or NULL if not cached
+  GooString *lookup(const std::string &key, const char *date_str) {
+    GooString *n2_commands = NULL;
+    lock();
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+      n2_commands = new GooString(it->second.first.c_str(), it->second.first.size());
+      if (date_str != NULL)
+        n2_commands->append(date_str);
+      n2_commands->append(it->second.second.c_str(), it->second.second.size());
+    }
+    unlock();
+    return n2_commands;
+  }
+
+  void store(const std::string &key, GooString *n2_commands, const char *date_str, int date_offset) {
+    std::string commands(n2_commands->getCString(), n2_commands->getLength());
+    std::pair<std::string, std::string> entry;
+    if (date_str != NULL) {
+      if (date_offset < 0)
+        return;
+      entry.first = commands.substr(0, date_offset);
+      entry.second = commands.substr(date_offset + strlen(date_str));
+    } else {
+      entry.first = commands;
+    }
+
+    lock();
+    if (entries.size() >= SIGNATURE_APPEARANCE_CACHE_MAX)
+      entries.clear();
+    entries[key] = entry;
+    unlock();
+  }
+
+private:
+  void lock() {
+#if MULTITHREADED
+    gLockMutex(&mutex);
+#endif
+  }
+
+  void unlock() {
+#if MULTITHREADED
+    gUnlockMutex(&mutex);
+#endif
+  }
+
+  // Stream before and after the date
+  std::unordered_map<std::string, std::pair<std::string, std::string>> entries;
+  bool fontTablesReady;
+#if MULTITHREADED
+  GooMutex mutex;
+#endif
+};
+
+static SignatureAppearanceCache signatureAppearanceCache;
+
+/*
+ * Everything that changes the n2 layer stream except the date itself
+ */
+std::string Catalog::signatureAppearanceKey(SignatureSignerInfo *signer_info, bool has_date, const char *location,
+    const char *reason, int rect_width, int rect_height, int rect_y, bool custom_image, bool isPTLanguage, bool scap)
+{
+  std::string key;
+  const char *fields[] = { signer_info->name, signer_info->civil_number, signer_info->attribute_provider,
+                           signer_info->attribute_name, location, reason };
+
+  for (const char *field : fields) {
+    // Distinguish NULL from empty string
+    key += field != NULL ? "1" : "0";
+    if (field != NULL)
+      key += field;
+    key += '\0';
+  }
+
+  key += std::to_string(rect_width) + "," + std::to_string(rect_height) + "," + std::to_string(rect_y);
+  key += has_date ? "D" : "-";
+  key += custom_image ? "I" : "-";
+  key += isPTLanguage ? "P" : "-";
+  key += scap ? "S" : "-";
+  key += small_signature_format ? "s" : "-";
+  key += useCCLogo ? "C" : "-";
+
+  return key;
+}
+
+GooString *Catalog::formatSignatureAppearance(SignatureSignerInfo *signer_info, char *date_str, const char *location,
+	const char *reason, int rect_y, int rect_width, int rect_height, unsigned char *img_data, bool isPTLanguage,
+	int *date_offset)
 {
 	const char * strings_pt[] = {	"(Assinado por: ) Tj\r\n{0:f} 0 Td\r\n/F3 {1:d} Tf\r\n", 
 									"(Num. de Identifica\xE7\xE3o: {0:s}) Tj\r\n",
@@ -975,35 +1101,6 @@ void Catalog::addSignatureAppearance(Object *signature_field, SignatureSignerInf
 									"(Date: {0:s}) Tj\r\n",
 									"(Location: ) Tj\r\n{0:f} 0 Td\r\n/F1 {1:d} Tf\r\n"};
 
-	Object ap_dict, appearance_obj, obj1, obj2, obj3,
-	       ref_to_dict, ref_to_dict2, ref_to_n2, ref_to_n0, font_dict, xobject_layers;
-
-	GooString ap_command_toplevel;
-
-	if (rotate_signature == 90)
-	{
-		ap_command_toplevel.appendf("0 1 -1 0 {0:d} 0 cm \r\n", rect_x);
-	}
-	else if (rotate_signature == 270)
-	{
-		ap_command_toplevel.appendf("0 -1 1 0 0 {0:d} cm \r\n", rect_y);
-	}
-	else if (rotate_signature == 180)
-	{
-		ap_command_toplevel.appendf("-1 0 0 -1 {0:d} {1:d} cm \r\n", rect_x, rect_y);
-	}
-
-
-
-	initBuiltinFontTables();
-	
-	//const char appearance_command1[] = 
-	ap_command_toplevel.append("q 1 0 0 1 0 0 cm /n0 Do Q\r\nq 1 0 0 1 0 0 cm /n2 Do Q\r\n");
-		
-	char n0_commands[] = "% DSBlank\n";
-	int rect_width  = ((rotate_signature == 90 || rotate_signature == 270) ? rect_y : rect_x);
-	int rect_height = ((rotate_signature == 90 || rotate_signature == 270) ? rect_x : rect_y);
-	
 	std::string _reason;
   if (!small_signature_format && reason != NULL && strlen(reason) > 0)
   {
@@ -1115,6 +1212,9 @@ void Catalog::addSignatureAppearance(Object *signature_field, SignatureSignerInf
 	  std::unique_ptr<GooString> str5(GooString::format(isPTLanguage ? strings_pt[2] : strings_en[2],
 		  date_str));
 	  n2_commands->append(str5.get());
+	  // Remember where the date is so that the cached stream can be reused with other dates
+	  *date_offset = n2_commands->getLength() - str5->getLength() +
+	                 (int)(strstr(str5->getCString(), date_str) - str5->getCString());
     std::unique_ptr<GooString> changeLine(GooString::format("0 -{0:d} Td\r\n", (int)line_height));
     n2_commands->append(changeLine.get());
   }
@@ -1158,6 +1258,55 @@ void Catalog::addSignatureAppearance(Object *signature_field, SignatureSignerInf
 
 	n2_commands->append("\r\nET\r\nQ\r\n");
 
+	delete name_str;
+	free(name_latin1);
+
+	return n2_commands;
+}
+
+void Catalog::addSignatureAppearance(Object *signature_field, SignatureSignerInfo *signer_info,
+	char * date_str, const char* location, const char* reason, int rect_x, int rect_y,
+	unsigned char *img_data, unsigned long img_length, int rotate_signature, bool isPTLanguage)
+{
+	Object ap_dict, appearance_obj, obj1, obj2, obj3,
+	       ref_to_dict, ref_to_dict2, ref_to_n2, ref_to_n0, font_dict, xobject_layers;
+
+	GooString ap_command_toplevel;
+
+	if (rotate_signature == 90)
+	{
+		ap_command_toplevel.appendf("0 1 -1 0 {0:d} 0 cm \r\n", rect_x);
+	}
+	else if (rotate_signature == 270)
+	{
+		ap_command_toplevel.appendf("0 -1 1 0 0 {0:d} cm \r\n", rect_y);
+	}
+	else if (rotate_signature == 180)
+	{
+		ap_command_toplevel.appendf("-1 0 0 -1 {0:d} {1:d} cm \r\n", rect_x, rect_y);
+	}
+
+
+
+	signatureAppearanceCache.initFontTables();
+	
+	//const char appearance_command1[] = 
+	ap_command_toplevel.append("q 1 0 0 1 0 0 cm /n0 Do Q\r\nq 1 0 0 1 0 0 cm /n2 Do Q\r\n");
+		
+	char n0_commands[] = "% DSBlank\n";
+	int rect_width  = ((rotate_signature == 90 || rotate_signature == 270) ? rect_y : rect_x);
+	int rect_height = ((rotate_signature == 90 || rotate_signature == 270) ? rect_x : rect_y);
+	
+	std::string cache_key = signatureAppearanceKey(signer_info, date_str != NULL, location, reason, rect_width, rect_height,
+	                                               rect_y, img_data != NULL, isPTLanguage, false);
+	GooString *n2_commands = signatureAppearanceCache.lookup(cache_key, date_str);
+	if (n2_commands == NULL) {
+		int date_offset = -1;
+		n2_commands = formatSignatureAppearance(signer_info, date_str, location, reason, rect_y, rect_width, rect_height,
+		                                       img_data, isPTLanguage, &date_offset);
+		signatureAppearanceCache.store(cache_key, n2_commands, date_str, date_offset);
+	}
+
 	appearance_obj.initDict(xref);
 	appearance_obj.dictAdd(copyString("Type"), obj1.initName("XObject"));
 	appearance_obj.dictAdd(copyString("Subtype"), obj1.initName("Form"));
@@ -1215,15 +1364,12 @@ void Catalog::addSignatureAppearance(Object *signature_field, SignatureSignerInf
 	
 	signature_field->dictAdd(copyString("AP"), &ap_dict);
 
-	delete name_str;
 	delete n2_commands;
-
-	free(name_latin1);
 }
 
-void Catalog::addSignatureAppearanceSCAP(Object *signature_field, SignatureSignerInfo *signer_info,
-        char * date_str, const char* location, const char* reason, int rect_x, int rect_y,
-        unsigned char *img_data, unsigned long img_length, int rotate_signature, bool isPTLanguage)
+GooString *Catalog::formatSignatureAppearanceSCAP(SignatureSignerInfo *signer_info, char *date_str, const char *location,
+        const char *reason, int rect_y, int rect_width, int rect_height, unsigned char *img_data, bool isPTLanguage,
+        int *date_offset)
 {
         const char * strings_pt[] = { "(Assinado por: ) Tj\r\n{0:f} 0 Td\r\n/F3 {1:d} Tf\r\n",
                                                         "(Num. de Identifica\xE7\xE3o: {0:s}) Tj\r\n",
@@ -1239,36 +1385,6 @@ void Catalog::addSignatureAppearanceSCAP(Object *signature_field, SignatureSigne
                                                         "(Certified by: ) Tj\r\n{0:f} 0 Td\r\n/F3 {1:d} Tf\r\n",
                                                         "(Certified Attributes: ) Tj\r\n{0:f} 0 Td\r\n/F3 {1:d} Tf\r\n"};
 
-        Object ap_dict, appearance_obj, obj1, obj2, obj3,
-               ref_to_dict, ref_to_dict2, ref_to_n2, ref_to_n0, font_dict, xobject_layers;
-
-        GooString ap_command_toplevel;
-
-        if (rotate_signature == 90)
-        {
-                ap_command_toplevel.appendf("0 1 -1 0 {0:d} 0 cm \r\n", rect_x);
-        } 
-        else if (rotate_signature == 270)
-        {
-          ap_command_toplevel.appendf("0 -1 1 0 0 {0:d} cm \r\n", rect_y);
-        }
-        else if (rotate_signature == 180)
-        {
-          ap_command_toplevel.appendf("-1 0 0 -1 {0:d} {1:d} cm \r\n", rect_x, rect_y);
-        }
-
-
-        initBuiltinFontTables();
-
-        //const char appearance_command1[] =
-        ap_command_toplevel.append("q 1 0 0 1 0 0 cm /n0 Do Q\r\nq 1 0 0 1 0 0 cm /n2 Do Q\r\n");
-
-        char n0_commands[] = "% DSBlank\n";
-
-
-		int rect_width = ((rotate_signature == 90 || rotate_signature == 270) ? rect_y : rect_x);
-		int rect_height = ((rotate_signature == 90 || rotate_signature == 270) ? rect_x : rect_y);
-
         int linesAttributeProvider = 0;
         int linesReason = 0;
 
@@ -1394,6 +1510,9 @@ void Catalog::addSignatureAppearanceSCAP(Object *signature_field, SignatureSigne
           std::unique_ptr<GooString> str5(GooString::format(isPTLanguage ? strings_pt[2] : strings_en[2],
             date_str));
           n2_commands->append(str5.get());
+          // Remember where the date is so that the cached stream can be reused with other dates
+          *date_offset = n2_commands->getLength() - str5->getLength() +
+                         (int)(strstr(str5->getCString(), date_str) - str5->getCString());
           std::unique_ptr<GooString> changeLine(GooString::format("0 -{0:d} Td\r\n", (int)line_height));
           n2_commands->append(changeLine.get());
         }
@@ -1500,6 +1619,56 @@ void Catalog::addSignatureAppearanceSCAP(Object *signature_field, SignatureSigne
 
         n2_commands->append("\r\nET\r\n");
 
+        delete name_str;
+        free(name_latin1);
+
+        return n2_commands;
+}
+
+void Catalog::addSignatureAppearanceSCAP(Object *signature_field, SignatureSignerInfo *signer_info,
+        char * date_str, const char* location, const char* reason, int rect_x, int rect_y,
+        unsigned char *img_data, unsigned long img_length, int rotate_signature, bool isPTLanguage)
+{
+        Object ap_dict, appearance_obj, obj1, obj2, obj3,
+               ref_to_dict, ref_to_dict2, ref_to_n2, ref_to_n0, font_dict, xobject_layers;
+
+        GooString ap_command_toplevel;
+
+        if (rotate_signature == 90)
+        {
+                ap_command_toplevel.appendf("0 1 -1 0 {0:d} 0 cm \r\n", rect_x);
+        } 
+        else if (rotate_signature == 270)
+        {
+          ap_command_toplevel.appendf("0 -1 1 0 0 {0:d} cm \r\n", rect_y);
+        }
+        else if (rotate_signature == 180)
+        {
+          ap_command_toplevel.appendf("-1 0 0 -1 {0:d} {1:d} cm \r\n", rect_x, rect_y);
+        }
+
+
+        signatureAppearanceCache.initFontTables();
+
+        //const char appearance_command1[] =
+        ap_command_toplevel.append("q 1 0 0 1 0 0 cm /n0 Do Q\r\nq 1 0 0 1 0 0 cm /n2 Do Q\r\n");
+
+        char n0_commands[] = "% DSBlank\n";
+
+
+		int rect_width = ((rotate_signature == 90 || rotate_signature == 270) ? rect_y : rect_x);
+		int rect_height = ((rotate_signature == 90 || rotate_signature == 270) ? rect_x : rect_y);
+
+        std::string cache_key = signatureAppearanceKey(signer_info, date_str != NULL, location, reason, rect_width, rect_height,
+                                                       rect_y, img_data != NULL, isPTLanguage, true);
+        GooString *n2_commands = signatureAppearanceCache.lookup(cache_key, date_str);
+        if (n2_commands == NULL) {
+                int date_offset = -1;
+                n2_commands = formatSignatureAppearanceSCAP(signer_info, date_str, location, reason, rect_y, rect_width,
+                                                            rect_height, img_data, isPTLanguage, &date_offset);
+                signatureAppearanceCache.store(cache_key, n2_commands, date_str, date_offset);
+        }
+
         appearance_obj.initDict(xref);
         appearance_obj.dictAdd(copyString("Type"), obj1.initName("XObject"));
         appearance_obj.dictAdd(copyString("Subtype"), obj1.initName("Form"));
@@ -1557,10 +1726,7 @@ void Catalog::addSignatureAppearanceSCAP(Object *signature_field, SignatureSigne
 
         signature_field->dictAdd(copyString("AP"), &ap_dict);
 
-        delete name_str;
         delete n2_commands;
-
-        free(name_latin1);
 }
 
 GBool Catalog::setSigFlags(Object * acroform, int value)
@@ -1617,7 +1783,8 @@ Page *Catalog::getPage(int i)
 {
   if (i < 1) return NULL;
 
-  if (i > lastCachedPage) {
+  // pages read in order are cached by walking the tree, other ones are looked up directly
+  if (i > lastCachedPage && (i == lastCachedPage + 1 || !findPageInTree(i))) {
      if (cachePageTree(i) == gFalse) return NULL;
   }
   return pages[i-1];
@@ -1627,12 +1794,158 @@ Ref *Catalog::getPageRef(int i)
 {
   if (i < 1) return NULL;
 
-  if (i > lastCachedPage) {
+  if (i > lastCachedPage && (i == lastCachedPage + 1 || !findPageInTree(i))) {
      if (cachePageTree(i) == gFalse) return NULL;
   }
   return &pageRefs[i-1];
 }
 
+// Index of the first leaf under each kid of a page tree node, computed
+// with the /Count of the kids, followed by the number of leaves under the
+// node, which must be its own /Count.  Returns gFalse if the kids are not
+// all page or pages dictionaries with a /Count, or if a kid is in path.
+static GBool countPageTreeLeaves(Object *node, const std::vector<Ref> &path,
+                                 std::vector<int> *firstLeaves)
+{
+  Object kids, count;
+  if (!node->dictLookup("Kids", &kids)->isArray()) {
+    kids.free();
+    return gFalse;
+  }
+  node->dictLookup("Count", &count);
+  int nodeCount = count.isNum() ? (int)count.getNum() : -1;
+  count.free();
+
+  GBool failed = gFalse;
+  int leaves = 0;
+  for (int k = 0; k < kids.arrayGetLength() && !failed; k++) {
+    Object kidRef, kid;
+    if (!kids.arrayGetNF(k, &kidRef)->isRef()) {
+      kidRef.free();
+      failed = gTrue;
+      break;
+    }
+    for (size_t i = 0; i < path.size(); i++) {
+      if (path[i].num == kidRef.getRefNum()) {
+        failed = gTrue;
+      }
+    }
+    if (failed) {
+      error(errSyntaxError, -1, "Loop in Pages tree");
+      kidRef.free();
+      break;
+    }
+
+    firstLeaves->push_back(leaves);
+    kids.arrayGet(k, &kid);
+    if (kid.isDict("Page") || (kid.isDict() && !kid.getDict()->hasKey("Kids"))) {
+      leaves++;
+    } else if (kid.isDict()) {
+      Object kidCount;
+      kid.dictLookup("Count", &kidCount);
+      if (!kidCount.isNum() || kidCount.getNum() < 0) {
+        failed = gTrue;
+      } else {
+        leaves += (int)kidCount.getNum();
+      }
+      kidCount.free();
+    } else {
+      failed = gTrue;
+    }
+    kidRef.free();
+    kid.free();
+  }
+  kids.free();
+  firstLeaves->push_back(leaves);
+  return !failed && leaves == nodeCount;
+}
+
+// Find a single page by descending the page tree from the root, choosing
+// at each node the kid that holds the page with the /Count of the kids
+// before it, so that only the nodes on the path to the page (and their
+// kids) are fetched and a single Page is built, instead of every page
+// before it as cachePageTree() does.  The kids of each node are counted
+// once, see countPageTreeLeaves().  Returns gFalse if the tree doesn't
+// allow it (missing or inconsistent /Count, loops...), cachePageTree() is
+// then used instead.
+GBool Catalog::findPageInTree(int page)
+{
+  if (pagesList == NULL && !cachePageTree(0)) return gFalse;
+  if (page > pagesSize) return gFalse;
+  if (pages[page-1]) return gTrue;
+  if (!pagesRoot) return gFalse;
+
+  Object node;
+  node.initDict(pagesRoot);
+  std::vector<Ref> path;
+  path.push_back(pagesRootRef);
+  PageAttrs *attrs = new PageAttrs(NULL, node.getDict());
+  int index = page - 1; // index of the page among the leaves under node
+  GBool found = gFalse;
+
+  while (!found) {
+    std::unordered_map<int, std::vector<int> >::iterator leaves = pageTreeLeaves.find(path.back().num);
+    if (leaves == pageTreeLeaves.end()) {
+      std::vector<int> firstLeaves;
+      if (!countPageTreeLeaves(&node, path, &firstLeaves)) {
+        break;
+      }
+      leaves = pageTreeLeaves.insert(std::make_pair(path.back().num, firstLeaves)).first;
+    }
+    const std::vector<int> &firstLeaves = leaves->second;
+    if (index >= firstLeaves.back()) {
+      break;
+    }
+    // the last kid whose leaves start at or before the page, the kids
+    // without leaves before the page are skipped
+    int k = (int)(std::upper_bound(firstLeaves.begin(), firstLeaves.end() - 1, index) - firstLeaves.begin()) - 1;
+
+    Object kids, kidRef, kid;
+    node.dictLookup("Kids", &kids);
+    kids.arrayGetNF(k, &kidRef);
+    kids.arrayGet(k, &kid);
+    kids.free();
+    GBool failed = gFalse;
+    if (kid.isDict("Page") || (kid.isDict() && !kid.getDict()->hasKey("Kids"))) {
+      PageAttrs *pageAttrs = new PageAttrs(attrs, kid.getDict());
+      Page *p = new Page(doc, page, kid.getDict(), kidRef.getRef(), pageAttrs, form);
+      if (p->isOk()) {
+        pages[page-1] = p;
+        pageRefs[page-1] = kidRef.getRef();
+        found = gTrue;
+      } else {
+        delete p;
+        failed = gTrue;
+      }
+    } else {
+      // the node may have been counted on another path, check for loops
+      for (size_t i = 0; i < path.size(); i++) {
+        if (path[i].num == kidRef.getRefNum()) {
+          failed = gTrue;
+        }
+      }
+    }
+    if (!found && !failed) {
+      PageAttrs *kidAttrs = new PageAttrs(attrs, kid.getDict());
+      delete attrs;
+      attrs = kidAttrs;
+      path.push_back(kidRef.getRef());
+      node.free();
+      kid.copy(&node);
+      index -= firstLeaves[k];
+    }
+    kidRef.free();
+    kid.free();
+    if (failed) {
+      break;
+    }
+  }
+
+  delete attrs;
+  node.free();
+  return found;
+}
+
 GBool Catalog::cachePageTree(int page)
 {
   Dict *pagesDict;
@@ -1688,6 +2001,10 @@ GBool Catalog::cachePageTree(int page)
       pageRefs[i].gen = -1;
     }
 
+    pagesRoot = pagesDict;
+    pagesRoot->incRef();
+    pagesRootRef = pagesRef;
+
     pagesList = new std::vector<Dict *>();
     pagesList->push_back(pagesDict);
     pagesRefList = new std::vector<Ref>();
@@ -1760,28 +2077,33 @@ GBool Catalog::cachePageTree(int page)
     kids.arrayGet(kidsIdx, &kid);
     kids.free();
     if (kid.isDict("Page") || (kid.isDict() && !kid.getDict()->hasKey("Kids"))) {
-      PageAttrs *attrs = new PageAttrs(attrsList->back(), kid.getDict());
-      Page *p = new Page(doc, lastCachedPage+1, kid.getDict(),
-                     kidRef.getRef(), attrs, form);
-      if (!p->isOk()) {
-        error(errSyntaxError, -1, "Failed to create page (page {0:d})", lastCachedPage+1);
-        delete p;
-        kidRef.free();
-        kid.free();
-        return gFalse;
-      }
-
       if (lastCachedPage >= numPages) {
         error(errSyntaxError, -1, "Page count in top-level pages object is incorrect");
-        delete p;
         kidRef.free();
         kid.free();
         return gFalse;
       }
 
-      pages[lastCachedPage] = p;
-      pageRefs[lastCachedPage].num = kidRef.getRefNum();
-      pageRefs[lastCachedPage].gen = kidRef.getRefGen();
+      // the page may have been found already by findPageInTree()
+      if (pages[lastCachedPage] == NULL) {
+        PageAttrs *attrs = new PageAttrs(attrsList->back(), kid.getDict());
+        Page *p = new Page(doc, lastCachedPage+1, kid.getDict(),
+                       kidRef.getRef(), attrs, form);
+        if (!p->isOk()) {
+          error(errSyntaxError, -1, "Failed to create page (page {0:d})", lastCachedPage+1);
+          delete p;
+          kidRef.free();
+          kid.free();
+          return gFalse;
+        }
+
+        pages[lastCachedPage] = p;
+        pageRefs[lastCachedPage].num = kidRef.getRefNum();
+        pageRefs[lastCachedPage].gen = kidRef.getRefGen();
+      } else if (pageRefs[lastCachedPage].num != kidRef.getRefNum()) {
+        error(errSyntaxWarning, -1, "Page {0:d} found with the page counts is not the one in the page tree",
+              lastCachedPage+1);
+      }
 
       lastCachedPage++;
       kidsIdxList->back()++;
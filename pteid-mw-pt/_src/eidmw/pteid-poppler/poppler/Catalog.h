@@ -68,6 +68,7 @@
 #define PROVIDER_SCAP_MAX_LINES     3
 #define ATTR_SCAP_MAX_LINES         10   
 
+#include <unordered_map>
 #include <vector>
 
 class PDFDoc;
@@ -182,6 +183,17 @@ public:
 
   std::string get_commands_template(int rect_y, unsigned char *img_data);
 
+  /* Build the n2 layer content stream of the signature appearance. date_offset receives the position of date_str
+     in the returned stream so that it can be cached and reused with a different date */
+  GooString *formatSignatureAppearance(SignatureSignerInfo *signer_info, char *date_str, const char *location,
+      const char *reason, int rect_y, int rect_width, int rect_height, unsigned char *img_data, bool isPTLanguage,
+      int *date_offset);
+  GooString *formatSignatureAppearanceSCAP(SignatureSignerInfo *signer_info, char *date_str, const char *location,
+      const char *reason, int rect_y, int rect_width, int rect_height, unsigned char *img_data, bool isPTLanguage,
+      int *date_offset);
+  std::string signatureAppearanceKey(SignatureSignerInfo *signer_info, bool has_date, const char *location,
+      const char *reason, int rect_width, int rect_height, int rect_y, bool custom_image, bool isPTLanguage, bool scap);
+
   /* Fill the following keys of the signature field dictionary: Type, SubType, FT, F, SigSector, Rect, T and P.*/
   void fillSignatureField(Object *signatureFieldDict, PDFRectangle *rect, int sig_sector, 
       Ref *refFirstPage, bool isSmallSignature = false);
@@ -283,6 +295,11 @@ private:
   std::vector<Ref> *pagesRefList;
   std::vector<PageAttrs *> *attrsList;
   std::vector<int> *kidsIdxList;
+  Dict *pagesRoot;		// top-level pages object, for findPageInTree()
+  Ref pagesRootRef;
+  // for findPageInTree(): index of the first leaf under each kid of the
+  // page tree nodes already visited, and their number of leaves at the end
+  std::unordered_map<int, std::vector<int> > pageTreeLeaves;
   Form *form;
   ViewerPreferences *viewerPrefs;
   Object catDict;       //****Signing patch**** The actual raw dict, for later modification
@@ -315,6 +332,7 @@ private:
   GBool useCCLogo;
 
   GBool cachePageTree(int page); // Cache first <page> pages.
+  GBool findPageInTree(int page); // Cache only page <page>, see Catalog.cc
   Object *findDestInTree(Object *tree, GooString *name, Object *obj);
 
   Object *getNames();
@@ -40,7 +40,6 @@ static void aesDecryptBlock(DecryptAESState *s, Guchar *in, GBool last);
 static void aes256KeyExpansion(DecryptAES256State *s,
 			       Guchar *objKey, int objKeyLen);
 static void aes256DecryptBlock(DecryptAES256State *s, Guchar *in, GBool last);
-static void sha256(Guchar *msg, int msgLen, Guchar *hash);
 
 static const Guchar passwordPad[32] = {
   0x28, 0xbf, 0x4e, 0x5e, 0x4e, 0x75, 0x8a, 0x41,
@@ -1130,7 +1129,7 @@ void sha256HashBlock(Guchar *blk, Guint *H) {
   H[7] += h;
 }
 
-static void sha256(Guchar *msg, int msgLen, Guchar *hash) {
+void sha256(Guchar *msg, int msgLen, Guchar *hash) {
   Guchar blk[64];
   Guint H[8];
   int blkLen, i;
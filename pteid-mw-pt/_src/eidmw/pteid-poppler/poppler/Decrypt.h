@@ -123,5 +123,6 @@ private:
 extern void rc4InitKey(Guchar *key, int keyLen, Guchar *state);
 extern Guchar rc4DecryptByte(Guchar *state, Guchar *x, Guchar *y, Guchar c);
 extern void md5(Guchar *msg, int msgLen, Guchar *digest);
+extern void sha256(Guchar *msg, int msgLen, Guchar *hash);
 
 #endif
@@ -34,6 +34,8 @@
 
 #include "Object.h"
 
+#include <atomic>
+
 //------------------------------------------------------------------------
 // Dict
 //------------------------------------------------------------------------
@@ -73,7 +75,7 @@ public:
 
   // Look up an entry and return the value.  Returns a null object
   // if <key> is not in the dictionary.
-  Object *lookup(const char *key, Object *obj, int recursion = 0);
+  POPPLER_API Object *lookup(const char *key, Object *obj, int recursion = 0);
   Object *lookupNF(const char *key, Object *obj);
   GBool lookupInt(const char *key, const char *alt_key, int *value);
 
@@ -105,7 +107,7 @@ private:
   DictEntry *entries;		// array of entries
   int size;			// size of <entries> array
   int length;			// number of entries in dictionary
-  int ref;			// reference count
+  std::atomic<int> ref;		// reference count, shared objects can be copied by several threads
 
 
   DictEntry *find(const char *key);
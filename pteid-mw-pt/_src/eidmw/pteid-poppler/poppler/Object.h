@@ -160,7 +160,7 @@ public:
   Object *fetch(XRef *xref, Object *obj, int recursion = 0);
 
   // Free object contents.
-  void free();
+  POPPLER_API void free();
 
   // Type checking.
   ObjType getType() { return type; }
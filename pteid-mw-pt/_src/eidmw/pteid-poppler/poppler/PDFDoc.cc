@@ -58,6 +58,9 @@
 #include <stddef.h>
 #include <string.h>
 #include <memory>
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
 #include <time.h>
 #if defined(_DEBUG) && !defined(_WIN32)
 #include <fcntl.h>
@@ -111,6 +114,12 @@ POPPLER_API void *memmem(const void *haystack, size_t n, const void *needle, siz
 #define xrefSearchSize 1024	// read this many bytes at end of file
 				//   to look for 'startxref'
 
+#define OBJSTM_MAX_OBJECTS 100	// objects per object stream in the compressed
+				//   incremental updates, a reader decodes the
+				//   whole stream to fetch one of them
+
+static std::atomic<bool> compressedUpdates(false);
+
 
 //------------------------------------------------------------------------
 // PDFDoc
@@ -134,6 +143,8 @@ void PDFDoc::init()
   secHdlr = NULL;
   pageCache = NULL;
   signature_mode = gFalse;
+  incrementalOnly = gFalse;
+  fileSize = 0;
   m_image_data_jpeg = NULL;
   m_attribute_supplier = NULL;
   m_attribute_name = NULL;
@@ -188,9 +199,12 @@ PDFDoc::PDFDoc(GooString *fileNameA, GooString *ownerPassword,
     return;
   }
 
-  // create stream
+  // create stream, reading small files into memory
   obj.initNull();
-  str = new FileStream(file, 0, gFalse, size, &obj);
+  str = LoadedFileStream::create(file, &obj);
+  if (!str) {
+    str = new FileStream(file, 0, gFalse, size, &obj);
+  }
 
   ok = setup(ownerPassword, userPassword);
 }
@@ -231,9 +245,12 @@ PDFDoc::PDFDoc(wchar_t *fileNameA, int fileNameLen, GooString *ownerPassword,
     return;
   }
 
-  // create stream
+  // create stream, reading small files into memory
   obj.initNull();
-  str = new FileStream(file, 0, gFalse, size, &obj);
+  str = LoadedFileStream::create(file, &obj);
+  if (!str) {
+    str = new FileStream(file, 0, gFalse, size, &obj);
+  }
 
   ok = setup(ownerPassword, userPassword);
 }
@@ -264,6 +281,7 @@ PDFDoc::PDFDoc(BaseStream *strA, GooString *ownerPassword,
 #endif
   }
   str = strA;
+  fileSize = str->getLength();
   ok = setup(ownerPassword, userPassword);
 }
 
@@ -755,17 +773,18 @@ void PDFDoc::prepareSignature(PDFRectangle *rect, const char * name, const char
         isPTLanguage, isCCSignature, showDate, small_signature);
 	
 	//Add enough space for the placeholder string
-	MemOutStream mem_stream(this->fileSize + 20000); 
+	MemOutStream mem_stream(incrementalOnly ? 20000 : this->fileSize + 20000, incrementalOnly ? this->fileSize : 0);
 	OutStream * str = &mem_stream;
 
 	//We're adding additional signature so it has to be an incremental update
 	saveIncrementalUpdate(str);
 
-	long haystack = (long)mem_stream.getData();
+	//Where the document would start in the buffer, offsets are relative to it
+	long haystack = (long)mem_stream.getData() - (long)mem_stream.getStart();
 
 	//Start searching at the start of the new sig dictionary object
-	base_search = (char *)mem_stream.getData() + xref->getSigDictOffset();
-    size_t haystack_len = mem_stream.size() - xref->getSigDictOffset();
+	base_search = (char *)haystack + xref->getSigDictOffset();
+    size_t haystack_len = mem_stream.getPos() - xref->getSigDictOffset();
 
 	found = (long)memmem(base_search, haystack_len,
 			       	(const void *) needle, sizeof(needle)-1);
@@ -777,7 +796,7 @@ void PDFDoc::prepareSignature(PDFRectangle *rect, const char * name, const char
         return;
     }
 	
-	getCatalog()->setSignatureByteRange(m_sig_offset, ESTIMATED_LEN, mem_stream.size());
+	getCatalog()->setSignatureByteRange(m_sig_offset, ESTIMATED_LEN, mem_stream.getPos());
 
 }
 
@@ -787,76 +806,109 @@ void PDFDoc::prepareSignature(PDFRectangle *rect, const char * name, const char
 */
 unsigned long PDFDoc::getSigByteArray(unsigned char **byte_array)
 {
-	MemOutStream mem_stream(this->fileSize+ESTIMATED_LEN +190000);
+	MemOutStream mem_stream(incrementalOnly ? ESTIMATED_LEN + 190000 : this->fileSize + ESTIMATED_LEN + 190000,
+	                        incrementalOnly ? this->fileSize : 0);
 	unsigned int i = 0, ret_len = 0;
 	OutStream * out_str = &mem_stream;
 
 	saveIncrementalUpdate(out_str);
 
-  if (m_sig_offset >= mem_stream.size()) {
-    error(errInternal, -1, "getSigByteArray: m_sig_offset greater than current doc size: %d >= %d", m_sig_offset, mem_stream.size());
+  if (m_sig_offset < mem_stream.getStart() || m_sig_offset >= (unsigned long)mem_stream.getPos()) {
+    error(errInternal, -1, "getSigByteArray: m_sig_offset outside of the current doc: {0:uld} >= {1:d}", m_sig_offset, mem_stream.getPos());
     return 0;
   }
 	
 	char * base_ptr = (char *)mem_stream.getData();
+	// position of the placeholder in the buffer
+	unsigned long sig_pos = m_sig_offset - mem_stream.getStart();
 
 	ret_len = mem_stream.size() - ESTIMATED_LEN - 2;
 
 	*byte_array = (unsigned char *)gmalloc(ret_len);
 
-	memcpy((*byte_array)+i, base_ptr, m_sig_offset);
-	i+= m_sig_offset;
+	memcpy((*byte_array)+i, base_ptr, sig_pos);
+	i+= sig_pos;
 
-	int len2 = mem_stream.size() - m_sig_offset - ESTIMATED_LEN -2;
-	memcpy((*byte_array)+i, base_ptr + m_sig_offset+
+	int len2 = mem_stream.size() - sig_pos - ESTIMATED_LEN -2;
+	memcpy((*byte_array)+i, base_ptr + sig_pos+
 			ESTIMATED_LEN + 2, len2);
 
 	return ret_len;
 }
 
+unsigned long PDFDoc::getIncrementalUpdate(unsigned char **byte_array)
+{
+	GBool savedIncrementalOnly = incrementalOnly;
+	MemOutStream mem_stream(ESTIMATED_LEN + 190000, this->fileSize);
+
+	incrementalOnly = gTrue;
+	saveIncrementalUpdate(&mem_stream);
+	incrementalOnly = savedIncrementalOnly;
+
+	*byte_array = (unsigned char *)gmalloc(mem_stream.size());
+	memcpy(*byte_array, mem_stream.getData(), mem_stream.size());
+
+	return mem_stream.size();
+}
+
 void PDFDoc::closeSignature(const char *signature_contents)
 {
   	getCatalog()->closeSignature(signature_contents, ESTIMATED_LEN);
 }
 
-void PDFDoc::getCertsInDSS(std::vector<ValidationDataElement *> *certs)
+// Key of the DSS streams index: SHA-256 of the decoded stream data
+static std::string dssStreamKey(const unsigned char *data, size_t dataSize)
 {
-    Object *dss = getCatalog()->getDSS();
-
-    if (!dss->isDict())
-        return;
-
-    Object certArray;
-    dss->dictLookup("Certs", &certArray);
+    Guchar digest[32];
+    sha256((Guchar *)data, (int)dataSize, digest);
+    return std::string((const char *)digest, sizeof(digest));
+}
 
-    if (!certArray.isArray())
+// Add the streams of a DSS or VRI array to the index, each stream is only read once
+static void indexDSSArray(Object *array, XRef *xref, std::unordered_map<std::string, Ref> &index,
+                          std::unordered_set<int> &indexed)
+{
+    if (!array->isArray())
         return;
 
-    for (size_t i = 0; i < certArray.arrayGetLength(); i++)
+    for (int i = 0; i < array->arrayGetLength(); i++)
     {
-        Object certObj;
-        certArray.arrayGet(i, &certObj);
-
-        if (certObj.isStream())
+        Object ref, stream;
+        if (array->arrayGetNF(i, &ref)->isRef() && indexed.insert(ref.getRefNum()).second)
         {
-            Stream *certStream = certObj.getStream();
-            GooString certRaw;
-            certStream->fillGooString(&certRaw);
-
-            ValidationDataElement *vde = new ValidationDataElement(
-                (unsigned char*)certRaw.getCString(), certRaw.getLength(), ValidationDataElement::CERT);
-
-            certs->push_back(vde);
+            if (xref->fetch(ref.getRefNum(), ref.getRefGen(), &stream)->isStream())
+            {
+                GooString data;
+                stream.getStream()->fillGooString(&data);
+                index.insert(std::make_pair(dssStreamKey((unsigned char *)data.getCString(), data.getLength()),
+                                            ref.getRef()));
+            }
+            stream.free();
         }
-
-        certObj.free();
+        ref.free();
     }
+}
 
-    certArray.free();
+// Append ref to array unless it's already there
+static void addRefOnce(Object *array, Ref ref)
+{
+    for (int i = 0; i < array->arrayGetLength(); i++)
+    {
+        Object obj;
+        GBool found = array->arrayGetNF(i, &obj)->isRef() && obj.getRefNum() == ref.num &&
+                      obj.getRefGen() == ref.gen;
+        obj.free();
+        if (found)
+            return;
+    }
+    Object refObj;
+    array->arrayAdd(refObj.initRef(ref.num, ref.gen));
 }
 
-void PDFDoc::addDSS(std::vector<ValidationDataElement *> validationData)
+DSSUpdateStats PDFDoc::addDSS(std::vector<ValidationDataElement *> validationData)
 {
+    DSSUpdateStats stats = {0, 0, 0};
+
     /* Write and fill content with placeholder for the byterange. */
     MemOutStream mem_stream(this->fileSize + ESTIMATED_LEN);
     OutStream * str = &mem_stream;
@@ -865,88 +917,117 @@ void PDFDoc::addDSS(std::vector<ValidationDataElement *> validationData)
     // create DSS if it does not exist
     Object *dss = getCatalog()->createDSS();
 
+    static const char *arrayKeys[] = {"OCSPs", "CRLs", "Certs"};
+    static const char *vriPointerTypes[] = {"OCSP", "CRL", "Cert"};
+
+    /* The DSS of the last revision references the streams of all the previous ones: index them
+       by content so that the same certificate, OCSP response or CRL is only embedded once. */
+    std::unordered_map<std::string, Ref> index;
+    std::unordered_set<int> indexed;
+    Object vdeArrays[3], vdeArrayRefs[3], vriObj, vriRef;
+    for (int t = 0; t < 3; t++)
+    {
+        dss->dictLookup(arrayKeys[t], &vdeArrays[t]);
+        dss->dictLookupNF(arrayKeys[t], &vdeArrayRefs[t]);
+        indexDSSArray(&vdeArrays[t], xref, index, indexed);
+    }
+    dss->dictLookup("VRI", &vriObj);
+    dss->dictLookupNF("VRI", &vriRef);
+    for (int i = 0; vriObj.isDict() && i < vriObj.dictGetLength(); i++)
+    {
+        Object vriEntry, pointers;
+        if (vriObj.dictGetVal(i, &vriEntry)->isDict())
+        {
+            for (int t = 0; t < 3; t++)
+            {
+                indexDSSArray(vriEntry.dictLookup(vriPointerTypes[t], &pointers), xref, index, indexed);
+                pointers.free();
+            }
+        }
+        vriEntry.free();
+    }
+
     // Add validation data to DSS dictionary and VRI
     for (size_t i = 0; i < validationData.size(); i++)
     {
-        Object streamDictObj, streamObj;
-        streamDictObj.initDict(xref);
-        Stream *stream = new MemStream((char *)validationData[i]->getData(), 0, validationData[i]->getSize(), &streamDictObj);
+        int t = validationData[i]->getType() == ValidationDataElement::OCSP ? 0 :
+                validationData[i]->getType() == ValidationDataElement::CRL ? 1 : 2;
+        std::string key = dssStreamKey(validationData[i]->getData(), validationData[i]->getSize());
+        Ref streamRef;
 
-        /* Compress stream if it is CRL. */
-        if (validationData[i]->getType() == ValidationDataElement::CRL)
+        std::unordered_map<std::string, Ref>::iterator it = index.find(key);
+        if (it != index.end())
         {
-            Object obj;
-            streamDictObj.dictAdd(copyString("Filter"), obj.initName("FlateDecode"));
-            stream = new FlateEncoder(stream);
+            streamRef = it->second;
+            stats.reusedStreams++;
+            stats.reusedBytes += validationData[i]->getSize();
         }
-        streamObj.initStream(stream);
-
-        Ref streamRef = xref->addIndirectObject(&streamObj);
-        
-        Object streamRefObj;
-        streamRefObj.initRef(streamRef.num, streamRef.gen);
+        else
+        {
+            Object streamDictObj, streamObj;
+            streamDictObj.initDict(xref);
+            Stream *stream = new MemStream((char *)validationData[i]->getData(), 0, validationData[i]->getSize(), &streamDictObj);
 
-        const char *vriPointerType;
-        Object vdeArrayObj, vdeArrayRef;
+            /* Compress stream if it is CRL, or any stream for compressed updates. */
+            if (validationData[i]->getType() == ValidationDataElement::CRL || compressedUpdates)
+            {
+                Object obj;
+                streamDictObj.dictAdd(copyString("Filter"), obj.initName("FlateDecode"));
+                stream = new FlateEncoder(stream);
+            }
+            streamObj.initStream(stream);
 
-        switch (validationData[i]->getType())
-        {
-            case ValidationDataElement::OCSP:
-                dss->dictLookup("OCSPs", &vdeArrayObj);
-                dss->dictLookupNF("OCSPs", &vdeArrayRef);
-                vriPointerType = "OCSP";
-                break;
-
-            case ValidationDataElement::CRL:
-                dss->dictLookup("CRLs", &vdeArrayObj);
-                dss->dictLookupNF("CRL", &vdeArrayRef);
-                vriPointerType = "CRL";
-                break;
-
-            case ValidationDataElement::CERT:
-                dss->dictLookup("Certs", &vdeArrayObj);
-                dss->dictLookupNF("Cert", &vdeArrayRef);
-                vriPointerType = "Cert";
-                break;
+            streamRef = xref->addIndirectObject(&streamObj);
+            index.insert(std::make_pair(key, streamRef));
+            stats.addedStreams++;
         }
 
-        vdeArrayObj.arrayAdd(&streamRefObj);
-
-        /*If the array is indirect object we need to update it.*/
-        if (vdeArrayRef.isRef())
-            xref->setModifiedObject(&vdeArrayObj, vdeArrayRef.getRef());
+        // A stream found in a VRI entry may be missing from the DSS arrays
+        addRefOnce(&vdeArrays[t], streamRef);
 
         /* Each validation datum can be used to validate different objects
          and, for that reason, be present in multiple vri entries. */
-        Object vriObj, vriRef;
-        dss->dictLookup("VRI", &vriObj);
-        dss->dictLookupNF("VRI", &vriRef);
         Object vriEntry;
-        for (auto const& key : validationData[i]->getVriHashKeys())
+        for (auto const& vriKey : validationData[i]->getVriHashKeys())
         {
-            vriObj.dictLookup(key.c_str(), &vriEntry);
+            vriObj.dictLookup(vriKey.c_str(), &vriEntry);
 
             if (vriEntry.isNull())
             {
                 vriEntry.initDict(xref);
-                vriObj.dictAdd((char *)key.c_str(), &vriEntry);
+                vriObj.dictAdd(copyString(vriKey.c_str()), &vriEntry);
             }
 
             Object vriPointerArrayObj;
 
-            vriEntry.dictLookup(vriPointerType, &vriPointerArrayObj);
+            vriEntry.dictLookup(vriPointerTypes[t], &vriPointerArrayObj);
             if (vriPointerArrayObj.isNull())
             {
                 vriPointerArrayObj.initArray(xref);
-                vriEntry.dictAdd((char *)vriPointerType, &vriPointerArrayObj);
+                vriEntry.dictAdd(copyString(vriPointerTypes[t]), &vriPointerArrayObj);
             }
-            vriPointerArrayObj.arrayAdd(&streamRefObj);
+            addRefOnce(&vriPointerArrayObj, streamRef);
         }
+    }
+
+    /*If the arrays or the VRI dict are indirect objects we need to update them.*/
+    for (int t = 0; t < 3; t++)
+    {
+        if (vdeArrayRefs[t].isRef())
+            xref->setModifiedObject(&vdeArrays[t], vdeArrayRefs[t].getRef());
+    }
+    if (vriRef.isRef())
+        xref->setModifiedObject(&vriObj, vriRef.getRef());
 
-        /*If the VRI dict is indirect object we need to update it.*/
-        if (vriRef.isRef())
-            xref->setModifiedObject(&vriObj, vriRef.getRef());
+    for (int t = 0; t < 3; t++)
+    {
+        vdeArrays[t].free();
+        vdeArrayRefs[t].free();
     }
+    vriObj.free();
+    vriRef.free();
+
+    return stats;
 }
 
 void PDFDoc::prepareTimestamp()
@@ -1378,27 +1459,98 @@ int PDFDoc::saveWithoutChangesAs(GooString *name) {
 }
 
 int PDFDoc::saveWithoutChangesAs(OutStream *outStr) {
-  int c;
-  
-  str->reset();
-  while ((c = str->getChar()) != EOF) {
-    outStr->put(c);
-  }
-  str->close();
+  str->copyTo(outStr);
 
   return errNone;
 }
 
+void PDFDoc::setCompressedUpdates(GBool compressed)
+{
+  compressedUpdates = compressed;
+}
+
+// Objects that can be stored in an object stream: anything but streams, and not the
+// signature dictionaries, which are filled in at the offsets where they were written
+static GBool isCompressible(Object *obj)
+{
+  GBool compressible = gTrue;
+  Object obj1;
+
+  if (obj->isStream()) {
+    return gFalse;
+  } else if (obj->isDict()) {
+    Dict *dict = obj->getDict();
+    compressible = !dict->isSignatureDict();
+    for (int i = 0; compressible && i < dict->getLength(); i++) {
+      compressible = isCompressible(dict->getValNF(i, &obj1));
+      obj1.free();
+    }
+  } else if (obj->isArray()) {
+    for (int i = 0; compressible && i < obj->arrayGetLength(); i++) {
+      compressible = isCompressible(obj->arrayGetNF(i, &obj1));
+      obj1.free();
+    }
+  }
+  return compressible;
+}
+
+void PDFDoc::writeObjectStreams(const std::vector<int> &objects, XRef *uxref, int *numObjects, OutStream* outStr)
+{
+  for (size_t first = 0; first < objects.size(); first += OBJSTM_MAX_OBJECTS) {
+    int count = (int)std::min(objects.size() - first, (size_t)OBJSTM_MAX_OBJECTS);
+    Ref objStrRef;
+    objStrRef.num = (*numObjects)++;
+    objStrRef.gen = 0;
+
+    // Pairs of object number and offset in the body, then the objects
+    MemOutStream header(16 * count);
+    MemOutStream body(256 * count);
+    for (int i = 0; i < count; i++) {
+      Object obj1;
+      int num = objects[first + i];
+      header.printf("%i %i ", num, body.getPos());
+      writeObject(xref->fetch(num, 0, &obj1), NULL, &body, getXRef(), 0);
+      body.printf("\n");
+      obj1.free();
+      uxref->addCompressed(num, objStrRef.num, i);
+    }
+
+    Guint length = header.size() + body.size();
+    char *data = (char *)gmalloc(length);
+    memcpy(data, header.getData(), header.size());
+    memcpy(data + header.size(), body.getData(), body.size());
+
+    Object dictObj, obj1, streamObj;
+    dictObj.initDict(xref);
+    dictObj.dictAdd(copyString("Type"), obj1.initName("ObjStm"));
+    dictObj.dictAdd(copyString("N"), obj1.initInt(count));
+    dictObj.dictAdd(copyString("First"), obj1.initInt(header.size()));
+    dictObj.dictAdd(copyString("Filter"), obj1.initName("FlateDecode"));
+    MemStream *memStream = new MemStream(data, 0, length, &dictObj);
+    memStream->setNeedFree(gTrue);
+
+    // FlateEncoder doesn't own the stream it encodes
+    Guint offset = writeObject(streamObj.initStream(new FlateEncoder(memStream)), &objStrRef, outStr);
+    uxref->add(objStrRef.num, objStrRef.gen, offset, gTrue);
+    streamObj.free();
+    delete memStream;
+  }
+}
+
 void PDFDoc::saveIncrementalUpdate (OutStream* outStr)
 {
   XRef *uxref;
-  int c;
-  //copy the original file
-  str->reset();
-  while ((c = str->getChar()) != EOF) {
-    outStr->put(c);
+  //copy the original file, unless it's left out and outStr already counts it
+  if (!incrementalOnly) {
+    str->copyTo(outStr);
+  } else if ((unsigned long)outStr->getPos() != fileSize) {
+    error(errInternal, -1, "saveIncrementalUpdate: the output stream doesn't start after the original file");
+    return;
   }
-  str->close();
+
+  // The objects that can be compressed are written after the others, in object streams
+  GBool compressUpdate = compressedUpdates && (pdfMajorVersion > 1 || pdfMinorVersion >= 5);
+  std::vector<int> packedObjects;
 
   uxref = new XRef();
   uxref->add(0, 65535, 0, gFalse);
@@ -1414,8 +1566,12 @@ void PDFDoc::saveIncrementalUpdate (OutStream* outStr)
       if (xref->getEntry(i)->type != xrefEntryFree) {
         Object obj1;
         xref->fetch(ref.num, ref.gen, &obj1);
-        Guint offset = writeObject(&obj1, &ref, outStr);
-        uxref->add(ref.num, ref.gen, offset, gTrue);
+        if (compressUpdate && ref.gen == 0 && isCompressible(&obj1)) {
+          packedObjects.push_back(ref.num);
+        } else {
+          Guint offset = writeObject(&obj1, &ref, outStr);
+          uxref->add(ref.num, ref.gen, offset, gTrue);
+        }
         obj1.free();
       } else {
         uxref->add(ref.num, ref.gen, 0, gFalse);
@@ -1427,15 +1583,19 @@ void PDFDoc::saveIncrementalUpdate (OutStream* outStr)
     return;
   }
 
-  Guint uxrefOffset = outStr->getPos();
   int numobjects = xref->getNumObjects();
+  if (!packedObjects.empty()) {
+    writeObjectStreams(packedObjects, uxref, &numobjects, outStr);
+  }
+
+  Guint uxrefOffset = outStr->getPos();
   const char *fileNameA = fileName ? fileName->getCString() : NULL;
   Ref rootRef, uxrefStreamRef;
   rootRef.num = getXRef()->getRootNum();
   rootRef.gen = getXRef()->getRootGen();
 
   // Output a xref stream if there is a xref stream already
-  GBool xRefStream = xref->isXRefStream();
+  GBool xRefStream = xref->isXRefStream() || compressUpdate;
 
   if (xRefStream) {
     // Append an entry for the xref stream itself
@@ -1888,8 +2048,15 @@ void PDFDoc::writeXRefStreamTrailer (Dict *trailerDict, XRef *uxref, Ref *uxrefS
   Object obj1;
   MemStream *mStream = new MemStream( stmData.getCString(), 0,
                                       stmData.getLength(), obj1.initDict(trailerDict) );
-  writeObject(obj1.initStream(mStream), uxrefStreamRef, outStr, xRef, 0);
-  obj1.free();
+  if (compressedUpdates) {
+    mStream->getDict()->set("Filter", obj1.initName("FlateDecode"));
+    writeObject(obj1.initStream(new FlateEncoder(mStream)), uxrefStreamRef, outStr, xRef, 0);
+    obj1.free();
+    delete mStream;
+  } else {
+    writeObject(obj1.initStream(mStream), uxrefStreamRef, outStr, xRef, 0);
+    obj1.free();
+  }
 
   outStr->printf( "startxref\r\n");
   outStr->printf( "%i\r\n", uxrefOffset);
@@ -1902,10 +2069,11 @@ void PDFDoc::writeXRefTableTrailer(Guint uxrefOffset, XRef *uxref, GBool writeAl
   const char *fileNameA = fileName ? fileName->getCString() : NULL;
   // file size (doesn't include the trailer)
   unsigned int fileSize = 0;
-  int c;
+  Guchar sizeBuf[4096];
+  int n;
   str->reset();
-  while ((c = str->getChar()) != EOF) {
-    fileSize++;
+  while ((n = str->doGetChars(sizeof(sizeBuf), sizeBuf)) > 0) {
+    fileSize += n;
   }
   str->close();
   Ref ref;
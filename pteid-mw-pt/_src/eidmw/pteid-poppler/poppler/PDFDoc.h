@@ -140,6 +140,14 @@ private:
     std::unordered_set<std::string> vriHashKeys;
 };
 
+// Result of PDFDoc::addDSS()
+struct DSSUpdateStats
+{
+    int addedStreams;           // validation data embedded in new streams
+    int reusedStreams;          // validation data already in the document
+    unsigned long reusedBytes;  // size of the reused validation data
+};
+
 //------------------------------------------------------------------------
 // PDFDoc
 //------------------------------------------------------------------------
@@ -155,7 +163,7 @@ POPPLER_API PDFDoc(GooString *fileNameA, GooString *ownerPassword = NULL,
 	 GooString *userPassword = NULL, void *guiDataA = NULL);
 #endif
 
-  PDFDoc(BaseStream *strA, GooString *ownerPassword = NULL,
+  POPPLER_API PDFDoc(BaseStream *strA, GooString *ownerPassword = NULL,
 	 GooString *userPassword = NULL, void *guiDataA = NULL);
   POPPLER_API ~PDFDoc();
 
@@ -247,6 +255,18 @@ POPPLER_API PDFDoc(GooString *fileNameA, GooString *ownerPassword = NULL,
   // Is the file signed?
   POPPLER_API GBool isSigned();
   POPPLER_API unsigned long getSigByteArray(unsigned char **byte_array);
+
+  // Leave out the original file from the incremental updates written for the signature, e.g. when it's a
+  // remote file that is not kept locally: getSigByteArray() then only returns the signed bytes that follow
+  // the original file, which must be digested before them
+  POPPLER_API void setIncrementalOnly(GBool incrementalOnlyA) { incrementalOnly = incrementalOnlyA; }
+  // Allocates and fills a byte array with the incremental update (the bytes to append to the original file)
+  // The return value is the size of the array
+  POPPLER_API unsigned long getIncrementalUpdate(unsigned char **byte_array);
+  // Offset in the file of the signature placeholder <0000...> written by prepareSignature()
+  POPPLER_API unsigned long getSignatureOffset() { return m_sig_offset; }
+  // Size of the original file, where the incremental updates start
+  POPPLER_API unsigned long getFileSize() { return fileSize; }
   POPPLER_API GBool isReaderEnabled();
   /*Returns set of indexes of the signatures until (and including) the last timestamp signature. 
   The indexes are relative to the last signature: 0 is the last, 1 is the previous one, ... */
@@ -266,8 +286,9 @@ POPPLER_API PDFDoc(GooString *fileNameA, GooString *ownerPassword = NULL,
   POPPLER_API void closeSignature(const char *signature_contents);
 
   // LTV related methods
-  POPPLER_API void addDSS(std::vector<ValidationDataElement *> validationData);
-  POPPLER_API void getCertsInDSS(std::vector<ValidationDataElement *> *validationData);
+  // Validation data already in the DSS of any revision (same content) is referenced instead of
+  // being embedded again
+  POPPLER_API DSSUpdateStats addDSS(std::vector<ValidationDataElement *> validationData);
   POPPLER_API void prepareTimestamp();
   //POPPLER_API void closeLtv(const char *signature_contents);
 
@@ -320,6 +341,11 @@ POPPLER_API PDFDoc(GooString *fileNameA, GooString *ownerPassword = NULL,
   // Save this file in the given output stream without saving changes
   POPPLER_API int saveWithoutChangesAs(OutStream *outStr);
 
+  // Write the incremental updates of PDF 1.5 and later documents with a compressed xref stream,
+  // storing the new objects that allow it in compressed object streams, and compress all the DSS
+  // streams (only the CRLs otherwise). Applies to every document, off by default.
+  POPPLER_API static void setCompressedUpdates(GBool compressed);
+
   // Return a pointer to the GUI (XPDFCore or WinPDFCore object).
   void *getGUIData() { return guiData; }
 
@@ -356,6 +382,8 @@ private:
                               int uxrefSize, OutStream* outStr, GBool incrUpdate);
   static void writeString (GooString* s, OutStream* outStr);
   void saveIncrementalUpdate (OutStream* outStr);
+  // Write the objects in object streams of up to OBJSTM_MAX_OBJECTS objects, numbered from *numObjects
+  void writeObjectStreams (const std::vector<int> &objects, XRef *uxref, int *numObjects, OutStream* outStr);
   void saveCompleteRewrite (OutStream* outStr);
 
   Page *parsePage(int page);
@@ -394,6 +422,7 @@ private:
   //Insert a
 
   GBool signature_mode;
+  GBool incrementalOnly;
   BaseStream *str;
   void *guiData;
   int pdfMajorVersion;
@@ -24,64 +24,107 @@ PopplerCacheItem::~PopplerCacheItem()
 
 PopplerCache::PopplerCache(int cacheSizeA)
 {
-  cacheSize = cacheSizeA;
-  keys = new PopplerCacheKey*[cacheSize];
-  items = new PopplerCacheItem*[cacheSize];
-  lastValidCacheIndex = -1;
+  unsigned int bucketCount = 8;
+
+  cacheSize = cacheSizeA > 0 ? cacheSizeA : 1;
+  while (bucketCount < 2 * (unsigned int)cacheSize)
+    bucketCount <<= 1;
+  buckets = new Entry*[bucketCount];
+  for (unsigned int i = 0; i < bucketCount; ++i)
+    buckets[i] = 0;
+  bucketMask = bucketCount - 1;
+  head = tail = 0;
+  count = 0;
+  hitCount = missCount = 0;
 }
 
 PopplerCache::~PopplerCache()
 {
-  for (int i = 0; i <= lastValidCacheIndex; ++i) {
-    delete keys[i];
-    delete items[i];
+  clear();
+  delete[] buckets;
+}
+
+void PopplerCache::clear()
+{
+  Entry *entry = head;
+  while (entry) {
+    Entry *next = entry->next;
+    delete entry->key;
+    delete entry->item;
+    delete entry;
+    entry = next;
   }
-  delete[] keys;
-  delete[] items;
+  for (unsigned int i = 0; i <= bucketMask; ++i)
+    buckets[i] = 0;
+  head = tail = 0;
+  count = 0;
+}
+
+void PopplerCache::unlink(Entry *entry)
+{
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    head = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    tail = entry->prev;
+}
+
+void PopplerCache::pushFront(Entry *entry)
+{
+  entry->prev = 0;
+  entry->next = head;
+  if (head)
+    head->prev = entry;
+  head = entry;
+  if (!tail)
+    tail = entry;
 }
 
 PopplerCacheItem *PopplerCache::lookup(const PopplerCacheKey &key)
 {
-  if (lastValidCacheIndex < 0)
-    return 0;
+  unsigned int h = key.hash();
 
-  if (*keys[0] == key) {
-    return items[0];
-  }
-  for (int i = 1; i <= lastValidCacheIndex; i++) {
-    if (*keys[i] == key) {
-      PopplerCacheKey *keyHit = keys[i];
-      PopplerCacheItem *itemHit = items[i];
-
-      for (int j = i; j > 0; j--) {
-        keys[j] = keys[j - 1];
-        items[j] = items[j - 1];
+  for (Entry *entry = buckets[h & bucketMask]; entry; entry = entry->bucketNext) {
+    if (entry->hash == h && *entry->key == key) {
+      if (entry != head) {
+        unlink(entry);
+        pushFront(entry);
       }
-      
-      keys[0] = keyHit;
-      items[0] = itemHit;
-      return itemHit;
+      hitCount++;
+      return entry->item;
     }
   }
+  missCount++;
   return 0;
 }
 
 void PopplerCache::put(PopplerCacheKey *key, PopplerCacheItem *item)
 {
-  int movingStartIndex = lastValidCacheIndex + 1;
-  if (lastValidCacheIndex == cacheSize - 1) {
-    delete keys[lastValidCacheIndex];
-    delete items[lastValidCacheIndex];
-    movingStartIndex = cacheSize - 1;
-  } else {
-    lastValidCacheIndex++;
-  }
-  for (int i = movingStartIndex; i > 0; i--) {
-    keys[i] = keys[i - 1];
-    items[i] = items[i - 1];
+  if (count == cacheSize) {
+    // evict the least recently used entry
+    Entry *old = tail;
+    Entry **link = &buckets[old->hash & bucketMask];
+    while (*link != old)
+      link = &(*link)->bucketNext;
+    *link = old->bucketNext;
+    unlink(old);
+    delete old->key;
+    delete old->item;
+    delete old;
+    count--;
   }
-  keys[0] = key;
-  items[0] = item;
+
+  Entry *entry = new Entry;
+  entry->key = key;
+  entry->item = item;
+  entry->hash = key->hash();
+  entry->bucketNext = buckets[entry->hash & bucketMask];
+  buckets[entry->hash & bucketMask] = entry;
+  pushFront(entry);
+  count++;
 }
 
 int PopplerCache::size()
@@ -91,17 +134,27 @@ int PopplerCache::size()
 
 int PopplerCache::numberOfItems()
 {
-  return lastValidCacheIndex + 1;
+  return count;
+}
+
+PopplerCache::Entry *PopplerCache::entryAt(int index)
+{
+  Entry *entry = head;
+  while (entry && index-- > 0)
+    entry = entry->next;
+  return entry;
 }
     
 PopplerCacheItem *PopplerCache::item(int index)
 {
-  return items[index];
+  Entry *entry = entryAt(index);
+  return entry ? entry->item : 0;
 }
     
 PopplerCacheKey *PopplerCache::key(int index)
 {
-  return keys[index];
+  Entry *entry = entryAt(index);
+  return entry ? entry->key : 0;
 }
 
 class ObjectKey : public PopplerCacheKey {
@@ -116,6 +169,11 @@ class ObjectKey : public PopplerCacheKey {
       return k->num == num && k->gen == gen;
     }
 
+    unsigned int hash() const
+    {
+      return (unsigned int)num * 31 + (unsigned int)gen;
+    }
+
     int num, gen;
 };
 
@@ -27,8 +27,12 @@ class PopplerCacheKey
   public:
     virtual ~PopplerCacheKey();
     virtual bool operator==(const PopplerCacheKey &key) const = 0;
+
+    /* Keys that are equal must have the same hash */
+    virtual unsigned int hash() const { return 0; }
 };
 
+/* Least recently used cache, indexed by the hash of the keys */
 class PopplerCache
 {
   public:
@@ -41,25 +45,46 @@ class PopplerCache
     /* The key and item pointers ownership is taken by the cache */
     void put(PopplerCacheKey *key, PopplerCacheItem *item);
     
+    /* Delete all the keys and items */
+    void clear();
+
     /* The max size of the cache */
     int size();
     
     /* The number of items in the cache */
     int numberOfItems();
     
-    /* The n-th item in the cache */
+    /* The n-th item in the cache, from the most recently used */
     PopplerCacheItem *item(int index);
     
-    /* The n-th key in the cache */
+    /* The n-th key in the cache, from the most recently used */
     PopplerCacheKey *key(int index);
+
+    /* The number of lookups that found and didn't find their key */
+    unsigned long hits() { return hitCount; }
+    unsigned long misses() { return missCount; }
   
   private:
     PopplerCache(const PopplerCache &cache); // not allowed
+
+    struct Entry {
+      PopplerCacheKey *key;
+      PopplerCacheItem *item;
+      unsigned int hash;
+      Entry *prev, *next;	// usage order, most recent first
+      Entry *bucketNext;	// next entry in the same bucket
+    };
+
+    Entry *entryAt(int index);
+    void unlink(Entry *entry);
+    void pushFront(Entry *entry);
   
-    PopplerCacheKey **keys;
-    PopplerCacheItem **items;
-    int lastValidCacheIndex;
+    Entry **buckets;
+    unsigned int bucketMask;
+    Entry *head, *tail;
+    int count;
     int cacheSize;
+    unsigned long hitCount, missCount;
 };
 
 class PopplerObjectCache
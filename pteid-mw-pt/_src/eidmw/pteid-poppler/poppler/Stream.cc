@@ -41,13 +41,18 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <limits.h>
+#include <errno.h>
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
+#include <sys/stat.h>
 #endif
 #include <string.h>
 #include <ctype.h>
 #include "goo/gmem.h"
 #include "goo/gfile.h"
+#if MULTITHREADED
+#include "goo/GooMutex.h"
+#endif
 #include "poppler-config.h"
 #include "Error.h"
 #include "Object.h"
@@ -336,23 +341,58 @@ OutStream::~OutStream ()
 {
 }
 
+void OutStream::write (const char *data, Guint len)
+{
+  for (Guint i = 0; i < len; i++) {
+    put(data[i]);
+  }
+}
+
 MemOutStream::MemOutStream(unsigned long initial_size)
 {
+	if (initial_size == 0)
+		initial_size = 256;
+	// Only the first "used" bytes are ever read so the buffer doesn't need to be cleared
 	buffer = (unsigned char *)gmalloc(initial_size);
-	memset(buffer, 0, initial_size);
 	buffer_size = initial_size; used = 0;
+	start = 0;
+}
+
+MemOutStream::MemOutStream(unsigned long initial_size, unsigned long startA)
+	: MemOutStream(initial_size)
+{
+	start = startA;
 }
 
 MemOutStream::~MemOutStream()
 {
-	free(buffer);
+	gfree(buffer);
+}
+
+void MemOutStream::reserve(unsigned long len) {
+	if (len <= buffer_size - used)
+		return;
+
+	unsigned long new_size = buffer_size * 2;
+	if (new_size < used + len)
+		new_size = used + len;
+	buffer = (unsigned char *)grealloc(buffer, new_size);
+	buffer_size = new_size;
 }
 
 void MemOutStream::put(char c) {
+	if (used == buffer_size)
+		reserve(1);
 	*(buffer+used) = c;
 	used++;
 }
 
+void MemOutStream::write(const char *data, Guint len) {
+	reserve(len);
+	memcpy(buffer+used, data, len);
+	used += len;
+}
+
 void MemOutStream::printf(const char *format, ...)
 {
   va_list argptr;
@@ -366,9 +406,8 @@ void MemOutStream::printf(const char *format, ...)
      * so calling it again right away would return undefined values as there would be no more arguments
      * More info at the stdarg(3) manpage ... */
     va_start (argptr, format);
-    //Buffer is full need to reallocate to twice the size
-    buffer = (unsigned char *)grealloc(buffer, buffer_size*2);
-    buffer_size *=2;
+    //Buffer is full need to reallocate to twice the size or more
+    reserve(ret + 1);
     ret = vsnprintf((char *)buffer+used, buffer_size-used, format, argptr);
     va_end (argptr);
   }
@@ -406,6 +445,11 @@ void FileOutStream::put (char c)
   fputc(c,f);
 }
 
+void FileOutStream::write (const char *data, Guint len)
+{
+  fwrite(data, 1, len, f);
+}
+
 void FileOutStream::printf(const char *format, ...)
 {
   va_list argptr;
@@ -428,6 +472,20 @@ BaseStream::~BaseStream() {
   dict.free();
 }
 
+Guint BaseStream::copyTo(OutStream *outStr) {
+  Guchar copyBuf[65536];
+  Guint total = 0;
+  int n;
+
+  reset();
+  while ((n = doGetChars(sizeof(copyBuf), copyBuf)) > 0) {
+    outStr->write((const char *)copyBuf, n);
+    total += n;
+  }
+  close();
+  return total;
+}
+
 //------------------------------------------------------------------------
 // FilterStream
 //------------------------------------------------------------------------
@@ -779,6 +837,8 @@ FileStream::FileStream(FILE *fA, Guint startA, GBool limitedA,
   start = startA;
   limited = limitedA;
   length = lengthA;
+  window = NULL;
+  buf = smallBuf;
   bufPtr = bufEnd = buf;
   bufPos = start;
   savePos = 0;
@@ -787,6 +847,7 @@ FileStream::FileStream(FILE *fA, Guint startA, GBool limitedA,
 
 FileStream::~FileStream() {
   close();
+  gfree(window);
 }
 
 Stream *FileStream::makeSubStream(Guint startA, GBool limitedA,
@@ -824,19 +885,38 @@ void FileStream::close() {
 }
 
 GBool FileStream::fillBuf() {
-  int n;
+  int n, bufSize;
 
+  // Reading on from a full buffer: the stream is read sequentially, use the
+  // larger window from now on
+  GBool sequential = bufEnd > buf;
   bufPos += bufEnd - buf;
+  if (sequential && !window) {
+    window = (char *)gmalloc(fileStreamWindowSize);
+    buf = window;
+  }
   bufPtr = bufEnd = buf;
+  bufSize = buf == window ? fileStreamWindowSize : fileStreamBufSize;
   if (limited && bufPos >= start + length) {
     return gFalse;
   }
-  if (limited && bufPos + fileStreamBufSize > start + length) {
+  if (limited && bufPos + bufSize > start + length) {
     n = start + length - bufPos;
   } else {
-    n = fileStreamBufSize;
+    n = bufSize;
   }
+#ifdef HAVE_UNISTD_H
+  // Read at the position of this stream: the substreams of a document share
+  // the position of the FILE, pread() doesn't use it.  Pipes can't be read
+  // at a position, they are read through the FILE.
+  ssize_t ret = pread(fileno(f), buf, n, (off_t)bufPos);
+  if (ret < 0 && errno == ESPIPE) {
+    ret = fread(buf, 1, n, f);
+  }
+  n = ret > 0 ? (int)ret : 0;
+#else
   n = fread(buf, 1, n, f);
+#endif
   bufEnd = buf + n;
   if (bufPtr >= bufEnd) {
     return gFalse;
@@ -889,6 +969,64 @@ void FileStream::moveStart(int delta) {
   bufPos = start;
 }
 
+Guint FileStream::copyTo(OutStream *outStr) {
+#ifdef HAVE_UNISTD_H
+  // Copy straight from the file descriptor, leaving the FILE position and
+  // buffer untouched, and fall back to reading through the buffer if the
+  // file isn't a regular file (e.g. a pipe). The file isn't mapped: a
+  // mapping of a file truncated by another process faults with SIGBUS,
+  // read errors only end the copy early.
+  int fd = fileno(f);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < (off_t)start) {
+    return BaseStream::copyTo(outStr);
+  }
+
+  Guint n = (Guint)(st.st_size - start);
+  if (limited && length < n) {
+    n = length;
+  }
+  Guint copied = 0;
+
+#if defined(__linux__) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+  // File to file: let the kernel copy the data without going through user space
+  FileOutStream *fileOutStr = dynamic_cast<FileOutStream *>(outStr);
+  if (fileOutStr && n > 0 && fflush(fileOutStr->getFile()) == 0) {
+    int outFd = fileno(fileOutStr->getFile());
+    off_t inOffset = start;
+    while (copied < n) {
+      ssize_t ret = copy_file_range(fd, &inOffset, outFd, NULL, n - copied, 0);
+      if (ret <= 0) {
+        break;
+      }
+      copied += ret;
+    }
+    // Resynchronize the FILE position with the descriptor
+    fseeko(fileOutStr->getFile(), lseek(outFd, 0, SEEK_CUR), SEEK_SET);
+  }
+#endif
+
+  // Not a file, or the kernel copy stopped halfway: copy the rest in large
+  // blocks with pread()
+  const size_t copyBufSize = 1024 * 1024;
+  char *copyBuf = copied < n ? (char *)gmalloc(copyBufSize) : NULL;
+  while (copied < n) {
+    size_t chunk = n - copied < copyBufSize ? n - copied : copyBufSize;
+    ssize_t ret = pread(fd, copyBuf, chunk, (off_t)start + copied);
+    if (ret <= 0) {
+      break;
+    }
+    outStr->write(copyBuf, (Guint)ret);
+    copied += ret;
+  }
+  gfree(copyBuf);
+  if (copied > 0 || n == 0) {
+    return copied;
+  }
+#endif
+  return BaseStream::copyTo(outStr);
+}
+
 //------------------------------------------------------------------------
 // CachedFileStream
 //------------------------------------------------------------------------
@@ -952,7 +1090,8 @@ GBool CachedFileStream::fillBuf()
   } else {
     n = cachedStreamBufSize - (bufPos % cachedStreamBufSize);
   }
-  cc->read(buf, 1, n);
+  // a chunk that can't be loaded ends the stream
+  n = cc->read(buf, 1, n);
   bufEnd = buf + n;
   if (bufPtr >= bufEnd) {
     return gFalse;
@@ -1067,6 +1206,153 @@ void MemStream::moveStart(int delta) {
   bufPtr = buf + start;
 }
 
+Guint MemStream::copyTo(OutStream *outStr) {
+  Guint n = (Guint)(bufEnd - (buf + start));
+  outStr->write(buf + start, n);
+  return n;
+}
+
+//------------------------------------------------------------------------
+// LoadedFileStream
+//------------------------------------------------------------------------
+
+struct LoadedFileStream::Contents {
+  char *data;
+  int refCnt;
+#if MULTITHREADED
+  GooMutex mutex;
+#endif
+};
+
+LoadedFileStream *LoadedFileStream::create(FILE *fA, Object *dictA) {
+  long size;
+
+  if (fseek(fA, 0, SEEK_END) != 0) {
+    return NULL;
+  }
+  size = ftell(fA);
+  if (size <= 0 || size > loadedFileMaxSize || fseek(fA, 0, SEEK_SET) != 0) {
+    return NULL;
+  }
+
+  char *data = (char *)gmalloc((int)size);
+  if (fread(data, 1, (size_t)size, fA) != (size_t)size) {
+    error(errIO, -1, "Couldn't read the file, reading it through a buffer");
+    gfree(data);
+    return NULL;
+  }
+
+  Contents *contentsA = new Contents;
+  contentsA->data = data;
+  contentsA->refCnt = 0;
+#if MULTITHREADED
+  gInitMutex(&contentsA->mutex);
+#endif
+  return new LoadedFileStream(contentsA, 0, (Guint)size, dictA);
+}
+
+LoadedFileStream::LoadedFileStream(Contents *contentsA, Guint startA, Guint lengthA, Object *dictA):
+    BaseStream(dictA, lengthA) {
+  contents = contentsA;
+#if MULTITHREADED
+  gLockMutex(&contents->mutex);
+#endif
+  ++contents->refCnt;
+#if MULTITHREADED
+  gUnlockMutex(&contents->mutex);
+#endif
+  buf = contents->data;
+  start = startA;
+  length = lengthA;
+  bufEnd = buf + start + length;
+  bufPtr = buf + start;
+}
+
+LoadedFileStream::~LoadedFileStream() {
+  int refCnt;
+
+#if MULTITHREADED
+  gLockMutex(&contents->mutex);
+#endif
+  refCnt = --contents->refCnt;
+#if MULTITHREADED
+  gUnlockMutex(&contents->mutex);
+#endif
+  if (refCnt == 0) {
+    gfree(contents->data);
+#if MULTITHREADED
+    gDestroyMutex(&contents->mutex);
+#endif
+    delete contents;
+  }
+}
+
+Stream *LoadedFileStream::makeSubStream(Guint startA, GBool limited,
+				  Guint lengthA, Object *dictA) {
+  Guint newLength;
+
+  if (startA > start + length) {
+    startA = start + length;
+  }
+  if (!limited || startA + lengthA > start + length) {
+    newLength = start + length - startA;
+  } else {
+    newLength = lengthA;
+  }
+  return new LoadedFileStream(contents, startA, newLength, dictA);
+}
+
+void LoadedFileStream::reset() {
+  bufPtr = buf + start;
+}
+
+void LoadedFileStream::close() {
+}
+
+int LoadedFileStream::getChars(int nChars, Guchar *buffer) {
+  int n;
+
+  if (nChars <= 0) {
+    return 0;
+  }
+  if (bufEnd - bufPtr < nChars) {
+    n = (int)(bufEnd - bufPtr);
+  } else {
+    n = nChars;
+  }
+  memcpy(buffer, bufPtr, n);
+  bufPtr += n;
+  return n;
+}
+
+void LoadedFileStream::setPos(Guint pos, int dir) {
+  Guint i;
+
+  if (dir >= 0) {
+    i = pos;
+  } else {
+    i = start + length - pos;
+  }
+  if (i < start) {
+    i = start;
+  } else if (i > start + length) {
+    i = start + length;
+  }
+  bufPtr = buf + i;
+}
+
+void LoadedFileStream::moveStart(int delta) {
+  start += delta;
+  length -= delta;
+  bufPtr = buf + start;
+}
+
+Guint LoadedFileStream::copyTo(OutStream *outStr) {
+  Guint n = (Guint)(bufEnd - (buf + start));
+  outStr->write(buf + start, n);
+  return n;
+}
+
 //------------------------------------------------------------------------
 // EmbedStream
 //------------------------------------------------------------------------
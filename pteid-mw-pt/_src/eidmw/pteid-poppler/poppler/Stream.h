@@ -257,6 +257,9 @@ public:
   // Put a char in the stream
   virtual void put (char c) = 0;
 
+  // Put len bytes in the stream
+  virtual void write (const char *data, Guint len);
+
   //FIXME
   // Printf-like function                         2,3 because the first arg is class instance ?
   virtual void printf (const char *format, ...) = 0 ; //__attribute__((format(printf, 2,3))) = 0;
@@ -269,12 +272,17 @@ private:
 class MemOutStream : public OutStream {
 	public:
 		MemOutStream(unsigned long initial_size);
+		// The data is meant to follow startA bytes that are not kept here, e.g. the original
+		// file of an incremental update: getPos() counts them but getData() and size() don't
+		MemOutStream(unsigned long initial_size, unsigned long startA);
 
 		void close() { };
 
-		int getPos() { return used; };
+		int getPos() { return start + used; };
+		unsigned long getStart() { return start; }
 
 		virtual void put (char c);
+		virtual void write (const char *data, Guint len);
 
 		~MemOutStream();
 		virtual void printf (const char *format, ...);
@@ -283,9 +291,13 @@ class MemOutStream : public OutStream {
 		unsigned int size() {return used;};
 
 	private:
+		// Grow the buffer so that it can hold len more bytes
+		void reserve(unsigned long len);
+
 		unsigned char *buffer;
 		unsigned long buffer_size;
 		unsigned long used;
+		unsigned long start;
 };
 		      
 
@@ -304,7 +316,11 @@ public:
 
   virtual void put (char c);
 
+  virtual void write (const char *data, Guint len);
+
   virtual void printf (const char *format, ...);
+
+  FILE *getFile() { return f; }
 private:
   FILE *f;
   Guint start;
@@ -337,6 +353,10 @@ public:
   virtual Guint getStart() = 0;
   virtual void moveStart(int delta) = 0;
 
+  // Copy the whole stream, from its start, to outStr without going through
+  // getChar().  Returns the number of bytes copied.
+  virtual Guint copyTo(OutStream *outStr);
+
 protected:
 
   Guint length;
@@ -458,7 +478,16 @@ private:
 // FileStream
 //------------------------------------------------------------------------
 
-#define fileStreamBufSize 256
+// The buffer sizes can be set at build time, a FileStream is created for
+// every object fetched so they shouldn't be much larger than a page.  A
+// FileStream that reads past its first buffer (content streams, images,
+// the copy of a save) switches to a window of fileStreamWindowSize.
+#ifndef fileStreamBufSize
+#define fileStreamBufSize 4096
+#endif
+#ifndef fileStreamWindowSize
+#define fileStreamWindowSize (256 * 1024)
+#endif
 
 class FileStream: public BaseStream {
 public:
@@ -479,6 +508,7 @@ public:
   virtual void setPos(Guint pos, int dir = 0);
   virtual Guint getStart() { return start; }
   virtual void moveStart(int delta);
+  virtual Guint copyTo(OutStream *outStr);
 
   virtual int getUnfilteredChar () { return getChar(); }
   virtual void unfilteredReset () { reset(); }
@@ -513,7 +543,9 @@ private:
   FILE *f;
   Guint start;
   GBool limited;
-  char buf[fileStreamBufSize];
+  char smallBuf[fileStreamBufSize];
+  char *window;			// allocated on the first read past smallBuf
+  char *buf;			// smallBuf or window
   char *bufPtr;
   char *bufEnd;
   Guint bufPos;
@@ -525,12 +557,14 @@ private:
 // CachedFileStream
 //------------------------------------------------------------------------
 
+#ifndef cachedStreamBufSize
 #define cachedStreamBufSize 1024
+#endif
 
 class CachedFileStream: public BaseStream {
 public:
 
-  CachedFileStream(CachedFile *ccA, Guint startA, GBool limitedA,
+  POPPLER_API CachedFileStream(CachedFile *ccA, Guint startA, GBool limitedA,
 	     Guint lengthA, Object *dictA);
   virtual ~CachedFileStream();
   virtual Stream *makeSubStream(Guint startA, GBool limitedA,
@@ -588,6 +622,7 @@ public:
   virtual void setPos(Guint pos, int dir = 0);
   virtual Guint getStart() { return start; }
   virtual void moveStart(int delta);
+  virtual Guint copyTo(OutStream *outStr);
 
   //if needFree = true, the stream will delete buf when it is destroyed
   //otherwise it will not touch it. Default value is false
@@ -608,6 +643,61 @@ private:
   GBool needFree;
 };
 
+//------------------------------------------------------------------------
+// LoadedFileStream
+//
+// Copy of a whole regular file read into memory once, read like a
+// MemStream.  Substreams share the copy, which is freed with the last
+// stream using it.  Unlike a memory mapping, a file truncated or
+// rewritten on disk while the document is open can't crash the process.
+// Files larger than loadedFileMaxSize are read through a FileStream.
+//------------------------------------------------------------------------
+
+#ifndef loadedFileMaxSize
+#define loadedFileMaxSize (16 * 1024 * 1024)
+#endif
+
+class LoadedFileStream: public BaseStream {
+public:
+
+  // Read the file open as fA, returns NULL if it is too large or can't be read
+  static LoadedFileStream *create(FILE *fA, Object *dictA);
+
+  virtual ~LoadedFileStream();
+  virtual Stream *makeSubStream(Guint startA, GBool limited,
+				Guint lengthA, Object *dictA);
+  virtual StreamKind getKind() { return strFile; }
+  virtual void reset();
+  virtual void close();
+  virtual int getChar()
+    { return (bufPtr < bufEnd) ? (*bufPtr++ & 0xff) : EOF; }
+  virtual int lookChar()
+    { return (bufPtr < bufEnd) ? (*bufPtr & 0xff) : EOF; }
+  virtual int getPos() { return (int)(bufPtr - buf); }
+  virtual void setPos(Guint pos, int dir = 0);
+  virtual Guint getStart() { return start; }
+  virtual void moveStart(int delta);
+  virtual Guint copyTo(OutStream *outStr);
+
+  virtual int getUnfilteredChar () { return getChar(); }
+  virtual void unfilteredReset () { reset (); }
+
+private:
+
+  struct Contents;
+
+  LoadedFileStream(Contents *contentsA, Guint startA, Guint lengthA, Object *dictA);
+
+  virtual GBool hasGetChars() { return true; }
+  virtual int getChars(int nChars, Guchar *buffer);
+
+  Contents *contents;
+  char *buf;
+  Guint start;
+  char *bufEnd;
+  char *bufPtr;
+};
+
 //------------------------------------------------------------------------
 // EmbedStream
 //
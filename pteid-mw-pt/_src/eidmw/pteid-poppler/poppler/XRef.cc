@@ -50,6 +50,12 @@
 #include "XRef.h"
 #include "PopplerCache.h"
 
+#include "Metrics.h"
+
+#include <algorithm>
+#include <mutex>
+#include <set>
+
 //------------------------------------------------------------------------
 // Permission bits
 // Note that the PDF spec uses 1 base (eg bit 3 is 1<<2)
@@ -109,6 +115,11 @@ class ObjectStreamKey : public PopplerCacheKey
       return objStrNum == k->objStrNum;
     }
 
+    unsigned int hash() const
+    {
+      return (unsigned int)objStrNum * 2654435761u;
+    }
+
     const int objStrNum;
 };
 
@@ -127,6 +138,41 @@ class ObjectStreamItem : public PopplerCacheItem
     ObjectStream *objStream;
 };
 
+// Number of decoded object streams kept by each XRef
+static std::atomic<int> objStrCacheSize(64);
+
+static eIDMW::CMetricCounter *objStrCacheLookups(bool hit) {
+  static eIDMW::CMetricCounter *hits = eIDMW::CMetrics::GetInstance()->GetCounter(
+      "pteid_pdf_object_stream_cache_lookups_total", "Lookups of decoded PDF object streams", "result=\"hit\"");
+  static eIDMW::CMetricCounter *misses = eIDMW::CMetrics::GetInstance()->GetCounter(
+      "pteid_pdf_object_stream_cache_lookups_total", "Lookups of decoded PDF object streams", "result=\"miss\"");
+  return hit ? hits : misses;
+}
+
+#if MULTITHREADED
+class XRefLocker {
+public:
+  XRefLocker(GooMutex *mutexA) : mutex(mutexA) { gLockMutex(mutex); }
+  ~XRefLocker() { gUnlockMutex(mutex); }
+private:
+  GooMutex *mutex;
+};
+#endif
+
+// XRefs alive, for releaseObjStrCaches(). Never destroyed so that XRefs
+// deleted by static destructors can still unregister
+struct LiveXRefs {
+  std::mutex mutex;
+  std::set<XRef *> xrefs;
+};
+
+static LiveXRefs &liveXRefs() {
+  static LiveXRefs *live = new LiveXRefs();
+  return *live;
+}
+
+static std::atomic<unsigned long long> fetchClock(0);
+
 ObjectStream::ObjectStream(XRef *xref, int objStrNumA) {
   Stream *str;
   Parser *parser;
@@ -264,7 +310,17 @@ void XRef::init() {
   size = 0;
   streamEnds = NULL;
   streamEndsLen = 0;
-  objStrs = new PopplerCache(5);
+  objStrs = new PopplerCache(objStrCacheSize);
+#if MULTITHREADED
+  // fetch() can be re-entered to resolve indirect stream lengths
+  gInitRecursiveMutex(&mutex);
+#endif
+  lastUse = 0;
+  {
+    LiveXRefs &live = liveXRefs();
+    std::lock_guard<std::mutex> lock(live.mutex);
+    live.xrefs.insert(this);
+  }
   mainXRefEntriesOffset = 0;
   xRefStream = gFalse;
   m_sig_dict_offset = 0;
@@ -362,6 +418,12 @@ XRef::XRef(BaseStream *strA, Guint pos, Guint mainXRefEntriesOffsetA, GBool *was
 }
 
 XRef::~XRef() {
+  {
+    LiveXRefs &live = liveXRefs();
+    std::lock_guard<std::mutex> lock(live.mutex);
+    live.xrefs.erase(this);
+  }
+
   for(int i=0; i<size; i++) {
       entries[i].obj.free ();
   }
@@ -374,6 +436,9 @@ XRef::~XRef() {
   if (objStrs) {
     delete objStrs;
   }
+#if MULTITHREADED
+  gDestroyMutex(&mutex);
+#endif
 }
 
 int XRef::reserve(int newSize)
@@ -987,10 +1052,41 @@ GBool XRef::okToAssemble(GBool ignoreOwnerPW) {
   return (!ignoreOwnerPW && ownerPasswordOk) || (permFlags & permAssemble);
 }
 
+void XRef::setObjStrCacheSize(int cacheSize) {
+  if (cacheSize > 0) {
+    objStrCacheSize = cacheSize;
+  }
+}
+
+int XRef::releaseObjStrCaches(size_t allocatedLimit) {
+  LiveXRefs &live = liveXRefs();
+  std::lock_guard<std::mutex> lock(live.mutex);
+  // The clocks keep changing while other threads fetch, sort a snapshot
+  std::vector<std::pair<unsigned long long, XRef *> > xrefs;
+  for (std::set<XRef *>::iterator it = live.xrefs.begin(); it != live.xrefs.end(); ++it)
+    xrefs.push_back(std::make_pair((*it)->lastUse.load(std::memory_order_relaxed), *it));
+  std::sort(xrefs.begin(), xrefs.end());
+
+  int released = 0;
+  for (size_t i = 0; i < xrefs.size() && gMemGetAllocated() > allocatedLimit; i++) {
+    XRef *xref = xrefs[i].second;
+#if MULTITHREADED
+    XRefLocker locker(&xref->mutex);
+#endif
+    released += xref->objStrs->numberOfItems();
+    xref->objStrs->clear();
+  }
+  return released;
+}
+
 Object *XRef::fetch(int num, int gen, Object *obj, int recursion) {
   XRefEntry *e;
   Parser *parser;
   Object obj1, obj2, obj3;
+#if MULTITHREADED
+  XRefLocker locker(&mutex);
+#endif
+  lastUse.store(++fetchClock, std::memory_order_relaxed);
 
   // check for bogus ref - this can happen in corrupted PDF files
   if (num < 0 || num >= size) {
@@ -1078,6 +1174,7 @@ Object *XRef::fetch(int num, int gen, Object *obj, int recursion) {
       ObjectStreamItem *it = static_cast<ObjectStreamItem *>(item);
       objStr = it->objStream;
     }
+    objStrCacheLookups(item != NULL)->Inc();
 
     if (!objStr) {
       objStr = new ObjectStream(this, e->offset);
@@ -1294,6 +1391,12 @@ void XRef::writeXRef(XRef::XRefWriter *writer, GBool writeAllEntries) {
   }
 }
 
+void XRef::addCompressed(int num, int objStrNum, int index) {
+  // Compressed entries keep the object stream number in offset and the index in gen, like readXRef()
+  add(num, index, objStrNum, gTrue);
+  getEntry(num)->type = xrefEntryCompressed;
+}
+
 XRef::XRefTableWriter::XRefTableWriter(OutStream* outStrA) {
   outStr = outStrA;
 }
@@ -1325,7 +1428,7 @@ void XRef::XRefStreamWriter::startSection(int first, int count) {
 
 void XRef::XRefStreamWriter::writeEntry(Guint offset, int gen, XRefEntryType type) {
   char data[7];
-  data[0] = (type==xrefEntryFree) ? 0 : 1;
+  data[0] = (type==xrefEntryFree) ? 0 : (type==xrefEntryCompressed) ? 2 : 1;
   data[1] = (offset >> 24) & 0xff;
   data[2] = (offset >> 16) & 0xff;
   data[3] = (offset >> 8) & 0xff;
@@ -38,6 +38,11 @@
 #include "goo/gtypes.h"
 #include "Object.h"
 
+#if MULTITHREADED
+#include "goo/GooMutex.h"
+#endif
+
+#include <atomic>
 #include <vector>
 
 class Dict;
@@ -109,8 +114,20 @@ public:
   // Get catalog object.
   Object *getCatalog(Object *obj) { return fetch(rootNum, rootGen, obj); }
 
-  // Fetch an indirect reference.
-  Object *fetch(int num, int gen, Object *obj, int recursion = 0);
+  // Fetch an indirect reference.  Can be called from several threads.  The
+  // streams it returns can be read from several threads when the document is
+  // a local file (LoadedFileStream or FileStream), not when it is remote: the
+  // substreams of a CachedFileStream share the position of the CachedFile.
+  POPPLER_API Object *fetch(int num, int gen, Object *obj, int recursion = 0);
+
+  // Number of decoded object streams cached by the XRefs created afterwards
+  // (64 by default).
+  static POPPLER_API void setObjStrCacheSize(int cacheSize);
+
+  // Release the decoded object streams of the least recently used XRefs
+  // until gMemGetAllocated() is within allocatedLimit. The XRefs stay usable,
+  // the streams are decoded again when needed. Returns the streams released.
+  static POPPLER_API int releaseObjStrCaches(size_t allocatedLimit);
 
   // Return the document's Info dictionary (if any).
   Object *getDocInfo(Object *obj);
@@ -140,6 +157,8 @@ public:
   void removeIndirectObject(Ref r);
   void removeEntry(XRefEntry * e);
   void add(int num, int gen,  Guint offs, GBool used);
+  // Add the entry of an object stored at index of the object stream objStrNum
+  void addCompressed(int num, int objStrNum, int index);
 
   // Output XRef table to stream
   void writeTableToFile(OutStream* outStr, GBool writeAllEntries);
@@ -168,6 +187,10 @@ private:
 				//   damaged files
   int streamEndsLen;		// number of valid entries in streamEnds
   PopplerCache *objStrs;	// cached object streams
+#if MULTITHREADED
+  GooMutex mutex;		// serializes fetch() so that readers can share the XRef
+#endif
+  std::atomic<unsigned long long> lastUse; // fetch() clock, orders releaseObjStrCaches()
   GBool encrypted;		// true if file is encrypted
   int encRevision;		
   int encVersion;		// encryption algorithm
@@ -8,9 +8,16 @@
 ****************************************************************************-*/
 
 #include <QString>
+#include <QDateTime>
 #include <QDir>
 #include <QFile>
 
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+
 #include <cjson/cJSON.h>
 
 #include "scapcache.h"
@@ -38,6 +45,30 @@ static QString get_attribute_cache_dir() { return get_cache_dir() + "/scap_attri
 
 static QString get_logo_cache_dir() { return get_cache_dir() + "/scap_logos/"; }
 
+/*
+	In-memory index of the attribute cache, one entry per cache file (i.e. per citizen document).
+	A file is only parsed again when its size or modification time changes so reading an unchanged
+	cache involves a directory listing and no JSON parsing. Attributes are also indexed by unique id
+	and provider for the lookups done when signing.
+*/
+struct CacheFileEntry {
+	QDateTime last_modified;
+	qint64 size;
+	std::vector<ScapAttribute> attributes;
+};
+
+struct CacheIndex {
+	QString cache_path;
+	std::map<QString, CacheFileEntry> files;
+	// All attributes in file name order and the positions of each attribute id and provider in it
+	std::vector<ScapAttribute> attributes;
+	std::unordered_map<std::string, std::vector<size_t>> by_id;
+	std::unordered_map<std::string, std::vector<size_t>> by_provider;
+};
+
+static std::mutex cache_index_mutex;
+static CacheIndex cache_index;
+
 static std::vector<ScapAttribute> deserialize_attributes(const std::string &response) {
 	std::vector<ScapAttribute> result;
 
@@ -231,12 +262,6 @@ static std::string serialize_attributes(const std::vector<ScapAttribute> &attrib
 			goto clean_up;
 		}
 
-		if (!provider.logo.empty()) {
-			if (!save_scap_image(provider.nipc, provider.logo)) {
-				MWLOG(LEV_ERROR, MOD_SCAP, "%s failed to save logo to cache", __FUNCTION__);
-			}
-		}
-
 		cJSON_AddItemToObject(citizen_attribute_obj, "attributeProviderInfo", provider_info);
 
 		attributes_array = cJSON_CreateArray();
@@ -335,45 +360,154 @@ static bool check_dir_readable(const QDir &dir) {
 	return is_readable;
 }
 
-ScapResult<std::vector<ScapAttribute>> load_cache() {
-	std::vector<ScapAttribute> result;
+static void rebuild_lookup_tables(CacheIndex &index) {
+	index.attributes.clear();
+	index.by_id.clear();
+	index.by_provider.clear();
+
+	for (const auto &file : index.files) {
+		for (const ScapAttribute &attribute : file.second.attributes) {
+			index.by_id[attribute.unique_id].push_back(index.attributes.size());
+			index.by_provider[attribute.provider.uriId].push_back(index.attributes.size());
+			index.attributes.push_back(attribute);
+		}
+	}
+}
+
+static void update_index_entry(CacheIndex &index, const QFileInfo &file_info, std::vector<ScapAttribute> attributes) {
+	CacheFileEntry &entry = index.files[file_info.fileName()];
+	entry.last_modified = file_info.lastModified();
+	entry.size = file_info.size();
+	entry.attributes = std::move(attributes);
+}
+
+// Caller must hold cache_index_mutex
+static ScapResult<void> refresh_cache_index() {
 	bool removed_legacy = false;
+	bool changed = false;
 
 	QString cache_path = get_attribute_cache_dir();
 	QDir cache_dir(cache_path);
 
+	if (cache_index.cache_path != cache_path) {
+		cache_index = CacheIndex();
+		cache_index.cache_path = cache_path;
+		changed = true;
+	}
+
 	if (QFileInfo::exists(cache_path) && !check_dir_readable(cache_dir)) {
 		std::string cache_path_str = cache_path.toStdString();
 		MWLOG(LEV_ERROR, MOD_SCAP, "%s cache dir not readable: %s", __FUNCTION__, cache_path_str.c_str());
 		return ScapError::cache_read_failure;
 	}
 
-	QStringList file_list = cache_dir.entryList(QStringList({"*.json", "*.xml"}), QDir::Files | QDir::NoSymLinks);
-	foreach (QString cache_file_name, file_list) {
-		QFile cache_file(get_attribute_cache_dir() + cache_file_name);
+	QFileInfoList file_list =
+		cache_dir.entryInfoList(QStringList({"*.json", "*.xml"}), QDir::Files | QDir::NoSymLinks, QDir::Name);
+
+	// Drop the files that no longer exist
+	std::set<QString> listed_files;
+	foreach (QFileInfo file_info, file_list) {
+		listed_files.insert(file_info.fileName());
+	}
+	for (auto it = cache_index.files.begin(); it != cache_index.files.end();) {
+		if (listed_files.count(it->first)) {
+			++it;
+		} else {
+			it = cache_index.files.erase(it);
+			changed = true;
+		}
+	}
+
+	foreach (QFileInfo file_info, file_list) {
+		if (file_info.completeSuffix() != "json") {
+			removed_legacy = QFile::remove(file_info.absoluteFilePath()) || removed_legacy;
+			continue;
+		}
+
+		auto it = cache_index.files.find(file_info.fileName());
+		if (it != cache_index.files.end() && it->second.last_modified == file_info.lastModified() &&
+			it->second.size == file_info.size()) {
+			continue;
+		}
+
+		QFile cache_file(file_info.absoluteFilePath());
 		if (!cache_file.open(QIODevice::ReadOnly)) {
 			MWLOG(LEV_ERROR, MOD_SCAP, "%s failed to open cache file", __FUNCTION__);
 			return ScapError::cache_read_failure;
 		}
 
-		QFileInfo file_info(cache_file);
-		if (file_info.completeSuffix() == "json") {
-			std::string cache_file_content = cache_file.readAll().constData();
-			std::vector<ScapAttribute> attributes = deserialize_attributes(cache_file_content);
-			result.insert(result.end(), attributes.begin(), attributes.end());
-		} else {
-			removed_legacy = cache_file.remove() || removed_legacy;
-		}
+		std::string cache_file_content = cache_file.readAll().constData();
+		update_index_entry(cache_index, file_info, deserialize_attributes(cache_file_content));
+		changed = true;
+	}
+
+	if (changed) {
+		rebuild_lookup_tables(cache_index);
 	}
 
 	if (removed_legacy) {
 		return ScapError::cache_removed_legacy;
 	}
 
+	return {};
+}
+
+ScapResult<std::vector<ScapAttribute>> load_cache() {
+	std::lock_guard<std::mutex> lock(cache_index_mutex);
+
+	const auto refresh_result = refresh_cache_index();
+	if (refresh_result.is_error()) {
+		return refresh_result.error();
+	}
+
+	return cache_index.attributes;
+}
+
+static std::vector<ScapAttribute> find_in_index(const std::unordered_map<std::string, std::vector<size_t>> &lookup,
+												const std::vector<std::string> &keys) {
+	std::vector<size_t> positions;
+	for (const std::string &key : keys) {
+		auto it = lookup.find(key);
+		if (it != lookup.end()) {
+			positions.insert(positions.end(), it->second.begin(), it->second.end());
+		}
+	}
+
+	// Keep the cache order and skip keys that were requested more than once
+	std::sort(positions.begin(), positions.end());
+	positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+
+	std::vector<ScapAttribute> result;
+	for (size_t position : positions) {
+		result.push_back(cache_index.attributes[position]);
+	}
+
 	return result;
 }
 
-static std::vector<ScapAttribute> merge_attributes(std::vector<ScapAttribute> &dirty,
+ScapResult<std::vector<ScapAttribute>> find_cached_attributes(const std::vector<std::string> &unique_ids) {
+	std::lock_guard<std::mutex> lock(cache_index_mutex);
+
+	const auto refresh_result = refresh_cache_index();
+	if (refresh_result.is_error() && refresh_result.error() != ScapError::cache_removed_legacy) {
+		return refresh_result.error();
+	}
+
+	return find_in_index(cache_index.by_id, unique_ids);
+}
+
+ScapResult<std::vector<ScapAttribute>> find_cached_attributes_by_provider(const std::string &provider_uri) {
+	std::lock_guard<std::mutex> lock(cache_index_mutex);
+
+	const auto refresh_result = refresh_cache_index();
+	if (refresh_result.is_error() && refresh_result.error() != ScapError::cache_removed_legacy) {
+		return refresh_result.error();
+	}
+
+	return find_in_index(cache_index.by_provider, {provider_uri});
+}
+
+static std::vector<ScapAttribute> merge_attributes(const std::vector<ScapAttribute> &dirty,
 												   std::vector<ScapAttribute> &fresh) {
 	for (const ScapAttribute &dirty_attribute : dirty)
 		if (dirty_attribute.citizen_name == fresh.front().citizen_name &&
@@ -383,12 +517,27 @@ static std::vector<ScapAttribute> merge_attributes(std::vector<ScapAttribute> &d
 	return fresh; // attributes to be saved
 }
 
+// Caller must hold cache_index_mutex
 static std::vector<ScapAttribute> handle_cache(const std::string &response) {
 	std::vector<ScapAttribute> attributes = deserialize_attributes(response);
+	if (attributes.empty()) {
+		return attributes;
+	}
+
+	// The logos of the providers in the response may have changed: they are generated again on first use
+	for (const ScapAttribute &attribute : attributes) {
+		remove_scap_image(attribute.provider.nipc);
+	}
 
 	// perform cache logic here -> merge attributes etc...
-	std::vector<ScapAttribute> dirty_attributes = load_cache().data();
-	std::vector<ScapAttribute> result = merge_attributes(dirty_attributes, attributes);
+	const auto refresh_result = refresh_cache_index();
+	if (refresh_result.is_error() && refresh_result.error() != ScapError::cache_removed_legacy) {
+		// The index may be stale: only the attributes of this response are saved
+		MWLOG(LEV_WARN, MOD_SCAP, "%s failed to read the attribute cache: %d. Previous attributes are not merged.",
+			  __FUNCTION__, (int)refresh_result.error());
+		return attributes;
+	}
+	std::vector<ScapAttribute> result = merge_attributes(cache_index.attributes, attributes);
 
 	return result;
 }
@@ -403,10 +552,21 @@ bool cache_response(const std::string &response, const std::string &id, std::vec
 		return false;
 	}
 
+	std::lock_guard<std::mutex> lock(cache_index_mutex);
+
 	std::vector<ScapAttribute> to_be_saved = handle_cache(response);
 	out_attributes = to_be_saved;
 
-	return save_cache(serialize_attributes(to_be_saved), id);
+	if (!save_cache(serialize_attributes(to_be_saved), id)) {
+		return false;
+	}
+
+	// Partial update of the index: only the file of this citizen document changed
+	QFileInfo file_info(cache_path + id.c_str() + ".json");
+	update_index_entry(cache_index, file_info, to_be_saved);
+	rebuild_lookup_tables(cache_index);
+
+	return true;
 }
 
 static bool clear_files_in_dir(QDir &dir, const std::string &file_filter) {
@@ -426,6 +586,9 @@ static bool clear_files_in_dir(QDir &dir, const std::string &file_filter) {
 }
 
 bool clear_cache() {
+	std::lock_guard<std::mutex> lock(cache_index_mutex);
+	cache_index = CacheIndex();
+
 	QDir attributes_dir(get_attribute_cache_dir());
 	QDir logos_dir(get_logo_cache_dir());
 
@@ -19,7 +19,13 @@ bool cache_response(const std::string &response, const std::string &id, std::vec
 ScapResult<std::vector<ScapAttribute>> load_cache();
 bool clear_cache();
 
+/* Lookups in the cached attributes, results are in cache order */
+ScapResult<std::vector<ScapAttribute>> find_cached_attributes(const std::vector<std::string> &unique_ids);
+ScapResult<std::vector<ScapAttribute>> find_cached_attributes_by_provider(const std::string &provider_uri);
+
 bool save_scap_image(const std::string &provider_id, const std::string &b64_scap_logo);
+bool remove_scap_image(const std::string &provider_id);
+/* The logo file is generated from the cached attributes on first use */
 QString get_scap_image_path(const std::vector<ScapAttribute> &attributes);
 QByteArray get_scap_image_data(const std::vector<ScapAttribute> &attributes);
 
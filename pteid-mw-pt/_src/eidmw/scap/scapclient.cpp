@@ -14,6 +14,7 @@
 #include <QDateTime>
 #include <QImage>
 
+#include <algorithm>
 #include <regex>
 
 #include "scapclient.h"
@@ -547,6 +548,31 @@ ScapClient::ScapClient(const ScapCredentials &credentials) {
 	m_oauth = NULL;
 }
 
+/*
+	Cancellation flag of one getCitizenAttributes() or sign() call, registered with the client while the call
+	is in progress. cancelOAuth() sets the flags of all the calls in progress, so a call that starts afterwards
+	doesn't clear the cancellation of another one.
+*/
+class ScapClient::CancelToken {
+public:
+	CancelToken(ScapClient &client) : m_client(client), m_cancelled(false) {
+		std::lock_guard<std::mutex> lock(m_client.m_cancel_mutex);
+		m_client.m_cancel_tokens.push_back(&m_cancelled);
+	}
+
+	~CancelToken() {
+		std::lock_guard<std::mutex> lock(m_client.m_cancel_mutex);
+		std::vector<std::atomic<bool> *> &tokens = m_client.m_cancel_tokens;
+		tokens.erase(std::remove(tokens.begin(), tokens.end(), &m_cancelled), tokens.end());
+	}
+
+	const std::atomic<bool> *cancelled() const { return &m_cancelled; }
+
+private:
+	ScapClient &m_client;
+	std::atomic<bool> m_cancelled;
+};
+
 static ScapError map_perform_error(const unsigned long error) {
 	switch (error) {
 	case CURL_PERFORM_ERROR:
@@ -653,6 +679,7 @@ ScapResult<std::vector<ScapAttribute>> ScapClient::getCitizenAttributes(PTEID_EI
 	if (missing_credentials(m_scap_credentials)) {
 		return ScapError::bad_credentials;
 	}
+	CancelToken cancel_token(*this);
 
 	CURL *curl = NULL;
 	std::unique_ptr<SSLConnection> connection;
@@ -706,7 +733,11 @@ ScapResult<std::vector<ScapAttribute>> ScapClient::getCitizenAttributes(PTEID_EI
 	second_request.endpoint = "/SCAPAttributeService/getCitizenAttributesResponse";
 	second_request.body = create_fetch_attributes_body(process_id);
 
-	ScapResponse second_response = perform_polling_request(m_scap_credentials, second_request);
+	ScapResponse second_response = perform_polling_request(m_scap_credentials, second_request, cancel_token.cancelled());
+	if (second_response.status == POLLING_CANCELED_ERROR) {
+		MWLOG(LEV_ERROR, MOD_SCAP, "getCitizenAttributesResponse polling cancelled by user.");
+		return ScapError::oauth_cancelled;
+	}
 	if (second_response.status != SCAP_OK) {
 		MWLOG(LEV_ERROR, MOD_SCAP, "getCitizenAttributesResponse polling request failed: %d", second_response.status);
 		return map_perform_error(second_response.status);
@@ -777,6 +808,7 @@ ScapResult<void> ScapClient::sign(PTEID_SigningDevice *device, const PDFSignatur
 	if (missing_credentials(m_scap_credentials)) {
 		return ScapError::bad_credentials;
 	}
+	CancelToken cancel_token(*this);
 
 	if (!device) {
 		MWLOG(LEV_ERROR, MOD_SCAP, "%s NULL pointer to signing device.", __FUNCTION__);
@@ -894,7 +926,13 @@ ScapResult<void> ScapClient::sign(PTEID_SigningDevice *device, const PDFSignatur
 		get_signed_hash_request.endpoint = "/SCAPSignatureService/getSignHashResult";
 		get_signed_hash_request.body = create_get_signed_hash_body(process_id, transaction);
 
-		ScapResponse get_signed_hash_response = perform_polling_request(m_scap_credentials, get_signed_hash_request);
+		ScapResponse get_signed_hash_response =
+			perform_polling_request(m_scap_credentials, get_signed_hash_request, cancel_token.cancelled());
+		if (get_signed_hash_response.status == POLLING_CANCELED_ERROR) {
+			MWLOG(LEV_ERROR, MOD_SCAP, "getSignHashResult polling cancelled by user.");
+			clean_up_temp_documents(documents);
+			return ScapError::sign_cancel;
+		}
 		if (get_signed_hash_response.status != SCAP_OK) {
 			MWLOG(LEV_ERROR, MOD_SCAP, "getSignHashResult failed with error: %d", get_signed_hash_response.status);
 			clean_up_temp_documents(documents);
@@ -932,6 +970,11 @@ ScapResult<void> ScapClient::sign(PTEID_SigningDevice *device, const PDFSignatur
 }
 
 void ScapClient::cancelOAuth() {
+	{
+		std::lock_guard<std::mutex> lock(m_cancel_mutex);
+		for (std::atomic<bool> *cancelled : m_cancel_tokens)
+			*cancelled = true;
+	}
 	if (m_oauth)
 		m_oauth->closeListener();
 }
@@ -9,7 +9,10 @@
 
 #pragma once
 
+#include <atomic>
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 
 #include "eidlib.h"
 #include "scaperrors.h"
@@ -90,11 +93,18 @@ public:
 	static ScapResult<std::vector<ScapAttribute>> readAttributeCache();
 	static bool clearAttributeCache();
 
+	/**
+	 * Cancel the OAuth authentication and any SCAP polling in progress.
+	 **/
 	void cancelOAuth();
 
 private:
+	class CancelToken;
+
 	ScapCredentials m_scap_credentials;
 	OAuthAttributes *m_oauth;
+	std::mutex m_cancel_mutex; // protects m_cancel_tokens
+	std::vector<std::atomic<bool> *> m_cancel_tokens; // one per operation in progress
 };
 
 struct ScapProviderHasher {
@@ -105,15 +105,22 @@ bool save_scap_image(const std::string &provider_id, const std::string &b64_imag
 	return true;
 }
 
-static std::string get_provider_with_logo(const std::vector<ScapAttribute> &attributes) {
-	std::string result;
+bool remove_scap_image(const std::string &provider_id) {
+	QString cache_path(get_logos_cache_path());
+	cache_path += get_unique_image_filename(provider_id);
+
+	return !QFile::exists(cache_path) || QFile::remove(cache_path);
+}
+
+static const ScapProvider *get_provider_with_logo(const std::vector<ScapAttribute> &attributes) {
+	const ScapProvider *result = NULL;
 	for (const auto &attribute : attributes) {
 		if (!attribute.provider.logo.empty()) {
-			if (!result.empty() && result != attribute.provider.nipc) {
-				// more than one provider has logo, return empty string
-				return {};
+			if (result && result->nipc != attribute.provider.nipc) {
+				// more than one provider has logo, return NULL
+				return NULL;
 			}
-			result = attribute.provider.nipc;
+			result = &attribute.provider;
 		}
 	}
 
@@ -121,15 +128,16 @@ static std::string get_provider_with_logo(const std::vector<ScapAttribute> &attr
 }
 
 QString get_scap_image_path(const std::vector<ScapAttribute> &attributes) {
-	std::string provider_id = get_provider_with_logo(attributes);
-	if (provider_id.empty()) {
+	const ScapProvider *provider = get_provider_with_logo(attributes);
+	if (!provider) {
 		return {};
 	}
 
 	QString cache_path(get_logos_cache_path());
-	cache_path += get_unique_image_filename(provider_id);
+	cache_path += get_unique_image_filename(provider->nipc);
 
-	if (!QFile::exists(cache_path)) {
+	if (!QFile::exists(cache_path) && !save_scap_image(provider->nipc, provider->logo)) {
+		MWLOG(LEV_ERROR, MOD_SCAP, "%s failed to save logo to cache", __FUNCTION__);
 		return {};
 	}
 
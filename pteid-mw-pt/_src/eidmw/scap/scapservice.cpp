@@ -12,6 +12,9 @@
 #include <thread>
 #include <ctime>
 #include <algorithm>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <sstream>
 
 #include <cjson/cJSON.h>
@@ -35,13 +38,16 @@ static size_t curl_write_data(char *data, size_t size, size_t nmemb, void *read_
 	return size * nmemb;
 }
 
-static std::string parse_date_header(const std::string &headers) {
-	const std::string to_find = "Date: ";
-	std::istringstream date_header_stream(headers);
+// Header names are case-insensitive (HTTP/2 servers send them in lowercase)
+static std::string parse_header(const std::string &headers, const std::string &name) {
+	const std::string to_find = name + ": ";
+	std::istringstream header_stream(headers);
 
 	std::string line;
-	while (std::getline(date_header_stream, line)) {
-		if (line.rfind(to_find, 0) == 0) {
+	while (std::getline(header_stream, line)) {
+		if (line.size() >= to_find.size() &&
+			std::equal(to_find.begin(), to_find.end(), line.begin(),
+					   [](char a, char b) { return tolower((unsigned char)a) == tolower((unsigned char)b); })) {
 			return line.substr(to_find.size());
 		}
 	}
@@ -49,17 +55,30 @@ static std::string parse_date_header(const std::string &headers) {
 	return "";
 }
 
+static std::string scap_test_host;
+static std::string scap_test_port;
+
+void set_scap_test_server(const std::string &host, const std::string &port) {
+	scap_test_host = host;
+	scap_test_port = port;
+}
+
 static CURLU *set_url(ScapSettings &settings, const std::string &endpoint, const std::vector<std::string> &queries) {
 	CURLU *url = curl_url();
 
 	std::string host = "https://" + settings.getScapServerHost();
+	std::string port = settings.getScapServerPort();
+	if (!scap_test_host.empty()) {
+		host = scap_test_host;
+		port = scap_test_port;
+	}
 
 	if (curl_url_set(url, CURLUPART_URL, host.c_str(), 0) != CURLUE_OK) {
 		MWLOG(LEV_ERROR, MOD_SCAP, "%s failed to set url: %s", __FUNCTION__, host.c_str());
 		return NULL;
 	}
 
-	if (curl_url_set(url, CURLUPART_PORT, settings.getScapServerPort().c_str(), 0) != CURLUE_OK) {
+	if (curl_url_set(url, CURLUPART_PORT, port.c_str(), 0) != CURLUE_OK) {
 		MWLOG(LEV_ERROR, MOD_SCAP, "%s failed to set port.", __FUNCTION__);
 		return NULL;
 	}
@@ -79,58 +98,59 @@ static CURLU *set_url(ScapSettings &settings, const std::string &endpoint, const
 	return url;
 }
 
-ScapResponse perform_request(const ScapCredentials &credentials, const ScapRequest &request, CURL *curl) {
-	ScapResponse response;
-	response.status = 0;
+/*
+	State of one HTTP exchange. It must stay alive until the transfer completes
+	as curl keeps pointers to the url, headers and buffers set in setup_transfer().
+*/
+struct ScapTransfer {
+	ScapTransfer() : url(NULL), header_list(NULL), using_proxy(false) {
+		error_buffer[0] = 0;
+		response.status = 0;
+	}
+	~ScapTransfer() {
+		curl_url_cleanup(url);
+		curl_slist_free_all(header_list);
+	}
 
-	CURLcode ret;
-	CURLU *url = NULL;
-	char error_buffer[CURL_ERROR_SIZE] = {0};
-	struct curl_slist *header_list = NULL;
+	CURLU *url;
+	struct curl_slist *header_list;
+	char error_buffer[CURL_ERROR_SIZE];
 	std::string received_header_data;
+	std::string cacerts_location;
+	bool using_proxy;
+	ScapResponse response;
+};
+
+static bool setup_transfer(CURL *curl, const ScapCredentials &credentials, const ScapRequest &request,
+						   ScapTransfer &transfer) {
 	ScapSettings settings;
 	std::string partial_url = "https://" + settings.getScapServerHost();
-	bool using_proxy = false;
 	APL_Config conf_certsdir(CConfig::EIDMW_CONFIG_PARAM_GENERAL_CERTS_DIR);
-	std::string cacerts_location = std::string(conf_certsdir.getString()) + "/cacerts.pem";
+	transfer.cacerts_location = std::string(conf_certsdir.getString()) + "/cacerts.pem";
 
-	// curl handle is always NULL here except when loading attributes with card
-	// as it is the only request with client certificate authentication
-	if (curl == NULL) {
-		curl_global_init(CURL_GLOBAL_NOTHING);
-		if ((curl = curl_easy_init()) == NULL) {
-			MWLOG(LEV_ERROR, MOD_SCAP, "%s curl_easy_init() failed", __FUNCTION__);
-			response.status = CURL_GENERIC_ERROR;
-			goto clean_up;
-		}
-		/* For a request with client certificate authentication we can't set a low connect timeout
-		   as the time for auth PIN introduction is included in the SSL "connect" phase */
-		curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 5L);
-	}
-
-	if ((url = set_url(settings, request.endpoint, request.get_parameters)) == NULL) {
+	if ((transfer.url = set_url(settings, request.endpoint, request.get_parameters)) == NULL) {
 		MWLOG(LEV_ERROR, MOD_SCAP, "%s failed to set url", __FUNCTION__);
-		response.status = CURL_GENERIC_ERROR;
-		goto clean_up;
+		transfer.response.status = CURL_GENERIC_ERROR;
+		return false;
 	}
 
 	if (!request.body.empty()) {
 		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request.body.c_str());
 		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, request.body.size());
-		header_list = curl_slist_append(header_list, "Content-Type: application/json");
+		transfer.header_list = curl_slist_append(transfer.header_list, "Content-Type: application/json");
 	}
 
 	for (const std::string &header : request.headers) {
-		header_list = curl_slist_append(header_list, header.c_str());
+		transfer.header_list = curl_slist_append(transfer.header_list, header.c_str());
 	}
 
-	if (header_list) {
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
+	if (transfer.header_list) {
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer.header_list);
 	}
 
 	curl_easy_setopt(curl, CURLOPT_USERAGENT, PTEID_USER_AGENT_VALUE);
 
-	curl_easy_setopt(curl, CURLOPT_CURLU, url);
+	curl_easy_setopt(curl, CURLOPT_CURLU, transfer.url);
 	// Maximum time the transfer is allowed to complete
 	curl_easy_setopt(curl, CURLOPT_TIMEOUT, 60L);
 
@@ -141,51 +161,81 @@ ScapResponse perform_request(const ScapCredentials &credentials, const ScapReque
 	curl_easy_setopt(curl, CURLOPT_USERNAME, credentials.basic_user.c_str());
 	curl_easy_setopt(curl, CURLOPT_PASSWORD, credentials.basic_pass.c_str());
 
-	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error_buffer);
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, transfer.error_buffer);
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &curl_write_data);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response.response);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer.response.response);
 
 	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &curl_write_data);
-	curl_easy_setopt(curl, CURLOPT_HEADERDATA, &received_header_data);
+	curl_easy_setopt(curl, CURLOPT_HEADERDATA, &transfer.received_header_data);
 
-	curl_easy_setopt(curl, CURLOPT_CAINFO, cacerts_location.c_str());
+	curl_easy_setopt(curl, CURLOPT_CAINFO, transfer.cacerts_location.c_str());
 
-	using_proxy = applyProxyConfigToCurl(curl, partial_url.c_str());
+	transfer.using_proxy = applyProxyConfigToCurl(curl, partial_url.c_str());
 
-	try {
-		ret = curl_easy_perform(curl);
-	} catch (CMWException &e) {
-		if (e.GetError() == EIDMW_ERR_PIN_CANCEL) {
-			response.status = SSL_PIN_CANCELED_ERROR;
-		} else {
-			response.status = CURL_GENERIC_ERROR;
-		}
-		goto clean_up;
-	}
+	return true;
+}
 
+static void finish_transfer(CURL *curl, CURLcode ret, const ScapRequest &request, ScapTransfer &transfer) {
 	if (ret != CURLE_OK) {
 		MWLOG(LEV_ERROR, MOD_SCAP, "Error on request %s. Libcurl returned %s\n", request.endpoint.c_str(),
-			  error_buffer);
+			  transfer.error_buffer);
 
 		long auth = 0;
 		if (!curl_easy_getinfo(curl, CURLINFO_PROXYAUTH_AVAIL, &auth) && auth) {
-			response.status = PROXY_AUTH_REQUIRED;
-		} else if (using_proxy) {
-			response.status = POSSIBLE_PROXY_ERROR;
+			transfer.response.status = PROXY_AUTH_REQUIRED;
+		} else if (transfer.using_proxy) {
+			transfer.response.status = POSSIBLE_PROXY_ERROR;
 		} else {
-			response.status = CURL_PERFORM_ERROR;
+			transfer.response.status = CURL_PERFORM_ERROR;
+		}
+		return;
+	}
+
+	long response_code = 0;
+	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+	transfer.response.status = response_code;
+
+	transfer.response.server_time = parse_header(transfer.received_header_data, "Date");
+}
+
+ScapResponse perform_request(const ScapCredentials &credentials, const ScapRequest &request, CURL *curl) {
+	ScapTransfer transfer;
+	CURLcode ret;
+
+	// curl handle is always NULL here except when loading attributes with card
+	// as it is the only request with client certificate authentication
+	if (curl == NULL) {
+		curl_global_init(CURL_GLOBAL_NOTHING);
+		if ((curl = curl_easy_init()) == NULL) {
+			MWLOG(LEV_ERROR, MOD_SCAP, "%s curl_easy_init() failed", __FUNCTION__);
+			transfer.response.status = CURL_GENERIC_ERROR;
+			goto clean_up;
 		}
+		/* For a request with client certificate authentication we can't set a low connect timeout
+		   as the time for auth PIN introduction is included in the SSL "connect" phase */
+		curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 5L);
+	}
+
+	if (!setup_transfer(curl, credentials, request, transfer)) {
 		goto clean_up;
 	}
 
-	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.status);
+	try {
+		ret = curl_easy_perform(curl);
+	} catch (CMWException &e) {
+		if (e.GetError() == EIDMW_ERR_PIN_CANCEL) {
+			transfer.response.status = SSL_PIN_CANCELED_ERROR;
+		} else {
+			transfer.response.status = CURL_GENERIC_ERROR;
+		}
+		goto clean_up;
+	}
 
-	response.server_time = parse_date_header(received_header_data);
+	finish_transfer(curl, ret, request, transfer);
 
 clean_up:
-	curl_url_cleanup(url);
 	curl_easy_cleanup(curl);
-	return response;
+	return transfer.response;
 }
 
 static cJSON *get_status_json_object(cJSON *&out_json, const std::string &response) {
@@ -232,34 +282,234 @@ std::string get_response_code_description(const std::string &response) {
 	return result;
 }
 
-ScapResponse perform_polling_request(const ScapCredentials &credentials, const ScapRequest &request) {
-	// polling must start 5 second after first request. polling every 2 seconds, max of 50 seconds
+// Delay of the first poll after the request that started the SCAP process, doubled after each poll
+#define POLLING_INITIAL_DELAY_MS 500
+#define POLLING_MAX_DELAY_MS 4000
+// The SCAP services give up on the process after 60 seconds
+#define POLLING_TIMEOUT_MS 55000
+// Upper bound on the time to notice a cancellation
+#define POLLING_CANCEL_CHECK_MS 100
+
+/*
+	Polls the SCAP "get result" endpoints until the process is no longer in progress.
+	All outstanding polls are multiplexed over one worker thread and one curl multi handle
+	so that they share its connection cache. The worker thread exits when there is nothing to poll.
+	The interval between polls grows exponentially unless the server sends a Retry-After header.
+*/
+class ScapPollingScheduler {
+public:
+	static ScapPollingScheduler &instance() {
+		// Never deleted: the worker thread may still be running at exit
+		static ScapPollingScheduler *scheduler = new ScapPollingScheduler();
+		return *scheduler;
+	}
+
+	ScapResponse poll(const ScapCredentials &credentials, const ScapRequest &request,
+					  const std::atomic<bool> *cancelled);
+
+private:
+	struct Job {
+		ScapCredentials credentials;
+		ScapRequest request;
+		const std::atomic<bool> *cancelled;
+		CURL *curl;
+		std::unique_ptr<ScapTransfer> transfer;
+		std::chrono::steady_clock::time_point start;
+		std::chrono::steady_clock::time_point next_attempt;
+		std::chrono::milliseconds delay;
+		bool in_flight;
+		bool done;
+		ScapResponse response;
+		std::promise<ScapResponse> result;
+	};
+
+	ScapPollingScheduler() : m_running(false) {
+		curl_global_init(CURL_GLOBAL_NOTHING);
+		m_multi = curl_multi_init();
+	}
 
-	ScapResponse response;
-	unsigned int inner_status = 0;
-	time_t start = time(NULL);
-	std::this_thread::sleep_for(std::chrono::seconds(3));
+	void run();
+	void startAttempt(Job &job);
+	void completeAttempt(Job &job, CURLcode ret);
+	void finish(Job &job);
 
-	do {
-		std::this_thread::sleep_for(std::chrono::seconds(2));
+	CURLM *m_multi;
+	std::mutex m_mutex; // protects m_submitted and m_running
+	std::vector<std::shared_ptr<Job>> m_submitted;
+	bool m_running;
+};
 
-		ScapResponse temp_response = perform_request(credentials, request);
-		if (temp_response.status != 200) {
-			MWLOG(LEV_ERROR, MOD_SCAP, "%s polling request failed: %d", __FUNCTION__, temp_response.status);
-			inner_status = 0;
+ScapResponse ScapPollingScheduler::poll(const ScapCredentials &credentials, const ScapRequest &request,
+										 const std::atomic<bool> *cancelled) {
+	if (m_multi == NULL) {
+		MWLOG(LEV_ERROR, MOD_SCAP, "%s curl_multi_init() failed", __FUNCTION__);
+		ScapResponse response;
+		response.status = CURL_GENERIC_ERROR;
+		return response;
+	}
+
+	std::shared_ptr<Job> job = std::make_shared<Job>();
+	job->credentials = credentials;
+	job->request = request;
+	job->cancelled = cancelled;
+	job->curl = NULL;
+	job->start = std::chrono::steady_clock::now();
+	job->delay = std::chrono::milliseconds(POLLING_INITIAL_DELAY_MS);
+	job->next_attempt = job->start + job->delay;
+	job->in_flight = false;
+	job->done = false;
+	job->response.status = 0;
+	std::future<ScapResponse> result = job->result.get_future();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_submitted.push_back(job);
+		if (!m_running) {
+			m_running = true;
+			std::thread(&ScapPollingScheduler::run, this).detach();
 		} else {
-			inner_status = get_response_status(temp_response.response);
-			if (inner_status == 404) {
-				MWLOG(LEV_DEBUG, MOD_SCAP, "Possibly reached polling time limit. Got incomplete response.");
-				break;
+			curl_multi_wakeup(m_multi);
+		}
+	}
+
+	return result.get();
+}
+
+void ScapPollingScheduler::run() {
+	std::vector<std::shared_ptr<Job>> jobs;
+
+	while (true) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			jobs.insert(jobs.end(), m_submitted.begin(), m_submitted.end());
+			m_submitted.clear();
+			if (jobs.empty()) {
+				m_running = false;
+				return;
 			}
 		}
 
-		response = temp_response;
+		auto now = std::chrono::steady_clock::now();
+		std::chrono::milliseconds wait(POLLING_CANCEL_CHECK_MS);
+		for (const std::shared_ptr<Job> &job : jobs) {
+			if (job->cancelled && *job->cancelled) {
+				MWLOG(LEV_DEBUG, MOD_SCAP, "Polling %s cancelled", job->request.endpoint.c_str());
+				if (job->in_flight)
+					curl_multi_remove_handle(m_multi, job->curl);
+				job->response = ScapResponse();
+				job->response.status = POLLING_CANCELED_ERROR;
+				finish(*job);
+			} else if (!job->in_flight) {
+				if (now >= job->next_attempt) {
+					startAttempt(*job);
+				} else {
+					wait = std::min(wait,
+									std::chrono::duration_cast<std::chrono::milliseconds>(job->next_attempt - now));
+				}
+			}
+		}
+
+		int running = 0;
+		curl_multi_perform(m_multi, &running);
+
+		CURLMsg *msg = NULL;
+		int msgs_left = 0;
+		while ((msg = curl_multi_info_read(m_multi, &msgs_left)) != NULL) {
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+
+			CURL *curl = msg->easy_handle;
+			CURLcode ret = msg->data.result;
+			Job *job = NULL;
+			curl_easy_getinfo(curl, CURLINFO_PRIVATE, &job);
+			curl_multi_remove_handle(m_multi, curl);
+			job->in_flight = false;
+			completeAttempt(*job, ret);
+		}
+
+		jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [](const std::shared_ptr<Job> &job) { return job->done; }),
+				   jobs.end());
 
-	} while ((inner_status == 102 || inner_status == 206) && difftime(time(NULL), start) < 55);
+		if (!jobs.empty())
+			curl_multi_poll(m_multi, NULL, 0, (int)wait.count(), NULL);
+	}
+}
+
+void ScapPollingScheduler::startAttempt(Job &job) {
+	if (job.curl == NULL) {
+		if ((job.curl = curl_easy_init()) == NULL) {
+			MWLOG(LEV_ERROR, MOD_SCAP, "%s curl_easy_init() failed", __FUNCTION__);
+			job.response.status = CURL_GENERIC_ERROR;
+			finish(job);
+			return;
+		}
+	} else {
+		curl_easy_reset(job.curl);
+	}
+	curl_easy_setopt(job.curl, CURLOPT_CONNECTTIMEOUT, 5L);
+	curl_easy_setopt(job.curl, CURLOPT_PRIVATE, &job);
+
+	job.transfer.reset(new ScapTransfer());
+	if (!setup_transfer(job.curl, job.credentials, job.request, *job.transfer)) {
+		job.response = job.transfer->response;
+		finish(job);
+		return;
+	}
+
+	curl_multi_add_handle(m_multi, job.curl);
+	job.in_flight = true;
+}
+
+void ScapPollingScheduler::completeAttempt(Job &job, CURLcode ret) {
+	finish_transfer(job.curl, ret, job.request, *job.transfer);
+
+	const ScapResponse &temp_response = job.transfer->response;
+	unsigned int inner_status = 0;
+	if (temp_response.status != 200) {
+		MWLOG(LEV_ERROR, MOD_SCAP, "%s polling request failed: %d", __FUNCTION__, temp_response.status);
+	} else {
+		inner_status = get_response_status(temp_response.response);
+		if (inner_status == 404) {
+			MWLOG(LEV_DEBUG, MOD_SCAP, "Possibly reached polling time limit. Got incomplete response.");
+			finish(job);
+			return;
+		}
+	}
+
+	job.response = temp_response;
+
+	if (inner_status == 102 || inner_status == 206) {
+		std::chrono::milliseconds delay = job.delay;
+		int retry_after = atoi(parse_header(job.transfer->received_header_data, "Retry-After").c_str());
+		if (retry_after > 0) {
+			delay = std::chrono::seconds(retry_after);
+		}
+		job.delay = std::min(job.delay * 2, std::chrono::milliseconds(POLLING_MAX_DELAY_MS));
+
+		auto next_attempt = std::chrono::steady_clock::now() + delay;
+		if (next_attempt - job.start < std::chrono::milliseconds(POLLING_TIMEOUT_MS)) {
+			job.next_attempt = next_attempt;
+			return;
+		}
+	}
+
+	finish(job);
+}
+
+void ScapPollingScheduler::finish(Job &job) {
+	if (job.curl) {
+		curl_easy_cleanup(job.curl);
+		job.curl = NULL;
+	}
+	job.transfer.reset();
+	job.in_flight = false;
+	job.done = true;
+	job.result.set_value(job.response);
+}
 
-	return response;
+ScapResponse perform_polling_request(const ScapCredentials &credentials, const ScapRequest &request,
+									 const std::atomic<bool> *cancelled) {
+	return ScapPollingScheduler::instance().poll(credentials, request, cancelled);
 }
 
 std::vector<ScapProvider> parse_providers(const std::string &read_buffer) {
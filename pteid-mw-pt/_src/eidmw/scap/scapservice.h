@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -23,6 +24,7 @@ namespace eIDMW {
 #define SSL_PIN_CANCELED_ERROR 3
 #define PROXY_AUTH_REQUIRED 4
 #define POSSIBLE_PROXY_ERROR 5
+#define POLLING_CANCELED_ERROR 6
 
 #define SCAP_OK 200
 #define SCAP_PROCESSING_REQUEST 102
@@ -82,8 +84,14 @@ struct CitizenInfo {
 	std::string cert_ssn;
 };
 
+/* Test seam of mw_unit_test: requests go to this server, e.g. "http://127.0.0.1" and its port, instead of the
+   configured SCAP host. An empty host restores the configured one. */
+void set_scap_test_server(const std::string &host, const std::string &port);
+
 ScapResponse perform_request(const ScapCredentials &credentials, const ScapRequest &request, CURL *curl = NULL);
-ScapResponse perform_polling_request(const ScapCredentials &credentials, const ScapRequest &request);
+/* Polls request until the SCAP process is finished. Returns early with POLLING_CANCELED_ERROR once *cancelled is set */
+ScapResponse perform_polling_request(const ScapCredentials &credentials, const ScapRequest &request,
+									 const std::atomic<bool> *cancelled = NULL);
 
 /* Create requests and parse responses*/
 unsigned int get_response_status(const std::string &response);
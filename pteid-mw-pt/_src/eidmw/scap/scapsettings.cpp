@@ -312,6 +312,10 @@ void ScapSettings::setAppID(const QString &appID) {
 
 const QString ScapSettings::getAppID() { return m_appID; }
 
-QString ScapSettings::getCacheDir() { return m_cache_dir; }
+static QString scap_test_cache_dir;
+
+void set_scap_test_cache_dir(const QString &cache_dir) { scap_test_cache_dir = cache_dir; }
+
+QString ScapSettings::getCacheDir() { return scap_test_cache_dir.isEmpty() ? m_cache_dir : scap_test_cache_dir; }
 
 }; // namespace eIDMW
\ No newline at end of file
@@ -45,4 +45,8 @@ private:
 	QString m_cache_dir;
 };
 
+/* Test seam of mw_unit_test: the SCAP attribute and logo caches are kept in this directory instead of the
+   configured cache dir. An empty directory restores the configured one. */
+void set_scap_test_cache_dir(const QString &cache_dir);
+
 }; // namespace eIDMW